@@ -0,0 +1,21 @@
+REM array2d.bas - 2-D array matrix multiply
+N = 120
+DIM A(N, N), B(N, N), C(N, N)
+FOR I = 1 TO N
+  FOR J = 1 TO N
+    A(I, J) = (I + J) MOD 7
+    B(I, J) = (I * J) MOD 5
+  NEXT J
+NEXT I
+FOR R = 1 TO 10
+  FOR I = 1 TO N
+    FOR J = 1 TO N
+      S = 0
+      FOR K = 1 TO N
+        S = S + A(I, K) * B(K, J)
+      NEXT K
+      C(I, J) = S
+    NEXT J
+  NEXT I
+NEXT R
+PRINT C(1, 1); C(N, N)
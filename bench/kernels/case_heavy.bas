@@ -0,0 +1,72 @@
+REM case_heavy.bas - SELECT CASE state machine with many arms
+T = 0
+ST = 0
+FOR I = 1 TO 15000000
+  SELECT CASE ST
+  CASE 0: T = T + 0: ST = 11
+  CASE 1: T = T + 1: ST = 48
+  CASE 2: T = T + 2: ST = 21
+  CASE 3: T = T + 3: ST = 58
+  CASE 4: T = T + 4: ST = 31
+  CASE 5: T = T + 0: ST = 4
+  CASE 6: T = T + 1: ST = 41
+  CASE 7: T = T + 2: ST = 14
+  CASE 8: T = T + 3: ST = 51
+  CASE 9: T = T + 4: ST = 24
+  CASE 10: T = T + 0: ST = 61
+  CASE 11: T = T + 1: ST = 34
+  CASE 12: T = T + 2: ST = 7
+  CASE 13: T = T + 3: ST = 44
+  CASE 14: T = T + 4: ST = 17
+  CASE 15: T = T + 0: ST = 54
+  CASE 16: T = T + 1: ST = 27
+  CASE 17: T = T + 2: ST = 0
+  CASE 18: T = T + 3: ST = 37
+  CASE 19: T = T + 4: ST = 10
+  CASE 20: T = T + 0: ST = 47
+  CASE 21: T = T + 1: ST = 20
+  CASE 22: T = T + 2: ST = 57
+  CASE 23: T = T + 3: ST = 30
+  CASE 24: T = T + 4: ST = 3
+  CASE 25: T = T + 0: ST = 40
+  CASE 26: T = T + 1: ST = 13
+  CASE 27: T = T + 2: ST = 50
+  CASE 28: T = T + 3: ST = 23
+  CASE 29: T = T + 4: ST = 60
+  CASE 30: T = T + 0: ST = 33
+  CASE 31: T = T + 1: ST = 6
+  CASE 32: T = T + 2: ST = 43
+  CASE 33: T = T + 3: ST = 16
+  CASE 34: T = T + 4: ST = 53
+  CASE 35: T = T + 0: ST = 26
+  CASE 36: T = T + 1: ST = 63
+  CASE 37: T = T + 2: ST = 36
+  CASE 38: T = T + 3: ST = 9
+  CASE 39: T = T + 4: ST = 46
+  CASE 40: T = T + 0: ST = 19
+  CASE 41: T = T + 1: ST = 56
+  CASE 42: T = T + 2: ST = 29
+  CASE 43: T = T + 3: ST = 2
+  CASE 44: T = T + 4: ST = 39
+  CASE 45: T = T + 0: ST = 12
+  CASE 46: T = T + 1: ST = 49
+  CASE 47: T = T + 2: ST = 22
+  CASE 48: T = T + 3: ST = 59
+  CASE 49: T = T + 4: ST = 32
+  CASE 50: T = T + 0: ST = 5
+  CASE 51: T = T + 1: ST = 42
+  CASE 52: T = T + 2: ST = 15
+  CASE 53: T = T + 3: ST = 52
+  CASE 54: T = T + 4: ST = 25
+  CASE 55: T = T + 0: ST = 62
+  CASE 56: T = T + 1: ST = 35
+  CASE 57: T = T + 2: ST = 8
+  CASE 58: T = T + 3: ST = 45
+  CASE 59: T = T + 4: ST = 18
+  CASE 60: T = T + 0: ST = 55
+  CASE 61: T = T + 1: ST = 28
+  CASE 62: T = T + 2: ST = 1
+  CASE 63: T = T + 3: ST = 38
+  END SELECT
+NEXT I
+PRINT T
@@ -0,0 +1,12 @@
+REM data_read.bas - DATA / READ / RESTORE throughput
+S = 0
+FOR R = 1 TO 200000
+  RESTORE
+  FOR I = 1 TO 20
+    READ V
+    S = S + V
+  NEXT I
+NEXT R
+PRINT S
+DATA 1, 2, 3, 4, 5, 6, 7, 8, 9, 10
+DATA 11, 12, 13, 14, 15, 16, 17, 18, 19, 20
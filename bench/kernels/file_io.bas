@@ -0,0 +1,16 @@
+REM file_io.bas - sequential file write and read back
+FOR R = 1 TO 5
+  OPEN "bench_file_io.tmp" FOR OUTPUT AS #1
+  FOR I = 1 TO 20000
+    PRINT #1, "line "; I
+  NEXT I
+  CLOSE #1
+  C = 0
+  OPEN "bench_file_io.tmp" FOR INPUT AS #1
+  WHILE NOT EOF(1)
+    LINE INPUT #1, L$
+    C = C + LEN(L$)
+  WEND
+  CLOSE #1
+NEXT R
+PRINT C
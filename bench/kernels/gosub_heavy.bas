@@ -0,0 +1,15 @@
+10 REM gosub_heavy.bas - GOSUB / RETURN dispatch
+20 S = 0
+30 FOR I = 1 TO 10000000
+40 GOSUB 100
+50 IF I MOD 3 = 0 THEN GOSUB 200
+60 NEXT I
+70 PRINT S
+80 END
+100 S = S + 1
+110 RETURN
+200 S = S - 1
+210 GOSUB 300
+220 RETURN
+300 S = S + 2
+310 RETURN
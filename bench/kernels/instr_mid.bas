@@ -0,0 +1,15 @@
+REM instr_mid.bas - INSTR searches and MID$ slicing
+T$ = ""
+FOR I = 1 TO 400
+  T$ = T$ + "the quick brown fox jumps over the lazy dog "
+NEXT I
+T$ = T$ + "needle"
+C = 0
+FOR R = 1 TO 20000
+  P = INSTR(T$, "needle")
+  Q = INSTR(T$, "lazy", 1 + R MOD 100)
+  W$ = MID$(T$, 1 + R MOD 1000, 12)
+  IF LEFT$(W$, 1) = "t" THEN C = C + 1
+  C = C + P + Q
+NEXT R
+PRINT C
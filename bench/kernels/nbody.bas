@@ -0,0 +1,28 @@
+REM nbody.bas - five-body gravitational simulation
+NB = 5
+DIM X(NB), Y(NB), Z(NB), VX(NB), VY(NB), VZ(NB), M(NB)
+FOR I = 1 TO NB
+  X(I) = I * 1.1: Y(I) = I * 0.7 - 2: Z(I) = 3 - I * 0.4
+  VX(I) = 0.01 * I: VY(I) = -0.02 * I: VZ(I) = 0.005
+  M(I) = 1 + I * 0.1
+NEXT I
+DT = 0.01
+FOR STP = 1 TO 1000000
+  FOR I = 1 TO NB - 1
+    FOR J = I + 1 TO NB
+      DX = X(I) - X(J): DY = Y(I) - Y(J): DZ = Z(I) - Z(J)
+      D2 = DX * DX + DY * DY + DZ * DZ + 0.01
+      MAG = DT / (D2 * SQR(D2))
+      VX(I) = VX(I) - DX * M(J) * MAG: VY(I) = VY(I) - DY * M(J) * MAG: VZ(I) = VZ(I) - DZ * M(J) * MAG
+      VX(J) = VX(J) + DX * M(I) * MAG: VY(J) = VY(J) + DY * M(I) * MAG: VZ(J) = VZ(J) + DZ * M(I) * MAG
+    NEXT J
+  NEXT I
+  FOR I = 1 TO NB
+    X(I) = X(I) + DT * VX(I): Y(I) = Y(I) + DT * VY(I): Z(I) = Z(I) + DT * VZ(I)
+  NEXT I
+NEXT STP
+KE = 0
+FOR I = 1 TO NB
+  KE = KE + 0.5 * M(I) * (VX(I) * VX(I) + VY(I) * VY(I) + VZ(I) * VZ(I))
+NEXT I
+PRINT INT(KE * 1000000)
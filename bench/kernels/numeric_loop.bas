@@ -0,0 +1,8 @@
+REM numeric_loop.bas - tight floating-point and integer arithmetic
+S = 0
+T% = 0
+FOR I = 1 TO 30000000
+  S = S + I * 0.5 - I / 3
+  T% = (T% + I) MOD 65521
+NEXT I
+PRINT INT(S); T%
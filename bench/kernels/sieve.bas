@@ -0,0 +1,14 @@
+REM sieve.bas - Sieve of Eratosthenes, repeated
+N = 200000
+DIM F(N)
+FOR R = 1 TO 50
+  FOR I = 2 TO N: F(I) = 1: NEXT I
+  C = 0
+  FOR I = 2 TO N
+    IF F(I) = 1 THEN
+      C = C + 1
+      FOR J = I + I TO N STEP I: F(J) = 0: NEXT J
+    END IF
+  NEXT I
+NEXT R
+PRINT C
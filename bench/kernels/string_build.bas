@@ -0,0 +1,10 @@
+REM string_build.bas - string building by repeated appends
+T = 0
+FOR R = 1 TO 100
+  S$ = ""
+  FOR I = 1 TO 20000
+    S$ = S$ + CHR$(65 + I MOD 26)
+  NEXT I
+  T = T + LEN(S$)
+NEXT R
+PRINT T
@@ -0,0 +1,280 @@
+--
+-- run_kernels.lua
+-- FasterBASIC - Runtime Kernel Benchmark Runner
+--
+-- Compiles every BASIC kernel in bench/kernels under each code generation
+-- configuration, runs it through fbc (which executes the generated Lua in
+-- LuaJIT and reports "Execution time" with -t), and prints a matrix of the
+-- median time and its coefficient of variation per kernel and configuration.
+-- Every configuration must print the same program output as the first one;
+-- a mismatch is flagged in the matrix instead of being timed silently.
+--
+-- The codegen backends (fasterbasic_lua_codegen.cpp, _optimized.cpp and
+-- _working.cpp) all define LuaCodeGenerator and cannot be linked into one
+-- binary, so each is compared as a separate fbc build passed as name=path.
+--
+-- Run:  luajit bench/run_kernels.lua [options] [name=path/to/fbc ...]
+--
+-- Options:
+--   --runs N        Timed runs per cell (default 5)
+--   --warmup N      Untimed runs per cell (default 1)
+--   --kernels DIR   Kernel directory (default: kernels/ next to this script)
+--   --only NAME     Run only kernels whose file name contains NAME
+--   --configs LIST  Comma-separated configuration names (default: all)
+--   --csv           Also print every individual run as CSV
+--
+
+-- =============================================================================
+-- Configurations
+-- =============================================================================
+
+-- fbc flags per configuration; "default" is the reference column
+local CONFIGS = {
+    { name = "default",    flags = "" },
+    { name = "no-varcache", flags = "--no-var-cache" },
+    { name = "no-jithints", flags = "--no-jit-hints" },
+    { name = "buffer",     flags = "--buffer-mode" },
+    { name = "opt-all",    flags = "--opt-all" },
+}
+
+-- Files the kernels leave behind in the working directory
+local SCRATCH_FILES = { "bench_file_io.tmp" }
+
+-- =============================================================================
+-- Command line
+-- =============================================================================
+
+local scriptDir = (arg and arg[0] or ""):match("^(.*)[/\\]") or "."
+
+local opts = {
+    runs = 5,
+    warmup = 1,
+    kernels = scriptDir .. "/kernels",
+    only = nil,
+    configs = nil,
+    csv = false,
+}
+local binaries = {}
+
+local function usage()
+    io.stderr:write("Usage: luajit run_kernels.lua [--runs N] [--warmup N] [--kernels DIR]\n")
+    io.stderr:write("                              [--only NAME] [--configs a,b] [--csv] [name=fbc ...]\n")
+    os.exit(1)
+end
+
+do
+    local i = 1
+    while arg and arg[i] do
+        local a = arg[i]
+        if a == "--runs" then
+            i = i + 1; opts.runs = tonumber(arg[i]) or usage()
+        elseif a == "--warmup" then
+            i = i + 1; opts.warmup = tonumber(arg[i]) or usage()
+        elseif a == "--kernels" then
+            i = i + 1; opts.kernels = arg[i] or usage()
+        elseif a == "--only" then
+            i = i + 1; opts.only = arg[i] or usage()
+        elseif a == "--configs" then
+            i = i + 1; opts.configs = arg[i] or usage()
+        elseif a == "--csv" then
+            opts.csv = true
+        elseif a == "-h" or a == "--help" then
+            usage()
+        elseif a:sub(1, 1) == "-" then
+            io.stderr:write("Unknown option: " .. a .. "\n")
+            usage()
+        else
+            local name, path = a:match("^([^=]+)=(.+)$")
+            binaries[#binaries + 1] = { name = name or ("fbc" .. (#binaries + 1)), path = path or a }
+        end
+        i = i + 1
+    end
+end
+
+if #binaries == 0 then
+    binaries[1] = { name = "fbc", path = "fbc" }
+end
+
+if opts.configs then
+    local wanted, selected = {}, {}
+    for name in opts.configs:gmatch("[^,]+") do wanted[name] = true end
+    for _, c in ipairs(CONFIGS) do
+        if wanted[c.name] then selected[#selected + 1] = c end
+    end
+    if #selected == 0 then
+        io.stderr:write("No configuration matches --configs " .. opts.configs .. "\n")
+        os.exit(1)
+    end
+    CONFIGS = selected
+end
+
+-- =============================================================================
+-- Helpers
+-- =============================================================================
+
+local function shellQuote(s)
+    return "'" .. s:gsub("'", "'\\''") .. "'"
+end
+
+local function listKernels(dir)
+    local kernels = {}
+    local p = io.popen("ls " .. shellQuote(dir) .. " 2>/dev/null")
+    for name in p:lines() do
+        if name:match("%.bas$") and (not opts.only or name:find(opts.only, 1, true)) then
+            kernels[#kernels + 1] = name
+        end
+    end
+    p:close()
+    table.sort(kernels)
+    return kernels
+end
+
+-- Run one compile+execute; returns seconds (or nil) and the program output
+local function runOnce(fbc, flags, file)
+    local cmd = shellQuote(fbc) .. " " .. flags .. " -t " .. shellQuote(file) .. " 2>&1"
+    local p = io.popen(cmd)
+    local out = p:read("*a")
+    p:close()
+    local seconds = tonumber(out:match("Execution time: ([%d%.eE%-+]+) seconds"))
+    out = out:gsub("\n*Execution time: [^\n]*\n?", "")
+    return seconds, out
+end
+
+local function median(xs)
+    local s = {}
+    for i, v in ipairs(xs) do s[i] = v end
+    table.sort(s)
+    local n = #s
+    if n == 0 then return nil end
+    if n % 2 == 1 then return s[(n + 1) / 2] end
+    return (s[n / 2] + s[n / 2 + 1]) / 2
+end
+
+-- Coefficient of variation (sample stddev / mean) in percent
+local function cvPercent(xs)
+    local n = #xs
+    if n < 2 then return 0 end
+    local sum = 0
+    for _, v in ipairs(xs) do sum = sum + v end
+    local mean = sum / n
+    if mean == 0 then return 0 end
+    local sq = 0
+    for _, v in ipairs(xs) do sq = sq + (v - mean) ^ 2 end
+    return math.sqrt(sq / (n - 1)) / mean * 100
+end
+
+-- =============================================================================
+-- Main
+-- =============================================================================
+
+local kernels = listKernels(opts.kernels)
+if #kernels == 0 then
+    io.stderr:write("No kernels found in " .. opts.kernels .. "\n")
+    os.exit(1)
+end
+
+-- One column per (binary, configuration)
+local columns = {}
+for _, b in ipairs(binaries) do
+    for _, c in ipairs(CONFIGS) do
+        local label = (#binaries > 1) and (b.name .. ":" .. c.name) or c.name
+        columns[#columns + 1] = { label = label, fbc = b.path, flags = c.flags }
+    end
+end
+
+local results = {}   -- results[kernel][column] = { times = {...}, status = nil|"FAIL"|"DIFF" }
+local csvRows = {}
+
+for _, kernel in ipairs(kernels) do
+    local file = opts.kernels .. "/" .. kernel
+    local reference = nil
+    results[kernel] = {}
+    io.stderr:write(kernel .. " ")
+    for ci, col in ipairs(columns) do
+        local cell = { times = {} }
+        for _ = 1, opts.warmup do runOnce(col.fbc, col.flags, file) end
+        for r = 1, opts.runs do
+            local seconds, out = runOnce(col.fbc, col.flags, file)
+            if not seconds then
+                cell.status = "FAIL"
+                cell.detail = out
+                break
+            end
+            if reference == nil then reference = out end
+            if out ~= reference then cell.status = "DIFF" end
+            cell.times[#cell.times + 1] = seconds
+            csvRows[#csvRows + 1] = string.format("%s,%s,%d,%.6f", kernel, col.label, r, seconds)
+        end
+        results[kernel][ci] = cell
+        io.stderr:write(".")
+    end
+    io.stderr:write("\n")
+    for _, f in ipairs(SCRATCH_FILES) do os.remove(f) end
+end
+
+-- Results matrix: median seconds with CV%, and the ratio to the first column
+local kernelWidth = 14
+for _, k in ipairs(kernels) do kernelWidth = math.max(kernelWidth, #k) end
+local cellWidth = 22
+for _, col in ipairs(columns) do cellWidth = math.max(cellWidth, #col.label + 2) end
+
+local function pad(s, w) return s .. string.rep(" ", w - #s) end
+
+print(string.format("\nRuntime kernels: %d runs per cell (%d warmup), median seconds (CV%%) [x vs %s]",
+    opts.runs, opts.warmup, columns[1].label))
+local header = pad("kernel", kernelWidth)
+for _, col in ipairs(columns) do header = header .. "  " .. pad(col.label, cellWidth) end
+print(header)
+print(string.rep("-", #header))
+
+local logRatioSum, ratioCount = {}, {}
+for _, kernel in ipairs(kernels) do
+    local line = pad(kernel, kernelWidth)
+    local base = median(results[kernel][1].times)
+    for ci, cell in ipairs(results[kernel]) do
+        local text
+        if cell.status == "FAIL" then
+            text = "FAIL"
+        else
+            local m = median(cell.times)
+            text = string.format("%.3f (%4.1f%%)", m, cvPercent(cell.times))
+            if base and base > 0 and m > 0 then
+                text = text .. string.format(" x%.2f", m / base)
+                logRatioSum[ci] = (logRatioSum[ci] or 0) + math.log(m / base)
+                ratioCount[ci] = (ratioCount[ci] or 0) + 1
+            end
+            if cell.status == "DIFF" then text = text .. " DIFF" end
+        end
+        line = line .. "  " .. pad(text, cellWidth)
+    end
+    print(line)
+end
+
+local summary = pad("geomean", kernelWidth)
+for ci = 1, #columns do
+    local text = "-"
+    if ratioCount[ci] then
+        text = string.format("x%.2f", math.exp(logRatioSum[ci] / ratioCount[ci]))
+    end
+    summary = summary .. "  " .. pad(text, cellWidth)
+end
+print(string.rep("-", #header))
+print(summary)
+
+-- Failures: show the first lines fbc printed
+for _, kernel in ipairs(kernels) do
+    for ci, cell in ipairs(results[kernel]) do
+        if cell.status == "FAIL" then
+            print(string.format("\n%s [%s] failed:", kernel, columns[ci].label))
+            print((cell.detail or ""):sub(1, 400))
+        elseif cell.status == "DIFF" then
+            print(string.format("\n%s [%s] printed different output than [%s]",
+                kernel, columns[ci].label, columns[1].label))
+        end
+    end
+end
+
+if opts.csv then
+    print("\nkernel,config,run,seconds")
+    for _, row in ipairs(csvRows) do print(row) end
+end
@@ -10,14 +10,17 @@
 #include <cmath>
 
 // Helper function to convert double to 32-bit signed integer
-// Uses truncation (towards zero) like BASIC INT() function
+// Truncates towards zero like BASIC FIX(), then wraps modulo 2^32 the same way
+// the generated code's basic_toint32 does; NaN is 0 and infinities saturate
 static inline int32_t to_int32(double value) {
     // Handle special cases
     if (std::isnan(value)) return 0;
     if (std::isinf(value)) return value > 0 ? INT32_MAX : INT32_MIN;
     
-    // Truncate towards zero (BASIC semantics)
-    return static_cast<int32_t>(std::trunc(value));
+    // fmod is exact, so the wrap is right for any magnitude
+    double wrapped = std::fmod(std::trunc(value), 4294967296.0);
+    if (wrapped < 0) wrapped += 4294967296.0;
+    return static_cast<int32_t>(static_cast<uint32_t>(wrapped));
 }
 
 // Bitwise AND
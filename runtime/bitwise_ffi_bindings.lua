@@ -91,14 +91,15 @@ if available then
     M.shr = function(a, b) return lib.basic_shr(a, b) end
 else
     -- Fallback: use Lua implementations (slower but functional)
+    -- Same conversion as basic_bitwise.cpp: truncate towards zero, wrap
+    -- modulo 2^32, NaN is 0 and infinities saturate
     local function to_int32(n)
-        n = math.floor(n)
-        -- Simulate 32-bit signed integer overflow
-        if n >= 2147483648 then
-            n = n - 4294967296
-        elseif n < -2147483648 then
-            n = n + 4294967296
-        end
+        if n ~= n then return 0 end
+        if n == math.huge then return 2147483647 end
+        if n == -math.huge then return -2147483648 end
+        n = math.fmod(n >= 0 and math.floor(n) or math.ceil(n), 4294967296)
+        if n < 0 then n = n + 4294967296 end
+        if n >= 2147483648 then n = n - 4294967296 end
         return n
     end
 
@@ -0,0 +1,292 @@
+--
+-- loop_cancel_bench.lua
+-- FasterBASIC - Loop Cancellation Overhead Benchmark
+--
+-- Compiles each BASIC kernel with fbc twice, under OPTION CANCELLABLE OFF and
+-- OPTION CANCELLABLE ON, so the loops timed here are exactly the strip-mined
+-- FOR loops and countdown scopes LuaCodeGenerator emits. Both variants must
+-- print the same output, and the cancellable one must stop once the stop flag
+-- is raised. GOTO loops carry no check (the host's SIGINT count hook stops
+-- them), so they are not measured here.
+--
+-- Run:  luajit loop_cancel_bench.lua [--reps N] [--only NAME] [path/to/fbc]
+--
+
+local ffi = require('ffi')
+
+local POLL_INTERVAL = 4096   -- LuaCodeGenerator::CANCEL_POLL_INTERVAL
+local BUDGET_PERCENT = 1.0
+
+-- =============================================================================
+-- Kernels
+-- =============================================================================
+
+local kernels = {
+    {
+        name = "for-sum",
+        source = [[
+S = 0
+FOR I = 1 TO 40000000
+  S = S + I
+NEXT I
+PRINT S
+]],
+    },
+    {
+        name = "for-nested",
+        source = [[
+S = 0
+FOR I = 1 TO 2000000
+  FOR J = 1 TO 8
+    S = S + I * J
+  NEXT J
+NEXT I
+PRINT S
+]],
+    },
+    {
+        name = "for-grid",
+        source = [[
+S = 0
+N = 100
+FOR I = 1 TO 200000
+  FOR J = 1 TO N
+    S = S + I * J
+  NEXT J
+NEXT I
+PRINT S
+]],
+    },
+    {
+        name = "for-short-outer",
+        source = [[
+S = 0
+N = 20000000
+FOR R = 1 TO 2
+  FOR I = 1 TO N
+    S = S + I
+  NEXT I
+NEXT R
+PRINT S
+]],
+    },
+    {
+        name = "for-varstep",
+        source = [[
+S = 0
+N = 3
+FOR I = 1 TO 60000000 STEP N
+  S = S + I
+NEXT I
+PRINT S
+]],
+    },
+    {
+        name = "for-fracstep",
+        source = [[
+S = 0
+N = 0.5
+FOR X = 0 TO 10000000 STEP N
+  S = S + X
+NEXT X
+PRINT S
+]],
+    },
+    {
+        name = "sieve",
+        source = [[
+DIM F(3000000)
+C = 0
+FOR I = 2 TO 3000000
+  IF F(I) = 0 THEN
+    C = C + 1
+    FOR J = I * I TO 3000000 STEP I
+      F(J) = 1
+    NEXT J
+  END IF
+NEXT I
+PRINT C
+]],
+    },
+    {
+        name = "while",
+        source = [[
+N = 0
+S = 0
+WHILE N < 20000000
+  N = N + 1
+  S = S + N MOD 7
+WEND
+PRINT S
+]],
+    },
+    {
+        name = "repeat",
+        source = [[
+N = 0
+S = 1
+REPEAT
+  N = N + 1
+  S = (S * 31 + N) MOD 1000003
+UNTIL N >= 20000000
+PRINT S
+]],
+    },
+}
+
+-- =============================================================================
+-- Command line
+-- =============================================================================
+
+local opts = { reps = 25, only = nil, fbc = "fbc" }
+
+local function usage()
+    io.stderr:write("Usage: luajit loop_cancel_bench.lua [--reps N] [--only NAME] [path/to/fbc]\n")
+    os.exit(1)
+end
+
+do
+    local i = 1
+    while arg and arg[i] do
+        local a = arg[i]
+        if a == "--reps" then
+            i = i + 1; opts.reps = tonumber(arg[i]) or usage()
+        elseif a == "--only" then
+            i = i + 1; opts.only = arg[i] or usage()
+        elseif a:sub(1, 1) == "-" then
+            usage()
+        else
+            opts.fbc = a
+        end
+        i = i + 1
+    end
+end
+
+-- =============================================================================
+-- Compilation
+-- =============================================================================
+
+local function shellQuote(s)
+    return "'" .. s:gsub("'", "'\\''") .. "'"
+end
+
+local function readFile(path)
+    local f = io.open(path, "rb")
+    if not f then return nil end
+    local text = f:read("*a")
+    f:close()
+    return text
+end
+
+-- Generated Lua for a kernel under the given OPTION CANCELLABLE setting
+local function generate(kernel, cancellable)
+    local basFile, luaFile = os.tmpname(), os.tmpname()
+    local f = assert(io.open(basFile, "wb"))
+    f:write("OPTION CANCELLABLE ", cancellable and "ON" or "OFF", "\n", kernel.source)
+    f:close()
+
+    local p = io.popen(shellQuote(opts.fbc) .. " -o " .. shellQuote(luaFile) .. " " ..
+                       shellQuote(basFile) .. " 2>&1")
+    local log = p:read("*a")
+    p:close()
+    local lua = readFile(luaFile)
+    os.remove(basFile)
+    os.remove(luaFile)
+    if not lua or lua == "" then
+        error(kernel.name .. ": fbc failed\n" .. log)
+    end
+    return lua
+end
+
+-- The generated program runs main when its chunk is called; PRINT goes
+-- through the runtime's basic_print, captured here
+local output = {}
+
+basic_print = function(value) output[#output + 1] = tostring(value) end
+basic_print_newline = function() output[#output + 1] = "\n" end
+
+local stop_flag = ffi.new('int32_t[1]')
+__fbc_stop_flag = stop_flag
+
+local function load(kernel, lua)
+    local chunk, err = loadstring(lua, "=" .. kernel.name)
+    if not chunk then error(kernel.name .. ": " .. err) end
+    return chunk
+end
+
+local function run(chunk)
+    output = {}
+    chunk()
+    return table.concat(output)
+end
+
+-- =============================================================================
+-- Timing
+-- =============================================================================
+
+-- Trace layout (hot-counter collisions, which loop gets compiled first) can
+-- move a nested kernel by 30% or more between otherwise identical runs, far
+-- more than the overhead being measured. Every sample therefore loads a
+-- fresh copy into a flushed trace cache, warms it up and times one run, and
+-- the best sample is compared.
+local function sample(kernel, lua)
+    if jit then jit.flush() end
+    local chunk = load(kernel, lua)
+    run(chunk)
+    local t0 = os.clock()
+    run(chunk)
+    return os.clock() - t0
+end
+
+local function best(samples)
+    table.sort(samples)
+    return samples[1]
+end
+
+local failures, measured, over_budget = 0, 0, 0
+
+print(string.format("Loop cancellation overhead, poll interval %d, best of %d runs (%s)",
+    POLL_INTERVAL, opts.reps, jit and jit.version or _VERSION))
+
+for _, kernel in ipairs(kernels) do
+    if not opts.only or kernel.name:find(opts.only, 1, true) then
+        local off_lua = generate(kernel, false)
+        local on_lua = generate(kernel, true)
+
+        local expected = run(load(kernel, off_lua))
+        if run(load(kernel, on_lua)) ~= expected then
+            print(string.format("MISMATCH: %s", kernel.name))
+            failures = failures + 1
+        end
+
+        -- Interleave the runs so frequency scaling affects both variants alike
+        local off_times, on_times = {}, {}
+        for i = 1, opts.reps do
+            off_times[i] = sample(kernel, off_lua)
+            on_times[i] = sample(kernel, on_lua)
+        end
+        local t_off, t_on = best(off_times), best(on_times)
+        local overhead = (t_on - t_off) / t_off * 100
+        measured = measured + 1
+        if overhead > BUDGET_PERCENT then over_budget = over_budget + 1 end
+
+        print(string.format("%-13s  off %8.2f ms   on %8.2f ms   overhead %+6.2f%%",
+            kernel.name, t_off * 1000, t_on * 1000, overhead))
+
+        -- A raised flag must stop the cancellable variant
+        stop_flag[0] = 1
+        local ok, err = pcall(run, load(kernel, on_lua))
+        stop_flag[0] = 0
+        if ok or not tostring(err):find("Interrupted by user", 1, true) then
+            print(string.format("NOT CANCELLED: %s (%s)", kernel.name, tostring(err)))
+            failures = failures + 1
+        end
+    end
+end
+
+if failures > 0 then
+    print(string.format("%d failures", failures))
+    os.exit(1)
+end
+print(string.format("%d of %d kernels within %.1f%% overhead budget",
+    measured - over_budget, measured, BUDGET_PERCENT))
@@ -24,6 +24,12 @@ ffi.cdef [[
     int32_t* unicode_upper_new(const int32_t* codepoints, int32_t len);
     int32_t* unicode_lower_new(const int32_t* codepoints, int32_t len);
 
+    // Substring Search
+    int32_t unicode_find_bytes(const char* haystack, int32_t hay_len,
+                               const char* needle, int32_t needle_len, int32_t start);
+    int32_t unicode_find_codepoints(const int32_t* haystack, int32_t hay_len,
+                                    const int32_t* needle, int32_t needle_len, int32_t start);
+
     // Validation and Utilities
     int unicode_is_valid_codepoint(int32_t codepoint);
     int unicode_codepoint_to_utf8_bytes(int32_t codepoint);
@@ -371,25 +377,85 @@ function M.instr(haystack, needle)
     return M.instr_start(1, haystack, needle)
 end
 
+-- INSTR needle cache: needle table -> Horspool shift table
+-- Weak keys so cached tables go away with their needle strings.
+-- MID$ assignment mutates codepoint tables in place and must call
+-- M.invalidate() on the target so a stale shift table is never used.
+local needle_cache = setmetatable({}, { __mode = 'k' })
+
+-- Needles shorter than this use a first-codepoint scan; the hash lookup
+-- per Horspool step only pays off once shifts get long
+local HORSPOOL_MIN_NEEDLE = 8
+
+local function needle_shifts(needle, nlen)
+    local shift = needle_cache[needle]
+    if not shift then
+        shift = {}
+        for j = 1, nlen - 1 do
+            shift[needle[j]] = nlen - j
+        end
+        needle_cache[needle] = shift
+    end
+    return shift
+end
+
+-- Drop any cached search data for a codepoint table that was modified in place
+function M.invalidate(codepoints)
+    needle_cache[codepoints] = nil
+end
+
 -- INSTR - find needle in haystack starting at position (3-arg version)
+-- Codepoint tables are searched in place: Boyer-Moore-Horspool reads
+-- roughly #haystack / #needle entries for long needles, so no copy
+-- into a C buffer is needed (unicode_find_codepoints serves callers
+-- that already hold an int32_t buffer).
 function M.instr_start(start, haystack, needle)
-    if #needle == 0 then
+    local nlen = #needle
+    if nlen == 0 then
         return 0
     end
+    if start < 1 then
+        start = 1
+    end
 
-    for i = start, #haystack - #needle + 1 do
-        local match = true
-        for j = 1, #needle do
-            if haystack[i + j - 1] ~= needle[j] then
-                match = false
-                break
+    local hlen = #haystack
+    if hlen - start + 1 < nlen then
+        return 0
+    end
+
+    if nlen < HORSPOOL_MIN_NEEDLE then
+        local first = needle[1]
+        for i = start, hlen - nlen + 1 do
+            if haystack[i] == first then
+                local j = 2
+                while j <= nlen and haystack[i + j - 1] == needle[j] do
+                    j = j + 1
+                end
+                if j > nlen then
+                    return i
+                end
             end
         end
-        if match then
-            return i
-        end
+        return 0
     end
 
+    local shift = needle_shifts(needle, nlen)
+    local last = needle[nlen]
+    local i = start + nlen - 1
+    while i <= hlen do
+        local c = haystack[i]
+        if c == last then
+            local j = nlen - 1
+            local base = i - nlen
+            while j >= 1 and haystack[base + j] == needle[j] do
+                j = j - 1
+            end
+            if j == 0 then
+                return base + 1
+            end
+        end
+        i = i + (shift[c] or nlen)
+    end
     return 0
 end
 
@@ -360,6 +360,133 @@ static int lua_unicode_string_repeat(lua_State* L) {
     return 1;
 }
 
+// Read codepoint i (1-based) from the table at stack index idx
+static inline int32_t table_codepoint(lua_State* L, int idx, int32_t i) {
+    lua_rawgeti(L, idx, i);
+    int32_t cp = (int32_t)lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    return cp;
+}
+
+// INSTR needle cache: needle table -> its codepoints and Horspool shift
+// table, so searching repeatedly for the same needle builds them once.
+// Weak keys, so entries go away with their needle strings. MID$ assignment
+// mutates codepoint tables in place and calls unicode.invalidate() on the
+// target, as with the FFI module, so a stale entry is never used.
+struct NeedleSearch {
+    int32_t length;
+    int32_t shift[256];     // Bad-character shifts by low byte of the codepoint
+    int32_t codepoints[1];  // length entries
+};
+
+static char needle_cache_key;
+
+// Push the needle cache table (created on first use)
+static void push_needle_cache(lua_State* L) {
+    lua_pushlightuserdata(L, &needle_cache_key);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_newtable(L);
+        lua_pushstring(L, "k");
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
+        lua_pushlightuserdata(L, &needle_cache_key);
+        lua_pushvalue(L, -2);
+        lua_rawset(L, LUA_REGISTRYINDEX);
+    }
+}
+
+// Search data for the needle table at needle_idx (a positive index). The
+// cache keeps it alive while the needle is, and the needle is on the
+// caller's stack for the whole search.
+static const NeedleSearch* needle_search(lua_State* L, int needle_idx, int32_t nlen) {
+    push_needle_cache(L);
+    lua_pushvalue(L, needle_idx);
+    lua_rawget(L, -2);
+    NeedleSearch* search = (NeedleSearch*)lua_touserdata(L, -1);
+    if (search && search->length == nlen) {
+        lua_pop(L, 2);
+        return search;
+    }
+    lua_pop(L, 1);
+    
+    search = (NeedleSearch*)lua_newuserdata(L, sizeof(NeedleSearch) + (nlen - 1) * sizeof(int32_t));
+    search->length = nlen;
+    for (int32_t j = 0; j < nlen; j++) {
+        search->codepoints[j] = table_codepoint(L, needle_idx, j + 1);
+    }
+    for (int b = 0; b < 256; b++) search->shift[b] = nlen;
+    for (int32_t j = 0; j < nlen - 1; j++) {
+        search->shift[search->codepoints[j] & 0xFF] = nlen - 1 - j;
+    }
+    
+    lua_pushvalue(L, needle_idx);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, -4);
+    lua_pop(L, 2);
+    return search;
+}
+
+// Boyer-Moore-Horspool over codepoint tables, reading entries in place so
+// a long needle touches roughly #haystack / #needle haystack entries.
+// The bad-character table is indexed by the low byte of the codepoint;
+// colliding codepoints keep the smallest shift, which is always safe.
+static int32_t instr_search(lua_State* L, int hay_idx, int needle_idx, int32_t start) {
+    int32_t nlen = (int32_t)lua_objlen(L, needle_idx);
+    int32_t hlen = (int32_t)lua_objlen(L, hay_idx);
+    if (nlen == 0) return 0;
+    if (start < 1) start = 1;
+    if (hlen - start + 1 < nlen) return 0;
+    
+    const NeedleSearch* search = needle_search(L, needle_idx, nlen);
+    const int32_t* needle = search->codepoints;
+    
+    int32_t last = needle[nlen - 1];
+    for (int32_t i = start + nlen - 1; i <= hlen; ) {  // i = 1-based window end
+        int32_t c = table_codepoint(L, hay_idx, i);
+        if (c == last) {
+            int32_t j = nlen - 2;
+            while (j >= 0 && table_codepoint(L, hay_idx, i - nlen + 1 + j) == needle[j]) {
+                j--;
+            }
+            if (j < 0) return i - nlen + 1;
+        }
+        i += search->shift[c & 0xFF];
+    }
+    return 0;
+}
+
+// unicode.instr(haystack_table, needle_table) -> 1-based position or 0
+static int lua_unicode_instr(lua_State* L) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_pushinteger(L, instr_search(L, 1, 2, 1));
+    return 1;
+}
+
+// unicode.instr_start(start, haystack_table, needle_table) -> 1-based position or 0
+static int lua_unicode_instr_start(lua_State* L) {
+    int32_t start = (int32_t)luaL_checkinteger(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    luaL_checktype(L, 3, LUA_TTABLE);
+    lua_pushinteger(L, instr_search(L, 2, 3, start));
+    return 1;
+}
+
+// unicode.invalidate(table) - drop cached search data for a codepoint
+// table that was modified in place
+static int lua_unicode_invalidate(lua_State* L) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    push_needle_cache(L);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    lua_rawset(L, -3);
+    lua_pop(L, 1);
+    return 0;
+}
+
 // unicode.version() -> version string
 static int lua_unicode_version(lua_State* L) {
     lua_pushstring(L, unicode_version());
@@ -385,18 +512,31 @@ static const luaL_Reg unicode_functions[] = {
     {"mid", lua_unicode_mid},
     {"space", lua_unicode_space},
     {"string_repeat", lua_unicode_string_repeat},
+    {"instr", lua_unicode_instr},
+    {"instr_start", lua_unicode_instr_start},
+    {"invalidate", lua_unicode_invalidate},
     {"version", lua_unicode_version},
     {NULL, NULL}
 };
 
+// Fields besides the functions, on the module table at the top of the stack
+static void set_module_fields(lua_State* L) {
+    // Set available flag
+    lua_pushboolean(L, 1);
+    lua_setfield(L, -2, "available");
+    
+    // Native byte search for INSTR in standard string mode, published as a
+    // function pointer: the prelude calls it through an FFI cast, which
+    // LuaJIT compiles into traces and which needs no exported symbol
+    lua_pushlightuserdata(L, (void*)&unicode_find_bytes);
+    lua_setfield(L, -2, "find_bytes");
+}
+
 // Register unicode module in Lua state
 extern "C" int luaopen_unicode(lua_State* L) {
     lua_newtable(L);
     luaL_register(L, NULL, unicode_functions);
-    
-    // Set available flag
-    lua_pushboolean(L, 1);
-    lua_setfield(L, -2, "available");
+    set_module_fields(L);
     
     return 1;
 }
@@ -406,10 +546,7 @@ extern "C" void register_unicode_module(lua_State* L) {
     // Create the module table
     lua_newtable(L);
     luaL_register(L, NULL, unicode_functions);
-    
-    // Set available flag
-    lua_pushboolean(L, 1);
-    lua_setfield(L, -2, "available");
+    set_module_fields(L);
     
     // Register as global "unicode"
     lua_setglobal(L, "unicode");
@@ -11,6 +11,14 @@
 #include <cstring>
 #include <algorithm>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define UNICODE_RUNTIME_SSE2 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define UNICODE_RUNTIME_NEON 1
+#endif
+
 // =============================================================================
 // UTF-8 Decoding/Encoding
 // =============================================================================
@@ -78,7 +86,7 @@ static int32_t utf8_decode(const char* utf8, int* bytes_consumed) {
 }
 
 // Encode a codepoint to UTF-8
-static int utf8_encode(int32_t codepoint, char* out) {
+static inline int utf8_encode(int32_t codepoint, char* out) {
     if (codepoint < 0 || codepoint > 0x10FFFF) {
         // Invalid codepoint - use replacement character
         out[0] = (char)0xEF;
@@ -122,6 +130,435 @@ static int utf8_encode(int32_t codepoint, char* out) {
     }
 }
 
+// =============================================================================
+// ASCII Fast Paths
+// =============================================================================
+//
+// Most BASIC program text is plain ASCII, so the converters first find the
+// longest run of bytes/codepoints below 0x80 and copy it with a straight
+// widening/narrowing loop. SSE2 is used when the compiler targets it (always
+// on x86-64), NEON on AArch64, and an 8-bytes-per-word scalar scan otherwise.
+
+// Number of leading bytes in s[0..len) that are 7-bit ASCII
+static inline size_t ascii_prefix_length(const unsigned char* s, size_t len) {
+    size_t i = 0;
+
+#if defined(UNICODE_RUNTIME_SSE2)
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(s + i));
+        int mask = _mm_movemask_epi8(chunk);
+        if (mask != 0) {
+            return i + __builtin_ctz((unsigned)mask);
+        }
+    }
+#elif defined(UNICODE_RUNTIME_NEON)
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t chunk = vld1q_u8(s + i);
+        if (vmaxvq_u8(chunk) >= 0x80) {
+            break;
+        }
+    }
+#endif
+
+    // Word-at-a-time tail (and whole scan on targets without SIMD)
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, s + i, sizeof(word));
+        if (word & 0x8080808080808080ULL) {
+            break;
+        }
+    }
+
+    while (i < len && s[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+// Widen n ASCII bytes to codepoints
+static inline void ascii_widen(const unsigned char* s, size_t n, int32_t* out) {
+    size_t i = 0;
+
+#if defined(UNICODE_RUNTIME_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(s + i));
+        __m128i lo16 = _mm_unpacklo_epi8(bytes, zero);
+        __m128i hi16 = _mm_unpackhi_epi8(bytes, zero);
+        _mm_storeu_si128((__m128i*)(out + i),      _mm_unpacklo_epi16(lo16, zero));
+        _mm_storeu_si128((__m128i*)(out + i + 4),  _mm_unpackhi_epi16(lo16, zero));
+        _mm_storeu_si128((__m128i*)(out + i + 8),  _mm_unpacklo_epi16(hi16, zero));
+        _mm_storeu_si128((__m128i*)(out + i + 12), _mm_unpackhi_epi16(hi16, zero));
+    }
+#elif defined(UNICODE_RUNTIME_NEON)
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t bytes = vld1q_u8(s + i);
+        uint16x8_t lo16 = vmovl_u8(vget_low_u8(bytes));
+        uint16x8_t hi16 = vmovl_u8(vget_high_u8(bytes));
+        vst1q_s32(out + i,      vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(lo16))));
+        vst1q_s32(out + i + 4,  vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(lo16))));
+        vst1q_s32(out + i + 8,  vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(hi16))));
+        vst1q_s32(out + i + 12, vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(hi16))));
+    }
+#endif
+
+    for (; i < n; i++) {
+        out[i] = s[i];
+    }
+}
+
+// Number of leading codepoints in cp[0..len) that are 7-bit ASCII
+static inline size_t ascii_codepoint_prefix_length(const int32_t* cp, size_t len) {
+    size_t i = 0;
+
+    // Treat as unsigned so negative (invalid) codepoints fall off the fast path
+    for (; i + 4 <= len; i += 4) {
+        uint32_t any = (uint32_t)cp[i] | (uint32_t)cp[i + 1] |
+                       (uint32_t)cp[i + 2] | (uint32_t)cp[i + 3];
+        if (any & ~0x7Fu) {
+            break;
+        }
+    }
+
+    while (i < len && (uint32_t)cp[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+// Narrow n ASCII codepoints to bytes
+static inline void ascii_narrow(const int32_t* cp, size_t n, char* out) {
+    size_t i = 0;
+
+#if defined(UNICODE_RUNTIME_SSE2)
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(cp + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(cp + i + 4));
+        __m128i c = _mm_loadu_si128((const __m128i*)(cp + i + 8));
+        __m128i d = _mm_loadu_si128((const __m128i*)(cp + i + 12));
+        __m128i ab = _mm_packs_epi32(a, b);
+        __m128i cd = _mm_packs_epi32(c, d);
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(ab, cd));
+    }
+#endif
+
+    for (; i < n; i++) {
+        out[i] = (char)cp[i];
+    }
+}
+
+// =============================================================================
+// AVX2 Validation and Transcoding
+// =============================================================================
+//
+// On x86-64 built with GCC or Clang, AVX2 kernels are compiled alongside the
+// baseline code and picked at run time when the CPU supports them:
+//
+//  - utf8_validate_avx2 checks a whole string 32 bytes at a time with the
+//    Keiser-Lemire nibble lookup tables (overlong forms, surrogates, values
+//    above U+10FFFF, and missing or surplus continuation bytes)
+//  - utf8_decode_valid_avx2 then decodes 8 bytes per step without any
+//    further checks, computing a codepoint for every position as if it were
+//    a lead byte and compacting out the continuation positions
+//  - utf32_encode_avx2 narrows all-ASCII runs 16 codepoints at a time and
+//    encodes 8 codepoints per step when all of them are in the BMP and not
+//    surrogates; other blocks use the scalar encoder
+//
+// Input that fails strict validation is decoded by the scalar loop, so the
+// U+FFFD substitution rules are the same on every CPU.
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define UNICODE_RUNTIME_AVX2 1
+#define UNICODE_AVX2_TARGET __attribute__((target("avx2")))
+
+static bool cpu_has_avx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+// Shuffle tables used to compact the per-lane results
+struct TranscodeTables {
+    // Decode: permutation moving the lanes set in an 8-bit lead mask to the front
+    alignas(32) int32_t decode_compact[256][8];
+    // Encode: pshufb pattern for 4 lanes of 1-3 bytes each, indexed by
+    // (lanes >= 0x80) | (lanes >= 0x800) << 4, and the resulting byte count
+    alignas(16) uint8_t encode_compact[256][16];
+    uint8_t encode_length[256];
+
+    TranscodeTables() {
+        for (int mask = 0; mask < 256; mask++) {
+            int n = 0;
+            for (int lane = 0; lane < 8; lane++) {
+                if (mask & (1 << lane)) decode_compact[mask][n++] = lane;
+            }
+            while (n < 8) decode_compact[mask][n++] = 0;
+
+            n = 0;
+            for (int lane = 0; lane < 4; lane++) {
+                int bytes = 1 + ((mask >> lane) & 1) + ((mask >> (lane + 4)) & 1);
+                for (int b = 0; b < bytes; b++) encode_compact[mask][n++] = (uint8_t)(lane * 4 + b);
+            }
+            encode_length[mask] = (uint8_t)n;
+            while (n < 16) encode_compact[mask][n++] = 0x80;
+        }
+    }
+};
+
+static const TranscodeTables& transcode_tables() {
+    static const TranscodeTables tables;
+    return tables;
+}
+
+// Error classes for the Keiser-Lemire lookups
+enum : uint8_t {
+    UTF8_TOO_SHORT  = 1 << 0,   // Lead byte not followed by a continuation
+    UTF8_TOO_LONG   = 1 << 1,   // Continuation byte after ASCII
+    UTF8_OVERLONG_3 = 1 << 2,
+    UTF8_TOO_LARGE  = 1 << 3,
+    UTF8_SURROGATE  = 1 << 4,
+    UTF8_OVERLONG_2 = 1 << 5,
+    UTF8_TOO_LARGE_1000 = 1 << 6,
+    UTF8_OVERLONG_4 = 1 << 6,
+    UTF8_TWO_CONTS  = 1 << 7,   // Continuation after continuation (checked below)
+    UTF8_CARRY = UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS,
+};
+
+UNICODE_AVX2_TARGET
+static inline __m256i lookup16_avx2(__m256i nibbles, const uint8_t table[16]) {
+    __m128i t = _mm_loadu_si128((const __m128i*)table);
+    return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(t), nibbles);
+}
+
+// Bytes of input shifted by n positions, pulling the first ones from prev
+template <int N>
+UNICODE_AVX2_TARGET
+static inline __m256i prev_bytes_avx2(__m256i input, __m256i prev) {
+    return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev, input, 0x21), 16 - N);
+}
+
+UNICODE_AVX2_TARGET
+static inline __m256i utf8_block_errors_avx2(__m256i input, __m256i prev_input) {
+    static const uint8_t byte_1_high_table[16] = {
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+        UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+        UTF8_TOO_SHORT,
+        UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+        UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+    };
+    static const uint8_t byte_1_low_table[16] = {
+        UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+        UTF8_CARRY | UTF8_OVERLONG_2,
+        UTF8_CARRY,
+        UTF8_CARRY,
+        UTF8_CARRY | UTF8_TOO_LARGE,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    };
+    static const uint8_t byte_2_high_table[16] = {
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    };
+
+    const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+    __m256i prev1 = prev_bytes_avx2<1>(input, prev_input);
+    __m256i byte_1_high = lookup16_avx2(
+        _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_nibble), byte_1_high_table);
+    __m256i byte_1_low = lookup16_avx2(_mm256_and_si256(prev1, low_nibble), byte_1_low_table);
+    __m256i byte_2_high = lookup16_avx2(
+        _mm256_and_si256(_mm256_srli_epi16(input, 4), low_nibble), byte_2_high_table);
+    __m256i special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    // Third and fourth bytes of 3- and 4-byte sequences must be continuations;
+    // there TWO_CONTS is expected and cancels out, anywhere else it is an error
+    __m256i prev2 = prev_bytes_avx2<2>(input, prev_input);
+    __m256i prev3 = prev_bytes_avx2<3>(input, prev_input);
+    __m256i is_third = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80)));
+    __m256i is_fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    __m256i must_continue = _mm256_and_si256(_mm256_or_si256(is_third, is_fourth),
+                                             _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must_continue, special);
+}
+
+// True if s[0..len) is well-formed UTF-8 with no overlong forms or surrogates
+UNICODE_AVX2_TARGET
+static bool utf8_validate_avx2(const unsigned char* s, size_t len) {
+    __m256i prev = _mm256_setzero_si256();
+    __m256i errors = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i input = _mm256_loadu_si256((const __m256i*)(s + i));
+        errors = _mm256_or_si256(errors, utf8_block_errors_avx2(input, prev));
+        prev = input;
+    }
+
+    // The final block is padded with NULs, which also flags a sequence
+    // truncated by the end of the string
+    alignas(32) unsigned char tail[32] = {0};
+    memcpy(tail, s + i, len - i);
+    __m256i input = _mm256_load_si256((const __m256i*)tail);
+    errors = _mm256_or_si256(errors, utf8_block_errors_avx2(input, prev));
+
+    return _mm256_testz_si256(errors, errors) != 0;
+}
+
+// Decode validated UTF-8; returns the number of codepoints written to out,
+// which must have room for len entries
+UNICODE_AVX2_TARGET
+static int32_t utf8_decode_valid_avx2(const unsigned char* s, size_t len, int32_t* out) {
+    const TranscodeTables& tables = transcode_tables();
+    const __m256i cont_mask = _mm256_set1_epi32(0x3F);
+    size_t i = 0;
+    int32_t count = 0;
+
+    // Each step reads bytes i..i+10 and writes 8 lanes at out + count <= out + i
+    while (i + 11 <= len) {
+        if (i + 32 <= len) {
+            __m256i chunk = _mm256_loadu_si256((const __m256i*)(s + i));
+            if (_mm256_movemask_epi8(chunk) == 0) {
+                __m128i lo = _mm256_castsi256_si128(chunk);
+                __m128i hi = _mm256_extracti128_si256(chunk, 1);
+                _mm256_storeu_si256((__m256i*)(out + count),      _mm256_cvtepu8_epi32(lo));
+                _mm256_storeu_si256((__m256i*)(out + count + 8),  _mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8)));
+                _mm256_storeu_si256((__m256i*)(out + count + 16), _mm256_cvtepu8_epi32(hi));
+                _mm256_storeu_si256((__m256i*)(out + count + 24), _mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8)));
+                i += 32;
+                count += 32;
+                continue;
+            }
+        }
+
+        __m256i b0 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(s + i)));
+        __m256i b1 = _mm256_and_si256(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(s + i + 1))), cont_mask);
+        __m256i b2 = _mm256_and_si256(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(s + i + 2))), cont_mask);
+        __m256i b3 = _mm256_and_si256(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(s + i + 3))), cont_mask);
+
+        // Codepoint for each position read as a lead byte of its own length
+        __m256i cp2 = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(b0, _mm256_set1_epi32(0x1F)), 6), b1);
+        __m256i cp3 = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(b0, _mm256_set1_epi32(0x0F)), 12),
+                                      _mm256_or_si256(_mm256_slli_epi32(b1, 6), b2));
+        __m256i cp4 = _mm256_or_si256(
+            _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(b0, _mm256_set1_epi32(0x07)), 18),
+                            _mm256_slli_epi32(b1, 12)),
+            _mm256_or_si256(_mm256_slli_epi32(b2, 6), b3));
+
+        __m256i is_multi = _mm256_cmpgt_epi32(b0, _mm256_set1_epi32(0xBF));
+        __m256i is_3 = _mm256_cmpgt_epi32(b0, _mm256_set1_epi32(0xDF));
+        __m256i is_4 = _mm256_cmpgt_epi32(b0, _mm256_set1_epi32(0xEF));
+        __m256i cp = _mm256_blendv_epi8(b0, cp2, is_multi);
+        cp = _mm256_blendv_epi8(cp, cp3, is_3);
+        cp = _mm256_blendv_epi8(cp, cp4, is_4);
+
+        // Keep ASCII and lead positions, drop continuation bytes
+        __m256i is_cont = _mm256_and_si256(_mm256_cmpgt_epi32(b0, _mm256_set1_epi32(0x7F)),
+                                           _mm256_cmpgt_epi32(_mm256_set1_epi32(0xC0), b0));
+        int keep = ~_mm256_movemask_ps(_mm256_castsi256_ps(is_cont)) & 0xFF;
+        __m256i perm = _mm256_load_si256((const __m256i*)tables.decode_compact[keep]);
+        _mm256_storeu_si256((__m256i*)(out + count), _mm256_permutevar8x32_epi32(cp, perm));
+        count += __builtin_popcount((unsigned)keep);
+        i += 8;
+    }
+
+    // The last step may have decoded a sequence running past i
+    while (i < len && (s[i] & 0xC0) == 0x80) {
+        i++;
+    }
+    while (i < len) {
+        int bytes_consumed = 0;
+        out[count++] = utf8_decode((const char*)s + i, &bytes_consumed);
+        i += bytes_consumed;
+    }
+    return count;
+}
+
+// Encode codepoints[0..len) into out (room for 4 bytes each); returns bytes written
+UNICODE_AVX2_TARGET
+static int32_t utf32_encode_avx2(const int32_t* codepoints, int32_t len, char* out) {
+    const TranscodeTables& tables = transcode_tables();
+    const __m256i cont_mask = _mm256_set1_epi32(0x3F);
+    const __m256i cont_tag = _mm256_set1_epi32(0x80);
+    int32_t pos = 0;
+    int32_t i = 0;
+
+    for (; i + 8 <= len; i += 8) {
+        __m256i cp = _mm256_loadu_si256((const __m256i*)(codepoints + i));
+
+        if (i + 16 <= len) {
+            __m256i next = _mm256_loadu_si256((const __m256i*)(codepoints + i + 8));
+            if (_mm256_testz_si256(_mm256_or_si256(cp, next), _mm256_set1_epi32(~0x7F))) {
+                ascii_narrow(codepoints + i, 16, out + pos);
+                pos += 16;
+                i += 8;
+                continue;
+            }
+        }
+
+        // Negative, beyond the BMP or a surrogate: scalar encoder for this block
+        __m256i outside = _mm256_or_si256(
+            _mm256_cmpgt_epi32(cp, _mm256_set1_epi32(0xFFFF)),
+            _mm256_cmpgt_epi32(_mm256_setzero_si256(), cp));
+        __m256i surrogate = _mm256_cmpeq_epi32(_mm256_and_si256(cp, _mm256_set1_epi32(0xF800)),
+                                               _mm256_set1_epi32(0xD800));
+        if (!_mm256_testz_si256(_mm256_or_si256(outside, surrogate), _mm256_set1_epi32(-1))) {
+            for (int32_t j = i; j < i + 8; j++) {
+                pos += utf8_encode(codepoints[j], out + pos);
+            }
+            continue;
+        }
+
+        __m256i ge80 = _mm256_cmpgt_epi32(cp, _mm256_set1_epi32(0x7F));
+        __m256i ge800 = _mm256_cmpgt_epi32(cp, _mm256_set1_epi32(0x7FF));
+
+        // Each lane holds its encoding in the low 1-3 bytes, in output order
+        __m256i two = _mm256_or_si256(
+            _mm256_or_si256(_mm256_srli_epi32(cp, 6), _mm256_set1_epi32(0xC0)),
+            _mm256_slli_epi32(_mm256_or_si256(_mm256_and_si256(cp, cont_mask), cont_tag), 8));
+        __m256i three = _mm256_or_si256(
+            _mm256_or_si256(_mm256_srli_epi32(cp, 12), _mm256_set1_epi32(0xE0)),
+            _mm256_or_si256(
+                _mm256_slli_epi32(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(cp, 6), cont_mask), cont_tag), 8),
+                _mm256_slli_epi32(_mm256_or_si256(_mm256_and_si256(cp, cont_mask), cont_tag), 16)));
+        __m256i words = _mm256_blendv_epi8(cp, two, ge80);
+        words = _mm256_blendv_epi8(words, three, ge800);
+
+        int m80 = _mm256_movemask_ps(_mm256_castsi256_ps(ge80));
+        int m800 = _mm256_movemask_ps(_mm256_castsi256_ps(ge800));
+        int lo_key = (m80 & 0x0F) | ((m800 & 0x0F) << 4);
+        int hi_key = (m80 >> 4) | (m800 & 0xF0);
+
+        __m128i lo = _mm_shuffle_epi8(_mm256_castsi256_si128(words),
+                                      _mm_load_si128((const __m128i*)tables.encode_compact[lo_key]));
+        _mm_storeu_si128((__m128i*)(out + pos), lo);
+        pos += tables.encode_length[lo_key];
+        __m128i hi = _mm_shuffle_epi8(_mm256_extracti128_si256(words, 1),
+                                      _mm_load_si128((const __m128i*)tables.encode_compact[hi_key]));
+        _mm_storeu_si128((__m128i*)(out + pos), hi);
+        pos += tables.encode_length[hi_key];
+    }
+
+    for (; i < len; i++) {
+        pos += utf8_encode(codepoints[i], out + pos);
+    }
+    return pos;
+}
+#endif
+
 // =============================================================================
 // Public API: UTF-8 / UTF-32 Conversion
 // =============================================================================
@@ -131,28 +568,48 @@ int32_t* unicode_from_utf8(const char* utf8_str, int32_t* out_len) {
         return nullptr;
     }
     
-    // First pass: count codepoints
-    int32_t count = 0;
-    const char* p = utf8_str;
-    while (*p) {
-        int bytes_consumed = 0;
-        utf8_decode(p, &bytes_consumed);
-        p += bytes_consumed;
-        count++;
-    }
+    const unsigned char* s = (const unsigned char*)utf8_str;
+    size_t byte_len = strlen(utf8_str);
     
-    // Allocate array
-    int32_t* codepoints = (int32_t*)malloc(count * sizeof(int32_t));
+    // A codepoint needs at least one byte, so byte_len is an upper bound
+    // and a single decoding pass is enough
+    int32_t* codepoints = (int32_t*)malloc((byte_len ? byte_len : 1) * sizeof(int32_t));
     if (!codepoints) {
         return nullptr;
     }
     
-    // Second pass: decode codepoints
-    p = utf8_str;
-    for (int32_t i = 0; i < count; i++) {
+    size_t pos = 0;
+    int32_t count = 0;
+#if defined(UNICODE_RUNTIME_AVX2)
+    // All-ASCII strings are left to the widening loop, which needs no validation pass
+    if (cpu_has_avx2() && ascii_prefix_length(s, byte_len) < byte_len &&
+        utf8_validate_avx2(s, byte_len)) {
+        count = utf8_decode_valid_avx2(s, byte_len, codepoints);
+        pos = byte_len;
+    }
+#endif
+    while (pos < byte_len) {
+        size_t ascii_run = ascii_prefix_length(s + pos, byte_len - pos);
+        if (ascii_run > 0) {
+            ascii_widen(s + pos, ascii_run, codepoints + count);
+            pos += ascii_run;
+            count += (int32_t)ascii_run;
+            continue;
+        }
+        
+        // Multi-byte (or invalid) sequence; utf8_decode stops at the
+        // terminator because a NUL byte never matches a continuation byte
         int bytes_consumed = 0;
-        codepoints[i] = utf8_decode(p, &bytes_consumed);
-        p += bytes_consumed;
+        codepoints[count++] = utf8_decode(utf8_str + pos, &bytes_consumed);
+        pos += bytes_consumed;
+    }
+    
+    // Give back the slack for non-ASCII text
+    if ((size_t)count < byte_len) {
+        int32_t* shrunk = (int32_t*)realloc(codepoints, (count ? count : 1) * sizeof(int32_t));
+        if (shrunk) {
+            codepoints = shrunk;
+        }
     }
     
     *out_len = count;
@@ -171,11 +628,31 @@ char* unicode_to_utf8(const int32_t* codepoints, int32_t len, int32_t* out_len)
         return nullptr;
     }
     
-    // Encode each codepoint
+#if defined(UNICODE_RUNTIME_AVX2)
+    if (cpu_has_avx2()) {
+        int32_t pos = utf32_encode_avx2(codepoints, len, buffer);
+        buffer[pos] = '\0';
+        *out_len = pos;
+        return buffer;
+    }
+#endif
+    
+    // Encode in blocks of 16 codepoints: all-ASCII blocks are narrowed in
+    // bulk, anything else goes through the per-codepoint encoder
     int32_t pos = 0;
-    for (int32_t i = 0; i < len; i++) {
-        int bytes_written = utf8_encode(codepoints[i], buffer + pos);
-        pos += bytes_written;
+    int32_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        if (ascii_codepoint_prefix_length(codepoints + i, 16) == 16) {
+            ascii_narrow(codepoints + i, 16, buffer + pos);
+            pos += 16;
+            continue;
+        }
+        for (int32_t j = i; j < i + 16; j++) {
+            pos += utf8_encode(codepoints[j], buffer + pos);
+        }
+    }
+    for (; i < len; i++) {
+        pos += utf8_encode(codepoints[i], buffer + pos);
     }
     
     buffer[pos] = '\0';
@@ -192,8 +669,9 @@ void unicode_free(void* ptr) {
 // Unicode Case Conversion
 // =============================================================================
 
-// Simple case conversion for ASCII and Latin-1
-// For full Unicode support, would need comprehensive case mapping tables
+// Simple case conversion for ASCII, Latin-1, basic Greek and Cyrillic.
+// For full Unicode support, would need comprehensive case mapping tables.
+// These rules are only used to build the lookup tables below.
 static int32_t simple_upper(int32_t cp) {
     // ASCII lowercase to uppercase
     if (cp >= 0x61 && cp <= 0x7A) {
@@ -234,31 +712,55 @@ static int32_t simple_lower(int32_t cp) {
     return cp;
 }
 
+// Every mapped codepoint lies below 0x500 (end of the Cyrillic block), so
+// case conversion is a single table lookup of a signed delta. Codepoints at
+// or above the limit map to themselves.
+static const int32_t CASE_TABLE_LIMIT = 0x500;
+
+struct CaseTables {
+    int8_t upper[CASE_TABLE_LIMIT];
+    int8_t lower[CASE_TABLE_LIMIT];
+
+    CaseTables() {
+        for (int32_t cp = 0; cp < CASE_TABLE_LIMIT; cp++) {
+            upper[cp] = (int8_t)(simple_upper(cp) - cp);
+            lower[cp] = (int8_t)(simple_lower(cp) - cp);
+        }
+    }
+};
+
+static const CaseTables& case_tables() {
+    static const CaseTables tables;
+    return tables;
+}
+
+// Map src[0..len) to dst[0..len) through a delta table (src may equal dst)
+static void map_case(const int32_t* src, int32_t* dst, int32_t len, const int8_t* delta) {
+    for (int32_t i = 0; i < len; i++) {
+        int32_t cp = src[i];
+        dst[i] = ((uint32_t)cp < (uint32_t)CASE_TABLE_LIMIT) ? cp + delta[cp] : cp;
+    }
+}
+
 void unicode_upper(int32_t* codepoints, int32_t len) {
     if (!codepoints || len < 0) return;
     
-    for (int32_t i = 0; i < len; i++) {
-        codepoints[i] = simple_upper(codepoints[i]);
-    }
+    map_case(codepoints, codepoints, len, case_tables().upper);
 }
 
 void unicode_lower(int32_t* codepoints, int32_t len) {
     if (!codepoints || len < 0) return;
     
-    for (int32_t i = 0; i < len; i++) {
-        codepoints[i] = simple_lower(codepoints[i]);
-    }
+    map_case(codepoints, codepoints, len, case_tables().lower);
 }
 
 int32_t* unicode_upper_new(const int32_t* codepoints, int32_t len) {
     if (!codepoints || len < 0) return nullptr;
     
-    int32_t* result = (int32_t*)malloc(len * sizeof(int32_t));
+    int32_t* result = (int32_t*)malloc((len ? len : 1) * sizeof(int32_t));
     if (!result) return nullptr;
     
-    for (int32_t i = 0; i < len; i++) {
-        result[i] = simple_upper(codepoints[i]);
-    }
+    map_case(codepoints, result, len, case_tables().upper);
     
     return result;
 }
@@ -266,16 +768,121 @@ int32_t* unicode_upper_new(const int32_t* codepoints, int32_t len) {
 int32_t* unicode_lower_new(const int32_t* codepoints, int32_t len) {
     if (!codepoints || len < 0) return nullptr;
     
-    int32_t* result = (int32_t*)malloc(len * sizeof(int32_t));
+    int32_t* result = (int32_t*)malloc((len ? len : 1) * sizeof(int32_t));
     if (!result) return nullptr;
     
-    for (int32_t i = 0; i < len; i++) {
-        result[i] = simple_lower(codepoints[i]);
-    }
+    map_case(codepoints, result, len, case_tables().lower);
     
     return result;
 }
 
+// =============================================================================
+// Substring Search (INSTR)
+// =============================================================================
+//
+// Both searches use the first/last element filter: broadcast the needle's
+// first and last elements, compare a block of candidate positions against
+// both at once, and only memcmp the candidates where both ends agree. Text
+// rarely matches at both ends by accident, so almost every block is
+// rejected with two compares and no per-position branching.
+
+int32_t unicode_find_bytes(const char* haystack, int32_t hay_len,
+                           const char* needle, int32_t needle_len, int32_t start) {
+    if (!haystack || !needle || needle_len <= 0 || hay_len < 0) return 0;
+    if (start < 1) start = 1;
+    
+    size_t n = (size_t)hay_len;
+    size_t m = (size_t)needle_len;
+    size_t i = (size_t)(start - 1);
+    if (i > n || m > n - i) return 0;
+    
+    const unsigned char* h = (const unsigned char*)haystack;
+    const unsigned char* nd = (const unsigned char*)needle;
+    
+    // Single byte: memchr is already vectorised by libc
+    if (m == 1) {
+        const void* hit = memchr(h + i, nd[0], n - i);
+        return hit ? (int32_t)((const unsigned char*)hit - h) + 1 : 0;
+    }
+    
+    size_t last_start = n - m;  // Last valid match position (0-based)
+    
+#if defined(UNICODE_RUNTIME_SSE2)
+    const __m128i first = _mm_set1_epi8((char)nd[0]);
+    const __m128i last = _mm_set1_epi8((char)nd[m - 1]);
+    
+    for (; i + 16 <= last_start + 1; i += 16) {
+        __m128i block_first = _mm_loadu_si128((const __m128i*)(h + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i*)(h + i + m - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                          _mm_cmpeq_epi8(last, block_last)));
+        while (mask != 0) {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (memcmp(h + i + bit + 1, nd + 1, m - 2) == 0) {
+                return (int32_t)(i + bit) + 1;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    
+    // Scalar tail (and whole search without SSE2): skip to candidate first bytes
+    while (i <= last_start) {
+        const unsigned char* hit = (const unsigned char*)memchr(h + i, nd[0], last_start - i + 1);
+        if (!hit) return 0;
+        i = (size_t)(hit - h);
+        if (h[i + m - 1] == nd[m - 1] && memcmp(h + i + 1, nd + 1, m - 2) == 0) {
+            return (int32_t)i + 1;
+        }
+        i++;
+    }
+    return 0;
+}
+
+int32_t unicode_find_codepoints(const int32_t* haystack, int32_t hay_len,
+                                const int32_t* needle, int32_t needle_len, int32_t start) {
+    if (!haystack || !needle || needle_len <= 0 || hay_len < 0) return 0;
+    if (start < 1) start = 1;
+    
+    size_t n = (size_t)hay_len;
+    size_t m = (size_t)needle_len;
+    size_t i = (size_t)(start - 1);
+    if (i > n || m > n - i) return 0;
+    
+    size_t last_start = n - m;
+    const int32_t first_cp = needle[0];
+    const int32_t last_cp = needle[m - 1];
+    
+#if defined(UNICODE_RUNTIME_SSE2)
+    const __m128i first = _mm_set1_epi32(first_cp);
+    const __m128i last = _mm_set1_epi32(last_cp);
+    
+    for (; i + 4 <= last_start + 1; i += 4) {
+        __m128i block_first = _mm_loadu_si128((const __m128i*)(haystack + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i*)(haystack + i + m - 1));
+        unsigned mask = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(
+            _mm_and_si128(_mm_cmpeq_epi32(first, block_first),
+                          _mm_cmpeq_epi32(last, block_last))));
+        while (mask != 0) {
+            unsigned lane = (unsigned)__builtin_ctz(mask);
+            if (m <= 2 || memcmp(haystack + i + lane + 1, needle + 1, (m - 2) * sizeof(int32_t)) == 0) {
+                return (int32_t)(i + lane) + 1;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    
+    for (; i <= last_start; i++) {
+        if (haystack[i] == first_cp && haystack[i + m - 1] == last_cp &&
+            (m <= 2 || memcmp(haystack + i + 1, needle + 1, (m - 2) * sizeof(int32_t)) == 0)) {
+            return (int32_t)i + 1;
+        }
+    }
+    return 0;
+}
+
 // =============================================================================
 // Validation and Utilities
 // =============================================================================
@@ -89,6 +89,40 @@ int32_t* unicode_upper_new(const int32_t* codepoints, int32_t len);
  */
 int32_t* unicode_lower_new(const int32_t* codepoints, int32_t len);
 
+// =============================================================================
+// Substring Search (INSTR)
+// =============================================================================
+
+/**
+ * Find the first occurrence of a byte string (INSTR in standard mode)
+ * Candidate positions are found by matching the needle's first and last
+ * bytes 16 positions at a time, then verified with memcmp.
+ * 
+ * @param haystack Bytes to search (need not be null-terminated)
+ * @param hay_len Number of bytes in haystack
+ * @param needle Bytes to search for
+ * @param needle_len Number of bytes in needle
+ * @param start 1-based position to start searching from (values < 1 mean 1)
+ * @return 1-based position of the match, or 0 if not found or needle is empty
+ */
+int32_t unicode_find_bytes(const char* haystack, int32_t hay_len,
+                           const char* needle, int32_t needle_len, int32_t start);
+
+/**
+ * Find the first occurrence of a codepoint sequence (INSTR in OPTION UNICODE)
+ * Uses the same first/last element filter as unicode_find_bytes, 4 codepoints
+ * at a time.
+ * 
+ * @param haystack Codepoints to search
+ * @param hay_len Number of codepoints in haystack
+ * @param needle Codepoints to search for
+ * @param needle_len Number of codepoints in needle
+ * @param start 1-based position to start searching from (values < 1 mean 1)
+ * @return 1-based position of the match, or 0 if not found or needle is empty
+ */
+int32_t unicode_find_codepoints(const int32_t* haystack, int32_t hay_len,
+                                const int32_t* needle, int32_t needle_len, int32_t start);
+
 // =============================================================================
 // Validation and Utilities
 // =============================================================================
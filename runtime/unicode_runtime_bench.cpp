@@ -0,0 +1,256 @@
+//
+// unicode_runtime_bench.cpp
+// FasterBASIC - Unicode Runtime Micro-Benchmark
+//
+// Times UTF-8 decode, UTF-8 encode, case mapping and INSTR search over
+// ASCII, Latin-1 and CJK corpora, and checks every result against a
+// straightforward byte-at-a-time reference implementation.
+//
+// Build:  c++ -O2 -std=c++17 unicode_runtime.cpp unicode_runtime_bench.cpp -o unicode_bench
+// Run:    ./unicode_bench [iterations]
+//
+
+#include "unicode_runtime.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// =============================================================================
+// Reference Implementation
+// =============================================================================
+
+static std::vector<int32_t> reference_decode(const std::string& s) {
+    std::vector<int32_t> out;
+    const unsigned char* p = (const unsigned char*)s.c_str();
+    while (*p) {
+        unsigned char c = p[0];
+        int len = (c < 0x80) ? 1 : ((c & 0xE0) == 0xC0) ? 2 :
+                  ((c & 0xF0) == 0xE0) ? 3 : ((c & 0xF8) == 0xF0) ? 4 : 0;
+        if (len == 0) { out.push_back(0xFFFD); p++; continue; }
+        bool ok = true;
+        for (int i = 1; i < len; i++) {
+            if ((p[i] & 0xC0) != 0x80) { ok = false; break; }
+        }
+        if (!ok) { out.push_back(0xFFFD); p++; continue; }
+        int32_t cp = (len == 1) ? c : (len == 2) ? (c & 0x1F) : (len == 3) ? (c & 0x0F) : (c & 0x07);
+        for (int i = 1; i < len; i++) cp = (cp << 6) | (p[i] & 0x3F);
+        if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) cp = 0xFFFD;
+        out.push_back(cp);
+        p += len;
+    }
+    return out;
+}
+
+static int32_t reference_upper(int32_t cp) {
+    if (cp >= 0x61 && cp <= 0x7A) return cp - 32;
+    if (cp >= 0xE0 && cp <= 0xFE && cp != 0xF7) return cp - 32;
+    if (cp >= 0x3B1 && cp <= 0x3C9) return cp - 32;
+    if (cp >= 0x430 && cp <= 0x44F) return cp - 32;
+    return cp;
+}
+
+static int32_t reference_lower(int32_t cp) {
+    if (cp >= 0x41 && cp <= 0x5A) return cp + 32;
+    if (cp >= 0xC0 && cp <= 0xDE && cp != 0xD7) return cp + 32;
+    if (cp >= 0x391 && cp <= 0x3A9) return cp + 32;
+    if (cp >= 0x410 && cp <= 0x42F) return cp + 32;
+    return cp;
+}
+
+template <typename T>
+static int32_t reference_find(const T* h, int32_t n, const T* nd, int32_t m, int32_t start) {
+    if (m <= 0) return 0;
+    if (start < 1) start = 1;
+    for (int32_t i = start - 1; i + m <= n; i++) {
+        int32_t j = 0;
+        while (j < m && h[i + j] == nd[j]) j++;
+        if (j == m) return i + 1;
+    }
+    return 0;
+}
+
+// =============================================================================
+// Corpora
+// =============================================================================
+
+static std::string repeat_to_size(const std::string& unit, size_t bytes) {
+    std::string s;
+    while (s.size() < bytes) s += unit;
+    return s;
+}
+
+static std::string make_ascii(size_t bytes) {
+    return repeat_to_size("10 PRINT \"HELLO, WORLD\": LET A$ = MID$(B$, I, 1) + CHR$(65)\n", bytes);
+}
+
+static std::string make_latin1(size_t bytes) {
+    return repeat_to_size("Ça va très bien, déjà vu à Zürich; ÆØÅ æøå ß\n", bytes);
+}
+
+static std::string make_cjk(size_t bytes) {
+    return repeat_to_size("日本語のテキスト、中文文本，한국어 텍스트。\n", bytes);
+}
+
+// =============================================================================
+// Timing
+// =============================================================================
+
+static int g_failures = 0;
+static volatile int32_t g_sink = 0;  // Keeps timed results observable
+
+#define CHECK(cond, what) \
+    if (!(cond)) { fprintf(stderr, "MISMATCH: %s (%s)\n", what, #cond); g_failures++; }
+
+template <typename F>
+static double time_ns_per_byte(size_t bytes, int iterations, F&& body) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) body();
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    return ns / ((double)bytes * iterations);
+}
+
+static void bench_corpus(const char* name, const std::string& text, int iterations) {
+    // Correctness against the reference first
+    std::vector<int32_t> expected = reference_decode(text);
+
+    int32_t cp_len = 0;
+    int32_t* cps = unicode_from_utf8(text.c_str(), &cp_len);
+    CHECK(cps != nullptr, name);
+    CHECK(cp_len == (int32_t)expected.size(), name);
+    CHECK(memcmp(cps, expected.data(), expected.size() * sizeof(int32_t)) == 0, name);
+
+    int32_t utf8_len = 0;
+    char* round_trip = unicode_to_utf8(cps, cp_len, &utf8_len);
+    CHECK(round_trip != nullptr, name);
+    CHECK(std::string(round_trip, utf8_len) == text, name);
+    unicode_free(round_trip);
+
+    int32_t* upper = unicode_upper_new(cps, cp_len);
+    int32_t* lower = unicode_lower_new(cps, cp_len);
+    for (int32_t i = 0; i < cp_len; i++) {
+        CHECK(upper[i] == reference_upper(cps[i]), name);
+        CHECK(lower[i] == reference_lower(cps[i]), name);
+        if (g_failures) break;
+    }
+    unicode_free(upper);
+    unicode_free(lower);
+
+    // Timings
+    size_t bytes = text.size();
+    double decode = time_ns_per_byte(bytes, iterations, [&] {
+        int32_t n = 0;
+        unicode_free(unicode_from_utf8(text.c_str(), &n));
+    });
+    double encode = time_ns_per_byte(bytes, iterations, [&] {
+        int32_t n = 0;
+        unicode_free(unicode_to_utf8(cps, cp_len, &n));
+    });
+    double casemap = time_ns_per_byte(bytes, iterations, [&] {
+        unicode_upper(cps, cp_len);
+        unicode_lower(cps, cp_len);
+    });
+
+    printf("%-8s %8zu bytes %8d cps   decode %6.3f ns/B   encode %6.3f ns/B   upper+lower %6.3f ns/B\n",
+           name, bytes, cp_len, decode, encode, casemap);
+
+    // INSTR: search for a needle that only occurs at the very end
+    std::string needle_text = "\xE2\x80\xA2 END";
+    std::string hay_text = text + needle_text;
+    int32_t needle_len = 0, hay_len = 0;
+    int32_t* needle_cps = unicode_from_utf8(needle_text.c_str(), &needle_len);
+    int32_t* hay_cps = unicode_from_utf8(hay_text.c_str(), &hay_len);
+
+    int32_t byte_pos = unicode_find_bytes(hay_text.data(), (int32_t)hay_text.size(),
+                                          needle_text.data(), (int32_t)needle_text.size(), 1);
+    CHECK(byte_pos == reference_find(hay_text.data(), (int32_t)hay_text.size(),
+                                     needle_text.data(), (int32_t)needle_text.size(), 1), name);
+    int32_t cp_pos = unicode_find_codepoints(hay_cps, hay_len, needle_cps, needle_len, 1);
+    CHECK(cp_pos == hay_len - needle_len + 1, name);
+    for (int32_t start = 1; start < 200; start += 7) {
+        for (int32_t m = 1; m <= 6; m++) {
+            CHECK(unicode_find_bytes(text.data(), (int32_t)text.size(), text.data() + 97, m, start) ==
+                  reference_find(text.data(), (int32_t)text.size(), text.data() + 97, m, start), name);
+            CHECK(unicode_find_codepoints(cps, cp_len, cps + 41, m, start) ==
+                  reference_find(cps, cp_len, cps + 41, m, start), name);
+        }
+    }
+
+    double find_bytes = time_ns_per_byte(hay_text.size(), iterations, [&] {
+        g_sink = unicode_find_bytes(hay_text.data(), (int32_t)hay_text.size(),
+                           needle_text.data(), (int32_t)needle_text.size(), 1);
+    });
+    double find_naive = time_ns_per_byte(hay_text.size(), iterations, [&] {
+        g_sink = reference_find(hay_text.data(), (int32_t)hay_text.size(),
+                       needle_text.data(), (int32_t)needle_text.size(), 1);
+    });
+    double find_cps = time_ns_per_byte(hay_text.size(), iterations, [&] {
+        g_sink = unicode_find_codepoints(hay_cps, hay_len, needle_cps, needle_len, 1);
+    });
+    printf("%-8s   instr bytes %6.3f ns/B (naive %6.3f)   instr codepoints %6.3f ns/B\n",
+           "", find_bytes, find_naive, find_cps);
+
+    unicode_free(needle_cps);
+    unicode_free(hay_cps);
+
+    unicode_free(cps);
+}
+
+int main(int argc, char** argv) {
+    int iterations = (argc > 1) ? atoi(argv[1]) : 200;
+    if (iterations <= 0) iterations = 200;
+    const size_t corpus_bytes = 64 * 1024;
+
+    printf("Unicode runtime %s (%s), %d iterations\n",
+           unicode_version(), unicode_standard_version(), iterations);
+
+    bench_corpus("ascii", make_ascii(corpus_bytes), iterations);
+    bench_corpus("latin1", make_latin1(corpus_bytes), iterations);
+    bench_corpus("cjk", make_cjk(corpus_bytes), iterations);
+
+    // Malformed and edge-case input must match the reference too
+    const char* edge_cases[] = {
+        "", "A", "\xC3", "abc\xE2\x82", "\xF0\x9F\x98\x80 emoji", "\xED\xA0\x80 surrogate",
+        "\xFF\xFE bad lead", "0123456789abcdef0123456789abcdef\xC3\xA9",
+        "\xC0\x80 overlong", "\xE0\x9F\xBF overlong", "\xF4\x90\x80\x80 too large",
+        "\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9"
+        "\xC3\xA9\xC3\xA9\xC3\xA9\xE6\x97",
+    };
+    for (const char* s : edge_cases) {
+        std::vector<int32_t> expected = reference_decode(s);
+        int32_t n = 0;
+        int32_t* cps = unicode_from_utf8(s, &n);
+        CHECK(n == (int32_t)expected.size(), s);
+        CHECK(n == 0 || memcmp(cps, expected.data(), n * sizeof(int32_t)) == 0, s);
+        unicode_free(cps);
+    }
+
+    // Codepoints with no UTF-8 form encode as U+FFFD, inside SIMD-sized blocks too
+    const int32_t bad_codepoints[] = {
+        'a', 0xE9, 0x65E5, -1, 'b', 0xD800, 0x110000, 0x1F600,
+        'c', 'd', 'e', 'f', 'g', 'h', 0xDFFF, 'i',
+    };
+    std::string expected_utf8;
+    for (int32_t cp : bad_codepoints) {
+        std::vector<int32_t> one(1, cp);
+        int32_t n = 0;
+        char* bytes = unicode_to_utf8(one.data(), 1, &n);
+        expected_utf8.append(bytes, n);
+        unicode_free(bytes);
+    }
+    int32_t encoded_len = 0;
+    char* encoded = unicode_to_utf8(bad_codepoints, 16, &encoded_len);
+    CHECK(std::string(encoded, encoded_len) == expected_utf8, "invalid codepoints");
+    CHECK(expected_utf8.find("\xEF\xBF\xBD") != std::string::npos, "invalid codepoints");
+    unicode_free(encoded);
+
+    if (g_failures) {
+        printf("%d mismatches against reference implementation\n", g_failures);
+        return 1;
+    }
+    printf("All results match reference implementation\n");
+    return 0;
+}
@@ -0,0 +1,385 @@
+//
+//  CFGAnalysis_test.cpp
+//  FasterBASIC - Dataflow Analysis Tests
+//
+//  Builds the CFG of small numbered BASIC programs the way fbc does and
+//  checks the flow graph, dominators, natural loops, liveness and reaching
+//  definitions that CFGAnalysis computes over it.
+//
+//  Link with the compiler sources and runtime/ConstantsManager.cpp.
+//
+
+#include "fasterbasic_lexer.h"
+#include "fasterbasic_parser.h"
+#include "fasterbasic_semantic.h"
+#include "fasterbasic_cfg.h"
+#include "fasterbasic_data_preprocessor.h"
+#include "modular_commands.h"
+#include "command_registry_core.h"
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace FasterBASIC;
+using namespace FasterBASIC::ModularCommands;
+
+// Test counter
+static int g_testsPassed = 0;
+static int g_testsFailed = 0;
+
+// Tests register themselves and run from main, after the command registry
+// is populated
+static std::vector<std::pair<const char*, void (*)()>>& testList() {
+    static std::vector<std::pair<const char*, void (*)()>> tests;
+    return tests;
+}
+
+// Helper macros
+#define TEST(name) void test_##name(); \
+    struct TestRegistrar_##name { \
+        TestRegistrar_##name() { testList().push_back({#name, test_##name}); } \
+    } g_testRegistrar_##name; \
+    void test_##name()
+
+#define ASSERT(condition) \
+    if (!(condition)) { \
+        std::cerr << "FAILED: " << #condition << " at line " << __LINE__ << std::endl; \
+        g_testsFailed++; \
+        return; \
+    }
+
+#define ASSERT_EQ(a, b) \
+    if ((a) != (b)) { \
+        std::cerr << "FAILED: " << #a << " != " << #b << " at line " << __LINE__ << std::endl; \
+        std::cerr << "  Expected: " << (b) << std::endl; \
+        std::cerr << "  Got:      " << (a) << std::endl; \
+        g_testsFailed++; \
+        return; \
+    }
+
+// =============================================================================
+// Helpers
+// =============================================================================
+
+// Everything the analysis points into must outlive it
+struct Analyzed {
+    std::unique_ptr<Program> ast;
+    std::unique_ptr<SemanticAnalyzer> semantic;
+    std::unique_ptr<ControlFlowGraph> cfg;
+    std::unique_ptr<CFGAnalysis> analysis;
+
+    // Flow node holding the first statement of a BASIC line, -1 if none
+    int node(int lineNumber) const {
+        for (int id = 0; id < analysis->getNodeCount(); ++id) {
+            const FlowNode& flowNode = analysis->getNode(id);
+            const BasicBlock* block = cfg->getBlock(flowNode.blockId);
+            if (!block) continue;
+            for (int i = flowNode.firstStatement; i < flowNode.endStatement; ++i) {
+                if (block->getLineNumber(block->statements[i]) == lineNumber) return id;
+            }
+        }
+        return -1;
+    }
+
+    // Line numbers of the definitions of a variable reaching a node
+    std::vector<int> reachingLines(int lineNumber, const std::string& variable) const {
+        std::vector<int> lines;
+        int index = analysis->variableIndex(variable);
+        if (index < 0) return lines;
+        for (int id : analysis->reachingDefinitions(node(lineNumber), index)) {
+            lines.push_back(analysis->getDefinitions()[id].lineNumber);
+        }
+        std::sort(lines.begin(), lines.end());
+        return lines;
+    }
+
+    int edgeCount() const {
+        int edges = 0;
+        for (int id = 0; id < analysis->getNodeCount(); ++id) {
+            edges += static_cast<int>(analysis->successors(id).size());
+        }
+        return edges;
+    }
+};
+
+static std::unique_ptr<Analyzed> analyze(const std::string& basic) {
+    // Line numbers stay in place so statements can be found by them
+    std::string source = DataPreprocessor::preprocessREM(basic);
+
+    Lexer lexer;
+    lexer.tokenize(source);
+    auto tokens = lexer.getTokens();
+
+    auto result = std::make_unique<Analyzed>();
+    Parser parser;
+    result->ast = parser.parse(tokens, "test.bas");
+    if (!result->ast || parser.hasErrors()) return nullptr;
+
+    result->semantic = std::make_unique<SemanticAnalyzer>();
+    result->semantic->analyze(*result->ast, parser.getOptions());
+
+    CFGBuilder builder;
+    result->cfg = builder.build(*result->ast, result->semantic->getSymbolTable());
+
+    result->analysis = std::make_unique<CFGAnalysis>(*result->cfg, &result->semantic->getSymbolTable());
+    result->analysis->run();
+    return result;
+}
+
+static std::string lineList(const std::vector<int>& lines) {
+    std::string text;
+    for (int line : lines) text += (text.empty() ? "" : ",") + std::to_string(line);
+    return text;
+}
+
+// =============================================================================
+// Dominators
+// =============================================================================
+
+TEST(DominatorsOfBranch) {
+    auto a = analyze(
+        "10 INPUT X\n"
+        "20 IF X > 0 THEN GOTO 50\n"
+        "30 Y = 1\n"
+        "40 GOTO 60\n"
+        "50 Y = 2\n"
+        "60 PRINT Y\n"
+        "70 END\n");
+    ASSERT(a);
+    const CFGAnalysis& an = *a->analysis;
+    int branch = a->node(20), left = a->node(30), right = a->node(50), join = a->node(60);
+    ASSERT(branch >= 0 && left >= 0 && right >= 0 && join >= 0);
+
+    ASSERT(an.dominates(branch, left));
+    ASSERT(an.dominates(branch, right));
+    ASSERT(an.dominates(branch, join));
+    ASSERT(!an.dominates(left, join));
+    ASSERT(!an.dominates(right, join));
+    ASSERT_EQ(an.immediateDominator(join), branch);
+
+    ASSERT(an.postDominates(join, branch));
+    ASSERT(!an.postDominates(left, branch));
+    ASSERT_EQ(an.immediatePostDominator(branch), join);
+}
+
+// =============================================================================
+// Natural Loops
+// =============================================================================
+
+TEST(NestedForLoops) {
+    auto a = analyze(
+        "10 S = 0\n"
+        "20 FOR I = 1 TO 10\n"
+        "30 FOR J = 1 TO 10\n"
+        "40 S = S + I * J\n"
+        "50 NEXT J\n"
+        "60 NEXT I\n"
+        "70 PRINT S\n");
+    ASSERT(a);
+    const CFGAnalysis& an = *a->analysis;
+    ASSERT_EQ(an.getLoops().size(), 2u);
+    ASSERT_EQ(an.getIrreducibleEdgeCount(), 0);
+
+    int body = a->node(40);
+    ASSERT(body >= 0);
+    ASSERT_EQ(an.loopDepth(body), 2);
+    ASSERT_EQ(an.loopDepth(a->node(10)), 0);
+    ASSERT_EQ(an.loopDepth(a->node(70)), 0);
+
+    const NaturalLoop& inner = an.getLoops()[an.innermostLoop(body)];
+    ASSERT_EQ(inner.depth, 2);
+    ASSERT(inner.parent >= 0);
+    const NaturalLoop& outer = an.getLoops()[inner.parent];
+    ASSERT(outer.contains(inner.header));
+    ASSERT(!inner.contains(outer.header));
+    ASSERT(an.dominates(outer.header, inner.header));
+}
+
+TEST(GotoLoop) {
+    auto a = analyze(
+        "10 I = 0\n"
+        "20 I = I + 1\n"
+        "30 IF I < 5 THEN GOTO 20\n"
+        "40 PRINT I\n");
+    ASSERT(a);
+    const CFGAnalysis& an = *a->analysis;
+    ASSERT_EQ(an.getLoops().size(), 1u);
+    const NaturalLoop& loop = an.getLoops()[0];
+    ASSERT_EQ(loop.header, a->node(20));
+    ASSERT(loop.contains(a->node(30)));
+    ASSERT(!loop.contains(a->node(10)));
+    ASSERT(!loop.contains(a->node(40)));
+}
+
+// =============================================================================
+// Liveness
+// =============================================================================
+
+TEST(LivenessAcrossBranch) {
+    auto a = analyze(
+        "10 A = 1\n"
+        "20 B = 2\n"
+        "30 INPUT C\n"
+        "40 IF C > 0 THEN GOTO 70\n"
+        "50 B = 3\n"
+        "60 PRINT A\n"
+        "70 PRINT B\n");
+    ASSERT(a);
+    const CFGAnalysis& an = *a->analysis;
+    int test = a->node(40), redefine = a->node(50), use = a->node(70);
+    ASSERT(test >= 0 && redefine >= 0 && use >= 0);
+
+    ASSERT(an.isLiveOut(test, "A"));
+    ASSERT(an.isLiveOut(test, "B"));
+    ASSERT(!an.isLiveIn(redefine, "B"));
+    ASSERT(an.isLiveIn(use, "B"));
+    ASSERT(!an.isLiveIn(use, "A"));
+    ASSERT(!an.isLiveIn(use, "C"));
+}
+
+// =============================================================================
+// Reaching Definitions
+// =============================================================================
+
+TEST(ReachingDefinitionsAtJoin) {
+    auto a = analyze(
+        "10 INPUT C\n"
+        "20 X = 1\n"
+        "30 IF C > 0 THEN GOTO 50\n"
+        "40 X = 2\n"
+        "50 PRINT X\n"
+        "60 X = 3\n"
+        "70 GOTO 90\n"
+        "80 X = 4\n"
+        "90 PRINT X\n");
+    ASSERT(a);
+    ASSERT_EQ(lineList(a->reachingLines(50, "X")), std::string("20,40"));
+    ASSERT_EQ(lineList(a->reachingLines(90, "X")), std::string("60"));
+}
+
+// =============================================================================
+// GOSUB / RETURN
+// =============================================================================
+
+// RETURN resumes after every GOSUB through the one return-join node, so
+// results flow from each subroutine to each call site
+TEST(ReturnFlowsToEveryGosubSite) {
+    auto a = analyze(
+        "10 X = 1\n"
+        "20 GOSUB 100\n"
+        "30 PRINT X\n"
+        "40 GOSUB 200\n"
+        "50 PRINT X\n"
+        "60 END\n"
+        "100 X = 2\n"
+        "110 RETURN\n"
+        "200 X = 3\n"
+        "210 RETURN\n");
+    ASSERT(a);
+    const CFGAnalysis& an = *a->analysis;
+    int join = an.returnJoinNode();
+    ASSERT(join >= 0);
+    ASSERT_EQ(an.getNode(join).blockId, -1);
+    ASSERT(an.isReachable(join));
+
+    std::vector<int> sites = an.successors(join);
+    std::sort(sites.begin(), sites.end());
+    ASSERT_EQ(sites.size(), 2u);
+    ASSERT_EQ(sites[0], a->node(30));
+    ASSERT_EQ(sites[1], a->node(50));
+
+    for (int line : {110, 210}) {
+        int ret = a->node(line);
+        ASSERT(ret >= 0);
+        ASSERT_EQ(an.successors(ret).size(), 1u);
+        ASSERT_EQ(an.successors(ret)[0], join);
+    }
+
+    // The GOSUB's own fallthrough edge also lets line 10 through
+    ASSERT_EQ(lineList(a->reachingLines(30, "X")), std::string("10,100,200"));
+    ASSERT(an.isLiveOut(a->node(110), "X"));
+    ASSERT(an.isLiveIn(join, "X"));
+}
+
+// RETURN edges grow with RETURNs + GOSUBs, not their product
+TEST(ReturnEdgesAreLinear) {
+    std::string program;
+    int line = 10;
+    for (int i = 0; i < 40; ++i) {
+        program += std::to_string(line) + " GOSUB " + std::to_string(1000 + (i % 20) * 10) + "\n";
+        line += 10;
+    }
+    program += std::to_string(line) + " END\n";
+    for (int i = 0; i < 20; ++i) {
+        program += std::to_string(1000 + i * 10) + " RETURN\n";
+    }
+
+    auto a = analyze(program);
+    ASSERT(a);
+    const CFGAnalysis& an = *a->analysis;
+    ASSERT(an.returnJoinNode() >= 0);
+    ASSERT_EQ(an.successors(an.returnJoinNode()).size(), 40u);
+    ASSERT_EQ(an.predecessors(an.returnJoinNode()).size(), 20u);
+    ASSERT(a->edgeCount() < 4 * (40 + 20));
+}
+
+// Without a GOSUB a RETURN leaves the program
+TEST(ReturnWithoutGosub) {
+    auto a = analyze(
+        "10 PRINT 1\n"
+        "20 RETURN\n");
+    ASSERT(a);
+    const CFGAnalysis& an = *a->analysis;
+    ASSERT_EQ(an.returnJoinNode(), -1);
+    int ret = a->node(20);
+    ASSERT(ret >= 0);
+    ASSERT_EQ(an.successors(ret).size(), 1u);
+    ASSERT_EQ(an.successors(ret)[0], an.exitNode());
+}
+
+// =============================================================================
+// Main Test Runner
+// =============================================================================
+
+int main() {
+    // Same command set as fbc
+    CommandRegistry& registry = getGlobalCommandRegistry();
+    CoreCommandRegistry::registerCoreCommands(registry);
+    CoreCommandRegistry::registerCoreFunctions(registry);
+    markGlobalRegistryInitialized();
+
+    std::cout << "========================================" << std::endl;
+    std::cout << "CFGAnalysis Tests" << std::endl;
+    std::cout << "========================================" << std::endl;
+    std::cout << std::endl;
+
+    for (const auto& test : testList()) {
+        std::cout << "Running test: " << test.first << "... ";
+        int failedBefore = g_testsFailed;
+        test.second();
+        if (g_testsFailed == failedBefore) {
+            std::cout << "PASSED" << std::endl;
+            g_testsPassed++;
+        }
+    }
+
+    std::cout << std::endl;
+    std::cout << "========================================" << std::endl;
+    std::cout << "Test Results" << std::endl;
+    std::cout << "========================================" << std::endl;
+    std::cout << "Passed: " << g_testsPassed << std::endl;
+    std::cout << "Failed: " << g_testsFailed << std::endl;
+    std::cout << "Total:  " << (g_testsPassed + g_testsFailed) << std::endl;
+
+    if (g_testsFailed == 0) {
+        std::cout << std::endl;
+        std::cout << "✓ All tests passed!" << std::endl;
+        return 0;
+    } else {
+        std::cout << std::endl;
+        std::cout << "✗ Some tests failed!" << std::endl;
+        return 1;
+    }
+}
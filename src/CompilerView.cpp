@@ -39,13 +39,11 @@ std::string CompilerView::getSourceText() const {
 
 std::vector<CompilerView::CompilerLine> CompilerView::getLines() const {
     std::vector<CompilerLine> result;
+    result.reserve(m_document->getLineCount());
     
-    const auto& lines = m_document->getLines();
-    result.reserve(lines.size());
-    
-    for (size_t i = 0; i < lines.size(); ++i) {
-        result.emplace_back(lines[i].lineNumber, lines[i].text, i);
-    }
+    m_document->forEachLine([&result](const SourceLine& line, size_t i) {
+        result.emplace_back(line.lineNumber, line.text, i);
+    });
     
     return result;
 }
@@ -59,21 +57,15 @@ size_t CompilerView::getLineCount() const {
 // =============================================================================
 
 void CompilerView::forEachLine(std::function<void(const CompilerLine&)> callback) const {
-    const auto& lines = m_document->getLines();
-    
-    for (size_t i = 0; i < lines.size(); ++i) {
-        CompilerLine line(lines[i].lineNumber, lines[i].text, i);
-        callback(line);
-    }
+    m_document->forEachLine([&callback](const SourceLine& line, size_t i) {
+        callback(CompilerLine(line.lineNumber, line.text, i));
+    });
 }
 
 void CompilerView::forEachLineIndexed(std::function<void(const CompilerLine&, size_t)> callback) const {
-    const auto& lines = m_document->getLines();
-    
-    for (size_t i = 0; i < lines.size(); ++i) {
-        CompilerLine line(lines[i].lineNumber, lines[i].text, i);
-        callback(line, i);
-    }
+    m_document->forEachLine([&callback](const SourceLine& line, size_t i) {
+        callback(CompilerLine(line.lineNumber, line.text, i), i);
+    });
 }
 
 // =============================================================================
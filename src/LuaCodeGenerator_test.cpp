@@ -0,0 +1,874 @@
+//
+//  LuaCodeGenerator_test.cpp
+//  FasterBASIC - Lua Code Generator Tests
+//
+//  Compiles small BASIC programs through the same pipeline as fbc and runs
+//  the generated Lua in an embedded LuaJIT state with PRINT captured.
+//
+//  Link with the compiler sources, runtime/unicode_lua_bindings.cpp,
+//  runtime/unicode_runtime.cpp, runtime/basic_bitwise.cpp,
+//  runtime/ConstantsManager.cpp and LuaJIT.
+//
+
+#include "fasterbasic_lexer.h"
+#include "fasterbasic_parser.h"
+#include "fasterbasic_semantic.h"
+#include "fasterbasic_cfg.h"
+#include "fasterbasic_ircode.h"
+#include "fasterbasic_optimizer.h"
+#include "fasterbasic_peephole.h"
+#include "fasterbasic_lua_codegen.h"
+#include "fasterbasic_data_preprocessor.h"
+#include "fasterbasic_compile.h"
+#include "modular_commands.h"
+#include "command_registry_core.h"
+#include "basic_bitwise.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+
+extern "C" {
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+}
+
+extern "C" void register_unicode_module(lua_State* L);
+
+using namespace FasterBASIC;
+using namespace FasterBASIC::ModularCommands;
+
+// Test counter
+static int g_testsPassed = 0;
+static int g_testsFailed = 0;
+
+// Tests register themselves and run from main, after the compiler's own
+// static tables are initialized
+static std::vector<std::pair<const char*, void (*)()>>& testList() {
+    static std::vector<std::pair<const char*, void (*)()>> tests;
+    return tests;
+}
+
+// Helper macros
+#define TEST(name) void test_##name(); \
+    struct TestRegistrar_##name { \
+        TestRegistrar_##name() { testList().push_back({#name, test_##name}); } \
+    } g_testRegistrar_##name; \
+    void test_##name()
+
+#define ASSERT(condition) \
+    if (!(condition)) { \
+        std::cerr << "FAILED: " << #condition << " at line " << __LINE__ << std::endl; \
+        g_testsFailed++; \
+        return; \
+    }
+
+#define ASSERT_EQ(a, b) \
+    if ((a) != (b)) { \
+        std::cerr << "FAILED: " << #a << " != " << #b << " at line " << __LINE__ << std::endl; \
+        std::cerr << "  Expected: " << (b) << std::endl; \
+        std::cerr << "  Got:      " << (a) << std::endl; \
+        g_testsFailed++; \
+        return; \
+    }
+
+// =============================================================================
+// Helpers
+// =============================================================================
+
+// Optimizer flags for compileToLua, as fbc's --opt-ast / --opt-peep / --opt-all
+enum Optimize {
+    OPT_NONE = 0,
+    OPT_AST = 1,
+    OPT_PEEP = 2,
+    OPT_ALL = OPT_AST | OPT_PEEP
+};
+
+// What a compile left behind besides the Lua text
+struct CompileInfo {
+    LuaSourceMap sourceMap;
+    std::string optimizerReport;  // --opt-stats output
+};
+
+// BASIC source -> Lua, as fbc compiles it with the given optimizer flags
+static std::string compileToLua(const std::string& basic, int optimize = OPT_NONE,
+                                CompileInfo* info = nullptr) {
+    std::string source = DataPreprocessor::preprocessREM(basic);
+    std::map<int, int> sourceLineNumbers;
+    source = DataPreprocessor::preprocessLineNumbersToLabels(source, &sourceLineNumbers);
+
+    Lexer lexer;
+    lexer.tokenize(source);
+    auto tokens = lexer.getTokens();
+
+    Parser parser;
+    parser.setSourceLineNumbers(sourceLineNumbers);
+    auto ast = parser.parse(tokens, "test.bas");
+    if (!ast || parser.hasErrors()) {
+        return "";
+    }
+
+    SemanticAnalyzer semantic;
+    semantic.analyze(*ast, parser.getOptions());
+
+    std::string report;
+    if (optimize & OPT_AST) {
+        ASTOptimizer astOptimizer;
+        astOptimizer.setOptimizationLevel(2);
+        astOptimizer.optimize(*ast, semantic.getSymbolTable());
+        report += astOptimizer.generateReport();
+    }
+
+    CFGBuilder cfgBuilder;
+    auto cfg = cfgBuilder.build(*ast, semantic.getSymbolTable());
+
+    IRGenerator irGen;
+    auto irCode = irGen.generate(*cfg, semantic.getSymbolTable());
+
+    if (optimize & OPT_PEEP) {
+        PeepholeOptimizer peepholeOpt;
+        peepholeOpt.setOptimizationLevel(1);
+        peepholeOpt.optimize(*irCode);
+        report += peepholeOpt.generateReport();
+    }
+
+    LuaCodeGenerator luaGen;
+    std::string lua = luaGen.generate(*irCode);
+    if (info) {
+        info->sourceMap = luaGen.getSourceMap();
+        info->optimizerReport = report;
+    }
+    return lua;
+}
+
+// Run generated Lua and return what it PRINTed, or "error: <message>".
+// setup runs first, in the same state.
+static std::string runLua(const std::string& lua, const std::string& setup = "") {
+    lua_State* L = luaL_newstate();
+    luaL_openlibs(L);
+    register_unicode_module(L);
+
+    std::string capture =
+        "__output = {}\n"
+        "function basic_print(value)\n"
+        "    if type(value) == 'table' then value = unicode.to_utf8(value) end\n"
+        "    __output[#__output + 1] = tostring(value)\n"
+        "end\n"
+        "function basic_print_newline() __output[#__output + 1] = '\\n' end\n";
+    std::string result;
+    if (luaL_dostring(L, capture.c_str()) != 0 ||
+        (!setup.empty() && luaL_dostring(L, setup.c_str()) != 0) ||
+        luaL_dostring(L, lua.c_str()) != 0) {
+        const char* message = lua_tostring(L, -1);
+        result = std::string("error: ") + (message ? message : "?");
+    } else {
+        luaL_dostring(L, "return table.concat(__output)");
+        result = lua_tostring(L, -1);
+    }
+    lua_close(L);
+    return result;
+}
+
+// =============================================================================
+// INSTR
+// =============================================================================
+
+// Multi-byte needles go to the runtime's native search; string.find is
+// replaced so a fallback to the Lua path fails the test
+TEST(InstrUsesNativeSearch) {
+    std::string lua = compileToLua(
+        "H$ = \"the quick brown fox jumps over the lazy dog\"\n"
+        "PRINT STR$(INSTR(H$, \"fox\")); \",\"; STR$(INSTR(H$, \"the\")); \",\"\n"
+        "PRINT STR$(INSTR(H$, \"the\", 2)); \",\"; STR$(INSTR(H$, \"cat\"))\n");
+    ASSERT(!lua.empty());
+    std::string output = runLua(lua, "string.find = function() error('string.find fallback') end");
+    ASSERT_EQ(output, std::string("17,1,\n32,0\n"));
+}
+
+// OPTION UNICODE keeps a per-needle search cache; MID$ changing the needle
+// in place must not leave a stale entry behind
+TEST(UnicodeInstrCacheSeesMidAssignment) {
+    std::string lua = compileToLua(
+        "OPTION UNICODE\n"
+        "H$ = \"aaaaaaaaxbcdefghaaaaaaaaabcdefgh\"\n"
+        "N$ = \"abcdefgh\" + \"\"\n"
+        "PRINT STR$(INSTR(H$, N$)); \",\"\n"
+        "MID$(N$, 1, 1) = \"x\"\n"
+        "PRINT STR$(INSTR(H$, N$)); \",\"; STR$(INSTR(H$, N$))\n");
+    ASSERT(!lua.empty());
+    ASSERT_EQ(runLua(lua), std::string("25,\n9,9\n"));
+}
+
+// =============================================================================
+// String concatenation
+// =============================================================================
+
+// + over string function results concatenates, also when an operand reads a
+// string builder inside the loop that appends to it
+TEST(ConcatOfStringFunctionResults) {
+    std::string lua = compileToLua(
+        "S$ = \"HELLO\"\n"
+        "FOR I = 1 TO 3\n"
+        "  PRINT LEFT$(S$, 2) + STR$(I)\n"
+        "  S$ = S$ + \"X\"\n"
+        "NEXT I\n");
+    ASSERT(!lua.empty());
+    ASSERT_EQ(runLua(lua), std::string("HE1\nHE2\nHE3\n"));
+}
+
+// + with a numeric function result stays addition
+TEST(AddOfLenIsNumeric) {
+    std::string lua = compileToLua(
+        "C = 0\n"
+        "FOR I = 1 TO 3\n"
+        "  L$ = LEFT$(\"ABCDEF\", I)\n"
+        "  C = C + LEN(L$)\n"
+        "NEXT I\n"
+        "PRINT STR$(C); \",\"; MID$(L$, 2, 1) + RIGHT$(L$, 1)\n");
+    ASSERT(!lua.empty());
+    ASSERT_EQ(runLua(lua), std::string("6,BC\n"));
+}
+
+// =============================================================================
+// FOR loops
+// =============================================================================
+
+// Variable steps are strip-mined with the direction picked at runtime; every
+// sign and fractional steps or starts must visit the same values as a plain loop
+TEST(VariableStepForMatchesPlainLoop) {
+    std::string lua = compileToLua(
+        "OPTION CANCELLABLE ON\n"
+        "S = 0: C = 0: K = 3\n"
+        "FOR I = 1 TO 20000 STEP K: S = S + I: C = C + 1: NEXT I\n"
+        "PRINT STR$(S); \",\"; STR$(C)\n"
+        "S = 0: C = 0: K = -7\n"
+        "FOR I = 10000 TO -3 STEP K: S = S + I: C = C + 1: NEXT I\n"
+        "PRINT STR$(S); \",\"; STR$(C)\n"
+        "C = 0: K = 0.25\n"
+        "FOR X = 0 TO 2 STEP K: C = C + 1: NEXT X\n"
+        "PRINT STR$(C)\n"
+        "C = 0: K = 0.1\n"
+        "FOR X = 0 TO 1000 STEP K: C = C + 1: NEXT X\n"
+        "PRINT STR$(C)\n"
+        "C = 0: K = 2\n"
+        "FOR I = 1 TO 100000 STEP K: C = C + 1: IF I >= 9001 THEN EXIT FOR\n"
+        "NEXT I\n"
+        "PRINT STR$(C)\n"
+        "C = 0: K = 1\n"
+        "FOR X = 0.1 TO 9000.1 STEP K: C = C + 1: NEXT X\n"
+        "PRINT STR$(C)\n");
+    ASSERT(!lua.empty());
+    ASSERT(lua.find("_cstep") != std::string::npos);
+    ASSERT_EQ(runLua(lua, "basic_cancel_poll = function() end"),
+              std::string("66670000,6667\n7147855,1430\n9\n10000\n4501\n9001\n"));
+}
+
+// A short outer FOR does not cover a long inner one: the inner loop polls
+// for itself, and nested short loops make their enclosing loop poll sooner
+TEST(NestedForLoopsPollForCancellation) {
+    std::string lua = compileToLua(
+        "OPTION CANCELLABLE ON\n"
+        "N = 100000: S = 0\n"
+        "FOR R = 1 TO 2\n"
+        "  FOR I = 1 TO N: S = S + 1: NEXT I\n"
+        "NEXT R\n"
+        "PRINT STR$(S)\n");
+    ASSERT(!lua.empty());
+    ASSERT_EQ(runLua(lua), std::string("200000\n"));
+    // Two runs of the inner loop poll about 50 times
+    std::string stopAfter20 =
+        "local polls = 0\n"
+        "function shouldStopScript() polls = polls + 1 return polls > 20 end\n";
+    ASSERT(runLua(lua, stopAfter20).find("Interrupted by user") != std::string::npos);
+
+    // 100 x 100 iterations, none of them in a loop long enough to poll alone
+    lua = compileToLua(
+        "OPTION CANCELLABLE ON\n"
+        "S = 0\n"
+        "FOR R = 1 TO 100\n"
+        "  FOR I = 1 TO 100: S = S + I: NEXT I\n"
+        "NEXT R\n"
+        "PRINT STR$(S)\n");
+    ASSERT(!lua.empty());
+    ASSERT_EQ(runLua(lua), std::string("505000\n"));
+    std::string stopAfter1 =
+        "local polls = 0\n"
+        "function shouldStopScript() polls = polls + 1 return polls > 1 end\n";
+    ASSERT(runLua(lua, stopAfter1).find("Interrupted by user") != std::string::npos);
+}
+
+// =============================================================================
+// Bitwise Operators
+// =============================================================================
+
+// Operands truncate towards zero and wrap modulo 2^32, in the generated code
+// and in the runtime's bitwise module alike, whatever their magnitude
+TEST(BitwiseOperandsWrapLikeRuntime) {
+    std::string lua = compileToLua(
+        "X = -2147483649: Y = 4294967301: Z = 9007199254740994\n"
+        "W = -1152921504606847232: F = -2.7\n"
+        "PRINT STR$(X OR 0); \",\"; STR$(Y AND 255); \",\"; STR$(Z OR 0); \",\";\n"
+        "PRINT STR$(W OR 0); \",\"; STR$(F OR 0); \",\"; STR$(NOT F)\n");
+    ASSERT(!lua.empty());
+    ASSERT_EQ(runLua(lua), std::string("2147483647,5,2,-256,-2,1\n"));
+
+    ASSERT_EQ(basic_bor(-2147483649.0, 0), 2147483647);
+    ASSERT_EQ(basic_band(4294967301.0, 255), 5);
+    ASSERT_EQ(basic_bor(9007199254740994.0, 0), 2);
+    ASSERT_EQ(basic_bor(-1152921504606847232.0, 0), -256);
+    ASSERT_EQ(basic_bor(-2.7, 0), -2);
+    ASSERT_EQ(basic_bnot(-2.7), 1);
+}
+
+// =============================================================================
+// Inlining
+// =============================================================================
+
+// "Runtime error at BASIC line N" part of a runLua error
+static std::string errorLine(const std::string& result) {
+    size_t at = result.find("BASIC line ");
+    if (at == std::string::npos) return result;
+    return result.substr(at, result.find(':', at) - at);
+}
+
+// An inlined SUB body still reports, counts and profiles as the SUB's lines
+TEST(InlinedSubKeepsItsSourceLines) {
+    std::string basic =
+        "OPTION PROFILE COUNTS\n"
+        "K = 0\n"
+        "PRINT \"start\"\n"
+        "CALL BOOM(K)\n"
+        "PRINT \"done\"\n"
+        "END\n"
+        "SUB BOOM(N)\n"
+        "  PRINT \"in boom\"\n"
+        "  X$ = CHR$(N - 5)\n"
+        "END SUB\n";
+    CompileInfo plainInfo, inlinedInfo;
+    std::string plain = compileToLua(basic, OPT_NONE, &plainInfo);
+    std::string inlined = compileToLua(basic, OPT_PEEP, &inlinedInfo);
+    ASSERT(!plain.empty());
+    ASSERT(inlined.find("func_BOOM") == std::string::npos);
+
+    std::string plainError = runLua(plain);
+    ASSERT(plainError.find("error: Runtime error at BASIC line ") != std::string::npos);
+    ASSERT_EQ(errorLine(runLua(inlined)), errorLine(plainError));
+
+    // Every counted line is credited to the same procedure as without inlining
+    auto functionOf = [](const CompileInfo& info, int basicLine) {
+        for (const auto& counter : info.sourceMap.counters) {
+            if (counter.basicLine == basicLine) return counter.function;
+        }
+        return std::string();
+    };
+    bool countedBoom = false;
+    for (const auto& counter : inlinedInfo.sourceMap.counters) {
+        ASSERT_EQ(counter.function, functionOf(plainInfo, counter.basicLine));
+        countedBoom = countedBoom || counter.function == "BOOM";
+    }
+    ASSERT(countedBoom);
+
+    // Profiler samples map through the same table
+    bool sawBoom = false;
+    for (const auto& function : inlinedInfo.sourceMap.functions) {
+        sawBoom = sawBoom || function.second == "BOOM";
+    }
+    ASSERT(sawBoom);
+}
+
+// The argument variable is assigned inside the body, so the parameter must
+// keep the value it had at the call
+TEST(InlinedParameterNotAliasedToStoredArgument) {
+    std::string basic =
+        "B = 1\n"
+        "CALL P(B)\n"
+        "PRINT B\n"
+        "END\n"
+        "SUB P(A)\n"
+        "  B = 5\n"
+        "  PRINT A\n"
+        "END SUB\n";
+    std::string inlined = compileToLua(basic, OPT_PEEP);
+    ASSERT(!inlined.empty());
+    ASSERT(inlined.find("func_P") == std::string::npos);
+    ASSERT_EQ(runLua(compileToLua(basic)), std::string("1\n5\n"));
+    ASSERT_EQ(runLua(inlined), std::string("1\n5\n"));
+}
+
+// =============================================================================
+// Loop-Invariant Code Motion
+// =============================================================================
+
+// A loop that never runs must not evaluate its body's builtins, hoisted or not
+TEST(HoistedBuiltinsStayBehindZeroTripLoops) {
+    std::string basic =
+        "A$ = \"\": N = -5: S = 0\n"
+        "FOR I = 1 TO 0: S = S + ASC(A$) + LEN(CHR$(N)): NEXT I\n"
+        "WHILE S > 0: S = S - ASC(A$) - LEN(CHR$(N)): WEND\n"
+        "K = 0\n"
+        "DO WHILE K > 0: S = S + ASC(A$) * LEN(CHR$(N)): K = K - 1: LOOP\n"
+        "PRINT S\n";
+    ASSERT_EQ(runLua(compileToLua(basic)), std::string("0\n"));
+    ASSERT_EQ(runLua(compileToLua(basic, OPT_PEEP)), std::string("0\n"));
+}
+
+// MID$ assignment and READ change a string the body reads through LEN and LEFT$
+TEST(StringStoresInLoopKeepLenAndLeftInside) {
+    std::string basic =
+        "A$ = \"abcdef\": P$ = \"\": T = 0\n"
+        "FOR I = 1 TO 3\n"
+        "  P$ = P$ + LEFT$(A$, 2): T = T + LEN(A$)\n"
+        "  MID$(A$, 1, 1) = CHR$(65 + I)\n"
+        "NEXT I\n"
+        "PRINT P$; T\n"
+        "DATA \"xy\", \"xyz\", \"w\"\n"
+        "B$ = \"q\": L = 0: Q$ = \"\"\n"
+        "FOR I = 1 TO 3: L = L + LEN(B$): Q$ = Q$ + LEFT$(B$, 1): READ B$: NEXT I\n"
+        "PRINT Q$; L\n";
+    // READ goes through the host's DATA bindings
+    std::string data =
+        "local values, next = {'xy', 'xyz', 'w'}, 0\n"
+        "function basic_read_data_string() next = next + 1 return values[next] end\n";
+    ASSERT_EQ(runLua(compileToLua(basic), data), std::string("abBbCb18\nqxx6\n"));
+    ASSERT_EQ(runLua(compileToLua(basic, OPT_PEEP), data), std::string("abBbCb18\nqxx6\n"));
+}
+
+// An expression invariant in both loops of a nest ends up ahead of the
+// outer one, one level per optimizer iteration
+TEST(HoistClimbsNestedLoops) {
+    std::string basic =
+        "S = 0: K = 7\n"
+        "FOR I = 1 TO 3\n"
+        "  FOR J = 1 TO 4\n"
+        "    S = S + K * K + I\n"
+        "  NEXT J\n"
+        "NEXT I\n"
+        "PRINT S\n";
+    std::string lua = compileToLua(basic, OPT_PEEP);
+    ASSERT_EQ(runLua(lua), runLua(compileToLua(basic)));
+
+    size_t product = lua.find("var_K * var_K");
+    size_t outer = lua.find("for var_I");
+    ASSERT(product != std::string::npos && outer != std::string::npos);
+    ASSERT(product < outer);
+    ASSERT(lua.find("var_K * var_K", product + 1) == std::string::npos);
+}
+
+// --opt-stats lists every loop that lost an expression
+TEST(HoistReportListsEachLoop) {
+    CompileInfo info;
+    compileToLua(
+        "S = 0: K = 7: A$ = \"abc\"\n"
+        "FOR I = 1 TO 3\n"
+        "  FOR J = 1 TO 4\n"
+        "    S = S + K * K + I\n"
+        "  NEXT J\n"
+        "NEXT I\n"
+        "N = 0\n"
+        "WHILE N < 10: N = N + LEN(A$) * 2: WEND\n"
+        "PRINT S; N\n", OPT_PEEP, &info);
+    const std::string& report = info.optimizerReport;
+    size_t table = report.find("Loop-Invariant Code Motion:");
+    ASSERT(table != std::string::npos);
+    ASSERT(report.find("FOR I", table) != std::string::npos);
+    ASSERT(report.find("FOR J", table) != std::string::npos);
+    ASSERT(report.find("WHILE", table) != std::string::npos);
+}
+
+// =============================================================================
+// CSE and Strength Reduction
+// =============================================================================
+
+// Output of a program under every optimizer setting; all must agree with
+// the unoptimized build
+static bool sameUnderOptimizers(const std::string& basic, const std::string& expected,
+                                const std::string& setup = "") {
+    bool same = true;
+    for (int optimize : {OPT_NONE, OPT_AST, OPT_PEEP, OPT_ALL}) {
+        std::string output = runLua(compileToLua(basic, optimize), setup);
+        if (output != expected) {
+            std::cerr << "  optimize=" << optimize << " printed: " << output << std::endl;
+            same = false;
+        }
+    }
+    return same;
+}
+
+// The hoisted N * 3 lives in a global slot; the recursive call in between
+// reassigns it
+TEST(CseAcrossRecursiveCall) {
+    ASSERT(sameUnderOptimizers(
+        "FUNCTION F(N)\n"
+        "  IF N <= 0 THEN RETURN 0\n"
+        "  RETURN N * 3 + F(N - 1) + N * 3\n"
+        "END FUNCTION\n"
+        "PRINT F(4)\n",
+        "60\n"));
+}
+
+// I * 4 + 1 as an induction variable around a self-call that runs the same
+// loop (and so the same induction slot) one level down
+TEST(InductionTempAroundRecursiveSub) {
+    std::string basic =
+        "DIM A(20)\n"
+        "SUB R(D)\n"
+        "  IF D > 0 THEN\n"
+        "    FOR I = 1 TO 2\n"
+        "      A(I * 4 + 1) = A(I * 4 + 1) + D\n"
+        "      CALL R(D - 1)\n"
+        "      PRINT I * 4 + 1;\n"
+        "    NEXT I\n"
+        "  END IF\n"
+        "END SUB\n"
+        "CALL R(2)\n"
+        "PRINT\n"
+        "PRINT A(5); A(9)\n";
+    std::string expected = runLua(compileToLua(basic));
+    ASSERT(expected.find("error") == std::string::npos);
+    ASSERT(sameUnderOptimizers(basic, expected));
+}
+
+// The loop variable is assigned inside the body; the induction temp must
+// follow whatever value the unoptimized loop sees
+TEST(InductionWithLoopVariableAssigned) {
+    std::string basic =
+        "FOR I = 1 TO 10\n"
+        "  PRINT I * 4 + 1;\n"
+        "  IF I = 3 THEN I = 6\n"
+        "  PRINT I * 4 + 1;\n"
+        "NEXT I\n"
+        "PRINT\n";
+    std::string expected = runLua(compileToLua(basic));
+    ASSERT(expected.find("1325") != std::string::npos);
+    ASSERT(sameUnderOptimizers(basic, expected));
+}
+
+// A GOSUB in the loop body changes the loop variable and a CSE operand
+TEST(InductionAndCseAroundGosub) {
+    std::string basic =
+        "10 C = 2\n"
+        "20 FOR I = 1 TO 5\n"
+        "30 PRINT I * 4 + 1; I * C + 1;\n"
+        "40 GOSUB 100\n"
+        "50 PRINT I * 4 + 1; I * C + 1;\n"
+        "60 NEXT I\n"
+        "70 PRINT\n"
+        "80 END\n"
+        "100 I = I + 1: C = C + 1\n"
+        "110 RETURN\n";
+    std::string expected = runLua(compileToLua(basic));
+    ASSERT(expected.find("error") == std::string::npos);
+    ASSERT(sameUnderOptimizers(basic, expected));
+}
+
+// =============================================================================
+// Type Inference
+// =============================================================================
+
+// Main only assigns integers, but a GOSUB target stores a fraction: INT and
+// AND must still truncate
+TEST(FractionFromGosubKeepsIntAndBitwise) {
+    ASSERT(sameUnderOptimizers(
+        "10 X = 1\n"
+        "20 PRINT INT(X); X AND 3\n"
+        "30 GOSUB 100\n"
+        "40 PRINT INT(X); X AND 3\n"
+        "50 END\n"
+        "100 X = 2.5\n"
+        "110 RETURN\n",
+        "11\n22\n"));
+}
+
+// Same through a SUB assigning the global
+TEST(FractionFromSubKeepsIntAndBitwise) {
+    ASSERT(sameUnderOptimizers(
+        "X = 4\n"
+        "CALL HALVE()\n"
+        "PRINT INT(X); X AND 7; INT(X / 2)\n"
+        "SUB HALVE()\n"
+        "  X = X / 2 + 0.75\n"
+        "END SUB\n",
+        "221\n"));
+}
+
+// =============================================================================
+// Conditions
+// =============================================================================
+
+// AND / OR are bitwise in BASIC: both operands run even when the left one
+// already decides a condition
+TEST(ConditionOperandsAreNotShortCircuited) {
+    ASSERT(sameUnderOptimizers(
+        "FUNCTION T(N)\n"
+        "  PRINT \"t\"; N;\n"
+        "  RETURN N\n"
+        "END FUNCTION\n"
+        "IF T(0) AND T(1) THEN PRINT \"yes\" ELSE PRINT \"no\"\n"
+        "IF T(1) OR T(2) THEN PRINT \"yes\"\n"
+        "IF T(0) > 0 AND T(3) > 0 THEN PRINT \"yes\" ELSE PRINT \"no\"\n"
+        "K = 0\n"
+        "WHILE K < 1 OR T(4) = 0\n"
+        "  K = K + 1\n"
+        "WEND\n"
+        "PRINT\n"
+        "B = T(5) < 0 AND T(6) > 0\n"
+        "PRINT B\n",
+        "t0t1no\nt1t2yes\nt0t3no\nt4t4\nt5t60\n"));
+}
+
+// =============================================================================
+// SELECT CASE
+// =============================================================================
+
+// A duplicate key goes to the first arm that lists it, and 2.0 and 2 are
+// the same key
+TEST(SelectCaseDuplicateAndFloatKeys) {
+    ASSERT(sameUnderOptimizers(
+        "FOR X = 0 TO 4\n"
+        "  SELECT CASE X\n"
+        "    CASE 1, 3\n"
+        "      PRINT \"a\";\n"
+        "    CASE 3\n"
+        "      PRINT \"b\";\n"
+        "    CASE 2.0\n"
+        "      PRINT \"c\";\n"
+        "    CASE 2\n"
+        "      PRINT \"d\";\n"
+        "    ELSE\n"
+        "      PRINT \"e\";\n"
+        "  END SELECT\n"
+        "NEXT X\n"
+        "PRINT\n"
+        "Y = 2.5\n"
+        "SELECT CASE Y\n"
+        "  CASE 2\n"
+        "    PRINT \"two\"\n"
+        "  ELSE\n"
+        "    PRINT \"other\"\n"
+        "END SELECT\n",
+        "eacae\nother\n"));
+}
+
+// A variable key is compared in order with the constant ones, with its value
+// at the time of the SELECT
+TEST(SelectCaseVariableKey) {
+    ASSERT(sameUnderOptimizers(
+        "K = 3\n"
+        "FOR X = 1 TO 4\n"
+        "  SELECT CASE X\n"
+        "    CASE 1\n"
+        "      PRINT \"a\";\n"
+        "    CASE K\n"
+        "      PRINT \"k\";\n"
+        "    CASE 3, 4\n"
+        "      PRINT \"b\";\n"
+        "    ELSE\n"
+        "      PRINT \"e\";\n"
+        "  END SELECT\n"
+        "  K = 4\n"
+        "NEXT X\n"
+        "PRINT\n",
+        "aebk\n"));
+}
+
+// =============================================================================
+// PRINT USING
+// =============================================================================
+
+// A format the code generator compiles (a literal) prints exactly what the
+// runtime formatter makes of the same format held in a variable
+TEST(PrintUsingConstantMatchesVariableFormat) {
+    const char* formats[] = {
+        "###.##",
+        "## items, 100%",
+        "#,### | #,###",
+        "! \\  \\ &",
+        "[###] [###]",
+        "no fields",
+    };
+    const char* values = "2.5, -1234.567, \"hello\", 98765";
+
+    std::string basic;
+    for (const char* format : formats) {
+        basic += std::string("F$ = \"") + format + "\"\n";
+        basic += std::string("PRINT USING \"") + format + "\"; " + values + "\n";
+        basic += std::string("PRINT USING F$; ") + values + "\n";
+        // Fewer values than fields
+        basic += std::string("PRINT USING \"") + format + "\"; 7\n";
+        basic += "PRINT USING F$; 7\n";
+    }
+    std::string lua = compileToLua(basic);
+    ASSERT(!lua.empty());
+    ASSERT(lua.find("basic_print(string.format(") != std::string::npos);
+    std::string output = runLua(lua);
+    ASSERT(output.find("error") == std::string::npos);
+
+    // Lines come in constant / variable pairs
+    std::vector<std::string> lines;
+    size_t start = 0;
+    for (size_t end; (end = output.find('\n', start)) != std::string::npos; start = end + 1) {
+        lines.push_back(output.substr(start, end - start));
+    }
+    ASSERT_EQ(lines.size(), 4 * (sizeof(formats) / sizeof(formats[0])));
+    for (size_t i = 0; i < lines.size(); i += 2) {
+        ASSERT_EQ(lines[i], lines[i + 1]);
+    }
+}
+
+// =============================================================================
+// Line Counts
+// =============================================================================
+
+// Lines in a multi-line IF arm or a SUB body get counters of their own: an
+// arm that never ran reads 0 rather than the count of the IF that holds it
+TEST(BlockBodyLinesCountSeparately) {
+    CompileInfo info;
+    std::string lua = compileToLua(
+        "OPTION PROFILE COUNTS\n"
+        "X = 1\n"
+        "IF X = 2 THEN\n"
+        "  PRINT \"two\"\n"
+        "ELSE\n"
+        "  PRINT \"other\"\n"
+        "END IF\n"
+        "CALL S(X)\n"
+        "END\n"
+        "SUB S(N)\n"
+        "  IF N > 5 THEN\n"
+        "    PRINT \"big\"\n"
+        "  END IF\n"
+        "  PRINT \"small\"\n"
+        "END SUB\n", OPT_NONE, &info);
+    ASSERT(!lua.empty());
+
+    // After the run, print " function:hits;" for every counted line
+    std::string counters = "{";
+    for (const auto& counter : info.sourceMap.counters) {
+        counters += "{" + std::to_string(counter.slot) + ", '" + counter.function + "'},";
+    }
+    counters += "}";
+    std::string output = runLua(lua +
+        "\nfor _, c in ipairs(" + counters + ") do\n"
+        "    basic_print(' ' .. c[2] .. ':' .. tostring(tonumber(" + LuaSourceMap::COUNTERS_GLOBAL + "[c[1]])) .. ';')\n"
+        "end\n");
+    ASSERT_EQ(output.substr(0, 12), std::string("other\nsmall\n"));
+
+    // One line that never ran in each of main and S
+    auto unexecuted = [&output](const std::string& function) {
+        size_t count = 0;
+        std::string needle = " " + function + ":0;";
+        for (size_t at = output.find(needle); at != std::string::npos; at = output.find(needle, at + 1)) {
+            count++;
+        }
+        return count;
+    };
+    ASSERT_EQ(unexecuted("main"), 1u);
+    ASSERT_EQ(unexecuted("S"), 1u);
+}
+
+// Errors and line counts name the line a statement is written on: its source
+// line, or the user's number in numbered source, also inside IF arms and SUBs
+TEST(LinesReportAsWritten) {
+    std::vector<std::string> lines = {
+        "OPTION PROFILE COUNTS",
+        "X = 1",
+        "IF X = 2 THEN",
+        "  PRINT \"two\"",
+        "END IF",
+        "CALL S(X)",
+        "END",
+        "SUB S(N)",
+        "  PRINT \"in S\"",
+        "  Y$ = CHR$(N - 5)",
+        "END SUB",
+    };
+    for (int step : {0, 10}) {
+        // step 0 leaves the source unnumbered; else line i is numbered i * step
+        std::string basic;
+        for (size_t i = 0; i < lines.size(); i++) {
+            if (step > 0) basic += std::to_string((i + 1) * step) + " ";
+            basic += lines[i] + "\n";
+        }
+        auto lineOf = [step](int sourceLine) { return step > 0 ? sourceLine * step : sourceLine; };
+
+        CompileInfo info;
+        std::string lua = compileToLua(basic, OPT_NONE, &info);
+        ASSERT(!lua.empty());
+        ASSERT_EQ(errorLine(runLua(lua)), "BASIC line " + std::to_string(lineOf(10)));
+
+        std::set<int> counted;
+        for (const auto& counter : info.sourceMap.counters) {
+            counted.insert(counter.basicLine);
+        }
+        ASSERT(counted.count(lineOf(4)) == 1);
+        ASSERT(counted.count(lineOf(9)) == 1);
+        for (int basicLine : counted) {
+            ASSERT(basicLine % (step > 0 ? step : 1) == 0);
+            ASSERT(basicLine >= lineOf(2) && basicLine <= lineOf(11));
+        }
+    }
+}
+
+// fbc compiles through compileProgram(), whose source map feeds --count,
+// --profile-run and --jit-diag
+TEST(CompileProgramKeepsSourceMap) {
+    CompileSettings settings;
+    settings.threads = 1;
+    CompiledProgram program;
+    ASSERT(compileProgram(
+        "OPTION PROFILE COUNTS\n"
+        "X = 1\n"
+        "IF X = 2 THEN\n"
+        "  PRINT \"two\"\n"
+        "END IF\n", "test.bas", settings, program));
+    ASSERT(!program.luaCode.empty());
+    ASSERT(!program.sourceMap.counters.empty());
+    ASSERT(!program.sourceMap.lines.empty());
+    ASSERT(program.sourceMap.basicLineAt(program.sourceMap.lines.front().first) > 0);
+}
+
+// =============================================================================
+// Main Test Runner
+// =============================================================================
+
+int main() {
+    // Same command set as fbc
+    CommandRegistry& registry = getGlobalCommandRegistry();
+    CoreCommandRegistry::registerCoreCommands(registry);
+    CoreCommandRegistry::registerCoreFunctions(registry);
+    markGlobalRegistryInitialized();
+
+    std::cout << "========================================" << std::endl;
+    std::cout << "LuaCodeGenerator Tests" << std::endl;
+    std::cout << "========================================" << std::endl;
+    std::cout << std::endl;
+
+    for (const auto& test : testList()) {
+        std::cout << "Running test: " << test.first << "... ";
+        int failedBefore = g_testsFailed;
+        test.second();
+        if (g_testsFailed == failedBefore) {
+            std::cout << "PASSED" << std::endl;
+            g_testsPassed++;
+        }
+    }
+
+    std::cout << std::endl;
+    std::cout << "========================================" << std::endl;
+    std::cout << "Test Results" << std::endl;
+    std::cout << "========================================" << std::endl;
+    std::cout << "Passed: " << g_testsPassed << std::endl;
+    std::cout << "Failed: " << g_testsFailed << std::endl;
+    std::cout << "Total:  " << (g_testsPassed + g_testsFailed) << std::endl;
+
+    if (g_testsFailed == 0) {
+        std::cout << std::endl;
+        std::cout << "✓ All tests passed!" << std::endl;
+        return 0;
+    } else {
+        std::cout << std::endl;
+        std::cout << "✗ Some tests failed!" << std::endl;
+        return 1;
+    }
+}
@@ -32,12 +32,173 @@ std::string DocumentLocation::toString() const {
     return oss.str();
 }
 
+// =============================================================================
+// Line Tree Helpers
+// =============================================================================
+
+SourceLineNode::SourceLineNode(SourceLine&& src, uint32_t prio)
+    : line(std::move(src)), priority(prio), count(1)
+    , minNumber(line.lineNumber > 0 ? line.lineNumber : INT_MAX)
+    , maxNumber(line.lineNumber > 0 ? line.lineNumber : 0)
+{
+}
+
+namespace {
+
+using LineNode = SourceLineNode;
+using LineNodePtr = std::shared_ptr<LineNode>;
+
+size_t subtreeCount(const LineNodePtr& node) {
+    return node ? node->count : 0;
+}
+
+// Recompute a node's cached values from its line and children
+void refreshNode(LineNode* node) {
+    node->count = 1 + subtreeCount(node->left) + subtreeCount(node->right);
+    int number = node->line.lineNumber;
+    node->minNumber = number > 0 ? number : INT_MAX;
+    node->maxNumber = number > 0 ? number : 0;
+    for (const LineNode* child : {node->left.get(), node->right.get()}) {
+        if (child) {
+            node->minNumber = std::min(node->minNumber, child->minNumber);
+            node->maxNumber = std::max(node->maxNumber, child->maxNumber);
+        }
+    }
+}
+
+// Nodes may be shared with undo states, so a node is copied before it is
+// changed unless this tree is its only owner. Callers work from the root
+// down, so once a node is owned, its uniquely held children are too.
+LineNodePtr ownNode(LineNodePtr node) {
+    if (node.use_count() > 1) {
+        return std::make_shared<LineNode>(*node);
+    }
+    return node;
+}
+
+// Split into the first `index` lines and the rest
+void splitTree(LineNodePtr node, size_t index, LineNodePtr& left, LineNodePtr& right) {
+    if (!node) {
+        left.reset();
+        right.reset();
+        return;
+    }
+    node = ownNode(std::move(node));
+    size_t leftCount = subtreeCount(node->left);
+    if (index <= leftCount) {
+        splitTree(std::move(node->left), index, left, node->left);
+        refreshNode(node.get());
+        right = std::move(node);
+    } else {
+        splitTree(std::move(node->right), index - leftCount - 1, node->right, right);
+        refreshNode(node.get());
+        left = std::move(node);
+    }
+}
+
+// Concatenate two trees (all of `left` precedes all of `right`)
+LineNodePtr mergeTrees(LineNodePtr left, LineNodePtr right) {
+    if (!left) return right;
+    if (!right) return left;
+    if (left->priority >= right->priority) {
+        left = ownNode(std::move(left));
+        left->right = mergeTrees(std::move(left->right), std::move(right));
+        refreshNode(left.get());
+        return left;
+    }
+    right = ownNode(std::move(right));
+    right->left = mergeTrees(std::move(left), std::move(right->left));
+    refreshNode(right.get());
+    return right;
+}
+
+// In-order walk from `start`. The stack holds the nodes still to visit,
+// so reaching `start` is O(log n).
+template <typename Visit>
+void visitInOrder(const LineNode* root, size_t start, Visit&& visit) {
+    std::vector<const LineNode*> pending;
+    const LineNode* node = root;
+    size_t skip = start;
+    while (node) {
+        size_t leftCount = subtreeCount(node->left);
+        if (skip < leftCount) {
+            pending.push_back(node);
+            node = node->left.get();
+        } else if (skip == leftCount) {
+            pending.push_back(node);
+            break;
+        } else {
+            skip -= leftCount + 1;
+            node = node->right.get();
+        }
+    }
+    size_t index = start;
+    while (!pending.empty()) {
+        const LineNode* current = pending.back();
+        pending.pop_back();
+        if (!visit(current->line, index++)) {
+            return;
+        }
+        for (const LineNode* next = current->right.get(); next; next = next->left.get()) {
+            pending.push_back(next);
+        }
+    }
+}
+
+// Index of the last line numbered lineNumber in the subtree whose first line
+// is at `offset`. Subtrees whose number range excludes it are skipped, so in
+// an ordered program this is a single root-to-leaf walk.
+size_t findLastNumbered(const LineNode* node, size_t offset, int lineNumber) {
+    if (!node || lineNumber < node->minNumber || lineNumber > node->maxNumber) {
+        return static_cast<size_t>(-1);
+    }
+    size_t nodeIndex = offset + subtreeCount(node->left);
+    size_t found = findLastNumbered(node->right.get(), nodeIndex + 1, lineNumber);
+    if (found != static_cast<size_t>(-1)) {
+        return found;
+    }
+    if (node->line.lineNumber == lineNumber) {
+        return nodeIndex;
+    }
+    return findLastNumbered(node->left.get(), offset, lineNumber);
+}
+
+// In-order rewrite of the lines `changes` selects. Only the paths to those
+// lines are copied; subtrees without one are returned as they are and stay
+// shared with the undo history.
+template <typename Changes, typename Update>
+LineNodePtr updateTree(const LineNodePtr& node, Changes& changes, Update& update) {
+    if (!node) {
+        return node;
+    }
+    LineNodePtr left = updateTree(node->left, changes, update);
+    LineNodePtr copy;
+    if (changes(node->line)) {
+        copy = std::make_shared<LineNode>(*node);
+        update(copy->line);
+    }
+    LineNodePtr right = updateTree(node->right, changes, update);
+    if (!copy) {
+        if (left == node->left && right == node->right) {
+            return node;
+        }
+        copy = std::make_shared<LineNode>(*node);
+    }
+    copy->left = std::move(left);
+    copy->right = std::move(right);
+    refreshNode(copy.get());
+    return copy;
+}
+
+} // namespace
+
 // =============================================================================
 // SourceDocument - Construction
 // =============================================================================
 
 SourceDocument::SourceDocument()
-    : m_encoding("UTF-8")
+    : m_priorityState(0x9E3779B9u)
+    , m_encoding("UTF-8")
     , m_version(0)
     , m_dirty(false)
     , m_autoNumbering(false)
@@ -59,8 +220,8 @@ SourceDocument::SourceDocument(const std::string& filename)
 SourceDocument::~SourceDocument() = default;
 
 SourceDocument::SourceDocument(const SourceDocument& other)
-    : m_lines(other.m_lines)
-    , m_lineNumberIndex(other.m_lineNumberIndex)
+    : m_root(other.m_root)  // Shared until either document changes
+    , m_priorityState(other.m_priorityState)
     , m_filename(other.m_filename)
     , m_encoding(other.m_encoding)
     , m_version(other.m_version)
@@ -76,8 +237,8 @@ SourceDocument::SourceDocument(const SourceDocument& other)
 }
 
 SourceDocument::SourceDocument(SourceDocument&& other) noexcept
-    : m_lines(std::move(other.m_lines))
-    , m_lineNumberIndex(std::move(other.m_lineNumberIndex))
+    : m_root(std::move(other.m_root))
+    , m_priorityState(other.m_priorityState)
     , m_filename(std::move(other.m_filename))
     , m_encoding(std::move(other.m_encoding))
     , m_version(other.m_version)
@@ -94,8 +255,8 @@ SourceDocument::SourceDocument(SourceDocument&& other) noexcept
 
 SourceDocument& SourceDocument::operator=(const SourceDocument& other) {
     if (this != &other) {
-        m_lines = other.m_lines;
-        m_lineNumberIndex = other.m_lineNumberIndex;
+        m_root = other.m_root;
+        m_priorityState = other.m_priorityState;
         m_filename = other.m_filename;
         m_encoding = other.m_encoding;
         m_version = other.m_version;
@@ -113,8 +274,8 @@ SourceDocument& SourceDocument::operator=(const SourceDocument& other) {
 
 SourceDocument& SourceDocument::operator=(SourceDocument&& other) noexcept {
     if (this != &other) {
-        m_lines = std::move(other.m_lines);
-        m_lineNumberIndex = std::move(other.m_lineNumberIndex);
+        m_root = std::move(other.m_root);
+        m_priorityState = other.m_priorityState;
         m_filename = std::move(other.m_filename);
         m_encoding = std::move(other.m_encoding);
         m_version = other.m_version;
@@ -134,70 +295,53 @@ SourceDocument& SourceDocument::operator=(SourceDocument&& other) noexcept {
 // Line Access - By Index
 // =============================================================================
 
-SourceLine& SourceDocument::getLineByIndex(size_t index) {
+const SourceLine& SourceDocument::getLineByIndex(size_t index) const {
     static SourceLine dummy;
-    if (index >= m_lines.size()) {
+    const LineNode* node = nodeAt(index);
+    if (!node) {
         return dummy;
     }
-    return m_lines[index];
+    return node->line;
 }
 
-const SourceLine& SourceDocument::getLineByIndex(size_t index) const {
-    static SourceLine dummy;
-    if (index >= m_lines.size()) {
-        return dummy;
+bool SourceDocument::isEmpty() const {
+    if (!m_root) {
+        return true;
     }
-    return m_lines[index];
+    return m_root->count == 1 && m_root->line.text.empty() && m_root->line.lineNumber == 0;
 }
 
 // =============================================================================
 // Line Access - By Line Number
 // =============================================================================
 
-SourceLine* SourceDocument::getLineByNumber(int lineNumber) {
-    auto it = m_lineNumberIndex.find(lineNumber);
-    if (it == m_lineNumberIndex.end()) {
-        return nullptr;
-    }
-    size_t index = it->second;
-    if (index >= m_lines.size()) {
-        return nullptr;
-    }
-    return &m_lines[index];
-}
-
 const SourceLine* SourceDocument::getLineByNumber(int lineNumber) const {
-    auto it = m_lineNumberIndex.find(lineNumber);
-    if (it == m_lineNumberIndex.end()) {
+    const LineNode* node = nodeAt(findLineNumber(lineNumber));
+    if (!node) {
         return nullptr;
     }
-    size_t index = it->second;
-    if (index >= m_lines.size()) {
-        return nullptr;
-    }
-    return &m_lines[index];
+    return &node->line;
 }
 
 bool SourceDocument::hasLineNumber(int lineNumber) const {
-    return m_lineNumberIndex.find(lineNumber) != m_lineNumberIndex.end();
+    return findLineNumber(lineNumber) != static_cast<size_t>(-1);
 }
 
 std::vector<int> SourceDocument::getLineNumbers() const {
     std::vector<int> numbers;
-    numbers.reserve(m_lineNumberIndex.size());
-    for (const auto& pair : m_lineNumberIndex) {
-        numbers.push_back(pair.first);
-    }
+    visitLines(0, [&numbers](const SourceLine& line, size_t) {
+        if (line.lineNumber > 0) {
+            numbers.push_back(line.lineNumber);
+        }
+        return true;
+    });
     std::sort(numbers.begin(), numbers.end());
+    numbers.erase(std::unique(numbers.begin(), numbers.end()), numbers.end());
     return numbers;
 }
 
 size_t SourceDocument::getIndexForLineNumber(int lineNumber) const {
-    auto it = m_lineNumberIndex.find(lineNumber);
-    if (it == m_lineNumberIndex.end()) {
-        return static_cast<size_t>(-1);
-    }
-    return it->second;
+    return findLineNumber(lineNumber);
 }
 
 // =============================================================================
@@ -210,42 +354,30 @@ void SourceDocument::setLineByNumber(int lineNumber, const std::string& text) {
     }
     
     // Check if line number already exists
-    auto it = m_lineNumberIndex.find(lineNumber);
-    if (it != m_lineNumberIndex.end()) {
+    LineNode* node = mutableNodeAt(findLineNumber(lineNumber));
+    if (node) {
         // Replace existing line
-        size_t index = it->second;
-        if (index < m_lines.size()) {
-            m_lines[index].text = text;
-            m_lines[index].isDirty = true;
-            m_lines[index].version = m_version;
-        }
+        node->line.text = text;
+        node->line.isDirty = true;
+        node->line.version = m_version;
     } else {
         // Insert new line at correct position
         size_t insertPos = findInsertionPoint(lineNumber);
         SourceLine newLine(lineNumber, text);
         newLine.version = m_version;
-        m_lines.insert(m_lines.begin() + insertPos, newLine);
-        
-        // Rebuild index (indices shifted)
-        rebuildLineNumberIndex();
+        insertNode(insertPos, std::move(newLine));
     }
     
     markDirty();
 }
 
 bool SourceDocument::deleteLineByNumber(int lineNumber) {
-    auto it = m_lineNumberIndex.find(lineNumber);
-    if (it == m_lineNumberIndex.end()) {
+    size_t index = findLineNumber(lineNumber);
+    if (index >= getLineCount()) {
         return false;
     }
     
-    size_t index = it->second;
-    if (index >= m_lines.size()) {
-        return false;
-    }
-    
-    m_lines.erase(m_lines.begin() + index);
-    rebuildLineNumberIndex();
+    eraseLines(index, 1);
     
     ensureNonEmpty();
     markDirty();
@@ -260,30 +392,17 @@ void SourceDocument::insertLineAtIndex(size_t index, const std::string& text, in
     SourceLine newLine(lineNumber, text);
     newLine.version = m_version;
     
-    if (index >= m_lines.size()) {
-        m_lines.push_back(newLine);
-    } else {
-        m_lines.insert(m_lines.begin() + index, newLine);
-    }
-    
-    if (lineNumber > 0) {
-        rebuildLineNumberIndex();
-    }
+    insertNode(std::min(index, getLineCount()), std::move(newLine));
     
     markDirty();
 }
 
 bool SourceDocument::deleteLineAtIndex(size_t index) {
-    if (index >= m_lines.size()) {
+    if (index >= getLineCount()) {
         return false;
     }
     
-    int lineNumber = m_lines[index].lineNumber;
-    m_lines.erase(m_lines.begin() + index);
-    
-    if (lineNumber > 0) {
-        rebuildLineNumberIndex();
-    }
+    eraseLines(index, 1);
     
     ensureNonEmpty();
     markDirty();
@@ -291,35 +410,39 @@ bool SourceDocument::deleteLineAtIndex(size_t index) {
 }
 
 bool SourceDocument::replaceLineAtIndex(size_t index, const std::string& text) {
-    if (index >= m_lines.size()) {
+    return setLineText(index, text);
+}
+
+bool SourceDocument::setLineText(size_t index, const std::string& text) {
+    LineNode* node = mutableNodeAt(index);
+    if (!node) {
         return false;
     }
     
-    m_lines[index].text = text;
-    m_lines[index].isDirty = true;
-    m_lines[index].version = m_version;
+    node->line.text = text;
+    node->line.isDirty = true;
+    node->line.version = m_version;
     
     markDirty();
     return true;
 }
 
 bool SourceDocument::splitLine(size_t index, size_t column) {
-    if (index >= m_lines.size()) {
+    LineNode* node = mutableNodeAt(index);
+    if (!node) {
         return false;
     }
     
-    std::string& line = m_lines[index].text;
+    std::string& line = node->line.text;
     if (column > line.length()) {
         column = line.length();
     }
     
     // Split the line
-    std::string firstPart = line.substr(0, column);
     std::string secondPart = line.substr(column);
-    
-    m_lines[index].text = firstPart;
-    m_lines[index].isDirty = true;
-    m_lines[index].version = m_version;
+    line.erase(column);
+    node->line.isDirty = true;
+    node->line.version = m_version;
     
     // Insert new line (unnumbered)
     insertLineAtIndex(index + 1, secondPart, 0);
@@ -328,13 +451,14 @@ bool SourceDocument::splitLine(size_t index, size_t column) {
 }
 
 bool SourceDocument::joinWithNext(size_t index) {
-    if (index >= m_lines.size() - 1) {
+    if (index + 1 >= getLineCount()) {
         return false;
     }
     
-    m_lines[index].text += m_lines[index + 1].text;
-    m_lines[index].isDirty = true;
-    m_lines[index].version = m_version;
+    LineNode* node = mutableNodeAt(index);
+    node->line.text += nodeAt(index + 1)->line.text;
+    node->line.isDirty = true;
+    node->line.version = m_version;
     
     deleteLineAtIndex(index + 1);
     
@@ -346,11 +470,12 @@ bool SourceDocument::joinWithNext(size_t index) {
 // =============================================================================
 
 bool SourceDocument::insertChar(size_t lineIndex, size_t column, char32_t ch) {
-    if (lineIndex >= m_lines.size()) {
+    LineNode* node = mutableNodeAt(lineIndex);
+    if (!node) {
         return false;
     }
     
-    std::string& line = m_lines[lineIndex].text;
+    std::string& line = node->line.text;
     
     // Convert UTF-32 to UTF-8
     std::string utf8Char = utf32ToUtf8(ch);
@@ -360,34 +485,36 @@ bool SourceDocument::insertChar(size_t lineIndex, size_t column, char32_t ch) {
     }
     
     line.insert(column, utf8Char);
-    m_lines[lineIndex].isDirty = true;
-    m_lines[lineIndex].version = m_version;
+    node->line.isDirty = true;
+    node->line.version = m_version;
     
     markDirty();
     return true;
 }
 
 bool SourceDocument::deleteChar(size_t lineIndex, size_t column) {
-    if (lineIndex >= m_lines.size()) {
+    LineNode* node = mutableNodeAt(lineIndex);
+    if (!node) {
         return false;
     }
     
-    std::string& line = m_lines[lineIndex].text;
+    std::string& line = node->line.text;
     if (column >= line.length()) {
         return false;
     }
     
     // Simple byte deletion (could be enhanced for multi-byte UTF-8)
     line.erase(column, 1);
-    m_lines[lineIndex].isDirty = true;
-    m_lines[lineIndex].version = m_version;
+    node->line.isDirty = true;
+    node->line.version = m_version;
     
     markDirty();
     return true;
 }
 
 bool SourceDocument::insertText(size_t lineIndex, size_t column, const std::string& text) {
-    if (lineIndex >= m_lines.size()) {
+    LineNode* node = mutableNodeAt(lineIndex);
+    if (!node) {
         return false;
     }
     
@@ -399,19 +526,19 @@ bool SourceDocument::insertText(size_t lineIndex, size_t column, const std::stri
             return true;
         }
         
-        std::string& currentLine = m_lines[lineIndex].text;
+        std::string& currentLine = node->line.text;
         if (column > currentLine.length()) {
             column = currentLine.length();
         }
         
         // Insert first part
         currentLine.insert(column, lines[0]);
-        m_lines[lineIndex].isDirty = true;
+        node->line.isDirty = true;
         
         // If multiple lines, split and insert rest
         if (lines.size() > 1) {
             std::string remainder = currentLine.substr(column + lines[0].length());
-            currentLine = currentLine.substr(0, column + lines[0].length());
+            currentLine.erase(column + lines[0].length());
             
             for (size_t i = 1; i < lines.size(); ++i) {
                 std::string newLineText = lines[i];
@@ -423,13 +550,13 @@ bool SourceDocument::insertText(size_t lineIndex, size_t column, const std::stri
         }
     } else {
         // Single line insertion
-        std::string& line = m_lines[lineIndex].text;
+        std::string& line = node->line.text;
         if (column > line.length()) {
             column = line.length();
         }
         line.insert(column, text);
-        m_lines[lineIndex].isDirty = true;
-        m_lines[lineIndex].version = m_version;
+        node->line.isDirty = true;
+        node->line.version = m_version;
     }
     
     markDirty();
@@ -437,11 +564,12 @@ bool SourceDocument::insertText(size_t lineIndex, size_t column, const std::stri
 }
 
 char32_t SourceDocument::getChar(size_t lineIndex, size_t column) const {
-    if (lineIndex >= m_lines.size()) {
+    const LineNode* node = nodeAt(lineIndex);
+    if (!node) {
         return 0;
     }
     
-    const std::string& line = m_lines[lineIndex].text;
+    const std::string& line = node->line.text;
     if (column >= line.length()) {
         return 0;
     }
@@ -456,84 +584,82 @@ char32_t SourceDocument::getChar(size_t lineIndex, size_t column) const {
 
 std::string SourceDocument::getTextRange(size_t startLine, size_t startCol,
                                         size_t endLine, size_t endCol) const {
-    if (startLine >= m_lines.size()) {
+    size_t lineCount = getLineCount();
+    if (startLine >= lineCount) {
         return "";
     }
     
-    if (endLine >= m_lines.size()) {
-        endLine = m_lines.size() - 1;
+    if (endLine >= lineCount) {
+        endLine = lineCount - 1;
     }
     
     if (startLine == endLine) {
         // Single line
-        const std::string& line = m_lines[startLine].text;
+        const std::string& line = nodeAt(startLine)->line.text;
         if (startCol > line.length()) startCol = line.length();
         if (endCol > line.length()) endCol = line.length();
         if (startCol >= endCol) return "";
         return line.substr(startCol, endCol - startCol);
     }
     
-    std::ostringstream result;
-    
-    // First line
-    const std::string& firstLine = m_lines[startLine].text;
-    if (startCol < firstLine.length()) {
-        result << firstLine.substr(startCol) << "\n";
-    } else {
-        result << "\n";
-    }
-    
-    // Middle lines
-    for (size_t i = startLine + 1; i < endLine; ++i) {
-        result << m_lines[i].text << "\n";
-    }
-    
-    // Last line
-    const std::string& lastLine = m_lines[endLine].text;
-    if (endCol > lastLine.length()) {
-        endCol = lastLine.length();
-    }
-    result << lastLine.substr(0, endCol);
+    std::string result;
+    visitLines(startLine, [&](const SourceLine& line, size_t index) {
+        if (index == startLine) {
+            // First line
+            if (startCol < line.text.length()) {
+                result.append(line.text, startCol, std::string::npos);
+            }
+            result += "\n";
+        } else if (index < endLine) {
+            // Middle lines
+            result += line.text;
+            result += "\n";
+        } else {
+            // Last line
+            result.append(line.text, 0, std::min(endCol, line.text.length()));
+            return false;
+        }
+        return true;
+    });
     
-    return result.str();
+    return result;
 }
 
 std::string SourceDocument::deleteRange(size_t startLine, size_t startCol,
                                        size_t endLine, size_t endCol) {
     std::string deletedText = getTextRange(startLine, startCol, endLine, endCol);
     
-    if (startLine >= m_lines.size()) {
+    size_t lineCount = getLineCount();
+    if (startLine >= lineCount) {
         return deletedText;
     }
     
-    if (endLine >= m_lines.size()) {
-        endLine = m_lines.size() - 1;
+    if (endLine >= lineCount) {
+        endLine = lineCount - 1;
     }
     
+    LineNode* first = mutableNodeAt(startLine);
     if (startLine == endLine) {
         // Single line deletion
-        std::string& line = m_lines[startLine].text;
+        std::string& line = first->line.text;
         if (startCol > line.length()) startCol = line.length();
         if (endCol > line.length()) endCol = line.length();
         if (startCol < endCol) {
             line.erase(startCol, endCol - startCol);
-            m_lines[startLine].isDirty = true;
+            first->line.isDirty = true;
         }
     } else {
         // Multi-line deletion
-        std::string firstPart = m_lines[startLine].text.substr(0, startCol);
-        std::string lastPart = (endCol < m_lines[endLine].text.length()) 
-            ? m_lines[endLine].text.substr(endCol) 
-            : "";
+        const std::string& lastText = nodeAt(endLine)->line.text;
+        std::string lastPart = (endCol < lastText.length()) ? lastText.substr(endCol) : "";
         
         // Combine first and last parts
-        m_lines[startLine].text = firstPart + lastPart;
-        m_lines[startLine].isDirty = true;
+        first->line.text = first->line.text.substr(0, startCol) + lastPart;
+        first->line.isDirty = true;
         
-        // Delete middle lines
-        for (size_t i = endLine; i > startLine; --i) {
-            deleteLineAtIndex(i);
-        }
+        // Delete the following lines in one split
+        eraseLines(startLine + 1, endLine - startLine);
+        ensureNonEmpty();
     }
     
     markDirty();
@@ -547,15 +673,20 @@ std::string SourceDocument::deleteRange(size_t startLine, size_t startCol,
 void SourceDocument::renumber(int start, int step) {
     int currentNumber = start;
     
-    for (auto& line : m_lines) {
-        if (line.lineNumber > 0) {
-            line.lineNumber = currentNumber;
-            line.isDirty = true;
-            currentNumber += step;
+    int target = 0;
+    
+    updateAllLines([&](const SourceLine& line) {
+        if (line.lineNumber <= 0) {
+            return false;
         }
-    }
+        target = currentNumber;
+        currentNumber += step;
+        return line.lineNumber != target || !line.isDirty;
+    }, [&target](SourceLine& line) {
+        line.lineNumber = target;
+        line.isDirty = true;
+    });
     
-    rebuildLineNumberIndex();
     markDirty();
 }
 
@@ -577,65 +708,57 @@ int SourceDocument::getNextAutoNumber() {
 }
 
 void SourceDocument::stripLineNumbers() {
-    for (auto& line : m_lines) {
-        if (line.lineNumber > 0) {
-            line.lineNumber = 0;
-            line.isDirty = true;
-        }
-    }
+    updateAllLines([](const SourceLine& line) {
+        return line.lineNumber > 0;
+    }, [](SourceLine& line) {
+        line.lineNumber = 0;
+        line.isDirty = true;
+    });
     
-    m_lineNumberIndex.clear();
     markDirty();
 }
 
 void SourceDocument::assignLineNumbers(int start, int step) {
     int currentNumber = start;
     
-    for (auto& line : m_lines) {
+    updateAllLines([](const SourceLine&) {
+        return true;
+    }, [&currentNumber, step](SourceLine& line) {
         line.lineNumber = currentNumber;
         line.isDirty = true;
         currentNumber += step;
-    }
+    });
     
-    rebuildLineNumberIndex();
     markDirty();
 }
 
 bool SourceDocument::hasLineNumbers() const {
-    for (const auto& line : m_lines) {
-        if (line.lineNumber > 0) {
-            return true;
-        }
-    }
-    return false;
+    return m_root && m_root->maxNumber > 0;
 }
 
 bool SourceDocument::isMixedMode() const {
     bool hasNumbered = false;
     bool hasUnnumbered = false;
     
-    for (const auto& line : m_lines) {
+    visitLines(0, [&](const SourceLine& line, size_t) {
         if (line.lineNumber > 0) {
             hasNumbered = true;
         } else {
             hasUnnumbered = true;
         }
-        
-        if (hasNumbered && hasUnnumbered) {
-            return true;
-        }
-    }
+        return !(hasNumbered && hasUnnumbered);
+    });
     
-    return false;
+    return hasNumbered && hasUnnumbered;
 }
 
 bool SourceDocument::isFullyNumbered() const {
-    for (const auto& line : m_lines) {
-        if (line.lineNumber == 0) {
-            return false;
-        }
-    }
-    return !m_lines.empty();
+    bool allNumbered = true;
+    visitLines(0, [&allNumbered](const SourceLine& line, size_t) {
+        allNumbered = line.lineNumber != 0;
+        return allNumbered;
+    });
+    return allNumbered && m_root;
 }
 
 // =============================================================================
@@ -643,38 +766,29 @@ bool SourceDocument::isFullyNumbered() const {
 // =============================================================================
 
 void SourceDocument::setText(const std::string& text) {
-    m_lines.clear();
-    m_lineNumberIndex.clear();
-    
-    auto lines = splitLines(text);
-    if (lines.empty()) {
-        markDirty();
-        return;
-    }
+    auto texts = splitLines(text);
     
-    m_lines.reserve(lines.size());
-    
-    for (const auto& lineText : lines) {
-        m_lines.emplace_back(0, lineText);
+    std::vector<SourceLine> lines;
+    lines.reserve(texts.size());
+    for (auto& lineText : texts) {
+        lines.emplace_back(0, std::move(lineText));
     }
+    m_root = buildTree(lines, 0, lines.size());
     
     markDirty();
 }
 
 std::string SourceDocument::getText() const {
-    if (m_lines.empty()) {
-        return "";
-    }
-    
-    std::ostringstream result;
-    for (size_t i = 0; i < m_lines.size(); ++i) {
-        if (i > 0) {
-            result << "\n";
+    std::string result;
+    visitLines(0, [&result](const SourceLine& line, size_t index) {
+        if (index > 0) {
+            result += "\n";
         }
-        result << m_lines[i].text;
-    }
+        result += line.text;
+        return true;
+    });
     
-    return result.str();
+    return result;
 }
 
 bool SourceDocument::loadFromFile(const std::string& filename) {
@@ -700,8 +814,14 @@ bool SourceDocument::saveToFile(const std::string& filename) const {
         return false;
     }
     
-    std::string content = getText();
-    file.write(content.c_str(), content.length());
+    // Stream line by line rather than materializing the whole text
+    visitLines(0, [&file](const SourceLine& line, size_t index) {
+        if (index > 0) {
+            file.put('\n');
+        }
+        file.write(line.text.data(), line.text.size());
+        return true;
+    });
     file.close();
     
     return file.good();
@@ -710,17 +830,20 @@ bool SourceDocument::saveToFile(const std::string& filename) const {
 std::string SourceDocument::getTextRangeByNumber(int startLineNum, int endLineNum) const {
     std::ostringstream result;
     
-    for (const auto& line : m_lines) {
+    // No line before the first one numbered startLineNum or above can match
+    size_t first = startLineNum > 0 ? lowerBoundLineNumber(startLineNum) : 0;
+    visitLines(first, [&](const SourceLine& line, size_t) {
         if (line.lineNumber >= startLineNum) {
             if (endLineNum > 0 && line.lineNumber > endLineNum) {
-                break;
+                return false;
             }
             if (line.lineNumber > 0) {
                 result << line.lineNumber << " ";
             }
             result << line.text << "\n";
         }
-    }
+        return true;
+    });
     
     return result.str();
 }
@@ -778,25 +901,26 @@ void SourceDocument::clearUndoHistory() {
 
 void SourceDocument::markClean() {
     m_dirty = false;
-    for (auto& line : m_lines) {
-        line.isDirty = false;
-    }
+    markLinesClean();
 }
 
 std::vector<size_t> SourceDocument::getDirtyLines() const {
     std::vector<size_t> dirtyIndices;
-    for (size_t i = 0; i < m_lines.size(); ++i) {
-        if (m_lines[i].isDirty) {
-            dirtyIndices.push_back(i);
+    visitLines(0, [&dirtyIndices](const SourceLine& line, size_t index) {
+        if (line.isDirty) {
+            dirtyIndices.push_back(index);
         }
-    }
+        return true;
+    });
     return dirtyIndices;
 }
 
 void SourceDocument::markLinesClean() {
-    for (auto& line : m_lines) {
+    updateAllLines([](const SourceLine& line) {
+        return line.isDirty;
+    }, [](SourceLine& line) {
         line.isDirty = false;
-    }
+    });
 }
 
 // =============================================================================
@@ -804,31 +928,41 @@ void SourceDocument::markLinesClean() {
 // =============================================================================
 
 std::string SourceDocument::generateSourceForCompiler() const {
-    if (m_lines.empty()) {
-        return "";
-    }
-    
-    std::ostringstream result;
-    for (size_t i = 0; i < m_lines.size(); ++i) {
-        if (i > 0) {
-            result << "\n";
+    std::string result;
+    visitLines(0, [&result](const SourceLine& line, size_t index) {
+        if (index > 0) {
+            result += "\n";
         }
         
         // Include line number if present
-        if (m_lines[i].lineNumber > 0) {
-            result << m_lines[i].lineNumber << " ";
+        if (line.lineNumber > 0) {
+            result += std::to_string(line.lineNumber);
+            result += " ";
         }
         
-        result << m_lines[i].text;
-    }
+        result += line.text;
+        return true;
+    });
     
-    return result.str();
+    return result;
 }
 
 void SourceDocument::forEachLine(std::function<void(const SourceLine&, size_t)> callback) const {
-    for (size_t i = 0; i < m_lines.size(); ++i) {
-        callback(m_lines[i], i);
+    visitLines(0, [&callback](const SourceLine& line, size_t index) {
+        callback(line, index);
+        return true;
+    });
+}
+
+void SourceDocument::forEachLineInRange(size_t startIndex, size_t endIndex,
+                                        std::function<void(const SourceLine&, size_t)> callback) const {
+    if (startIndex >= endIndex) {
+        return;
     }
+    visitLines(startIndex, [&](const SourceLine& line, size_t index) {
+        callback(line, index);
+        return index + 1 < endIndex;
+    });
 }
 
 // =============================================================================
@@ -838,31 +972,25 @@ void SourceDocument::forEachLine(std::function<void(const SourceLine&, size_t)>
 SourceDocument::Statistics SourceDocument::getStatistics() const {
     Statistics stats;
     
-    stats.lineCount = m_lines.size();
-    stats.minLineNumber = INT_MAX;
-    stats.maxLineNumber = 0;
+    stats.lineCount = getLineCount();
     
-    for (const auto& line : m_lines) {
+    visitLines(0, [&stats](const SourceLine& line, size_t) {
         stats.totalCharacters += line.text.length();
         stats.totalBytes += line.text.size();
         
         if (line.lineNumber > 0) {
             stats.numberedLines++;
-            stats.hasLineNumbers = true;
-            if (line.lineNumber < stats.minLineNumber) {
-                stats.minLineNumber = line.lineNumber;
-            }
-            if (line.lineNumber > stats.maxLineNumber) {
-                stats.maxLineNumber = line.lineNumber;
-            }
         } else {
             stats.unnumberedLines++;
         }
-    }
+        return true;
+    });
     
-    if (!stats.hasLineNumbers) {
-        stats.minLineNumber = 0;
-        stats.maxLineNumber = 0;
+    // The tree already knows the numbering range
+    stats.hasLineNumbers = stats.numberedLines > 0;
+    if (stats.hasLineNumbers) {
+        stats.minLineNumber = m_root->minNumber;
+        stats.maxLineNumber = m_root->maxNumber;
     }
     
     stats.hasMixedNumbering = (stats.numberedLines > 0 && stats.unnumberedLines > 0);
@@ -881,31 +1009,31 @@ std::vector<SourceDocument::SearchResult> SourceDocument::find(const std::string
         return results;
     }
     
-    for (size_t lineIdx = 0; lineIdx < m_lines.size(); ++lineIdx) {
-        const std::string& line = m_lines[lineIdx].text;
+    std::string lowerPattern = pattern;
+    std::transform(lowerPattern.begin(), lowerPattern.end(), lowerPattern.begin(), ::tolower);
+    
+    visitLines(0, [&](const SourceLine& sourceLine, size_t lineIdx) {
+        const std::string& line = sourceLine.text;
+        std::string lowerLine;
+        if (!caseSensitive) {
+            // Simple case-insensitive search
+            lowerLine = line;
+            std::transform(lowerLine.begin(), lowerLine.end(), lowerLine.begin(), ::tolower);
+        }
         size_t pos = 0;
         
         while (pos < line.length()) {
-            size_t found;
-            if (caseSensitive) {
-                found = line.find(pattern, pos);
-            } else {
-                // Simple case-insensitive search
-                std::string lowerLine = line;
-                std::string lowerPattern = pattern;
-                std::transform(lowerLine.begin(), lowerLine.end(), lowerLine.begin(), ::tolower);
-                std::transform(lowerPattern.begin(), lowerPattern.end(), lowerPattern.begin(), ::tolower);
-                found = lowerLine.find(lowerPattern, pos);
-            }
+            size_t found = caseSensitive ? line.find(pattern, pos) : lowerLine.find(lowerPattern, pos);
             
             if (found == std::string::npos) {
                 break;
             }
             
-            results.emplace_back(lineIdx, found, pattern.length(), m_lines[lineIdx].lineNumber);
+            results.emplace_back(lineIdx, found, pattern.length(), sourceLine.lineNumber);
             pos = found + 1;
         }
-    }
+        return true;
+    });
     
     return results;
 }
@@ -913,7 +1041,13 @@ std::vector<SourceDocument::SearchResult> SourceDocument::find(const std::string
 size_t SourceDocument::replaceAll(const std::string& pattern, const std::string& replacement) {
     size_t count = 0;
     
-    for (auto& line : m_lines) {
+    if (pattern.empty()) {
+        return 0;
+    }
+    
+    updateAllLines([&pattern](const SourceLine& line) {
+        return line.text.find(pattern) != std::string::npos;
+    }, [&](SourceLine& line) {
         std::string& text = line.text;
         size_t pos = 0;
         
@@ -924,7 +1058,7 @@ size_t SourceDocument::replaceAll(const std::string& pattern, const std::string&
             line.version = m_version;
             count++;
         }
-    }
+    });
     
     if (count > 0) {
         markDirty();
@@ -938,8 +1072,7 @@ size_t SourceDocument::replaceAll(const std::string& pattern, const std::string&
 // =============================================================================
 
 void SourceDocument::clear() {
-    m_lines.clear();
-    m_lineNumberIndex.clear();
+    m_root.reset();
     m_filename.clear();
     m_encoding = "UTF-8";
     m_version = 0;
@@ -952,32 +1085,35 @@ void SourceDocument::clear() {
 }
 
 bool SourceDocument::isValidPosition(size_t lineIndex, size_t column) const {
-    if (m_lines.empty() || lineIndex >= m_lines.size()) {
+    const LineNode* node = nodeAt(lineIndex);
+    if (!node) {
         return false;
     }
-    return column <= m_lines[lineIndex].text.length();
+    return column <= node->line.text.length();
 }
 
 void SourceDocument::clampPosition(size_t& lineIndex, size_t& column) const {
-    if (m_lines.empty()) {
+    size_t lineCount = getLineCount();
+    if (lineCount == 0) {
         lineIndex = 0;
         column = 0;
         return;
     }
     
-    if (lineIndex >= m_lines.size()) {
-        lineIndex = m_lines.size() - 1;
+    if (lineIndex >= lineCount) {
+        lineIndex = lineCount - 1;
     }
     
-    if (lineIndex < m_lines.size() && column > m_lines[lineIndex].text.length()) {
-        column = m_lines[lineIndex].text.length();
+    const std::string& text = nodeAt(lineIndex)->line.text;
+    if (column > text.length()) {
+        column = text.length();
     }
 }
 
 DocumentLocation SourceDocument::getLocation(size_t lineIndex, size_t column) const {
     int lineNumber = 0;
-    if (lineIndex < m_lines.size()) {
-        lineNumber = m_lines[lineIndex].lineNumber;
+    if (const LineNode* node = nodeAt(lineIndex)) {
+        lineNumber = node->line.lineNumber;
     }
     return DocumentLocation(m_filename, lineIndex, column, lineNumber);
 }
@@ -1051,46 +1187,139 @@ size_t SourceDocument::utf8Length(const std::string& utf8) {
 // Internal Helpers
 // =============================================================================
 
-void SourceDocument::rebuildLineNumberIndex() {
-    m_lineNumberIndex.clear();
-    
-    for (size_t i = 0; i < m_lines.size(); ++i) {
-        if (m_lines[i].lineNumber > 0) {
-            m_lineNumberIndex[m_lines[i].lineNumber] = i;
+uint32_t SourceDocument::nextPriority() {
+    // xorshift32: cheap, and the treap only needs priorities to look random
+    m_priorityState ^= m_priorityState << 13;
+    m_priorityState ^= m_priorityState >> 17;
+    m_priorityState ^= m_priorityState << 5;
+    return m_priorityState;
+}
+
+const SourceDocument::LineNode* SourceDocument::nodeAt(size_t index) const {
+    const LineNode* node = m_root.get();
+    while (node) {
+        size_t leftCount = subtreeCount(node->left);
+        if (index < leftCount) {
+            node = node->left.get();
+        } else if (index == leftCount) {
+            return node;
+        } else {
+            index -= leftCount + 1;
+            node = node->right.get();
         }
     }
+    return nullptr;
 }
 
-size_t SourceDocument::findInsertionPoint(int lineNumber) const {
-    // Binary search for insertion point
-    size_t left = 0;
-    size_t right = m_lines.size();
-    
-    while (left < right) {
-        size_t mid = left + (right - left) / 2;
-        
-        int midLineNumber = m_lines[mid].lineNumber;
-        if (midLineNumber == 0 || midLineNumber < lineNumber) {
-            left = mid + 1;
+SourceDocument::LineNode* SourceDocument::mutableNodeAt(size_t index) {
+    if (index >= getLineCount()) {
+        return nullptr;
+    }
+    // Copy the path to the line so its new contents are not seen by undo states
+    LineNodePtr* slot = &m_root;
+    for (;;) {
+        *slot = ownNode(std::move(*slot));
+        LineNode* node = slot->get();
+        size_t leftCount = subtreeCount(node->left);
+        if (index < leftCount) {
+            slot = &node->left;
+        } else if (index == leftCount) {
+            return node;
         } else {
-            right = mid;
+            index -= leftCount + 1;
+            slot = &node->right;
         }
     }
-    
-    return left;
+}
+
+void SourceDocument::insertNode(size_t index, SourceLine&& line) {
+    LineNodePtr left, right;
+    splitTree(std::move(m_root), index, left, right);
+    LineNodePtr node = std::make_shared<LineNode>(std::move(line), nextPriority());
+    m_root = mergeTrees(mergeTrees(std::move(left), std::move(node)), std::move(right));
+}
+
+void SourceDocument::eraseLines(size_t index, size_t count) {
+    LineNodePtr left, middle, right;
+    splitTree(std::move(m_root), index, left, right);
+    splitTree(std::move(right), count, middle, right);
+    m_root = mergeTrees(std::move(left), std::move(right));
+}
+
+SourceDocument::LineNodePtr SourceDocument::buildTree(std::vector<SourceLine>& lines, size_t begin, size_t end) {
+    // Perfectly balanced shape; a parent takes the largest priority of its
+    // subtree so later inserts and merges keep the heap order
+    if (begin >= end) {
+        return nullptr;
+    }
+    size_t mid = begin + (end - begin) / 2;
+    LineNodePtr node = std::make_shared<LineNode>(std::move(lines[mid]), nextPriority());
+    node->left = buildTree(lines, begin, mid);
+    node->right = buildTree(lines, mid + 1, end);
+    for (const LineNode* child : {node->left.get(), node->right.get()}) {
+        if (child && child->priority > node->priority) {
+            node->priority = child->priority;
+        }
+    }
+    refreshNode(node.get());
+    return node;
+}
+
+size_t SourceDocument::findLineNumber(int lineNumber) const {
+    if (lineNumber <= 0) {
+        return static_cast<size_t>(-1);
+    }
+    // A duplicated number resolves to its last line
+    return findLastNumbered(m_root.get(), 0, lineNumber);
+}
+
+size_t SourceDocument::lowerBoundLineNumber(int lineNumber) const {
+    // First line whose number is >= lineNumber: descend toward the leftmost
+    // subtree whose largest number qualifies
+    size_t offset = 0;
+    size_t result = getLineCount();
+    const LineNode* node = m_root.get();
+    while (node && node->maxNumber >= lineNumber) {
+        size_t leftCount = subtreeCount(node->left);
+        if (node->left && node->left->maxNumber >= lineNumber) {
+            node = node->left.get();
+        } else if (node->line.lineNumber >= lineNumber) {
+            result = offset + leftCount;
+            break;
+        } else {
+            offset += leftCount + 1;
+            node = node->right.get();
+        }
+    }
+    return result;
+}
+
+size_t SourceDocument::findInsertionPoint(int lineNumber) const {
+    // Before the first line numbered above lineNumber, which keeps numbered
+    // lines in order even when unnumbered lines sit between them
+    return lowerBoundLineNumber(lineNumber);
+}
+
+void SourceDocument::visitLines(size_t startIndex, const std::function<bool(const SourceLine&, size_t)>& visit) const {
+    visitInOrder(m_root.get(), startIndex, visit);
+}
+
+void SourceDocument::updateAllLines(const std::function<bool(const SourceLine&)>& changes,
+                                    const std::function<void(SourceLine&)>& update) {
+    m_root = updateTree(m_root, changes, update);
 }
 
 SourceDocument::UndoState SourceDocument::captureState() const {
+    // The tree is persistent: sharing the root is the snapshot, and later
+    // edits copy only the paths they change
     UndoState state;
-    state.lines = m_lines;
-    state.lineNumberIndex = m_lineNumberIndex;
+    state.root = m_root;
     state.version = m_version;
     return state;
 }
 
 void SourceDocument::restoreState(const UndoState& state) {
-    m_lines = state.lines;
-    m_lineNumberIndex = state.lineNumberIndex;
+    m_root = state.root;
     m_version = state.version;
     markDirty();
 }
@@ -1110,14 +1339,34 @@ void SourceDocument::ensureNonEmpty() {
 }
 
 void SourceDocument::validateIndices() const {
-    // Debug validation
-    for (const auto& pair : m_lineNumberIndex) {
-        int lineNumber = pair.first;
-        size_t index = pair.second;
+    // Debug validation: every node's cached values match its subtree
+    std::vector<const LineNode*> pending;
+    if (m_root) {
+        pending.push_back(m_root.get());
+    }
+    while (!pending.empty()) {
+        const LineNode* node = pending.back();
+        pending.pop_back();
+        
+        size_t count = 1;
+        int minNumber = node->line.lineNumber > 0 ? node->line.lineNumber : INT_MAX;
+        int maxNumber = node->line.lineNumber > 0 ? node->line.lineNumber : 0;
+        for (const LineNode* child : {node->left.get(), node->right.get()}) {
+            if (child) {
+                count += child->count;
+                minNumber = std::min(minNumber, child->minNumber);
+                maxNumber = std::max(maxNumber, child->maxNumber);
+                pending.push_back(child);
+            }
+        }
         
-        assert(index < m_lines.size());
-        assert(m_lines[index].lineNumber == lineNumber);
+        assert(node->count == count);
+        assert(node->minNumber == minNumber);
+        assert(node->maxNumber == maxNumber);
+        (void)count;
+        (void)minNumber;
+        (void)maxNumber;
     }
 }
 
-} // namespace FasterBASIC
\ No newline at end of file
+} // namespace FasterBASIC
@@ -18,6 +18,7 @@
 #include <functional>
 #include <cstdint>
 #include <memory>
+#include <climits>
 
 namespace FasterBASIC {
 
@@ -48,6 +49,22 @@ struct SourceLine {
     SourceLine& operator=(SourceLine&&) noexcept = default;
 };
 
+// =============================================================================
+// SourceLineNode - Node of SourceDocument's line tree
+// =============================================================================
+
+struct SourceLineNode {
+    SourceLine line;
+    uint32_t priority;           // Treap heap key (random)
+    size_t count;                // Lines in this subtree
+    int minNumber;               // Smallest line number in subtree (INT_MAX if none)
+    int maxNumber;               // Largest line number in subtree (0 if none)
+    std::shared_ptr<SourceLineNode> left;   // Shared with undo states until changed
+    std::shared_ptr<SourceLineNode> right;
+    
+    SourceLineNode(SourceLine&& src, uint32_t prio);
+};
+
 // =============================================================================
 // DocumentLocation - Position in source for error reporting
 // =============================================================================
@@ -92,13 +109,14 @@ public:
     // =========================================================================
     
     // By sequential index (0-based, for editor/iteration)
-    SourceLine& getLineByIndex(size_t index);
+    // Lines are read-only here: text changes go through setLineText and the
+    // editing operations below, line numbers through the numbering operations
+    // (the tree caches them, and shares nodes with undo states and copies)
     const SourceLine& getLineByIndex(size_t index) const;
-    size_t getLineCount() const { return m_lines.size(); }
-    bool isEmpty() const { return m_lines.empty() || (m_lines.size() == 1 && m_lines[0].text.empty() && m_lines[0].lineNumber == 0); }
+    size_t getLineCount() const { return m_root ? m_root->count : 0; }
+    bool isEmpty() const;
     
     // By line number (for BASIC GOTO/GOSUB/renumber)
-    SourceLine* getLineByNumber(int lineNumber);
     const SourceLine* getLineByNumber(int lineNumber) const;
     bool hasLineNumber(int lineNumber) const;
     std::vector<int> getLineNumbers() const;
@@ -129,6 +147,9 @@ public:
     /// Replace line at index
     bool replaceLineAtIndex(size_t index, const std::string& text);
     
+    /// Set the text of the line at index, keeping its line number
+    bool setLineText(size_t index, const std::string& text);
+    
     /// Split line at column (creates new line)
     bool splitLine(size_t index, size_t column);
     
@@ -267,12 +288,13 @@ public:
     /// Generate source text for compiler (preserves line numbers if present)
     std::string generateSourceForCompiler() const;
     
-    /// Get direct access to lines (for fast iteration)
-    const std::vector<SourceLine>& getLines() const { return m_lines; }
-    
-    /// Iterate over lines with callback
+    /// Iterate over lines with callback (streams from the tree, no copy)
     void forEachLine(std::function<void(const SourceLine&, size_t index)> callback) const;
     
+    /// Iterate over lines [startIndex, endIndex) - O(log n) to reach the start
+    void forEachLineInRange(size_t startIndex, size_t endIndex,
+                            std::function<void(const SourceLine&, size_t index)> callback) const;
+    
     // =========================================================================
     // Statistics
     // =========================================================================
@@ -346,11 +368,17 @@ private:
     // Member Variables
     // =========================================================================
     
-    // Primary storage: sequential vector for fast iteration
-    std::vector<SourceLine> m_lines;
+    // Primary storage: balanced tree of lines ordered by position (implicit
+    // treap). Each node caches its subtree's line count and the smallest and
+    // largest BASIC line number below it, so access by index, insert, delete
+    // and line-number lookup are O(log n) without a separate index to rebuild.
+    // The tree is persistent: an edit copies the O(log n) nodes on its path
+    // and shares the rest, so an undo state is just an old root.
+    using LineNode = SourceLineNode;
+    using LineNodePtr = std::shared_ptr<SourceLineNode>;
     
-    // Secondary index: line number -> vector index for O(1) lookup
-    std::unordered_map<int, size_t> m_lineNumberIndex;
+    LineNodePtr m_root;
+    uint32_t m_priorityState;           // xorshift state for node priorities
     
     // Metadata
     std::string m_filename;
@@ -366,8 +394,7 @@ private:
     
     // Undo/redo stacks
     struct UndoState {
-        std::vector<SourceLine> lines;
-        std::unordered_map<int, size_t> lineNumberIndex;
+        LineNodePtr root;                // Shares unchanged lines with the document
         uint64_t version;
         
         UndoState() : version(0) {}
@@ -381,8 +408,27 @@ private:
     // Internal Helpers
     // =========================================================================
     
-    /// Rebuild line number index from scratch
-    void rebuildLineNumberIndex();
+    /// Tree primitives (all O(log n) except build)
+    uint32_t nextPriority();
+    const LineNode* nodeAt(size_t index) const;
+    LineNode* mutableNodeAt(size_t index);  // Copies the path if it is shared
+    void insertNode(size_t index, SourceLine&& line);
+    void eraseLines(size_t index, size_t count);
+    LineNodePtr buildTree(std::vector<SourceLine>& lines, size_t begin, size_t end);
+    
+    /// Index of the last line numbered lineNumber, or -1
+    size_t findLineNumber(int lineNumber) const;
+    
+    /// Index of the first line numbered at least lineNumber (line count if none)
+    size_t lowerBoundLineNumber(int lineNumber) const;
+    
+    /// Visit lines from startIndex in order until the visitor returns false
+    void visitLines(size_t startIndex, const std::function<bool(const SourceLine&, size_t)>& visit) const;
+    
+    /// Visit every line in order and apply update to those changes selects,
+    /// copying only the paths to the updated lines
+    void updateAllLines(const std::function<bool(const SourceLine&)>& changes,
+                        const std::function<void(SourceLine&)>& update);
     
     /// Increment version counter
     void incrementVersion() { ++m_version; }
@@ -214,6 +214,19 @@ TEST(ReplaceLineAtIndex) {
     ASSERT_EQ(doc.getLineByIndex(0).text, "Replaced");
 }
 
+TEST(SetLineText) {
+    SourceDocument doc;
+    doc.setLineByNumber(10, "PRINT 1");
+    doc.setLineByNumber(20, "PRINT 2");
+    SourceDocument copy(doc);
+    
+    ASSERT_TRUE(doc.setLineText(1, "PRINT 3"));
+    ASSERT_EQ(doc.getLineByNumber(20)->text, "PRINT 3");
+    ASSERT_EQ(doc.getLineByIndex(1).lineNumber, 20);
+    ASSERT_EQ(copy.getLineByNumber(20)->text, "PRINT 2");
+    ASSERT_FALSE(doc.setLineText(2, "PRINT 4"));
+}
+
 TEST(SplitLine) {
     SourceDocument doc;
     doc.clear();
@@ -709,6 +722,102 @@ TEST(LineNumberOrdering) {
     ASSERT_EQ(doc.getLineByIndex(4).lineNumber, 50);
 }
 
+// =============================================================================
+// Line Tree Tests
+// =============================================================================
+
+TEST(LargeDocument_EditNearTop) {
+    SourceDocument doc;
+    for (int i = 1; i <= 5000; ++i) {
+        doc.setLineByNumber(i * 10, "PRINT " + std::to_string(i));
+    }
+    
+    doc.setLineByNumber(5, "REM top");
+    ASSERT_EQ(doc.getLineCount(), 5001);
+    ASSERT_EQ(doc.getIndexForLineNumber(5), 0);
+    ASSERT_EQ(doc.getIndexForLineNumber(10), 1);
+    ASSERT_EQ(doc.getIndexForLineNumber(50000), 5000);
+    ASSERT_EQ(doc.getLineByNumber(25000)->text, "PRINT 2500");
+    
+    ASSERT_TRUE(doc.deleteLineByNumber(5));
+    ASSERT_TRUE(doc.deleteLineByNumber(20));
+    ASSERT_EQ(doc.getLineCount(), 4999);
+    ASSERT_EQ(doc.getIndexForLineNumber(30), 1);
+    ASSERT_FALSE(doc.hasLineNumber(20));
+    ASSERT_EQ(doc.getLineByIndex(4998).lineNumber, 50000);
+}
+
+TEST(GetLineByNumber_Unordered) {
+    SourceDocument doc;
+    doc.insertLineAtIndex(0, "A", 30);
+    doc.insertLineAtIndex(1, "B", 10);
+    doc.insertLineAtIndex(2, "C", 0);
+    doc.insertLineAtIndex(3, "D", 20);
+    doc.insertLineAtIndex(4, "E", 10);
+    
+    // Duplicated numbers resolve to the last line
+    ASSERT_EQ(doc.getIndexForLineNumber(10), 4);
+    ASSERT_EQ(doc.getLineByNumber(20)->text, "D");
+    ASSERT_EQ(doc.getLineByNumber(30)->text, "A");
+    ASSERT_TRUE(doc.getLineByNumber(15) == nullptr);
+    
+    auto numbers = doc.getLineNumbers();
+    ASSERT_EQ(numbers.size(), 3);
+    ASSERT_EQ(numbers[0], 10);
+    ASSERT_EQ(numbers[2], 30);
+}
+
+TEST(ForEachLineInRange) {
+    SourceDocument doc;
+    for (int i = 0; i < 100; ++i) {
+        doc.insertLineAtIndex(i, "Line " + std::to_string(i), 0);
+    }
+    
+    std::string seen;
+    size_t first = 0;
+    int count = 0;
+    doc.forEachLineInRange(40, 43, [&](const SourceLine& line, size_t index) {
+        if (count == 0) first = index;
+        seen += line.text + ";";
+        count++;
+    });
+    
+    ASSERT_EQ(count, 3);
+    ASSERT_EQ(first, 40);
+    ASSERT_EQ(seen, "Line 40;Line 41;Line 42;");
+}
+
+TEST(LargeDocument_UndoHistory) {
+    SourceDocument doc;
+    for (int i = 1; i <= 5000; ++i) {
+        doc.setLineByNumber(i * 10, "PRINT " + std::to_string(i));
+    }
+    std::string original = doc.getText();
+    
+    for (int i = 0; i < 50; ++i) {
+        doc.pushUndoState();
+        doc.replaceLineAtIndex(i * 100, "REM edit " + std::to_string(i));
+    }
+    doc.pushUndoState();
+    doc.renumber(100, 5);
+    
+    SourceDocument copy(doc);
+    ASSERT_EQ(copy.getLineByIndex(100).text, "REM edit 1");
+    
+    while (doc.canUndo()) {
+        ASSERT_TRUE(doc.undo());
+    }
+    ASSERT_EQ(doc.getText(), original);
+    
+    // Copies keep their own lines while the original is edited
+    ASSERT_EQ(copy.getLineByIndex(0).lineNumber, 100);
+    ASSERT_EQ(copy.getLineByIndex(100).text, "REM edit 1");
+    
+    ASSERT_TRUE(doc.redo());
+    ASSERT_EQ(doc.getLineByIndex(0).text, "REM edit 0");
+    ASSERT_EQ(doc.getLineByIndex(100).text, "PRINT 101");
+}
+
 // =============================================================================
 // Main Test Runner
 // =============================================================================
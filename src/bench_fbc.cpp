@@ -0,0 +1,522 @@
+//
+// bench_fbc.cpp
+// FasterBASIC - Compiler Throughput Benchmark
+//
+// Generates a synthetic BASIC program from a handful of shape parameters
+// and compiles it repeatedly, timing every compiler phase on its own and
+// counting the bytes each phase allocates. The generator is deterministic
+// for a given seed, so two builds of the compiler can be compared on the
+// same input.
+//
+// Build:  c++ -O2 -std=c++17 -I. -I../runtime bench_fbc.cpp fasterbasic_lexer.cpp
+//             fasterbasic_parser.cpp fasterbasic_semantic.cpp fasterbasic_optimizer.cpp
+//             fasterbasic_peephole.cpp fasterbasic_cfg.cpp fasterbasic_ircode.cpp
+//             fasterbasic_lua_codegen.cpp fasterbasic_lua_expr.cpp
+//             fasterbasic_threadpool.cpp fasterbasic_data_preprocessor.cpp
+//             modular_commands.cpp command_registry_core.cpp fasterbasic_events.cpp
+//             ../runtime/ConstantsManager.cpp -pthread -o bench_fbc
+// Run:    ./bench_fbc [options]        (./bench_fbc --help for the list)
+//
+
+#include "fasterbasic_lexer.h"
+#include "fasterbasic_parser.h"
+#include "fasterbasic_semantic.h"
+#include "fasterbasic_peephole.h"
+#include "fasterbasic_cfg.h"
+#include "fasterbasic_ircode.h"
+#include "fasterbasic_lua_codegen.h"
+#include "fasterbasic_data_preprocessor.h"
+#include "modular_commands.h"
+#include "command_registry_core.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace FasterBASIC;
+using namespace FasterBASIC::ModularCommands;
+
+// =============================================================================
+// Allocation Counting
+// =============================================================================
+
+// Every allocation in the process goes through these, so the bytes a
+// phase allocates are the difference of the counter around it (worker
+// threads compiling SUB/FUNCTION bodies included)
+static std::atomic<size_t> g_bytesAllocated{0};
+
+void* operator new(size_t size) {
+    g_bytesAllocated.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+// =============================================================================
+// Program Generator
+// =============================================================================
+
+struct ProgramShape {
+    int lines = 5000;            // Statements in the main program
+    double gosubDensity = 0.05;  // Fraction of statements that are GOSUBs
+    int dataValues = 500;        // Values spread over DATA lines
+    int nestingDepth = 3;        // Deepest FOR / block IF nesting
+    int includeFiles = 4;        // Files pulled in with INCLUDE, one SUB each
+    double arrayMix = 0.2;       // Fraction of statements indexing arrays
+    double stringMix = 0.2;      // Fraction of statements on strings
+    uint32_t seed = 1;
+};
+
+// Small LCG: std:: distributions differ between standard libraries, and
+// the program must be the same wherever the benchmark is built
+class ShapeRandom {
+public:
+    explicit ShapeRandom(uint32_t seed) : m_state(seed * 2654435761u + 1) {}
+
+    uint32_t next() {
+        m_state = m_state * 1664525u + 1013904223u;
+        return m_state >> 8;
+    }
+
+    int below(int n) { return static_cast<int>(next() % static_cast<uint32_t>(n)); }
+    bool chance(double p) { return (next() & 0xFFFF) < p * 65536.0; }
+
+private:
+    uint32_t m_state;
+};
+
+struct GeneratedProgram {
+    std::string mainSource;
+    std::vector<std::pair<std::string, std::string>> includes;  // (file name, source)
+    int subroutines = 0;
+
+    size_t totalBytes() const {
+        size_t bytes = mainSource.size();
+        for (const auto& include : includes) bytes += include.second.size();
+        return bytes;
+    }
+};
+
+class ProgramGenerator {
+public:
+    explicit ProgramGenerator(const ProgramShape& shape) : m_shape(shape), m_random(shape.seed) {}
+
+    GeneratedProgram generate() {
+        GeneratedProgram program;
+        program.subroutines = std::max(1, m_shape.lines / 200);
+
+        line("REM bench_fbc generated program");
+        line("DIM A(255)");
+        line("DIM B$(63)");
+        line("X = 1: Y = 2: K = 0: S$ = \"\"");
+        if (m_shape.dataValues > 0) {
+            line("RESTORE");
+            line("FOR D = 1 TO " + std::to_string(m_shape.dataValues) + ": READ V: X = X + V: NEXT D");
+        }
+
+        std::vector<std::string> closers;
+        for (int i = 0; i < m_shape.lines; i++) {
+            int depth = static_cast<int>(closers.size());
+            if (depth > 0 && m_random.chance(0.15)) {
+                line(closers.back());
+                closers.pop_back();
+                continue;
+            }
+            if (depth < m_shape.nestingDepth && m_random.chance(0.08)) {
+                openBlock(depth, closers);
+                continue;
+            }
+            statement(program.subroutines);
+        }
+        while (!closers.empty()) {
+            line(closers.back());
+            closers.pop_back();
+        }
+        line("PRINT X; Y; K; LEN(S$)");
+        line("END");
+
+        // GOSUB targets
+        m_lineNumber = 60000;
+        for (int s = 0; s < program.subroutines; s++) {
+            line("X = X + " + std::to_string(s + 1) + ": Y = (Y * 3) MOD 1009");
+            line("RETURN");
+        }
+
+        // DATA, ten values to a line
+        for (int v = 0; v < m_shape.dataValues; v += 10) {
+            std::string data = "DATA ";
+            for (int k = v; k < std::min(v + 10, m_shape.dataValues); k++) {
+                data += (k > v ? ", " : "") + std::to_string(m_random.below(1000));
+            }
+            line(data);
+        }
+
+        for (int f = 0; f < m_shape.includeFiles; f++) {
+            std::string name = "bench_inc" + std::to_string(f) + ".bas";
+            line("INCLUDE \"" + name + "\"");
+            program.includes.push_back({name, includeSource(f)});
+        }
+
+        program.mainSource = m_out.str();
+        return program;
+    }
+
+private:
+    void line(const std::string& text) {
+        m_out << m_lineNumber << " " << text << "\n";
+        m_lineNumber += 10;
+    }
+
+    void openBlock(int depth, std::vector<std::string>& closers) {
+        std::string var = "J" + std::to_string(depth + 1);
+        if (m_random.chance(0.5)) {
+            line("FOR " + var + " = 1 TO " + std::to_string(2 + m_random.below(4)));
+            closers.push_back("NEXT " + var);
+        } else {
+            line("IF X > " + std::to_string(m_random.below(100)) + " THEN");
+            closers.push_back("END IF");
+        }
+    }
+
+    void statement(int subroutines) {
+        if (m_random.chance(m_shape.gosubDensity)) {
+            line("GOSUB " + std::to_string(60000 + 20 * m_random.below(subroutines)));
+            return;
+        }
+        if (m_shape.includeFiles > 0 && m_random.chance(0.02)) {
+            line("CALL BENCHSUB" + std::to_string(m_random.below(m_shape.includeFiles)) + "(X)");
+            return;
+        }
+        int n = m_random.below(97) + 1;
+        if (m_random.chance(m_shape.arrayMix)) {
+            switch (m_random.below(3)) {
+                case 0: line("K = (K + " + std::to_string(n) + ") MOD 256: A(K) = A(K) + X"); break;
+                case 1: line("X = A((K + " + std::to_string(n) + ") MOD 256) * 2 + Y"); break;
+                default: line("B$(K MOD 64) = STR$(A(K))"); break;
+            }
+            return;
+        }
+        if (m_random.chance(m_shape.stringMix)) {
+            switch (m_random.below(3)) {
+                case 0: line("S$ = LEFT$(S$ + \"s" + std::to_string(n) + "\", 24)"); break;
+                case 1: line("Y = Y + LEN(MID$(S$, 2, " + std::to_string(n % 8 + 1) + "))"); break;
+                default: line("IF S$ = \"s" + std::to_string(n) + "\" THEN S$ = UCASE$(S$)"); break;
+            }
+            return;
+        }
+        switch (m_random.below(4)) {
+            case 0: line("X = X * 3 + " + std::to_string(n) + " - Y"); break;
+            case 1: line("Y = (X MOD " + std::to_string(n + 2) + ") + 1"); break;
+            case 2: line("IF X > " + std::to_string(n * 10) + " THEN X = X - Y ELSE Y = Y + 1"); break;
+            default: line("X = INT(X / 2) + SQR(ABS(Y))"); break;
+        }
+    }
+
+    std::string includeSource(int index) {
+        std::ostringstream oss;
+        oss << "SUB BENCHSUB" << index << "(N)\n";
+        oss << "  LOCAL T\n";
+        oss << "  FOR T = 1 TO " << (2 + index % 3) << "\n";
+        oss << "    N = N * 2 + T\n";
+        oss << "  NEXT T\n";
+        oss << "  PRINT N\n";
+        oss << "END SUB\n";
+        return oss.str();
+    }
+
+    const ProgramShape& m_shape;
+    ShapeRandom m_random;
+    std::ostringstream m_out;
+    int m_lineNumber = 10;
+};
+
+// =============================================================================
+// Phase Timing
+// =============================================================================
+
+enum Phase {
+    PHASE_DATA_PREPROCESSOR,
+    PHASE_LEXER,
+    PHASE_PARSER,
+    PHASE_SEMANTIC,
+    PHASE_CFG,
+    PHASE_IR,
+    PHASE_PEEPHOLE,
+    PHASE_CODEGEN,
+    PHASE_COUNT
+};
+
+static const char* PHASE_NAMES[PHASE_COUNT] = {
+    "DataPreprocessor", "Lexer", "Parser", "SemanticAnalyzer",
+    "CFGBuilder", "IRGenerator", "PeepholeOptimizer", "LuaCodeGenerator"
+};
+
+struct PhaseSample {
+    double ms[PHASE_COUNT];
+    size_t bytes[PHASE_COUNT];
+};
+
+class PhaseTimer {
+public:
+    explicit PhaseTimer(PhaseSample& sample) : m_sample(sample) {}
+
+    void begin() {
+        m_bytes = g_bytesAllocated;
+        m_start = std::chrono::steady_clock::now();
+    }
+
+    void end(Phase phase) {
+        auto stop = std::chrono::steady_clock::now();
+        m_sample.ms[phase] = std::chrono::duration<double, std::milli>(stop - m_start).count();
+        m_sample.bytes[phase] = g_bytesAllocated - m_bytes;
+    }
+
+private:
+    PhaseSample& m_sample;
+    size_t m_bytes = 0;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// One full compile, phase by phase as fbc runs them. The DataPreprocessor
+// phase is the source-level rewriting (REM stripping, line numbers to
+// labels) that fbc does before lexing; lexing is timed on its output.
+static bool compileOnce(const std::string& source, const std::string& path, int threads, PhaseSample& sample,
+                        std::string& error) {
+    PhaseTimer timer(sample);
+
+    timer.begin();
+    std::string preprocessed = DataPreprocessor::preprocessREM(source);
+    preprocessed = DataPreprocessor::preprocessLineNumbersToLabels(preprocessed);
+    timer.end(PHASE_DATA_PREPROCESSOR);
+
+    timer.begin();
+    Lexer lexer;
+    lexer.tokenize(preprocessed);
+    auto tokens = lexer.getTokens();
+    timer.end(PHASE_LEXER);
+
+    timer.begin();
+    Parser parser;
+    auto ast = parser.parse(tokens, path);
+    timer.end(PHASE_PARSER);
+    if (!ast || parser.hasErrors()) {
+        error = parser.getErrors().empty() ? "parse failed" : parser.getErrors()[0].toString();
+        return false;
+    }
+
+    timer.begin();
+    SemanticAnalyzer semantic;
+    semantic.analyze(*ast, parser.getOptions());
+    timer.end(PHASE_SEMANTIC);
+
+    timer.begin();
+    CFGBuilder cfgBuilder;
+    auto cfg = cfgBuilder.build(*ast, semantic.getSymbolTable());
+    timer.end(PHASE_CFG);
+
+    timer.begin();
+    IRGenerator irGen;
+    irGen.setThreadCount(threads);
+    auto irCode = irGen.generate(*cfg, semantic.getSymbolTable());
+    timer.end(PHASE_IR);
+
+    timer.begin();
+    PeepholeOptimizer peepholeOpt;
+    peepholeOpt.setOptimizationLevel(1);
+    peepholeOpt.optimize(*irCode);
+    timer.end(PHASE_PEEPHOLE);
+
+    timer.begin();
+    LuaCodeGenConfig config;
+    config.threads = threads;
+    LuaCodeGenerator luaGen(config);
+    std::string luaCode = luaGen.generate(*irCode);
+    timer.end(PHASE_CODEGEN);
+
+    if (luaCode.empty()) {
+        error = "code generation produced no output";
+        return false;
+    }
+    return true;
+}
+
+// Nearest-rank percentile of a sorted sample
+template <typename T>
+static T percentile(const std::vector<T>& sorted, double p) {
+    size_t rank = static_cast<size_t>(p / 100.0 * sorted.size() + 0.999999);
+    rank = std::min(std::max<size_t>(rank, 1), sorted.size());
+    return sorted[rank - 1];
+}
+
+// =============================================================================
+// Main
+// =============================================================================
+
+static void printUsage(const char* programName) {
+    std::cerr << "Usage: " << programName << " [options]\n";
+    std::cerr << "\nProgram shape:\n";
+    std::cerr << "  --lines N          Statements in the main program (default 5000)\n";
+    std::cerr << "  --gosub F          Fraction of statements that are GOSUBs (default 0.05)\n";
+    std::cerr << "  --data N           DATA values (default 500)\n";
+    std::cerr << "  --depth N          Maximum FOR / IF nesting depth (default 3)\n";
+    std::cerr << "  --includes N       INCLUDE files, one SUB each (default 4)\n";
+    std::cerr << "  --arrays F         Fraction of statements indexing arrays (default 0.2)\n";
+    std::cerr << "  --strings F        Fraction of statements on strings (default 0.2)\n";
+    std::cerr << "  --seed N           Generator seed (default 1)\n";
+    std::cerr << "\nMeasurement:\n";
+    std::cerr << "  --runs N           Timed compiles (default 20)\n";
+    std::cerr << "  --warmup N         Untimed compiles first (default 2)\n";
+    std::cerr << "  --threads N        Threads compiling SUB/FUNCTION bodies (default 0 = one per core)\n";
+    std::cerr << "  --csv              One phase,median_ms,p95_ms,bytes line per phase\n";
+    std::cerr << "  --emit DIR         Write the generated program to DIR and keep it\n";
+}
+
+int main(int argc, char* argv[]) {
+    ProgramShape shape;
+    int runs = 20;
+    int warmup = 2;
+    int threads = 0;
+    bool csv = false;
+    std::string emitDir;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--lines" && hasValue) shape.lines = std::atoi(argv[++i]);
+        else if (arg == "--gosub" && hasValue) shape.gosubDensity = std::atof(argv[++i]);
+        else if (arg == "--data" && hasValue) shape.dataValues = std::atoi(argv[++i]);
+        else if (arg == "--depth" && hasValue) shape.nestingDepth = std::atoi(argv[++i]);
+        else if (arg == "--includes" && hasValue) shape.includeFiles = std::atoi(argv[++i]);
+        else if (arg == "--arrays" && hasValue) shape.arrayMix = std::atof(argv[++i]);
+        else if (arg == "--strings" && hasValue) shape.stringMix = std::atof(argv[++i]);
+        else if (arg == "--seed" && hasValue) shape.seed = static_cast<uint32_t>(std::atoi(argv[++i]));
+        else if (arg == "--runs" && hasValue) runs = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--warmup" && hasValue) warmup = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--threads" && hasValue) threads = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--csv") csv = true;
+        else if (arg == "--emit" && hasValue) emitDir = argv[++i];
+        else {
+            printUsage(argv[0]);
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+    }
+
+    CommandRegistry& registry = getGlobalCommandRegistry();
+    CoreCommandRegistry::registerCoreCommands(registry);
+    CoreCommandRegistry::registerCoreFunctions(registry);
+    markGlobalRegistryInitialized();
+
+    ProgramGenerator generator(shape);
+    GeneratedProgram program = generator.generate();
+
+    // INCLUDE resolves against the main file's directory, so the program
+    // is compiled as if it lived next to its include files
+    namespace fs = std::filesystem;
+    fs::path dir = emitDir.empty()
+        ? fs::temp_directory_path() / ("bench_fbc_" + std::to_string(shape.seed) + "_" +
+                                       std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()))
+        : fs::path(emitDir);
+    fs::create_directories(dir);
+    std::string mainPath = (dir / "bench_main.bas").string();
+    std::ofstream(mainPath) << program.mainSource;
+    for (const auto& include : program.includes) {
+        std::ofstream((dir / include.first).string()) << include.second;
+    }
+
+    // The compiler reports progress on stdout/stderr, through both iostreams
+    // and stdio; keep it out of the report (producing it still counts)
+    std::fflush(stdout);
+    std::fflush(stderr);
+    int savedStdout = dup(STDOUT_FILENO);
+    int savedStderr = dup(STDERR_FILENO);
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, STDOUT_FILENO);
+    dup2(devNull, STDERR_FILENO);
+    close(devNull);
+
+    std::vector<PhaseSample> samples;
+    std::string error;
+    bool ok = true;
+    for (int i = 0; i < warmup + runs && ok; i++) {
+        PhaseSample sample = {};
+        ok = compileOnce(program.mainSource, mainPath, threads, sample, error);
+        if (i >= warmup) samples.push_back(sample);
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(stdout);
+    std::fflush(stderr);
+    dup2(savedStdout, STDOUT_FILENO);
+    dup2(savedStderr, STDERR_FILENO);
+    close(savedStdout);
+    close(savedStderr);
+
+    if (emitDir.empty()) {
+        std::error_code ec;
+        fs::remove_all(dir, ec);
+    }
+    if (!ok) {
+        std::cerr << "bench_fbc: generated program failed to compile: " << error << "\n";
+        return 1;
+    }
+
+    if (!csv) {
+        std::printf("bench_fbc: %d lines, gosub %.2f, data %d, depth %d, includes %d, arrays %.2f, strings %.2f, seed %u\n",
+                    shape.lines, shape.gosubDensity, shape.dataValues, shape.nestingDepth,
+                    shape.includeFiles, shape.arrayMix, shape.stringMix, shape.seed);
+        std::printf("source: %zu bytes in %zu files, %d runs after %d warmup\n\n",
+                    program.totalBytes(), program.includes.size() + 1, runs, warmup);
+        std::printf("%-20s %12s %12s %16s\n", "phase", "median ms", "p95 ms", "bytes allocated");
+    } else {
+        std::printf("phase,median_ms,p95_ms,bytes\n");
+    }
+
+    std::vector<double> totalMs(samples.size(), 0.0);
+    std::vector<size_t> totalBytes(samples.size(), 0);
+    for (int phase = 0; phase <= PHASE_COUNT; phase++) {
+        std::vector<double> ms;
+        std::vector<size_t> bytes;
+        if (phase < PHASE_COUNT) {
+            for (size_t s = 0; s < samples.size(); s++) {
+                ms.push_back(samples[s].ms[phase]);
+                bytes.push_back(samples[s].bytes[phase]);
+                totalMs[s] += samples[s].ms[phase];
+                totalBytes[s] += samples[s].bytes[phase];
+            }
+        } else {
+            ms = totalMs;
+            bytes = totalBytes;
+        }
+        std::sort(ms.begin(), ms.end());
+        std::sort(bytes.begin(), bytes.end());
+
+        const char* name = phase < PHASE_COUNT ? PHASE_NAMES[phase] : "Total";
+        if (csv) {
+            std::printf("%s,%.4f,%.4f,%zu\n", name, percentile(ms, 50), percentile(ms, 95),
+                        percentile(bytes, 50));
+        } else {
+            std::printf("%-20s %12.3f %12.3f %16zu\n", name, percentile(ms, 50), percentile(ms, 95),
+                        percentile(bytes, 50));
+        }
+    }
+
+    return 0;
+}
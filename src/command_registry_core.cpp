@@ -229,13 +229,15 @@ void CoreCommandRegistry::registerMathFunctions(CommandRegistry& registry) {
     // ABS - Absolute value
     CommandDefinition abs("ABS", "Return absolute value of number", "math.abs", "math");
     abs.addParameter("x", ParameterType::FLOAT, "Input number")
-       .setReturnType(ReturnType::FLOAT);
+       .setReturnType(ReturnType::FLOAT)
+       .setPure();
     registry.registerFunction(std::move(abs));
     
     // INT - Integer part
     CommandDefinition int_fn("INT", "Return integer part of number", "math.floor", "math");
     int_fn.addParameter("x", ParameterType::FLOAT, "Input number")
-          .setReturnType(ReturnType::INT);
+          .setReturnType(ReturnType::INT)
+          .setPure();
     registry.registerFunction(std::move(int_fn));
     
     // RND - Random number
@@ -247,95 +249,111 @@ void CoreCommandRegistry::registerMathFunctions(CommandRegistry& registry) {
     // SQR - Square root
     CommandDefinition sqr("SQR", "Return square root", "math.sqrt", "math");
     sqr.addParameter("x", ParameterType::FLOAT, "Input number")
-       .setReturnType(ReturnType::FLOAT);
+       .setReturnType(ReturnType::FLOAT)
+       .setPure();
     registry.registerFunction(std::move(sqr));
     
     // SIN, COS, TAN - Trigonometric functions
     CommandDefinition sin_fn("SIN", "Return sine of angle in radians", "math.sin", "math");
     sin_fn.addParameter("x", ParameterType::FLOAT, "Angle in radians")
-          .setReturnType(ReturnType::FLOAT);
+          .setReturnType(ReturnType::FLOAT)
+          .setPure();
     registry.registerFunction(std::move(sin_fn));
     
     CommandDefinition cos_fn("COS", "Return cosine of angle in radians", "math.cos", "math");
     cos_fn.addParameter("x", ParameterType::FLOAT, "Angle in radians")
-          .setReturnType(ReturnType::FLOAT);
+          .setReturnType(ReturnType::FLOAT)
+          .setPure();
     registry.registerFunction(std::move(cos_fn));
     
     CommandDefinition tan_fn("TAN", "Return tangent of angle in radians", "math.tan", "math");
     tan_fn.addParameter("x", ParameterType::FLOAT, "Angle in radians")
-          .setReturnType(ReturnType::FLOAT);
+          .setReturnType(ReturnType::FLOAT)
+          .setPure();
     registry.registerFunction(std::move(tan_fn));
     
     // ATN - Arctangent
     CommandDefinition atn("ATN", "Return arctangent in radians", "math.atan", "math");
     atn.addParameter("x", ParameterType::FLOAT, "Input value")
-       .setReturnType(ReturnType::FLOAT);
+       .setReturnType(ReturnType::FLOAT)
+       .setPure();
     registry.registerFunction(std::move(atn));
     
     // EXP - Exponential
     CommandDefinition exp_fn("EXP", "Return e^x", "math.exp", "math");
     exp_fn.addParameter("x", ParameterType::FLOAT, "Exponent")
-          .setReturnType(ReturnType::FLOAT);
+          .setReturnType(ReturnType::FLOAT)
+          .setPure();
     registry.registerFunction(std::move(exp_fn));
     
     // LOG - Natural logarithm
     CommandDefinition log_fn("LOG", "Return natural logarithm", "math.log", "math");
     log_fn.addParameter("x", ParameterType::FLOAT, "Input value (must be > 0)")
-          .setReturnType(ReturnType::FLOAT);
+          .setReturnType(ReturnType::FLOAT)
+          .setPure();
     registry.registerFunction(std::move(log_fn));
     
     // ACS - Arc-cosine (inverse cosine)
     CommandDefinition acs("ACS", "Return arc-cosine in radians", "math.acos", "math");
     acs.addParameter("x", ParameterType::FLOAT, "Input value (-1 to 1)")
-       .setReturnType(ReturnType::FLOAT);
+       .setReturnType(ReturnType::FLOAT)
+       .setPure();
     registry.registerFunction(std::move(acs));
     
     // ASN - Arc-sine (inverse sine)
     CommandDefinition asn("ASN", "Return arc-sine in radians", "math.asin", "math");
     asn.addParameter("x", ParameterType::FLOAT, "Input value (-1 to 1)")
-       .setReturnType(ReturnType::FLOAT);
+       .setReturnType(ReturnType::FLOAT)
+       .setPure();
     registry.registerFunction(std::move(asn));
     
     // DEG - Convert radians to degrees
     CommandDefinition deg("DEG", "Convert radians to degrees", "math.deg", "math");
     deg.addParameter("x", ParameterType::FLOAT, "Angle in radians")
-       .setReturnType(ReturnType::FLOAT);
+       .setReturnType(ReturnType::FLOAT)
+       .setPure();
     registry.registerFunction(std::move(deg));
     
     // RAD - Convert degrees to radians
     CommandDefinition rad("RAD", "Convert degrees to radians", "math.rad", "math");
     rad.addParameter("x", ParameterType::FLOAT, "Angle in degrees")
-       .setReturnType(ReturnType::FLOAT);
+       .setReturnType(ReturnType::FLOAT)
+       .setPure();
     registry.registerFunction(std::move(rad));
     
     // SGN - Sign function (-1, 0, or 1)
     CommandDefinition sgn("SGN", "Return sign of number", "basic_sgn", "math");
     sgn.addParameter("x", ParameterType::FLOAT, "Input number")
-       .setReturnType(ReturnType::INT);
+       .setReturnType(ReturnType::INT)
+       .setPure();
     registry.registerFunction(std::move(sgn));
     
     // PI - Mathematical constant pi
     CommandDefinition pi("PI", "Mathematical constant pi", "math.pi", "math");
-    pi.setReturnType(ReturnType::FLOAT);
+    pi.setReturnType(ReturnType::FLOAT)
+      .setPure();
     registry.registerFunction(std::move(pi));
     
     // LN - Natural logarithm (alias for LOG for BBC BASIC compatibility)
     CommandDefinition ln("LN", "Return natural logarithm", "math.log", "math");
     ln.addParameter("x", ParameterType::FLOAT, "Input value (must be > 0)")
-      .setReturnType(ReturnType::FLOAT);
+      .setReturnType(ReturnType::FLOAT)
+      .setPure();
     registry.registerFunction(std::move(ln));
     
     // FIX - Truncate towards zero (different from INT which floors)
     CommandDefinition fix("FIX", "Truncate towards zero", "basic_fix", "math");
     fix.addParameter("x", ParameterType::FLOAT, "Input number")
-       .setReturnType(ReturnType::INT);
+       .setReturnType(ReturnType::INT)
+       .setPure();
     registry.registerFunction(std::move(fix));
     
     // MOD - Enhanced modulo with vector magnitude support
     CommandDefinition mod("MOD", "Modulo or vector magnitude", "basic_mod", "math");
     mod.addParameter("x", ParameterType::FLOAT, "First operand or array")
        .addParameter("y", ParameterType::FLOAT, "Second operand (optional for arrays)", true, "nil")
-       .setReturnType(ReturnType::FLOAT);
+       .setReturnType(ReturnType::FLOAT)
+       .setPure();
     registry.registerFunction(std::move(mod));
     
     // =========================================================================
@@ -346,97 +364,113 @@ void CoreCommandRegistry::registerMathFunctions(CommandRegistry& registry) {
     CommandDefinition pow_fn("POW", "Return x raised to power y", "math_pow", "math");
     pow_fn.addParameter("x", ParameterType::FLOAT, "Base")
           .addParameter("y", ParameterType::FLOAT, "Exponent")
-          .setReturnType(ReturnType::FLOAT);
+          .setReturnType(ReturnType::FLOAT)
+          .setPure();
     registry.registerFunction(std::move(pow_fn));
     
     // CEIL - Ceiling (round up)
     CommandDefinition ceil("CEIL", "Round up to nearest integer", "math.ceil", "math");
     ceil.addParameter("x", ParameterType::FLOAT, "Input number")
-        .setReturnType(ReturnType::FLOAT);
+        .setReturnType(ReturnType::FLOAT)
+        .setPure();
     registry.registerFunction(std::move(ceil));
     
     // FLOOR - Floor (round down)
     CommandDefinition floor_fn("FLOOR", "Round down to nearest integer", "math.floor", "math");
     floor_fn.addParameter("x", ParameterType::FLOAT, "Input number")
-            .setReturnType(ReturnType::FLOAT);
+            .setReturnType(ReturnType::FLOAT)
+            .setPure();
     registry.registerFunction(std::move(floor_fn));
     
     // ROUND - Round to n decimal places
     CommandDefinition round_fn("ROUND", "Round to n decimal places", "math_round", "math");
     round_fn.addParameter("x", ParameterType::FLOAT, "Input number")
             .addParameter("places", ParameterType::INT, "Decimal places", true, "0")
-            .setReturnType(ReturnType::FLOAT);
+            .setReturnType(ReturnType::FLOAT)
+            .setPure();
     registry.registerFunction(std::move(round_fn));
     
     // TRUNC - Truncate (alias for FIX)
     CommandDefinition trunc("TRUNC", "Truncate towards zero", "basic_fix", "math");
     trunc.addParameter("x", ParameterType::FLOAT, "Input number")
-         .setReturnType(ReturnType::INT);
+         .setReturnType(ReturnType::INT)
+         .setPure();
     registry.registerFunction(std::move(trunc));
     
     // FRAC - Fractional part
     CommandDefinition frac("FRAC", "Return fractional part of number", "math_frac", "math");
     frac.addParameter("x", ParameterType::FLOAT, "Input number")
-        .setReturnType(ReturnType::FLOAT);
+        .setReturnType(ReturnType::FLOAT)
+        .setPure();
     registry.registerFunction(std::move(frac));
     
     // Hyperbolic Trig Functions
     CommandDefinition sinh_fn("SINH", "Hyperbolic sine", "math_sinh", "math");
     sinh_fn.addParameter("x", ParameterType::FLOAT, "Input value")
-           .setReturnType(ReturnType::FLOAT);
+           .setReturnType(ReturnType::FLOAT)
+           .setPure();
     registry.registerFunction(std::move(sinh_fn));
     
     CommandDefinition cosh_fn("COSH", "Hyperbolic cosine", "math_cosh", "math");
     cosh_fn.addParameter("x", ParameterType::FLOAT, "Input value")
-           .setReturnType(ReturnType::FLOAT);
+           .setReturnType(ReturnType::FLOAT)
+           .setPure();
     registry.registerFunction(std::move(cosh_fn));
     
     CommandDefinition tanh_fn("TANH", "Hyperbolic tangent", "math_tanh", "math");
     tanh_fn.addParameter("x", ParameterType::FLOAT, "Input value")
-           .setReturnType(ReturnType::FLOAT);
+           .setReturnType(ReturnType::FLOAT)
+           .setPure();
     registry.registerFunction(std::move(tanh_fn));
     
     // Inverse Hyperbolic Functions
     CommandDefinition asinh_fn("ASINH", "Inverse hyperbolic sine", "math_asinh", "math");
     asinh_fn.addParameter("x", ParameterType::FLOAT, "Input value")
-            .setReturnType(ReturnType::FLOAT);
+            .setReturnType(ReturnType::FLOAT)
+            .setPure();
     registry.registerFunction(std::move(asinh_fn));
     
     CommandDefinition acosh_fn("ACOSH", "Inverse hyperbolic cosine", "math_acosh", "math");
     acosh_fn.addParameter("x", ParameterType::FLOAT, "Input value (must be >= 1)")
-            .setReturnType(ReturnType::FLOAT);
+            .setReturnType(ReturnType::FLOAT)
+            .setPure();
     registry.registerFunction(std::move(acosh_fn));
     
     CommandDefinition atanh_fn("ATANH", "Inverse hyperbolic tangent", "math_atanh", "math");
     atanh_fn.addParameter("x", ParameterType::FLOAT, "Input value (-1 < x < 1)")
-            .setReturnType(ReturnType::FLOAT);
+            .setReturnType(ReturnType::FLOAT)
+            .setPure();
     registry.registerFunction(std::move(atanh_fn));
     
     // MIN - Minimum of two numbers
     CommandDefinition min_fn("MIN", "Return minimum of two numbers", "math.min", "math");
     min_fn.addParameter("a", ParameterType::FLOAT, "First number")
           .addParameter("b", ParameterType::FLOAT, "Second number")
-          .setReturnType(ReturnType::FLOAT);
+          .setReturnType(ReturnType::FLOAT)
+          .setPure();
     registry.registerFunction(std::move(min_fn));
     
     // MAX - Maximum of two numbers
     CommandDefinition max_fn("MAX", "Return maximum of two numbers", "math.max", "math");
     max_fn.addParameter("a", ParameterType::FLOAT, "First number")
           .addParameter("b", ParameterType::FLOAT, "Second number")
-          .setReturnType(ReturnType::FLOAT);
+          .setReturnType(ReturnType::FLOAT)
+          .setPure();
     registry.registerFunction(std::move(max_fn));
     
     // ATAN2 - Two-argument arctangent
     CommandDefinition atan2_fn("ATAN2", "Return atan2(y, x) in radians", "math.atan2", "math");
     atan2_fn.addParameter("y", ParameterType::FLOAT, "Y coordinate")
             .addParameter("x", ParameterType::FLOAT, "X coordinate")
-            .setReturnType(ReturnType::FLOAT);
+            .setReturnType(ReturnType::FLOAT)
+            .setPure();
     registry.registerFunction(std::move(atan2_fn));
     
     // LOG10 - Base-10 logarithm
     CommandDefinition log10_fn("LOG10", "Return base-10 logarithm", "math_log10", "math");
     log10_fn.addParameter("x", ParameterType::FLOAT, "Input value (must be > 0)")
-            .setReturnType(ReturnType::FLOAT);
+            .setReturnType(ReturnType::FLOAT)
+            .setPure();
     registry.registerFunction(std::move(log10_fn));
     
     // Number Conversion Functions
@@ -458,22 +492,26 @@ void CoreCommandRegistry::registerMathFunctions(CommandRegistry& registry) {
     // Type Conversion Functions
     CommandDefinition cdbl("CDBL", "Convert to double precision", "tonumber", "math");
     cdbl.addParameter("x", ParameterType::FLOAT, "Value to convert")
-        .setReturnType(ReturnType::FLOAT);
+        .setReturnType(ReturnType::FLOAT)
+        .setPure();
     registry.registerFunction(std::move(cdbl));
     
     CommandDefinition cint("CINT", "Convert to integer (rounded)", "math_cint", "math");
     cint.addParameter("x", ParameterType::FLOAT, "Value to convert")
-        .setReturnType(ReturnType::INT);
+        .setReturnType(ReturnType::INT)
+        .setPure();
     registry.registerFunction(std::move(cint));
     
     CommandDefinition clng("CLNG", "Convert to long integer", "math_clng", "math");
     clng.addParameter("x", ParameterType::FLOAT, "Value to convert")
-        .setReturnType(ReturnType::INT);
+        .setReturnType(ReturnType::INT)
+        .setPure();
     registry.registerFunction(std::move(clng));
     
     CommandDefinition csng("CSNG", "Convert to single precision", "tonumber", "math");
     csng.addParameter("x", ParameterType::FLOAT, "Value to convert")
-        .setReturnType(ReturnType::FLOAT);
+        .setReturnType(ReturnType::FLOAT)
+        .setPure();
     registry.registerFunction(std::move(csng));
 }
 
@@ -481,21 +519,24 @@ void CoreCommandRegistry::registerStringFunctions(CommandRegistry& registry) {
     // LEN - String length
     CommandDefinition len("LEN", "Return length of string", "string.len", "string");
     len.addParameter("str", ParameterType::STRING, "Input string")
-       .setReturnType(ReturnType::INT);
+       .setReturnType(ReturnType::INT)
+       .setPure();
     registry.registerFunction(std::move(len));
     
     // LEFT$ - Left substring
     CommandDefinition left("LEFT$", "Return leftmost characters of string", "string_left", "string");
     left.addParameter("str", ParameterType::STRING, "Input string")
         .addParameter("count", ParameterType::INT, "Number of characters")
-        .setReturnType(ReturnType::STRING);
+        .setReturnType(ReturnType::STRING)
+        .setPure();
     registry.registerFunction(std::move(left));
     
     // RIGHT$ - Right substring  
     CommandDefinition right("RIGHT$", "Return rightmost characters of string", "string_right", "string");
     right.addParameter("str", ParameterType::STRING, "Input string")
          .addParameter("count", ParameterType::INT, "Number of characters")
-         .setReturnType(ReturnType::STRING);
+         .setReturnType(ReturnType::STRING)
+         .setPure();
     registry.registerFunction(std::move(right));
     
     // MID$ - Middle substring
@@ -503,7 +544,8 @@ void CoreCommandRegistry::registerStringFunctions(CommandRegistry& registry) {
     mid.addParameter("str", ParameterType::STRING, "Input string")
        .addParameter("start", ParameterType::INT, "Starting position (1-based)")
        .addParameter("length", ParameterType::INT, "Length of substring", true, "nil")
-       .setReturnType(ReturnType::STRING);
+       .setReturnType(ReturnType::STRING)
+       .setPure();
     registry.registerFunction(std::move(mid));
     
     // CHR$ - Character from ASCII code
@@ -515,19 +557,22 @@ void CoreCommandRegistry::registerStringFunctions(CommandRegistry& registry) {
     // ASC - ASCII code from character
     CommandDefinition asc("ASC", "Return ASCII code of first character", "string.byte", "string");
     asc.addParameter("str", ParameterType::STRING, "Input string (uses first character)")
-       .setReturnType(ReturnType::INT);
+       .setReturnType(ReturnType::INT)
+       .setPure();
     registry.registerFunction(std::move(asc));
     
     // STR$ - Convert number to string
     CommandDefinition str("STR$", "Convert number to string", "tostring", "string");
     str.addParameter("num", ParameterType::FLOAT, "Number to convert")
-       .setReturnType(ReturnType::STRING);
+       .setReturnType(ReturnType::STRING)
+       .setPure();
     registry.registerFunction(std::move(str));
     
     // VAL - Convert string to number
     CommandDefinition val("VAL", "Convert string to number", "tonumber", "string");
     val.addParameter("str", ParameterType::STRING, "String to convert")
-       .setReturnType(ReturnType::FLOAT);
+       .setReturnType(ReturnType::FLOAT)
+       .setPure();
     registry.registerFunction(std::move(val));
     
     // INSTR - Find substring
@@ -535,7 +580,8 @@ void CoreCommandRegistry::registerStringFunctions(CommandRegistry& registry) {
     instr.addParameter("haystack", ParameterType::STRING, "String to search in")
          .addParameter("needle", ParameterType::STRING, "String to search for")
          .addParameter("start", ParameterType::INT, "Starting position", true, "1")
-         .setReturnType(ReturnType::INT);
+         .setReturnType(ReturnType::INT)
+         .setPure();
     registry.registerFunction(std::move(instr));
     
     // JOIN$ - Join string array elements with separator
@@ -578,31 +624,36 @@ void CoreCommandRegistry::registerStringFunctions(CommandRegistry& registry) {
     // UCASE$ - Convert to uppercase
     CommandDefinition ucase("UCASE$", "Convert string to uppercase", "string_ucase", "string");
     ucase.addParameter("str", ParameterType::STRING, "Input string")
-         .setReturnType(ReturnType::STRING);
+         .setReturnType(ReturnType::STRING)
+         .setPure();
     registry.registerFunction(std::move(ucase));
     
     // LCASE$ - Convert to lowercase
     CommandDefinition lcase("LCASE$", "Convert string to lowercase", "string_lcase", "string");
     lcase.addParameter("str", ParameterType::STRING, "Input string")
-         .setReturnType(ReturnType::STRING);
+         .setReturnType(ReturnType::STRING)
+         .setPure();
     registry.registerFunction(std::move(lcase));
     
     // LTRIM$ - Trim left whitespace
     CommandDefinition ltrim("LTRIM$", "Remove leading whitespace", "string_ltrim", "string");
     ltrim.addParameter("str", ParameterType::STRING, "Input string")
-         .setReturnType(ReturnType::STRING);
+         .setReturnType(ReturnType::STRING)
+         .setPure();
     registry.registerFunction(std::move(ltrim));
     
     // RTRIM$ - Trim right whitespace
     CommandDefinition rtrim("RTRIM$", "Remove trailing whitespace", "string_rtrim", "string");
     rtrim.addParameter("str", ParameterType::STRING, "Input string")
-         .setReturnType(ReturnType::STRING);
+         .setReturnType(ReturnType::STRING)
+         .setPure();
     registry.registerFunction(std::move(rtrim));
     
     // TRIM$ - Trim both sides whitespace
     CommandDefinition trim("TRIM$", "Remove leading and trailing whitespace", "string_trim", "string");
     trim.addParameter("str", ParameterType::STRING, "Input string")
-        .setReturnType(ReturnType::STRING);
+        .setReturnType(ReturnType::STRING)
+        .setPure();
     registry.registerFunction(std::move(trim));
     
     // SPACE$ - Create string of spaces
@@ -681,7 +732,8 @@ void CoreCommandRegistry::registerStringFunctions(CommandRegistry& registry) {
     instrrev.addParameter("haystack", ParameterType::STRING, "String to search in")
             .addParameter("needle", ParameterType::STRING, "String to search for")
             .addParameter("start", ParameterType::INT, "Starting position from left", true, "-1")
-            .setReturnType(ReturnType::INT);
+            .setReturnType(ReturnType::INT)
+            .setPure();
     registry.registerFunction(std::move(instrrev));
     
     // LPAD$ - Left pad string
@@ -102,6 +102,10 @@ const char* irOpcodeToString(IROpcode op) {
         case IROpcode::ELSEIF_START: return "ELSEIF_START";
         case IROpcode::ELSE_START: return "ELSE_START";
         case IROpcode::IF_END: return "IF_END";
+        case IROpcode::SWITCH_START: return "SWITCH_START";
+        case IROpcode::SWITCH_CASE: return "SWITCH_CASE";
+        case IROpcode::SWITCH_DEFAULT: return "SWITCH_DEFAULT";
+        case IROpcode::SWITCH_END: return "SWITCH_END";
         case IROpcode::HALT: return "HALT";
         case IROpcode::END: return "END";
         default: return "UNKNOWN";
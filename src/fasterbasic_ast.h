@@ -380,6 +380,10 @@ public:
 class Statement : public ASTNode {
 public:
     virtual ~Statement() = default;
+
+    // Line the statement starts on: the user's line number, or the source
+    // line in unnumbered programs. 0 for statements the compiler made up
+    int basicLine = 0;
 };
 
 // PRINT statement
@@ -404,7 +408,7 @@ public:
     ExpressionPtr formatExpr;               // Format string expression
     std::vector<ExpressionPtr> usingValues; // Values to format
 
-    PrintStatement() : trailingNewline(true), hasUsing(false) {}
+    PrintStatement() : fileNumber(0), trailingNewline(true), hasUsing(false) {}
 
     void addItem(ExpressionPtr expr, bool semicolon, bool comma) {
         items.emplace_back(std::move(expr), semicolon, comma);
@@ -1547,11 +1551,12 @@ public:
         EXPLICIT,
         UNICODE,
         ERROR,
-        CANCELLABLE
+        CANCELLABLE,
+        PROFILE_COUNTS
     };
 
     OptionType type;
-    int value;  // For OPTION BASE n
+    int value;  // For OPTION BASE n; 1/0 for ON/OFF options
 
     OptionStatement(OptionType t, int v = 0) : type(t), value(v) {}
 
@@ -1566,6 +1571,9 @@ public:
             case OptionType::BASE: oss << "BASE " << value; break;
             case OptionType::EXPLICIT: oss << "EXPLICIT"; break;
             case OptionType::UNICODE: oss << "UNICODE"; break;
+            case OptionType::ERROR: oss << "ERROR"; break;
+            case OptionType::CANCELLABLE: oss << "CANCELLABLE " << (value ? "ON" : "OFF"); break;
+            case OptionType::PROFILE_COUNTS: oss << "PROFILE " << (value ? "COUNTS" : "OFF"); break;
         }
         oss << "\n";
         return oss.str();
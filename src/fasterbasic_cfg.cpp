@@ -11,6 +11,7 @@
 #include <algorithm>
 #include <sstream>
 #include <iostream>
+#include <iterator>
 
 namespace FasterBASIC {
 
@@ -606,6 +607,1443 @@ void CFGBuilder::addReturnEdge(int source, int target) {
     m_edgesCreated++;
 }
 
+// =============================================================================
+// Dataflow Analysis - Flow Graph
+// =============================================================================
+
+CFGAnalysis::CFGAnalysis(const ControlFlowGraph& cfg, const SymbolTable* symbols)
+    : m_cfg(cfg)
+    , m_symbols(symbols)
+    , m_entryNode(-1)
+    , m_exitNode(-1)
+    , m_returnJoinNode(-1)
+    , m_irreducibleEdges(0)
+    , m_asyncHandlers(false)
+{
+}
+
+void CFGAnalysis::run() {
+    m_targetLines.clear();
+    m_labelNodes.clear();
+    m_lineNodes.clear();
+    m_retreatingEdges.clear();
+    m_loops.clear();
+    m_irreducibleEdges = 0;
+    m_variables.clear();
+    m_variableIndex.clear();
+    m_definitions.clear();
+    m_asyncHandlers = false;
+
+    for (const auto& block : m_cfg.blocks) {
+        for (const Statement* stmt : block->statements) collectJumpTargets(stmt);
+    }
+    splitBlocks();
+    buildFlowGraph();
+    computeOrder();
+
+    int n = getNodeCount();
+    m_idom = computeDominators(m_entryNode, m_succ, m_pred);
+    numberTree(m_idom, m_domPre, m_domPost);
+    if (m_exitNode >= 0) {
+        m_ipdom = computeDominators(m_exitNode, m_pred, m_succ);
+    } else {
+        m_ipdom.assign(n, -1);
+    }
+    numberTree(m_ipdom, m_pdomPre, m_pdomPost);
+
+    computeLoops();
+    scanAccesses();
+    computeLiveness();
+    computeReachingDefinitions();
+}
+
+// Numbered jump targets must start a node; labels always do
+void CFGAnalysis::collectJumpTargets(const Statement* stmt) {
+    switch (stmt->getType()) {
+        case ASTNodeType::STMT_GOTO: {
+            const auto* s = static_cast<const GotoStatement*>(stmt);
+            if (!s->isLabel) m_targetLines.insert(s->lineNumber);
+            break;
+        }
+
+        case ASTNodeType::STMT_GOSUB: {
+            const auto* s = static_cast<const GosubStatement*>(stmt);
+            if (!s->isLabel) m_targetLines.insert(s->lineNumber);
+            break;
+        }
+
+        case ASTNodeType::STMT_ON_GOTO: {
+            const auto* s = static_cast<const OnGotoStatement*>(stmt);
+            for (size_t i = 0; i < s->lineNumbers.size(); ++i) {
+                if (!s->isLabelList[i]) m_targetLines.insert(s->lineNumbers[i]);
+            }
+            break;
+        }
+
+        case ASTNodeType::STMT_ON_GOSUB: {
+            const auto* s = static_cast<const OnGosubStatement*>(stmt);
+            for (size_t i = 0; i < s->lineNumbers.size(); ++i) {
+                if (!s->isLabelList[i]) m_targetLines.insert(s->lineNumbers[i]);
+            }
+            break;
+        }
+
+        case ASTNodeType::STMT_ON_EVENT: {
+            const auto* s = static_cast<const OnEventStatement*>(stmt);
+            if (s->handlerType != EventHandlerType::CALL && s->isLineNumber) {
+                m_targetLines.insert(std::atoi(s->target.c_str()));
+            }
+            break;
+        }
+
+        case ASTNodeType::STMT_IF: {
+            const auto* s = static_cast<const IfStatement*>(stmt);
+            if (s->hasGoto) m_targetLines.insert(s->gotoLine);
+            for (const auto& inner : s->thenStatements) collectJumpTargets(inner.get());
+            for (const auto& clause : s->elseIfClauses) {
+                for (const auto& inner : clause.statements) collectJumpTargets(inner.get());
+            }
+            for (const auto& inner : s->elseStatements) collectJumpTargets(inner.get());
+            break;
+        }
+
+        case ASTNodeType::STMT_CASE: {
+            const auto* s = static_cast<const CaseStatement*>(stmt);
+            for (const auto& clause : s->whenClauses) {
+                for (const auto& inner : clause.statements) collectJumpTargets(inner.get());
+            }
+            for (const auto& inner : s->otherwiseStatements) collectJumpTargets(inner.get());
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+// True if the statement can transfer control somewhere other than the next
+// statement (directly or from inside an IF/CASE body)
+static bool transfersControl(const Statement* stmt) {
+    switch (stmt->getType()) {
+        case ASTNodeType::STMT_GOTO:
+        case ASTNodeType::STMT_GOSUB:
+        case ASTNodeType::STMT_ON_GOTO:
+        case ASTNodeType::STMT_ON_GOSUB:
+        case ASTNodeType::STMT_ON_EVENT:
+        case ASTNodeType::STMT_RETURN:
+        case ASTNodeType::STMT_END:
+        case ASTNodeType::STMT_EXIT:
+        case ASTNodeType::STMT_FOR:
+        case ASTNodeType::STMT_FOR_IN:
+        case ASTNodeType::STMT_WHILE:
+        case ASTNodeType::STMT_REPEAT:
+        case ASTNodeType::STMT_DO:
+        case ASTNodeType::STMT_NEXT:
+        case ASTNodeType::STMT_WEND:
+        case ASTNodeType::STMT_UNTIL:
+        case ASTNodeType::STMT_LOOP:
+            return true;
+
+        case ASTNodeType::STMT_IF: {
+            const auto* s = static_cast<const IfStatement*>(stmt);
+            if (s->hasGoto) return true;
+            for (const auto& inner : s->thenStatements) {
+                if (transfersControl(inner.get())) return true;
+            }
+            for (const auto& clause : s->elseIfClauses) {
+                for (const auto& inner : clause.statements) {
+                    if (transfersControl(inner.get())) return true;
+                }
+            }
+            for (const auto& inner : s->elseStatements) {
+                if (transfersControl(inner.get())) return true;
+            }
+            return false;
+        }
+
+        case ASTNodeType::STMT_CASE: {
+            const auto* s = static_cast<const CaseStatement*>(stmt);
+            for (const auto& clause : s->whenClauses) {
+                for (const auto& inner : clause.statements) {
+                    if (transfersControl(inner.get())) return true;
+                }
+            }
+            for (const auto& inner : s->otherwiseStatements) {
+                if (transfersControl(inner.get())) return true;
+            }
+            return false;
+        }
+
+        default:
+            return false;
+    }
+}
+
+// True if control never reaches the statement after this one
+static bool endsFlow(const Statement* stmt) {
+    switch (stmt->getType()) {
+        case ASTNodeType::STMT_GOTO:
+        case ASTNodeType::STMT_RETURN:
+        case ASTNodeType::STMT_END:
+        case ASTNodeType::STMT_EXIT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void CFGAnalysis::splitBlocks() {
+    m_nodes.clear();
+    m_blockFirstNode.assign(m_cfg.getBlockCount() + 1, 0);
+
+    for (const auto& block : m_cfg.blocks) {
+        m_blockFirstNode[block->id] = static_cast<int>(m_nodes.size());
+        int count = static_cast<int>(block->statements.size());
+        int start = 0;
+        int previousLine = -1;
+        for (int i = 0; i <= count; ++i) {
+            bool cut = (i == count);
+            if (!cut && i > start) {
+                // Control may enter here: a label or the start of a numbered target
+                const Statement* stmt = block->statements[i];
+                int line = block->getLineNumber(stmt);
+                cut = stmt->getType() == ASTNodeType::STMT_LABEL ||
+                      (line != previousLine && m_targetLines.count(line));
+                // ...or leave after the previous statement
+                cut = cut || transfersControl(block->statements[i - 1]);
+            }
+            if (cut && (i > start || i == count)) {
+                if (i > start || start == 0) {
+                    FlowNode node;
+                    node.id = static_cast<int>(m_nodes.size());
+                    node.blockId = block->id;
+                    node.firstStatement = start;
+                    node.endStatement = i;
+                    m_nodes.push_back(node);
+                }
+                start = i;
+            }
+            if (i < count) previousLine = block->getLineNumber(block->statements[i]);
+        }
+    }
+    m_blockFirstNode[m_cfg.getBlockCount()] = static_cast<int>(m_nodes.size());
+
+    // Jump targets by node
+    for (const FlowNode& node : m_nodes) {
+        const BasicBlock* block = m_cfg.getBlock(node.blockId);
+        if (node.firstStatement >= node.endStatement) continue;
+        const Statement* first = block->statements[node.firstStatement];
+        if (first->getType() == ASTNodeType::STMT_LABEL) {
+            m_labelNodes[static_cast<const LabelStatement*>(first)->labelName] = node.id;
+        }
+        int line = block->getLineNumber(first);
+        if (line > 0 && !m_lineNodes.count(line)) m_lineNodes[line] = node.id;
+    }
+
+    m_entryNode = m_cfg.entryBlock >= 0 ? firstNode(m_cfg.entryBlock) : -1;
+    m_exitNode = m_cfg.exitBlock >= 0 ? firstNode(m_cfg.exitBlock) : -1;
+}
+
+int CFGAnalysis::nodeForStatement(int blockId, int statementIndex) const {
+    int first = firstNode(blockId);
+    int last = lastNode(blockId);
+    while (first < last && m_nodes[first].endStatement <= statementIndex) ++first;
+    return first;
+}
+
+void CFGAnalysis::addFlowEdge(int source, int target) {
+    int n = getNodeCount();
+    if (source < 0 || target < 0 || source >= n || target >= n) return;
+    auto& succ = m_succ[source];
+    if (std::find(succ.begin(), succ.end(), target) != succ.end()) return;
+    succ.push_back(target);
+    m_pred[target].push_back(source);
+}
+
+int CFGAnalysis::resolveTarget(bool isLabel, const std::string& label, int lineNumber) const {
+    if (isLabel) {
+        auto it = m_labelNodes.find(label);
+        return it != m_labelNodes.end() ? it->second : -1;
+    }
+    auto it = m_lineNodes.find(lineNumber);
+    if (it != m_lineNodes.end()) return it->second;
+    int block = m_cfg.getBlockForLineOrNext(lineNumber);
+    return block >= 0 ? firstNode(block) : -1;
+}
+
+void CFGAnalysis::buildFlowGraph() {
+    int n = getNodeCount();
+    m_succ.assign(n, {});
+    m_pred.assign(n, {});
+    m_returnJoinNode = -1;
+
+    // The builder creates one loop header per opener, in program order, and
+    // each opener ends its block; so the n-th opener owns the n-th header
+    std::vector<int> loopHeaders;
+    for (const auto& block : m_cfg.blocks) {
+        if (block->isLoopHeader) loopHeaders.push_back(firstNode(block->id));
+    }
+    size_t nextHeader = 0;
+
+    struct OpenLoop {
+        int header;
+        bool preTest;                // FOR, WHILE, DO WHILE/UNTIL: the body may not run
+        std::vector<int> exitNodes;  // Nodes ending in an EXIT for this loop
+    };
+    std::vector<OpenLoop> openLoops;
+    std::vector<int> gosubSites;
+    std::vector<int> returnNodes;
+
+    for (const FlowNode& node : m_nodes) {
+        const BasicBlock* block = m_cfg.getBlock(node.blockId);
+        bool fallsThrough = true;
+
+        if (node.endStatement > node.firstStatement) {
+            const Statement* last = block->statements[node.endStatement - 1];
+            fallsThrough = !endsFlow(last);
+
+            switch (last->getType()) {
+                case ASTNodeType::STMT_FOR:
+                case ASTNodeType::STMT_FOR_IN:
+                case ASTNodeType::STMT_WHILE:
+                case ASTNodeType::STMT_REPEAT:
+                case ASTNodeType::STMT_DO: {
+                    if (nextHeader >= loopHeaders.size()) break;
+                    OpenLoop loop;
+                    loop.header = loopHeaders[nextHeader++];
+                    loop.preTest = true;
+                    if (last->getType() == ASTNodeType::STMT_REPEAT) {
+                        loop.preTest = false;
+                    } else if (last->getType() == ASTNodeType::STMT_DO) {
+                        loop.preTest = static_cast<const DoStatement*>(last)->conditionType !=
+                                       DoStatement::ConditionType::NONE;
+                    }
+                    openLoops.push_back(loop);
+                    break;
+                }
+
+                case ASTNodeType::STMT_NEXT:
+                case ASTNodeType::STMT_WEND:
+                case ASTNodeType::STMT_UNTIL:
+                case ASTNodeType::STMT_LOOP: {
+                    // Back to the header; the rest of the block runs once the
+                    // loop is done, which is where skips and EXITs land
+                    if (openLoops.empty()) break;
+                    OpenLoop loop = openLoops.back();
+                    openLoops.pop_back();
+                    addFlowEdge(node.id, loop.header);
+                    if (loop.preTest) addFlowEdge(loop.header, node.id + 1);
+                    for (int exitNode : loop.exitNodes) addFlowEdge(exitNode, node.id + 1);
+                    break;
+                }
+
+                default:
+                    addJumps(last, node.id, openLoops.empty() ? nullptr : &openLoops.back().exitNodes,
+                             gosubSites, returnNodes);
+                    break;
+            }
+        }
+
+        // Nodes are numbered in block order, so the next node is where the
+        // builder's fallthrough edge leads
+        if (fallsThrough && node.id + 1 < n && node.blockId != m_cfg.exitBlock) {
+            addFlowEdge(node.id, node.id + 1);
+        }
+    }
+
+    // RETURN may resume after any GOSUB. The edges meet in one synthetic join
+    // node, so their number grows with RETURNs + GOSUBs, not their product.
+    gosubSites.erase(std::remove_if(gosubSites.begin(), gosubSites.end(),
+                                    [n](int site) { return site >= n; }), gosubSites.end());
+    if (gosubSites.empty()) {
+        for (int returnNode : returnNodes) addFlowEdge(returnNode, m_exitNode);
+    } else if (!returnNodes.empty()) {
+        FlowNode join;
+        join.id = n;
+        join.blockId = -1;
+        join.firstStatement = 0;
+        join.endStatement = 0;
+        m_nodes.push_back(join);
+        m_succ.emplace_back();
+        m_pred.emplace_back();
+        m_returnJoinNode = n;
+        for (int returnNode : returnNodes) addFlowEdge(returnNode, m_returnJoinNode);
+        for (int site : gosubSites) addFlowEdge(m_returnJoinNode, site);
+    }
+}
+
+void CFGAnalysis::addJumps(const Statement* stmt, int node, std::vector<int>* loopExits,
+                           std::vector<int>& gosubSites, std::vector<int>& returnNodes) {
+    switch (stmt->getType()) {
+        case ASTNodeType::STMT_GOTO: {
+            const auto* s = static_cast<const GotoStatement*>(stmt);
+            addFlowEdge(node, resolveTarget(s->isLabel, s->label, s->lineNumber));
+            break;
+        }
+
+        case ASTNodeType::STMT_GOSUB: {
+            const auto* s = static_cast<const GosubStatement*>(stmt);
+            addFlowEdge(node, resolveTarget(s->isLabel, s->label, s->lineNumber));
+            gosubSites.push_back(node + 1);
+            break;
+        }
+
+        case ASTNodeType::STMT_ON_GOTO: {
+            const auto* s = static_cast<const OnGotoStatement*>(stmt);
+            for (size_t i = 0; i < s->lineNumbers.size(); ++i) {
+                addFlowEdge(node, resolveTarget(s->isLabelList[i], s->labels[i], s->lineNumbers[i]));
+            }
+            break;
+        }
+
+        case ASTNodeType::STMT_ON_GOSUB: {
+            const auto* s = static_cast<const OnGosubStatement*>(stmt);
+            for (size_t i = 0; i < s->lineNumbers.size(); ++i) {
+                addFlowEdge(node, resolveTarget(s->isLabelList[i], s->labels[i], s->lineNumbers[i]));
+            }
+            gosubSites.push_back(node + 1);
+            break;
+        }
+
+        case ASTNodeType::STMT_ON_EVENT: {
+            // The handler can start at any time; entering it from here keeps
+            // it reachable, and hasAsyncHandlers() covers the rest
+            const auto* s = static_cast<const OnEventStatement*>(stmt);
+            if (s->handlerType == EventHandlerType::CALL) break;
+            m_asyncHandlers = true;
+            int line = s->isLineNumber ? std::atoi(s->target.c_str()) : 0;
+            addFlowEdge(node, resolveTarget(!s->isLineNumber, s->target, line));
+            if (s->handlerType == EventHandlerType::GOSUB) gosubSites.push_back(node + 1);
+            break;
+        }
+
+        case ASTNodeType::STMT_RETURN:
+            returnNodes.push_back(node);
+            break;
+
+        case ASTNodeType::STMT_END:
+            addFlowEdge(node, m_exitNode);
+            break;
+
+        case ASTNodeType::STMT_IF: {
+            const auto* s = static_cast<const IfStatement*>(stmt);
+            if (s->hasGoto) {
+                addFlowEdge(node, resolveTarget(false, "", s->gotoLine));
+            }
+            for (const auto& inner : s->thenStatements) addJumps(inner.get(), node, loopExits, gosubSites, returnNodes);
+            for (const auto& clause : s->elseIfClauses) {
+                for (const auto& inner : clause.statements) addJumps(inner.get(), node, loopExits, gosubSites, returnNodes);
+            }
+            for (const auto& inner : s->elseStatements) addJumps(inner.get(), node, loopExits, gosubSites, returnNodes);
+            break;
+        }
+
+        case ASTNodeType::STMT_CASE: {
+            const auto* s = static_cast<const CaseStatement*>(stmt);
+            for (const auto& clause : s->whenClauses) {
+                for (const auto& inner : clause.statements) addJumps(inner.get(), node, loopExits, gosubSites, returnNodes);
+            }
+            for (const auto& inner : s->otherwiseStatements) addJumps(inner.get(), node, loopExits, gosubSites, returnNodes);
+            break;
+        }
+
+        case ASTNodeType::STMT_EXIT: {
+            // EXIT FOR/WHILE/DO lands after the innermost loop's closer
+            const auto* s = static_cast<const ExitStatement*>(stmt);
+            if (s->exitType != ExitStatement::ExitType::FUNCTION &&
+                s->exitType != ExitStatement::ExitType::SUB && loopExits) {
+                loopExits->push_back(node);
+            } else {
+                addFlowEdge(node, m_exitNode);
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+void CFGAnalysis::computeOrder() {
+    m_rpo.clear();
+    int n = getNodeCount();
+    m_rpoIndex.assign(n, -1);
+    int entry = m_entryNode;
+    if (entry < 0) return;
+
+    // Iterative DFS; edges to a node still on the stack are retreating edges
+    std::vector<int> state(n, 0);  // 0 = new, 1 = on stack, 2 = done
+    std::vector<std::pair<int, size_t>> stack;
+    std::vector<int> postOrder;
+    stack.push_back({entry, 0});
+    state[entry] = 1;
+    while (!stack.empty()) {
+        auto& [node, next] = stack.back();
+        if (next < m_succ[node].size()) {
+            int succ = m_succ[node][next++];
+            if (state[succ] == 0) {
+                state[succ] = 1;
+                stack.push_back({succ, 0});
+            } else if (state[succ] == 1) {
+                m_retreatingEdges.push_back({node, succ});
+            }
+        } else {
+            state[node] = 2;
+            postOrder.push_back(node);
+            stack.pop_back();
+        }
+    }
+
+    m_rpo.assign(postOrder.rbegin(), postOrder.rend());
+    for (size_t i = 0; i < m_rpo.size(); ++i) m_rpoIndex[m_rpo[i]] = static_cast<int>(i);
+}
+
+// =============================================================================
+// Dataflow Analysis - Dominators and Loops
+// =============================================================================
+
+// Cooper, Harvey & Kennedy's iterative algorithm: near-linear on reducible
+// graphs, which is what structured BASIC produces
+std::vector<int> CFGAnalysis::computeDominators(int root, const std::vector<std::vector<int>>& succ,
+                                                const std::vector<std::vector<int>>& pred) const {
+    int n = getNodeCount();
+    std::vector<int> idom(n, -1);
+    if (root < 0 || root >= n) return idom;
+
+    // Reverse post-order from the root in this direction
+    std::vector<int> order;
+    std::vector<int> index(n, -1);
+    {
+        std::vector<bool> seen(n, false);
+        std::vector<std::pair<int, size_t>> stack;
+        std::vector<int> postOrder;
+        stack.push_back({root, 0});
+        seen[root] = true;
+        while (!stack.empty()) {
+            auto& [node, next] = stack.back();
+            if (next < succ[node].size()) {
+                int s = succ[node][next++];
+                if (!seen[s]) {
+                    seen[s] = true;
+                    stack.push_back({s, 0});
+                }
+            } else {
+                postOrder.push_back(node);
+                stack.pop_back();
+            }
+        }
+        order.assign(postOrder.rbegin(), postOrder.rend());
+        for (size_t i = 0; i < order.size(); ++i) index[order[i]] = static_cast<int>(i);
+    }
+
+    auto intersect = [&](int a, int b) {
+        while (a != b) {
+            while (index[a] > index[b]) a = idom[a];
+            while (index[b] > index[a]) b = idom[b];
+        }
+        return a;
+    };
+
+    idom[root] = root;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 1; i < order.size(); ++i) {
+            int node = order[i];
+            int newIdom = -1;
+            for (int p : pred[node]) {
+                if (index[p] < 0 || idom[p] < 0) continue;
+                newIdom = (newIdom < 0) ? p : intersect(p, newIdom);
+            }
+            if (newIdom >= 0 && idom[node] != newIdom) {
+                idom[node] = newIdom;
+                changed = true;
+            }
+        }
+    }
+
+    idom[root] = -1;
+    return idom;
+}
+
+// Pre/post numbering of a dominator tree so dominance queries are O(1)
+void CFGAnalysis::numberTree(const std::vector<int>& idom, std::vector<int>& pre, std::vector<int>& post) const {
+    int n = getNodeCount();
+    pre.assign(n, -1);
+    post.assign(n, -1);
+    std::vector<std::vector<int>> children(n);
+    std::vector<int> roots;
+    for (int b = 0; b < n; ++b) {
+        if (idom[b] >= 0) children[idom[b]].push_back(b);
+    }
+    // Every node without an idom roots its own tree (the real root, and
+    // nodes the root cannot reach)
+    for (int b = 0; b < n; ++b) {
+        if (idom[b] < 0) roots.push_back(b);
+    }
+
+    int counter = 0;
+    std::vector<std::pair<int, size_t>> stack;
+    for (int root : roots) {
+        stack.push_back({root, 0});
+        pre[root] = counter++;
+        while (!stack.empty()) {
+            auto& [node, next] = stack.back();
+            if (next < children[node].size()) {
+                int child = children[node][next++];
+                pre[child] = counter++;
+                stack.push_back({child, 0});
+            } else {
+                post[node] = counter++;
+                stack.pop_back();
+            }
+        }
+    }
+}
+
+bool CFGAnalysis::dominates(int a, int b) const {
+    if (a < 0 || b < 0 || !isReachable(a) || !isReachable(b)) return false;
+    return m_domPre[a] <= m_domPre[b] && m_domPost[b] <= m_domPost[a];
+}
+
+bool CFGAnalysis::postDominates(int a, int b) const {
+    if (a < 0 || b < 0) return false;
+    if (a != b && m_ipdom[a] < 0 && a != m_exitNode) return false;
+    if (a != b && m_ipdom[b] < 0) return false;
+    return m_pdomPre[a] <= m_pdomPre[b] && m_pdomPost[b] <= m_pdomPost[a];
+}
+
+void CFGAnalysis::computeLoops() {
+    int n = getNodeCount();
+    m_nodeLoop.assign(n, -1);
+
+    // A retreating edge whose target dominates its source is a back edge;
+    // any other retreating edge enters a cycle from the side (irreducible)
+    std::unordered_map<int, int> loopByHeader;
+    for (const auto& [source, target] : m_retreatingEdges) {
+        if (!dominates(target, source)) {
+            m_irreducibleEdges++;
+            continue;
+        }
+        auto it = loopByHeader.find(target);
+        if (it == loopByHeader.end()) {
+            it = loopByHeader.emplace(target, static_cast<int>(m_loops.size())).first;
+            m_loops.emplace_back();
+            m_loops.back().header = target;
+        }
+        m_loops[it->second].latches.push_back(source);
+    }
+
+    // Body: everything that reaches a latch without passing the header
+    std::vector<int> mark(n, -1);
+    for (size_t l = 0; l < m_loops.size(); ++l) {
+        NaturalLoop& loop = m_loops[l];
+        int tag = static_cast<int>(l);
+        mark[loop.header] = tag;
+        loop.nodes.push_back(loop.header);
+        std::vector<int> work;
+        for (int latch : loop.latches) {
+            if (mark[latch] != tag) {
+                mark[latch] = tag;
+                loop.nodes.push_back(latch);
+                work.push_back(latch);
+            }
+        }
+        while (!work.empty()) {
+            int node = work.back();
+            work.pop_back();
+            for (int p : m_pred[node]) {
+                if (mark[p] != tag && isReachable(p)) {
+                    mark[p] = tag;
+                    loop.nodes.push_back(p);
+                    work.push_back(p);
+                }
+            }
+        }
+        std::sort(loop.nodes.begin(), loop.nodes.end());
+        std::sort(loop.latches.begin(), loop.latches.end());
+
+        for (int node : loop.nodes) {
+            for (int s : m_succ[node]) {
+                if (!loop.contains(s)) loop.exits.push_back(s);
+            }
+        }
+        std::sort(loop.exits.begin(), loop.exits.end());
+        loop.exits.erase(std::unique(loop.exits.begin(), loop.exits.end()), loop.exits.end());
+    }
+
+    // Natural loops with distinct headers are nested or disjoint, so visiting
+    // them largest first leaves each node tagged with its innermost loop and
+    // finds each loop's parent on its header
+    std::vector<int> bySize(m_loops.size());
+    for (size_t l = 0; l < bySize.size(); ++l) bySize[l] = static_cast<int>(l);
+    std::stable_sort(bySize.begin(), bySize.end(), [&](int a, int b) {
+        return m_loops[a].nodes.size() > m_loops[b].nodes.size();
+    });
+    for (int l : bySize) {
+        NaturalLoop& loop = m_loops[l];
+        loop.parent = m_nodeLoop[loop.header];
+        if (loop.parent >= 0) {
+            loop.depth = m_loops[loop.parent].depth + 1;
+            m_loops[loop.parent].children.push_back(l);
+        }
+        for (int node : loop.nodes) m_nodeLoop[node] = l;
+    }
+}
+
+int CFGAnalysis::loopDepth(int node) const {
+    int loop = m_nodeLoop[node];
+    return loop >= 0 ? m_loops[loop].depth : 0;
+}
+
+// =============================================================================
+// Dataflow Analysis - Variable Access
+// =============================================================================
+
+int CFGAnalysis::internVariable(const std::string& name) {
+    auto it = m_variableIndex.find(name);
+    if (it != m_variableIndex.end()) return it->second;
+    int index = static_cast<int>(m_variables.size());
+    m_variables.push_back(name);
+    m_variableIndex.emplace(name, index);
+    return index;
+}
+
+int CFGAnalysis::variableIndex(const std::string& name) const {
+    auto it = m_variableIndex.find(name);
+    return it != m_variableIndex.end() ? it->second : -1;
+}
+
+void CFGAnalysis::noteUse(int node, const std::string& name) {
+    m_accesses[node].push_back({internVariable(name), -1});
+}
+
+void CFGAnalysis::noteDef(int node, const std::string& name, bool conditional, const Statement* topLevel,
+                          int lineNumber) {
+    VariableDefinition def;
+    def.id = static_cast<int>(m_definitions.size());
+    def.node = node;
+    def.variable = internVariable(name);
+    def.statement = topLevel;
+    def.lineNumber = lineNumber;
+    def.conditional = conditional;
+    m_definitions.push_back(def);
+    m_accesses[node].push_back({def.variable, def.id});
+}
+
+void CFGAnalysis::scanAccesses() {
+    int n = getNodeCount();
+    m_accesses.assign(n, {});
+    m_callsUser.assign(n, false);
+    m_scanForVars.clear();
+    for (const FlowNode& node : m_nodes) {
+        const BasicBlock* block = m_cfg.getBlock(node.blockId);
+        for (int i = node.firstStatement; i < node.endStatement; ++i) {
+            const Statement* stmt = block->statements[i];
+            scanStatement(stmt, node.id, block->getLineNumber(stmt), false, stmt);
+        }
+    }
+}
+
+// Record reads before writes, in evaluation order. Arrays are tracked as a
+// whole: an element store reads the array and never kills it.
+void CFGAnalysis::scanStatement(const Statement* stmt, int node, int lineNumber, bool conditional,
+                                const Statement* topLevel) {
+    auto expr = [&](const ExpressionPtr& e) { scanExpression(e.get(), node); };
+    auto def = [&](const std::string& name) { noteDef(node, name, conditional, topLevel, lineNumber); };
+    auto body = [&](const std::vector<StatementPtr>& statements) {
+        for (const auto& inner : statements) {
+            scanStatement(inner.get(), node, lineNumber, true, topLevel);
+        }
+    };
+
+    switch (stmt->getType()) {
+        case ASTNodeType::STMT_LET: {
+            const auto* s = static_cast<const LetStatement*>(stmt);
+            for (const auto& index : s->indices) expr(index);
+            expr(s->value);
+            if (s->indices.empty()) {
+                def(s->variable);
+            } else {
+                noteUse(node, s->variable + "()");
+                noteDef(node, s->variable + "()", true, topLevel, lineNumber);
+            }
+            break;
+        }
+
+        case ASTNodeType::STMT_MID_ASSIGN: {
+            const auto* s = static_cast<const MidAssignStatement*>(stmt);
+            expr(s->position);
+            expr(s->length);
+            expr(s->replacement);
+            noteUse(node, s->variable);
+            def(s->variable);
+            break;
+        }
+
+        case ASTNodeType::STMT_PRINT: {
+            const auto* s = static_cast<const PrintStatement*>(stmt);
+            for (const auto& item : s->items) expr(item.expr);
+            expr(s->formatExpr);
+            for (const auto& value : s->usingValues) expr(value);
+            break;
+        }
+
+        case ASTNodeType::STMT_CONSOLE: {
+            const auto* s = static_cast<const ConsoleStatement*>(stmt);
+            for (const auto& item : s->items) expr(item.expr);
+            break;
+        }
+
+        case ASTNodeType::STMT_PRINT_AT: {
+            const auto* s = static_cast<const PrintAtStatement*>(stmt);
+            expr(s->x);
+            expr(s->y);
+            for (const auto& item : s->items) expr(item.expr);
+            expr(s->fg);
+            expr(s->bg);
+            expr(s->formatExpr);
+            for (const auto& value : s->usingValues) expr(value);
+            break;
+        }
+
+        case ASTNodeType::STMT_INPUT: {
+            const auto* s = static_cast<const InputStatement*>(stmt);
+            for (const auto& name : s->variables) def(name);
+            break;
+        }
+
+        case ASTNodeType::STMT_INPUT_AT: {
+            const auto* s = static_cast<const InputAtStatement*>(stmt);
+            expr(s->x);
+            expr(s->y);
+            expr(s->fgColor);
+            expr(s->bgColor);
+            def(s->variable);
+            break;
+        }
+
+        case ASTNodeType::STMT_READ: {
+            const auto* s = static_cast<const ReadStatement*>(stmt);
+            for (const auto& name : s->variables) def(name);
+            break;
+        }
+
+        case ASTNodeType::STMT_IF: {
+            const auto* s = static_cast<const IfStatement*>(stmt);
+            expr(s->condition);
+            body(s->thenStatements);
+            for (const auto& clause : s->elseIfClauses) {
+                expr(clause.condition);
+                body(clause.statements);
+            }
+            body(s->elseStatements);
+            break;
+        }
+
+        case ASTNodeType::STMT_CASE: {
+            const auto* s = static_cast<const CaseStatement*>(stmt);
+            expr(s->caseExpression);
+            for (const auto& clause : s->whenClauses) {
+                for (const auto& value : clause.values) expr(value);
+                body(clause.statements);
+            }
+            body(s->otherwiseStatements);
+            break;
+        }
+
+        case ASTNodeType::STMT_FOR: {
+            const auto* s = static_cast<const ForStatement*>(stmt);
+            expr(s->start);
+            expr(s->end);
+            expr(s->step);
+            def(s->variable);
+            m_scanForVars.push_back(s->variable);
+            break;
+        }
+
+        case ASTNodeType::STMT_FOR_IN: {
+            const auto* s = static_cast<const ForInStatement*>(stmt);
+            expr(s->array);
+            def(s->variable);
+            if (!s->indexVariable.empty()) def(s->indexVariable);
+            m_scanForVars.push_back(s->variable);
+            break;
+        }
+
+        case ASTNodeType::STMT_NEXT: {
+            // NEXT steps the loop variable: a read and a write
+            const auto* s = static_cast<const NextStatement*>(stmt);
+            std::string variable = s->variable;
+            if (!m_scanForVars.empty()) {
+                if (variable.empty()) variable = m_scanForVars.back();
+                m_scanForVars.pop_back();
+            }
+            if (!variable.empty()) {
+                noteUse(node, variable);
+                def(variable);
+            }
+            break;
+        }
+
+        case ASTNodeType::STMT_WHILE:
+            expr(static_cast<const WhileStatement*>(stmt)->condition);
+            break;
+
+        case ASTNodeType::STMT_UNTIL:
+            expr(static_cast<const UntilStatement*>(stmt)->condition);
+            break;
+
+        case ASTNodeType::STMT_DO:
+            expr(static_cast<const DoStatement*>(stmt)->condition);
+            break;
+
+        case ASTNodeType::STMT_LOOP:
+            expr(static_cast<const LoopStatement*>(stmt)->condition);
+            break;
+
+        case ASTNodeType::STMT_DIM: {
+            const auto* s = static_cast<const DimStatement*>(stmt);
+            for (const auto& array : s->arrays) {
+                for (const auto& dimension : array.dimensions) expr(dimension);
+                def(array.name + "()");
+            }
+            break;
+        }
+
+        case ASTNodeType::STMT_LOCAL: {
+            const auto* s = static_cast<const LocalStatement*>(stmt);
+            for (const auto& local : s->variables) {
+                expr(local.initialValue);
+                def(local.name);
+            }
+            break;
+        }
+
+        case ASTNodeType::STMT_ON_GOTO:
+            expr(static_cast<const OnGotoStatement*>(stmt)->selector);
+            break;
+
+        case ASTNodeType::STMT_ON_GOSUB:
+            expr(static_cast<const OnGosubStatement*>(stmt)->selector);
+            break;
+
+        case ASTNodeType::STMT_ON_CALL:
+            expr(static_cast<const OnCallStatement*>(stmt)->selector);
+            m_callsUser[node] = true;
+            break;
+
+        case ASTNodeType::STMT_RETURN:
+            expr(static_cast<const ReturnStatement*>(stmt)->returnValue);
+            break;
+
+        case ASTNodeType::STMT_CALL: {
+            const auto* s = static_cast<const CallStatement*>(stmt);
+            for (const auto& arg : s->arguments) expr(arg);
+            m_callsUser[node] = true;
+            break;
+        }
+
+        case ASTNodeType::STMT_CONSTANT:
+            expr(static_cast<const ConstantStatement*>(stmt)->value);
+            break;
+
+        case ASTNodeType::STMT_PLAY: {
+            const auto* s = static_cast<const PlayStatement*>(stmt);
+            expr(s->filename);
+            expr(s->wavOutput);
+            expr(s->slotNumber);
+            break;
+        }
+
+        case ASTNodeType::STMT_PLAY_SOUND: {
+            const auto* s = static_cast<const PlaySoundStatement*>(stmt);
+            expr(s->soundId);
+            expr(s->volume);
+            expr(s->capDuration);
+            break;
+        }
+
+        // No variable access (FUNCTION/SUB/DEF bodies are separate scopes)
+        case ASTNodeType::STMT_GOTO:
+        case ASTNodeType::STMT_GOSUB:
+        case ASTNodeType::STMT_LABEL:
+        case ASTNodeType::STMT_EXIT:
+        case ASTNodeType::STMT_END:
+        case ASTNodeType::STMT_WEND:
+        case ASTNodeType::STMT_REPEAT:
+        case ASTNodeType::STMT_REM:
+        case ASTNodeType::STMT_OPTION:
+        case ASTNodeType::STMT_DATA:
+        case ASTNodeType::STMT_RESTORE:
+        case ASTNodeType::STMT_OPEN:
+        case ASTNodeType::STMT_CLOSE:
+        case ASTNodeType::STMT_ON_EVENT:
+        case ASTNodeType::STMT_FUNCTION:
+        case ASTNodeType::STMT_SUB:
+        case ASTNodeType::STMT_DEF:
+            break;
+
+        default:
+            if (const auto* s = dynamic_cast<const ExpressionStatement*>(stmt)) {
+                for (const auto& arg : s->arguments) expr(arg);
+            } else if (!dynamic_cast<const SimpleStatement*>(stmt)) {
+                // Unknown statement shape: assume it may read anything
+                m_callsUser[node] = true;
+            }
+            break;
+    }
+}
+
+void CFGAnalysis::scanExpression(const Expression* expr, int node) {
+    if (!expr) return;
+
+    switch (expr->getType()) {
+        case ASTNodeType::EXPR_BINARY: {
+            const auto* e = static_cast<const BinaryExpression*>(expr);
+            scanExpression(e->left.get(), node);
+            scanExpression(e->right.get(), node);
+            break;
+        }
+
+        case ASTNodeType::EXPR_UNARY:
+            scanExpression(static_cast<const UnaryExpression*>(expr)->expr.get(), node);
+            break;
+
+        case ASTNodeType::EXPR_VARIABLE:
+            noteUse(node, static_cast<const VariableExpression*>(expr)->name);
+            break;
+
+        case ASTNodeType::EXPR_ARRAY_ACCESS: {
+            const auto* e = static_cast<const ArrayAccessExpression*>(expr);
+            for (const auto& index : e->indices) scanExpression(index.get(), node);
+            noteUse(node, e->name + "()");
+            break;
+        }
+
+        case ASTNodeType::EXPR_FUNCTION_CALL:
+            if (const auto* e = dynamic_cast<const FunctionCallExpression*>(expr)) {
+                for (const auto& arg : e->arguments) scanExpression(arg.get(), node);
+                if (e->isFN || (m_symbols && m_symbols->functions.count(e->name))) {
+                    m_callsUser[node] = true;
+                }
+            } else if (const auto* e = dynamic_cast<const RegistryFunctionExpression*>(expr)) {
+                for (const auto& arg : e->arguments) scanExpression(arg.get(), node);
+            }
+            break;
+
+        case ASTNodeType::EXPR_IIF: {
+            const auto* e = static_cast<const IIFExpression*>(expr);
+            scanExpression(e->condition.get(), node);
+            scanExpression(e->trueValue.get(), node);
+            scanExpression(e->falseValue.get(), node);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+// =============================================================================
+// Dataflow Analysis - Liveness and Reaching Definitions
+// =============================================================================
+
+void CFGAnalysis::computeLiveness() {
+    int n = getNodeCount();
+    size_t varCount = m_variables.size();
+    m_liveIn.assign(n, DataflowBitset(varCount));
+    m_liveOut.assign(n, DataflowBitset(varCount));
+
+    if (m_asyncHandlers) {
+        for (int node = 0; node < n; ++node) {
+            m_liveIn[node].setAll();
+            m_liveOut[node].setAll();
+        }
+        return;
+    }
+
+    // use = read before any killing write; def = killed by the node
+    std::vector<DataflowBitset> use(n, DataflowBitset(varCount));
+    std::vector<DataflowBitset> def(n, DataflowBitset(varCount));
+    for (int node = 0; node < n; ++node) {
+        if (m_callsUser[node]) use[node].setAll();
+        for (const Access& access : m_accesses[node]) {
+            if (access.definition < 0) {
+                if (!def[node].test(access.variable)) use[node].set(access.variable);
+            } else if (!m_definitions[access.definition].conditional) {
+                def[node].set(access.variable);
+            }
+        }
+    }
+
+    // Backward problem: visit in post-order (reverse RPO), unreachable nodes last
+    std::vector<int> order(m_rpo.rbegin(), m_rpo.rend());
+    for (int node = 0; node < n; ++node) {
+        if (!isReachable(node)) order.push_back(node);
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int node : order) {
+            DataflowBitset out(varCount);
+            for (int s : m_succ[node]) out.unionWith(m_liveIn[s]);
+            m_liveOut[node] = out;
+            out.subtract(def[node]);
+            out.unionWith(use[node]);
+            if (out != m_liveIn[node]) {
+                m_liveIn[node] = out;
+                changed = true;
+            }
+        }
+    }
+}
+
+// Reaching definitions are found the way SSA construction finds values:
+// joins are placed at the iterated dominance frontier of each variable's
+// definitions, one walk of the dominator tree names the value live at every
+// access, and each join is then expanded to the definitions behind it. This
+// stays near-linear where a set-per-node dataflow would be quadratic.
+void CFGAnalysis::computeReachingDefinitions() {
+    int n = getNodeCount();
+    size_t varCount = m_variables.size();
+    int defCount = static_cast<int>(m_definitions.size());
+    m_reaching.assign(n, {});
+
+    // An ON EVENT handler may run anywhere, so every definition reaches
+    if (m_asyncHandlers) {
+        std::vector<std::vector<int>> variableDefs(varCount);
+        for (const VariableDefinition& def : m_definitions) variableDefs[def.variable].push_back(def.id);
+        for (int node = 0; node < n; ++node) {
+            for (const Access& access : m_accesses[node]) {
+                auto& sets = m_reaching[node];
+                if (sets.empty() || sets.back().variable != access.variable) {
+                    sets.push_back({access.variable, variableDefs[access.variable]});
+                }
+            }
+            std::sort(m_reaching[node].begin(), m_reaching[node].end(),
+                      [](const ReachingSet& a, const ReachingSet& b) { return a.variable < b.variable; });
+            m_reaching[node].erase(std::unique(m_reaching[node].begin(), m_reaching[node].end(),
+                                               [](const ReachingSet& a, const ReachingSet& b) {
+                                                   return a.variable == b.variable;
+                                               }), m_reaching[node].end());
+        }
+        return;
+    }
+
+    // Dominance frontiers (Cooper, Harvey & Kennedy)
+    std::vector<std::vector<int>> frontier(n);
+    for (int node = 0; node < n; ++node) {
+        if (!isReachable(node) || m_pred[node].size() < 2) continue;
+        for (int p : m_pred[node]) {
+            if (!isReachable(p)) continue;
+            for (int runner = p; runner >= 0 && runner != m_idom[node]; runner = m_idom[runner]) {
+                auto& df = frontier[runner];
+                if (df.empty() || df.back() != node) df.push_back(node);
+            }
+        }
+    }
+
+    // Values: 0..defCount-1 are definitions, defCount + j is join j, and -1
+    // means nothing reaches. A join's value is the union of its arguments.
+    std::vector<std::vector<int>> joinArgs;
+    std::vector<std::vector<std::pair<int, int>>> nodeJoins(n);  // (variable, join) at node entry
+
+    std::vector<std::vector<int>> defNodes(varCount);
+    for (int node = 0; node < n; ++node) {
+        if (!isReachable(node)) continue;
+        for (const Access& access : m_accesses[node]) {
+            if (access.definition < 0) continue;
+            auto& nodes = defNodes[access.variable];
+            if (nodes.empty() || nodes.back() != node) nodes.push_back(node);
+        }
+    }
+    std::vector<int> placed(n, -1);
+    std::vector<int> work;
+    for (size_t v = 0; v < varCount; ++v) {
+        int variable = static_cast<int>(v);
+        work = defNodes[v];
+        while (!work.empty()) {
+            int node = work.back();
+            work.pop_back();
+            for (int f : frontier[node]) {
+                if (placed[f] == variable) continue;
+                placed[f] = variable;
+                nodeJoins[f].push_back({variable, static_cast<int>(joinArgs.size())});
+                joinArgs.emplace_back();
+                work.push_back(f);
+            }
+        }
+    }
+
+    // Dominator-tree walk with a stack of current values per variable
+    std::vector<std::vector<int>> children(n);
+    for (int node = 0; node < n; ++node) {
+        if (m_idom[node] >= 0) children[m_idom[node]].push_back(node);
+    }
+    std::vector<std::vector<int>> current(varCount);
+    std::vector<int> pushed;  // Variables pushed, in order, for unwinding
+    auto top = [&](int variable) { return current[variable].empty() ? -1 : current[variable].back(); };
+    auto push = [&](int variable, int value) {
+        current[variable].push_back(value);
+        pushed.push_back(variable);
+    };
+
+    std::vector<std::vector<std::pair<int, int>>> entryValues(n);  // (variable, value) per access node
+    std::vector<int> seen(varCount, -1);
+    std::vector<std::pair<int, size_t>> stack;  // (node, unwind mark); node < 0 marks exit
+    if (m_entryNode >= 0) stack.push_back({m_entryNode, 0});
+    while (!stack.empty()) {
+        auto [node, mark] = stack.back();
+        stack.pop_back();
+        if (node < 0) {
+            while (pushed.size() > mark) {
+                current[pushed.back()].pop_back();
+                pushed.pop_back();
+            }
+            continue;
+        }
+
+        size_t unwind = pushed.size();
+        for (const auto& [variable, join] : nodeJoins[node]) push(variable, defCount + join);
+
+        for (const Access& access : m_accesses[node]) {
+            if (seen[access.variable] != node) {
+                seen[access.variable] = node;
+                entryValues[node].push_back({access.variable, top(access.variable)});
+            }
+            if (access.definition < 0) continue;
+            if (m_definitions[access.definition].conditional) {
+                // Either this definition or whatever was there before
+                joinArgs.push_back({access.definition, top(access.variable)});
+                push(access.variable, defCount + static_cast<int>(joinArgs.size()) - 1);
+            } else {
+                push(access.variable, access.definition);
+            }
+        }
+
+        for (int s : m_succ[node]) {
+            for (const auto& [variable, join] : nodeJoins[s]) joinArgs[join].push_back(top(variable));
+        }
+
+        stack.push_back({-1, unwind});
+        for (int child : children[node]) stack.push_back({child, 0});
+    }
+
+    // Expand joins to definition sets. Joins form cycles around loops, so
+    // each strongly connected component (Tarjan) shares one set.
+    int joinCount = static_cast<int>(joinArgs.size());
+    std::vector<int> order(joinCount, -1), low(joinCount, 0), component(joinCount, -1);
+    std::vector<bool> onStack(joinCount, false);
+    std::vector<int> tarjan;
+    std::vector<std::vector<int>> componentDefs;
+    int counter = 0;
+
+    auto expand = [&](int root) {
+        std::vector<std::pair<int, size_t>> dfs;  // (join, next argument)
+        auto enter = [&](int j) {
+            order[j] = low[j] = counter++;
+            tarjan.push_back(j);
+            onStack[j] = true;
+            dfs.push_back({j, 0});
+        };
+        enter(root);
+        while (!dfs.empty()) {
+            auto& [j, next] = dfs.back();
+            if (next < joinArgs[j].size()) {
+                int arg = joinArgs[j][next++];
+                if (arg < defCount) continue;
+                int w = arg - defCount;
+                if (order[w] < 0) {
+                    enter(w);
+                } else if (onStack[w]) {
+                    low[j] = std::min(low[j], order[w]);
+                }
+                continue;
+            }
+
+            int finished = j;
+            dfs.pop_back();
+            if (!dfs.empty()) low[dfs.back().first] = std::min(low[dfs.back().first], low[finished]);
+            if (low[finished] != order[finished]) continue;
+
+            int id = static_cast<int>(componentDefs.size());
+            std::vector<int> members;
+            int member;
+            do {
+                member = tarjan.back();
+                tarjan.pop_back();
+                onStack[member] = false;
+                component[member] = id;
+                members.push_back(member);
+            } while (member != finished);
+
+            std::vector<int> defs;
+            for (int m : members) {
+                for (int arg : joinArgs[m]) {
+                    if (arg < 0) continue;
+                    if (arg < defCount) {
+                        defs.push_back(arg);
+                    } else if (component[arg - defCount] != id) {
+                        const auto& inner = componentDefs[component[arg - defCount]];
+                        defs.insert(defs.end(), inner.begin(), inner.end());
+                    }
+                }
+            }
+            std::sort(defs.begin(), defs.end());
+            defs.erase(std::unique(defs.begin(), defs.end()), defs.end());
+            componentDefs.push_back(std::move(defs));
+        }
+    };
+
+    for (int node = 0; node < n; ++node) {
+        auto& values = entryValues[node];
+        std::sort(values.begin(), values.end());
+        for (const auto& [variable, value] : values) {
+            ReachingSet set;
+            set.variable = variable;
+            if (value >= defCount) {
+                int join = value - defCount;
+                if (order[join] < 0) expand(join);
+                set.definitions = componentDefs[component[join]];
+            } else if (value >= 0) {
+                set.definitions.push_back(value);
+            }
+            m_reaching[node].push_back(std::move(set));
+        }
+    }
+}
+
+const std::vector<int>& CFGAnalysis::reachingDefinitions(int node, int variable) const {
+    static const std::vector<int> none;
+    const auto& sets = m_reaching[node];
+    auto it = std::lower_bound(sets.begin(), sets.end(), variable,
+                               [](const ReachingSet& set, int v) { return set.variable < v; });
+    return (it != sets.end() && it->variable == variable) ? it->definitions : none;
+}
+
+bool CFGAnalysis::isLiveIn(int node, const std::string& name) const {
+    int index = variableIndex(name);
+    return index >= 0 && m_liveIn[node].test(index);
+}
+
+bool CFGAnalysis::isLiveOut(int node, const std::string& name) const {
+    int index = variableIndex(name);
+    return index >= 0 && m_liveOut[node].test(index);
+}
+
+// =============================================================================
+// Dataflow Analysis - Report
+// =============================================================================
+
+std::string CFGAnalysis::formatVariableSet(const DataflowBitset& set) const {
+    std::ostringstream oss;
+    oss << "{";
+    bool first = true;
+    for (size_t i = 0; i < set.size(); ++i) {
+        if (!set.test(i)) continue;
+        if (!first) oss << ", ";
+        oss << m_variables[i];
+        first = false;
+    }
+    oss << "}";
+    return oss.str();
+}
+
+std::string CFGAnalysis::generateReport() const {
+    std::ostringstream oss;
+    int n = getNodeCount();
+
+    int maxDepth = 0;
+    for (const auto& loop : m_loops) maxDepth = std::max(maxDepth, loop.depth);
+
+    oss << "Dataflow Analysis:\n";
+    oss << "  Flow Nodes: " << n << " (from " << m_cfg.getBlockCount() << " blocks)\n";
+    oss << "  Reachable Nodes: " << m_rpo.size() << "\n";
+    oss << "  Natural Loops: " << m_loops.size() << " (max depth " << maxDepth << ")\n";
+    oss << "  Irreducible Edges: " << m_irreducibleEdges << "\n";
+    oss << "  Variables Tracked: " << m_variables.size() << "\n";
+    oss << "  Definitions: " << m_definitions.size() << "\n";
+    if (m_asyncHandlers) {
+        oss << "  ON EVENT GOTO/GOSUB present: liveness and reaching definitions are fully conservative\n";
+    }
+    oss << "\n";
+
+    oss << "Flow Nodes:\n";
+    for (const FlowNode& node : m_nodes) {
+        if (node.id == m_returnJoinNode) {
+            oss << "  Node " << node.id << ": RETURN join";
+        } else {
+            oss << "  Node " << node.id << ": Block " << node.blockId;
+        }
+        if (node.endStatement > node.firstStatement) {
+            oss << " [" << node.firstStatement << ".." << node.endStatement - 1 << "]";
+        }
+        if (!isReachable(node.id)) {
+            oss << ", unreachable\n";
+            continue;
+        }
+        oss << ", idom " << (m_idom[node.id] >= 0 ? std::to_string(m_idom[node.id]) : "-");
+        oss << ", ipdom " << (m_ipdom[node.id] >= 0 ? std::to_string(m_ipdom[node.id]) : "-");
+        oss << ", loop depth " << loopDepth(node.id);
+        if (!m_succ[node.id].empty()) {
+            oss << ", ->";
+            for (int s : m_succ[node.id]) oss << " " << s;
+        }
+        oss << "\n";
+    }
+    oss << "\n";
+
+    if (!m_loops.empty()) {
+        oss << "Loop Forest:\n";
+        // Depth-first from the outermost loops
+        std::vector<std::pair<int, int>> stack;  // (loop, indent)
+        for (int l = static_cast<int>(m_loops.size()) - 1; l >= 0; --l) {
+            if (m_loops[l].parent < 0) stack.push_back({l, 1});
+        }
+        while (!stack.empty()) {
+            auto [l, indent] = stack.back();
+            stack.pop_back();
+            const NaturalLoop& loop = m_loops[l];
+            oss << std::string(indent * 2, ' ') << "Loop " << l << ": header Node " << loop.header
+                << ", depth " << loop.depth << ", " << loop.nodes.size() << " nodes, latches";
+            for (int latch : loop.latches) oss << " " << latch;
+            oss << ", exits";
+            for (int exitNode : loop.exits) oss << " " << exitNode;
+            oss << "\n";
+            for (auto it = loop.children.rbegin(); it != loop.children.rend(); ++it) {
+                stack.push_back({*it, indent + 1});
+            }
+        }
+        oss << "\n";
+    }
+
+    oss << "Liveness:\n";
+    for (int node = 0; node < n; ++node) {
+        if (m_liveIn[node].count() == 0 && m_liveOut[node].count() == 0) continue;
+        oss << "  Node " << node << ": in " << formatVariableSet(m_liveIn[node])
+            << ", out " << formatVariableSet(m_liveOut[node]) << "\n";
+    }
+    oss << "\n";
+
+    oss << "Reaching Definitions:\n";
+    for (int node = 0; node < n; ++node) {
+        if (m_reaching[node].empty()) continue;
+        oss << "  Node " << node << ":";
+        for (const ReachingSet& set : m_reaching[node]) {
+            oss << " " << m_variables[set.variable] << " <-";
+            if (set.definitions.empty()) oss << " (none)";
+            for (int d : set.definitions) oss << " " << m_definitions[d].lineNumber;
+            oss << ";";
+        }
+        oss << "\n";
+    }
+    oss << "\n";
+
+    return oss.str();
+}
+
 // =============================================================================
 // Report Generation
 // =============================================================================
@@ -675,6 +2113,11 @@ std::string CFGBuilder::generateReport(const ControlFlowGraph& cfg) const {
     oss << "  Return: " << returnEdges << "\n";
     oss << "\n";
     
+    // Dominators, loops, liveness and reaching definitions
+    CFGAnalysis analysis(cfg, m_symbols);
+    analysis.run();
+    oss << analysis.generateReport();
+
     // Full CFG details
     oss << cfg.toString();
     
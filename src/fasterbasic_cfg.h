@@ -17,8 +17,11 @@
 #include <map>
 #include <set>
 #include <unordered_map>
+#include <unordered_set>
 #include <memory>
 #include <sstream>
+#include <algorithm>
+#include <cstdint>
 
 namespace FasterBASIC {
 
@@ -377,6 +380,254 @@ public:
     }
 };
 
+// =============================================================================
+// Dataflow Analysis
+// =============================================================================
+//
+// CFGAnalysis runs the classic analyses over a built ControlFlowGraph:
+// dominators and post-dominators, the natural-loop forest, reaching
+// definitions and variable liveness. Optimizers construct one, call run(),
+// and query the results by flow node.
+//
+// The CFG only starts blocks at numbered jump targets and loop openers, so
+// symbolic GOTO targets, GOSUB return points and loop closers can fall in the
+// middle of a block. The analyses therefore run on flow nodes: each block is
+// split wherever control can enter or leave it part way through, and the
+// edges the CFG leaves implicit (loop back edges and skips, label jumps,
+// ON GOTO/GOSUB targets, RETURN to each GOSUB site) are added between nodes.
+// Every RETURN flows into one synthetic return-join node that belongs to no
+// block and leads to each GOSUB site. The CFG itself is not modified.
+// Per-block results are read at a block's firstNode (entry) or lastNode (exit).
+
+// Fixed-size bitset for per-node variable sets
+class DataflowBitset {
+public:
+    DataflowBitset() : m_size(0) {}
+    explicit DataflowBitset(size_t size) : m_size(size), m_words((size + 63) / 64, 0) {}
+
+    size_t size() const { return m_size; }
+
+    void set(size_t i) { m_words[i / 64] |= (uint64_t(1) << (i % 64)); }
+    void reset(size_t i) { m_words[i / 64] &= ~(uint64_t(1) << (i % 64)); }
+    bool test(size_t i) const { return (m_words[i / 64] >> (i % 64)) & 1; }
+
+    void setAll() {
+        for (auto& word : m_words) word = ~uint64_t(0);
+        if (m_size % 64) m_words.back() &= (uint64_t(1) << (m_size % 64)) - 1;
+    }
+
+    // this |= other; returns true if any bit was added
+    bool unionWith(const DataflowBitset& other) {
+        bool changed = false;
+        for (size_t i = 0; i < m_words.size(); ++i) {
+            uint64_t merged = m_words[i] | other.m_words[i];
+            changed |= (merged != m_words[i]);
+            m_words[i] = merged;
+        }
+        return changed;
+    }
+
+    // this &= ~other
+    void subtract(const DataflowBitset& other) {
+        for (size_t i = 0; i < m_words.size(); ++i) m_words[i] &= ~other.m_words[i];
+    }
+
+    size_t count() const {
+        size_t n = 0;
+        for (uint64_t word : m_words) n += __builtin_popcountll(word);
+        return n;
+    }
+
+    bool operator==(const DataflowBitset& other) const { return m_words == other.m_words; }
+    bool operator!=(const DataflowBitset& other) const { return m_words != other.m_words; }
+
+private:
+    size_t m_size;
+    std::vector<uint64_t> m_words;
+};
+
+// A straight-line run of statements within one block: control enters only
+// at the first statement and leaves only after the last
+struct FlowNode {
+    int id;
+    int blockId;         // -1 for the synthetic return-join node
+    int firstStatement;  // Index into the block's statements
+    int endStatement;    // One past the last statement (== firstStatement if empty)
+};
+
+// A natural loop: a header plus every node that reaches a back edge to it
+struct NaturalLoop {
+    int header;                 // Loop header node
+    std::vector<int> nodes;     // Loop body, sorted, including the header
+    std::vector<int> latches;   // Sources of back edges to the header
+    std::vector<int> exits;     // Nodes outside the loop with a predecessor inside it
+    int parent;                 // Index of the enclosing loop, -1 if outermost
+    std::vector<int> children;  // Indices of directly nested loops
+    int depth;                  // Nesting depth, 1 for outermost loops
+
+    NaturalLoop() : header(-1), parent(-1), depth(1) {}
+
+    bool contains(int node) const {
+        return std::binary_search(nodes.begin(), nodes.end(), node);
+    }
+};
+
+// One assignment to a variable, as seen by reaching definitions
+struct VariableDefinition {
+    int id;                      // Index into CFGAnalysis::getDefinitions()
+    int node;                    // Flow node containing the assignment
+    int variable;                // Index into CFGAnalysis::getVariables()
+    const Statement* statement;  // Top-level statement containing the assignment
+    int lineNumber;              // BASIC line number (0 if unknown)
+    bool conditional;            // Inside IF/CASE, or an array element: never kills
+};
+
+class CFGAnalysis {
+public:
+    CFGAnalysis(const ControlFlowGraph& cfg, const SymbolTable* symbols = nullptr);
+
+    // Run every analysis; near-linear in nodes + edges for structured code
+    void run();
+
+    // Flow nodes and the edges between them
+    int getNodeCount() const { return static_cast<int>(m_nodes.size()); }
+    const FlowNode& getNode(int node) const { return m_nodes[node]; }
+    int firstNode(int blockId) const { return m_blockFirstNode[blockId]; }
+    int lastNode(int blockId) const { return m_blockFirstNode[blockId + 1] - 1; }
+    int nodeForStatement(int blockId, int statementIndex) const;
+    int entryNode() const { return m_entryNode; }
+    int exitNode() const { return m_exitNode; }
+    int returnJoinNode() const { return m_returnJoinNode; }  // -1 if no RETURN reaches a GOSUB site
+
+    const std::vector<int>& successors(int node) const { return m_succ[node]; }
+    const std::vector<int>& predecessors(int node) const { return m_pred[node]; }
+    bool isReachable(int node) const { return m_rpoIndex[node] >= 0; }
+    const std::vector<int>& reversePostOrder() const { return m_rpo; }
+
+    // Dominators (-1 for the entry/exit node and for unreachable nodes)
+    int immediateDominator(int node) const { return m_idom[node]; }
+    int immediatePostDominator(int node) const { return m_ipdom[node]; }
+    bool dominates(int a, int b) const;
+    bool postDominates(int a, int b) const;
+
+    // Natural-loop forest
+    const std::vector<NaturalLoop>& getLoops() const { return m_loops; }
+    int innermostLoop(int node) const { return m_nodeLoop[node]; }
+    int loopDepth(int node) const;
+    int getIrreducibleEdgeCount() const { return m_irreducibleEdges; }
+
+    // Variables: scalars by name, whole arrays as "NAME()"
+    const std::vector<std::string>& getVariables() const { return m_variables; }
+    int variableIndex(const std::string& name) const;
+
+    // Liveness (bitsets over getVariables()); by block, use firstNode/lastNode
+    const DataflowBitset& liveIn(int node) const { return m_liveIn[node]; }
+    const DataflowBitset& liveOut(int node) const { return m_liveOut[node]; }
+    bool isLiveIn(int node, const std::string& name) const;
+    bool isLiveOut(int node, const std::string& name) const;
+
+    // Reaching definitions as use-def chains: the definitions of a variable
+    // that reach the entry of a node which reads or writes it (sorted IDs).
+    // Nodes that do not touch the variable keep no set, so the cost grows
+    // with program size rather than with nodes x definitions.
+    const std::vector<VariableDefinition>& getDefinitions() const { return m_definitions; }
+    const std::vector<int>& reachingDefinitions(int node, int variable) const;
+
+    // True when the node calls a FUNCTION, SUB or DEF FN. Such a call may read
+    // any variable (liveness allows for this) or assign one; assignments made
+    // inside the callee are not definitions here, so callers must check.
+    bool callsUserCode(int node) const { return m_callsUser[node]; }
+
+    // True when ON EVENT handlers may run between any two statements; liveness
+    // and reaching definitions are then fully conservative
+    bool hasAsyncHandlers() const { return m_asyncHandlers; }
+
+    std::string generateReport() const;
+
+private:
+    // Flow graph construction
+    void collectJumpTargets(const Statement* stmt);
+    void splitBlocks();
+    void buildFlowGraph();
+    void addFlowEdge(int source, int target);
+    int resolveTarget(bool isLabel, const std::string& label, int lineNumber) const;
+    void addJumps(const Statement* stmt, int node, std::vector<int>* loopExits, std::vector<int>& gosubSites,
+                  std::vector<int>& returnNodes);
+    void computeOrder();
+
+    // Dominators over an arbitrary direction of the flow graph
+    std::vector<int> computeDominators(int root, const std::vector<std::vector<int>>& succ,
+                                       const std::vector<std::vector<int>>& pred) const;
+    void numberTree(const std::vector<int>& idom, std::vector<int>& pre, std::vector<int>& post) const;
+    void computeLoops();
+
+    // Dataflow
+    int internVariable(const std::string& name);
+    void scanAccesses();
+    void scanStatement(const Statement* stmt, int node, int lineNumber, bool conditional,
+                       const Statement* topLevel);
+    void scanExpression(const Expression* expr, int node);
+    void noteUse(int node, const std::string& name);
+    void noteDef(int node, const std::string& name, bool conditional, const Statement* topLevel,
+                 int lineNumber);
+    void computeLiveness();
+    void computeReachingDefinitions();
+
+    std::string formatVariableSet(const DataflowBitset& set) const;
+
+    const ControlFlowGraph& m_cfg;
+    const SymbolTable* m_symbols;
+
+    std::vector<FlowNode> m_nodes;
+    std::vector<int> m_blockFirstNode;  // Per block, plus a sentinel
+    int m_entryNode;
+    int m_exitNode;
+    int m_returnJoinNode;
+
+    // Jump targets, gathered before splitting so each target starts a node
+    std::unordered_set<int> m_targetLines;
+    std::unordered_map<std::string, int> m_labelNodes;
+    std::unordered_map<int, int> m_lineNodes;
+
+    std::vector<std::vector<int>> m_succ;
+    std::vector<std::vector<int>> m_pred;
+    std::vector<int> m_rpo;
+    std::vector<int> m_rpoIndex;      // -1 if unreachable from the entry node
+
+    std::vector<std::pair<int, int>> m_retreatingEdges;  // DFS edges to a node still on the stack
+
+    std::vector<int> m_idom;
+    std::vector<int> m_ipdom;
+    std::vector<int> m_domPre, m_domPost;    // Dominator tree DFS interval per node
+    std::vector<int> m_pdomPre, m_pdomPost;  // Post-dominator tree DFS interval per node
+
+    std::vector<NaturalLoop> m_loops;
+    std::vector<int> m_nodeLoop;      // Innermost loop index per node, -1 if none
+    int m_irreducibleEdges;
+
+    // Per-node access summaries, in statement order
+    struct Access {
+        int variable;
+        int definition;  // -1 for a use
+    };
+    std::vector<std::vector<Access>> m_accesses;
+    std::vector<bool> m_callsUser;    // Calls a FUNCTION/SUB/FN: may read any variable
+    std::vector<std::string> m_scanForVars;  // FOR variables open while scanning, for bare NEXT
+
+    std::vector<std::string> m_variables;
+    std::unordered_map<std::string, int> m_variableIndex;
+    std::vector<VariableDefinition> m_definitions;
+
+    std::vector<DataflowBitset> m_liveIn, m_liveOut;
+
+    struct ReachingSet {
+        int variable;
+        std::vector<int> definitions;
+    };
+    std::vector<std::vector<ReachingSet>> m_reaching;  // Per node, sorted by variable
+    bool m_asyncHandlers;
+};
+
 // =============================================================================
 // CFG Builder
 // =============================================================================
@@ -0,0 +1,208 @@
+//
+// fasterbasic_compile.cpp
+// FasterBASIC - Compile Pipeline Implementation
+//
+
+#include "fasterbasic_compile.h"
+#include "fasterbasic_lexer.h"
+#include "fasterbasic_parser.h"
+#include "fasterbasic_semantic.h"
+#include "fasterbasic_optimizer.h"
+#include "fasterbasic_peephole.h"
+#include "fasterbasic_cfg.h"
+#include "fasterbasic_ircode.h"
+#include "fasterbasic_data_preprocessor.h"
+#include <iostream>
+#include <chrono>
+
+namespace FasterBASIC {
+
+static double millisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+    auto now = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(now - start).count();
+}
+
+bool compileProgram(const std::string& basicSource, const std::string& path,
+                    const CompileSettings& settings, CompiledProgram& program) {
+    bool verbose = settings.verbose;
+
+    // Preprocess REM statements (strip comment text to simplify parsing)
+    if (verbose) {
+        std::cerr << "Preprocessing REM statements...\n";
+    }
+    std::string source = DataPreprocessor::preprocessREM(basicSource);
+
+    // Preprocess line numbers to labels (convert GOTO/GOSUB targets to symbolic labels)
+    if (verbose) {
+        std::cerr << "Converting line numbers to labels...\n";
+    }
+    std::map<int, int> sourceLineNumbers;
+    source = DataPreprocessor::preprocessLineNumbersToLabels(source, &sourceLineNumbers);
+
+    // Lexical analysis
+    auto phaseStartTime = std::chrono::high_resolution_clock::now();
+    if (verbose) {
+        std::cerr << "Lexing...\n";
+    }
+
+    Lexer lexer;
+    lexer.tokenize(source);
+    auto tokens = lexer.getTokens();
+
+    program.times.lexMs = millisecondsSince(phaseStartTime);
+    if (verbose) {
+        std::cerr << "Tokens: " << tokens.size() << "\n";
+    }
+
+    // Parsing
+    phaseStartTime = std::chrono::high_resolution_clock::now();
+    if (verbose) {
+        std::cerr << "Parsing...\n";
+    }
+
+    Parser parser;
+    parser.setSourceLineNumbers(sourceLineNumbers);
+    auto ast = parser.parse(tokens, path);
+
+    program.times.parseMs = millisecondsSince(phaseStartTime);
+
+    // Check for parser errors - if parsing failed, don't continue
+    if (!ast || parser.hasErrors()) {
+        for (const auto& error : parser.getErrors()) {
+            program.parseErrors.push_back(error.toString());
+        }
+        if (program.parseErrors.empty()) {
+            program.parseErrors.push_back("Parsing failed");
+        }
+        return false;
+    }
+
+    // Get compiler options from OPTION statements (collected during parsing)
+    const auto& compilerOptions = parser.getOptions();
+
+    if (verbose) {
+        std::cerr << "Program lines: " << ast->lines.size() << "\n";
+        std::cerr << "Compiler options: arrayBase=" << compilerOptions.arrayBase
+                  << " unicodeMode=" << compilerOptions.unicodeMode << "\n";
+    }
+
+    // Semantic analysis
+    phaseStartTime = std::chrono::high_resolution_clock::now();
+    if (verbose) {
+        std::cerr << "Semantic analysis...\n";
+    }
+
+    SemanticAnalyzer semantic;
+    semantic.analyze(*ast, compilerOptions);
+
+    program.times.semanticMs = millisecondsSince(phaseStartTime);
+
+    if (verbose) {
+        const auto& symTable = semantic.getSymbolTable();
+        size_t varCount = symTable.variables.size();
+        size_t funcCount = symTable.functions.size();
+        size_t labelCount = symTable.lineNumbers.size();
+        std::cerr << "Symbols: " << varCount << " variables, "
+                 << funcCount << " functions, " << labelCount << " labels\n";
+    }
+
+    // AST Optimization (constant folding, dead code, CSE, strength reduction)
+    if (settings.enableASTOptimizer) {
+        phaseStartTime = std::chrono::high_resolution_clock::now();
+        if (verbose) {
+            std::cerr << "Optimizing AST...\n";
+        }
+
+        ASTOptimizer astOptimizer;
+        astOptimizer.setOptimizationLevel(2);
+        astOptimizer.optimize(*ast, semantic.getSymbolTable());
+
+        program.times.astOptMs = millisecondsSince(phaseStartTime);
+
+        if (verbose || settings.showOptStats) {
+            std::cerr << astOptimizer.generateReport();
+        }
+    }
+
+    // Control flow graph
+    phaseStartTime = std::chrono::high_resolution_clock::now();
+    if (verbose) {
+        std::cerr << "Building CFG...\n";
+    }
+
+    CFGBuilder cfgBuilder;
+    auto cfg = cfgBuilder.build(*ast, semantic.getSymbolTable());
+
+    program.times.cfgMs = millisecondsSince(phaseStartTime);
+
+    if (verbose) {
+        std::cerr << "CFG blocks: " << cfg->blocks.size() << "\n";
+    }
+
+    // IR generation
+    phaseStartTime = std::chrono::high_resolution_clock::now();
+    if (verbose) {
+        std::cerr << "Generating IR...\n";
+    }
+
+    IRGenerator irGen;
+    irGen.setThreadCount(settings.threads);
+    auto irCode = irGen.generate(*cfg, semantic.getSymbolTable());
+
+    program.times.irMs = millisecondsSince(phaseStartTime);
+
+    if (verbose) {
+        std::cerr << "IR instructions: " << irCode->instructions.size() << "\n";
+    }
+
+    // Peephole Optimization (IR-level optimizations)
+    if (settings.enablePeepholeOptimizer) {
+        phaseStartTime = std::chrono::high_resolution_clock::now();
+        if (verbose) {
+            std::cerr << "Running peephole optimizer...\n";
+        }
+
+        PeepholeOptimizer peepholeOpt;
+        peepholeOpt.setOptimizationLevel(1);
+        if (settings.inlineBudget >= 0) {
+            peepholeOpt.setInlineBudget(settings.inlineBudget);
+        }
+        peepholeOpt.optimize(*irCode);
+
+        program.times.peepholeMs = millisecondsSince(phaseStartTime);
+
+        if (verbose || settings.showOptStats) {
+            std::cerr << peepholeOpt.generateReport();
+        }
+
+        if (verbose) {
+            std::cerr << "IR instructions after peephole: " << irCode->instructions.size() << "\n";
+        }
+    }
+
+    // Lua code generation
+    phaseStartTime = std::chrono::high_resolution_clock::now();
+    if (verbose) {
+        std::cerr << "Generating Lua code...\n";
+    }
+
+    LuaCodeGenConfig config = settings.config;
+    config.threads = settings.threads;
+    LuaCodeGenerator luaGen(config);
+    program.luaCode = luaGen.generate(*irCode);
+    program.sourceMap = luaGen.getSourceMap();
+
+    program.times.codegenMs = millisecondsSince(phaseStartTime);
+
+    if (verbose) {
+        std::cerr << "Generated Lua size: " << program.luaCode.length() << " bytes\n";
+    }
+
+    program.dataValues = std::move(irCode->dataValues);
+    program.dataLineRestorePoints = std::move(irCode->dataLineRestorePoints);
+    program.dataLabelRestorePoints = std::move(irCode->dataLabelRestorePoints);
+    program.constants = semantic.getConstantsManager();
+    return true;
+}
+
+} // namespace FasterBASIC
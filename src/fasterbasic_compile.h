@@ -0,0 +1,66 @@
+//
+// fasterbasic_compile.h
+// FasterBASIC - Compile Pipeline
+//
+// One program from BASIC source to Lua: preprocess, lex, parse, semantic
+// analysis, AST optimizer, CFG, IR, peephole optimizer and code generation.
+// fbc's single-program mode and --batch both compile through compileProgram().
+//
+
+#ifndef FASTERBASIC_COMPILE_H
+#define FASTERBASIC_COMPILE_H
+
+#include "fasterbasic_lua_codegen.h"
+#include "../runtime/ConstantsManager.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace FasterBASIC {
+
+// =============================================================================
+// Compile Settings and Results
+// =============================================================================
+
+struct CompileSettings {
+    bool verbose = false;         // Progress and sizes on stderr
+    bool showOptStats = false;    // Optimizer reports on stderr
+    bool enableASTOptimizer = false;
+    bool enablePeepholeOptimizer = false;
+    int inlineBudget = -1;        // -1 = pass default
+    int threads = 0;              // Threads compiling SUB/FUNCTION bodies (0 = one per hardware thread)
+    LuaCodeGenConfig config;      // Its thread count is taken from `threads`
+};
+
+// Milliseconds spent in each phase, for --profile
+struct CompilePhaseTimes {
+    double lexMs = 0.0;
+    double parseMs = 0.0;
+    double semanticMs = 0.0;
+    double astOptMs = 0.0;
+    double cfgMs = 0.0;
+    double irMs = 0.0;
+    double peepholeMs = 0.0;
+    double codegenMs = 0.0;
+};
+
+// What running a compiled program needs
+struct CompiledProgram {
+    std::vector<std::string> parseErrors;  // Set when parsing failed; nothing else is
+    std::string luaCode;
+    LuaSourceMap sourceMap;                // Line map, procedures and line counters of luaCode
+    std::vector<std::string> dataValues;
+    std::unordered_map<int, size_t> dataLineRestorePoints;
+    std::unordered_map<std::string, size_t> dataLabelRestorePoints;
+    ConstantsManager constants;
+    CompilePhaseTimes times;
+};
+
+// Compile BASIC source read from `path`. Returns false if parsing failed
+// (program.parseErrors says why); other compile errors are thrown.
+bool compileProgram(const std::string& basicSource, const std::string& path,
+                    const CompileSettings& settings, CompiledProgram& program);
+
+} // namespace FasterBASIC
+
+#endif // FASTERBASIC_COMPILE_H
@@ -0,0 +1,162 @@
+//
+// fasterbasic_coverage.cpp
+// FasterBASIC - Line Execution Counts Implementation
+//
+// The generated program bumps one uint64_t slot per straight-line run of
+// BASIC lines; everything here runs once, after the program has finished,
+// and gives every line the count of its slot. The counters are cdata,
+// which the C API cannot read as numbers, so a few lines of Lua convert
+// them into a plain array first.
+//
+
+#include "fasterbasic_coverage.h"
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <map>
+#include <cstring>
+
+extern "C" {
+#include <lua.h>
+#include <lauxlib.h>
+}
+
+namespace FasterBASIC {
+
+// (counters, n) -> { hits for slot 1..n }
+static const char* const READER_SOURCE =
+    "local counters, n = ...\n"
+    "local hits = {}\n"
+    "for i = 1, n do hits[i] = tonumber(counters[i]) or 0 end\n"
+    "return hits\n";
+
+LineCoverage::LineCoverage() {
+}
+
+bool LineCoverage::collect(lua_State* L, const LuaSourceMap& sourceMap) {
+    m_lines.clear();
+    if (sourceMap.counters.empty()) {
+        m_error = "Program was not compiled with line counters";
+        return false;
+    }
+
+    if (luaL_loadbuffer(L, READER_SOURCE, strlen(READER_SOURCE), "=fbc_coverage") != 0) {
+        m_error = std::string("Cannot read line counters: ") + lua_tostring(L, -1);
+        lua_pop(L, 1);
+        return false;
+    }
+    lua_getglobal(L, LuaSourceMap::COUNTERS_GLOBAL);
+    if (lua_isnil(L, -1)) {
+        m_error = "Program stopped before its line counters were created";
+        lua_pop(L, 2);
+        return false;
+    }
+    lua_pushinteger(L, (lua_Integer)sourceMap.counterSlots);
+    if (lua_pcall(L, 2, 1, 0) != 0) {
+        m_error = std::string("Cannot read line counters: ") + lua_tostring(L, -1);
+        lua_pop(L, 1);
+        return false;
+    }
+
+    for (const auto& counter : sourceMap.counters) {
+        lua_rawgeti(L, -1, counter.slot);
+        double hits = lua_tonumber(L, -1);
+        lua_pop(L, 1);
+        m_lines.push_back({counter.basicLine, counter.function, hits > 0 ? (uint64_t)hits : 0});
+    }
+    lua_pop(L, 1);
+
+    std::sort(m_lines.begin(), m_lines.end(), [](const LineHits& a, const LineHits& b) {
+        return a.line < b.line;
+    });
+    return true;
+}
+
+size_t LineCoverage::getExecutedCount() const {
+    return std::count_if(m_lines.begin(), m_lines.end(), [](const LineHits& l) { return l.hits > 0; });
+}
+
+// =============================================================================
+// Reporting
+// =============================================================================
+
+void LineCoverage::writeReport(std::ostream& out, size_t maxLines) const {
+    size_t executed = getExecutedCount();
+    out << std::fixed << std::setprecision(1);
+    out << "\n=== Line counts: " << executed << " of " << m_lines.size() << " lines executed ("
+        << (m_lines.empty() ? 0.0 : 100.0 * executed / m_lines.size()) << "%) ===\n";
+    if (m_lines.empty()) return;
+
+    // Hottest lines
+    std::vector<const LineHits*> hot;
+    for (const auto& l : m_lines) {
+        if (l.hits > 0) hot.push_back(&l);
+    }
+    std::stable_sort(hot.begin(), hot.end(), [](const LineHits* a, const LineHits* b) {
+        return a->hits > b->hits;
+    });
+    out << "\n          Hits     Line  Function\n";
+    for (size_t i = 0; i < hot.size() && i < maxLines; i++) {
+        out << "  " << std::setw(12) << hot[i]->hits
+            << "  " << std::setw(7) << hot[i]->line
+            << "  " << hot[i]->function << "\n";
+    }
+    if (hot.size() > maxLines) {
+        out << "  ... " << (hot.size() - maxLines) << " more lines\n";
+    }
+
+    // Coverage per SUB/FUNCTION
+    struct FunctionStats {
+        size_t lines = 0;
+        size_t executed = 0;
+        uint64_t hits = 0;
+    };
+    std::map<std::string, FunctionStats> functions;
+    for (const auto& l : m_lines) {
+        FunctionStats& stats = functions[l.function];
+        stats.lines++;
+        if (l.hits > 0) stats.executed++;
+        stats.hits += l.hits;
+    }
+    out << "\n   Cover%     Lines          Hits  Function\n";
+    for (const auto& [name, stats] : functions) {
+        out << "  " << std::setw(6) << (100.0 * stats.executed / stats.lines) << "%"
+            << "  " << std::setw(4) << stats.executed << "/" << std::left << std::setw(4) << stats.lines << std::right
+            << "  " << std::setw(12) << stats.hits
+            << "  " << name << "\n";
+    }
+
+    // Lines that never ran; runs of neighbouring counted lines are joined
+    if (executed < m_lines.size()) {
+        out << "\n  Not executed:";
+        size_t column = 15;
+        for (size_t i = 0; i < m_lines.size(); i++) {
+            if (m_lines[i].hits > 0) continue;
+            size_t last = i;
+            while (last + 1 < m_lines.size() && m_lines[last + 1].hits == 0) last++;
+            std::string range = std::to_string(m_lines[i].line);
+            if (last > i) range += "-" + std::to_string(m_lines[last].line);
+            if (column + range.size() + 1 > 78) {
+                out << "\n               ";
+                column = 15;
+            }
+            out << " " << range;
+            column += range.size() + 1;
+            i = last;
+        }
+        out << "\n";
+    }
+    out << "\n";
+}
+
+bool LineCoverage::writeCounts(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file.is_open()) return false;
+    file << "# line hits function\n";
+    for (const auto& l : m_lines) {
+        file << l.line << " " << l.hits << " " << l.function << "\n";
+    }
+    return true;
+}
+
+} // namespace FasterBASIC
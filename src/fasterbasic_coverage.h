@@ -0,0 +1,60 @@
+//
+// fasterbasic_coverage.h
+// FasterBASIC - Line Execution Counts
+//
+// Reads back the per-line counters a program compiled with OPTION PROFILE
+// COUNTS (or fbc --count) keeps while it runs, and reports hit counts and
+// coverage keyed to BASIC lines and SUB/FUNCTION names.
+//
+
+#ifndef FASTERBASIC_COVERAGE_H
+#define FASTERBASIC_COVERAGE_H
+
+#include "fasterbasic_lua_codegen.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <ostream>
+
+struct lua_State;
+
+namespace FasterBASIC {
+
+// =============================================================================
+// Line Coverage
+// =============================================================================
+
+class LineCoverage {
+public:
+    LineCoverage();
+
+    // Read the counters left in LuaSourceMap::COUNTERS_GLOBAL; works after a
+    // run that ended in an error too. False (see getError) when the program
+    // was not compiled with counters or never ran far enough to create them
+    bool collect(lua_State* L, const LuaSourceMap& sourceMap);
+
+    // Coverage summary, hottest lines, per-function coverage and the lines
+    // that never ran
+    void writeReport(std::ostream& out, size_t maxLines = 25) const;
+
+    // One "line hits function" row per counted line, in line order
+    bool writeCounts(const std::string& path) const;
+
+    size_t getLineCount() const { return m_lines.size(); }
+    size_t getExecutedCount() const;
+    const std::string& getError() const { return m_error; }
+
+private:
+    struct LineHits {
+        int line;
+        std::string function;
+        uint64_t hits;
+    };
+
+    std::vector<LineHits> m_lines;  // Sorted by BASIC line
+    std::string m_error;
+};
+
+} // namespace FasterBASIC
+
+#endif // FASTERBASIC_COVERAGE_H
@@ -671,16 +671,24 @@ std::set<int> DataPreprocessor::collectGotoTargets(const std::string& source) {
 
 // Pass 2: Convert target line numbers to labels and rewrite GOTO references
 std::string DataPreprocessor::convertLineNumbersToLabels(const std::string& source,
-                                                         const std::set<int>& targets) {
+                                                         const std::set<int>& targets,
+                                                         std::map<int, int>* lineNumbers) {
     std::istringstream sourceStream(source);
     std::ostringstream outputStream;
     std::string line;
+    int sourceLine = 0;
     
     while (std::getline(sourceStream, line)) {
+        sourceLine++;
+
         // Extract line number if present
         int lineNum = extractLineNumber(line);
         
         if (lineNum > 0) {
+            if (lineNumbers) {
+                (*lineNumbers)[sourceLine] = lineNum;
+            }
+
             // Find where the line number ends
             size_t pos = 0;
             while (pos < line.length() && isWhitespace(line[pos])) pos++;
@@ -854,12 +862,13 @@ std::string DataPreprocessor::replaceNumbersAfterKeyword(const std::string& line
 }
 
 // Preprocess line numbers to labels - two-pass process
-std::string DataPreprocessor::preprocessLineNumbersToLabels(const std::string& source) {
+std::string DataPreprocessor::preprocessLineNumbersToLabels(const std::string& source,
+                                                           std::map<int, int>* lineNumbers) {
     // Pass 1: Collect all GOTO/GOSUB targets
     std::set<int> targets = collectGotoTargets(source);
     
     // Pass 2: Convert targets to labels and rewrite GOTO/GOSUB statements
-    return convertLineNumbersToLabels(source, targets);
+    return convertLineNumbersToLabels(source, targets, lineNumbers);
 }
 
 } // namespace FasterBASIC
\ No newline at end of file
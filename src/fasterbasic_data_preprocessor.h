@@ -55,7 +55,10 @@ public:
     //   Pass 2: Convert those lines to labels (e.g., "60 PRINT" -> ":L60 PRINT")
     //           and convert GOTO references (e.g., "GOTO 60" -> "GOTO L60")
     // This simplifies the parser and makes GOTO resolution trivial
-    static std::string preprocessLineNumbersToLabels(const std::string& source);
+    // lineNumbers, if given, receives the stripped numbers keyed by source
+    // line (from 1), so reports can still name lines the way the user did
+    static std::string preprocessLineNumbersToLabels(const std::string& source,
+                                                     std::map<int, int>* lineNumbers = nullptr);
     
 private:
     // Parse a single data value string into typed variant
@@ -86,7 +89,8 @@ private:
     static std::set<int> collectGotoTargets(const std::string& source);
     static int extractLineNumber(const std::string& line);
     static std::string convertLineNumbersToLabels(const std::string& source, 
-                                                   const std::set<int>& targets);
+                                                   const std::set<int>& targets,
+                                                   std::map<int, int>* lineNumbers);
     static std::string replaceNumbersAfterKeyword(const std::string& line,
                                                    size_t startPos,
                                                    const std::set<int>& targets,
@@ -15,13 +15,11 @@ namespace FasterBASIC {
 // Global Event Manager Instance
 // =============================================================================
 
-static EventManager* g_eventManager = nullptr;
-
 EventManager& getEventManager() {
-    if (!g_eventManager) {
-        g_eventManager = new EventManager();
-    }
-    return *g_eventManager;
+    // Created on first use; a function-local static, so parsers running on
+    // several threads (fbc --batch) cannot create it twice
+    static EventManager* eventManager = new EventManager();
+    return *eventManager;
 }
 
 // =============================================================================
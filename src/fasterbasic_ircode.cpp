@@ -8,6 +8,7 @@
 
 #include "fasterbasic_ircode.h"
 #include "modular_commands.h"
+#include "fasterbasic_threadpool.h"
 #include <algorithm>
 #include <sstream>
 #include <cmath>
@@ -36,6 +37,27 @@ static std::string extractTypeSuffix(const std::string& name) {
     }
 }
 
+// Constant value of a CASE arm: a number, a negated number or a string literal
+static bool constantCaseValue(const Expression* expr, bool unicodeMode, IROperand& value) {
+    if (auto* e = dynamic_cast<const NumberExpression*>(expr)) {
+        value = e->value;
+        return true;
+    }
+    if (auto* e = dynamic_cast<const UnaryExpression*>(expr)) {
+        auto* operand = dynamic_cast<const NumberExpression*>(e->expr.get());
+        if (!operand || (e->op != TokenType::MINUS && e->op != TokenType::PLUS)) return false;
+        value = e->op == TokenType::MINUS ? -operand->value : operand->value;
+        return true;
+    }
+    if (auto* e = dynamic_cast<const StringExpression*>(expr)) {
+        // Unicode strings are codepoint tables, which do not hash by content
+        if (unicodeMode) return false;
+        value = e->value;
+        return true;
+    }
+    return false;
+}
+
 // =============================================================================
 // Constructor
 // =============================================================================
@@ -49,6 +71,11 @@ IRGenerator::IRGenerator()
     , m_currentLineNumber(0)
     , m_currentBlockId(-1)
     , m_inFunctionInlining(false)
+    , m_nextInlineTemp(1)
+    , m_threadCount(0)
+    , m_deferBodies(false)
+    , m_firstDynamicLabel(1)
+    , m_userFunctionDefs(0)
 {}
 
 // =============================================================================
@@ -63,13 +90,22 @@ std::unique_ptr<IRCode> IRGenerator::generate(
     m_symbols = &symbols;
     m_code = std::make_unique<IRCode>();
     m_nextLabel = 1;
+    m_nextInlineTemp = 1;
     m_blockLabels.clear();
+    m_userFunctions.clear();
+    m_functions.clear();
+    m_subs.clear();
+    m_whileLoopLabels.clear();
+    m_userFunctionDefs = 0;
+    m_deferBodies = ThreadPool::resolveThreadCount(m_threadCount) > 1;
+    m_deferredBodies.clear();
 
     m_code->blockCount = cfg.getBlockCount();
     m_code->arrayBase = symbols.arrayBase;  // Copy OPTION BASE setting
     m_code->unicodeMode = symbols.unicodeMode;  // Copy OPTION UNICODE setting
     m_code->errorTracking = symbols.errorTracking;  // Copy OPTION ERROR setting
     m_code->cancellableLoops = symbols.cancellableLoops;  // Copy OPTION CANCELLABLE setting
+    m_code->lineCounts = symbols.lineCounts;  // Copy OPTION PROFILE setting
     m_code->eventsUsed = symbols.eventsUsed;  // Copy EVENT DETECTION setting
 
     // Copy DATA segment from symbol table
@@ -104,6 +140,7 @@ std::unique_ptr<IRCode> IRGenerator::generate(
             getLabelForBlock(blockPtr->id);
         }
     }
+    m_firstDynamicLabel = m_nextLabel;
 
     // Generate code for each block in order
     for (const auto& blockPtr : cfg.blocks) {
@@ -120,15 +157,261 @@ std::unique_ptr<IRCode> IRGenerator::generate(
 
     m_code->labelCount = m_nextLabel - 1;
 
+    if (!m_deferredBodies.empty()) {
+        if (!generateDeferredBodies()) {
+            // A body reaches outside its procedure; only the single pass
+            // sees the program in the order it runs the generator
+            int threads = m_threadCount;
+            m_threadCount = 1;
+            auto code = generate(cfg, symbols);
+            m_threadCount = threads;
+            return code;
+        }
+        spliceDeferredBodies();
+    }
+
     return std::move(m_code);
 }
 
+// =============================================================================
+// Parallel SUB/FUNCTION Bodies
+// =============================================================================
+
+void IRGenerator::generateProcedureBody(const std::vector<StatementPtr>& body, int lineNumber) {
+    if (!m_deferBodies) {
+        for (const auto& bodyStmt : body) {
+            generateStatement(bodyStmt.get(), lineNumber);
+        }
+        return;
+    }
+
+    DeferredBody deferred;
+    deferred.statements = &body;
+    deferred.lineNumber = lineNumber;
+    deferred.blockId = m_currentBlockId;
+    deferred.insertAt = m_code->instructions.size();
+    deferred.userFunctions = m_userFunctions;
+    m_deferredBodies.push_back(std::move(deferred));
+}
+
+void IRGenerator::generateDeferredBody(DeferredBody& body) {
+    m_code = std::make_unique<IRCode>();
+    m_userFunctions = body.userFunctions;
+    m_userFunctionDefs = 0;
+    m_nextLabel = DEFERRED_ID_BASE;
+    m_nextInlineTemp = DEFERRED_ID_BASE;
+    m_whileLoopLabels.clear();
+
+    setSourceContext(body.lineNumber, body.blockId);
+    for (const auto& bodyStmt : *body.statements) {
+        generateStatement(bodyStmt.get(), body.lineNumber);
+    }
+
+    body.instructions = std::move(m_code->instructions);
+    body.switchTables = std::move(m_code->switchTables);
+    body.escaped = m_userFunctionDefs > 0 || !m_whileLoopLabels.empty();
+}
+
+bool IRGenerator::generateDeferredBodies() {
+    int threads = std::min(ThreadPool::resolveThreadCount(m_threadCount),
+                           static_cast<int>(m_deferredBodies.size()));
+    ThreadPool pool(threads);
+
+    // One generator per worker, sharing everything read-only with this one
+    std::vector<std::unique_ptr<IRGenerator>> workers(pool.getThreadCount());
+    try {
+        pool.run(m_deferredBodies.size(), [&](size_t index, int worker) {
+            if (!workers[worker]) {
+                auto generator = std::make_unique<IRGenerator>();
+                generator->m_cfg = m_cfg;
+                generator->m_symbols = m_symbols;
+                generator->m_blockLabels = m_blockLabels;
+                generator->m_functions = m_functions;
+                generator->m_traceEnabled = m_traceEnabled;
+                workers[worker] = std::move(generator);
+            }
+            workers[worker]->generateDeferredBody(m_deferredBodies[index]);
+        });
+    } catch (...) {
+        return false;
+    }
+
+    for (const auto& body : m_deferredBodies) {
+        if (body.escaped) {
+            return false;
+        }
+    }
+    return true;
+}
+
+namespace {
+
+// Labels, DEF FN temporaries and switch tables of one part of the spliced
+// program (the skeleton or one body), numbered in order of first use
+struct SpliceNumbering {
+    int firstLabel;  // Labels in [firstLabel, endLabel) were allocated by this part
+    int endLabel;
+    const std::vector<IRSwitchTable>* switchTables;
+    std::unordered_map<int, int> labels;
+    std::unordered_map<std::string, std::string> temps;
+};
+
+struct SpliceState {
+    int nextLabel;
+    int nextTemp = 1;
+    std::vector<IRSwitchTable> switchTables;
+};
+
+int renumberLabel(int label, SpliceNumbering& part, SpliceState& state) {
+    if (label < part.firstLabel || label >= part.endLabel) {
+        return label;  // CFG block or symbolic label
+    }
+    auto it = part.labels.find(label);
+    if (it == part.labels.end()) {
+        it = part.labels.emplace(label, state.nextLabel++).first;
+    }
+    return it->second;
+}
+
+std::string renumberLabelList(const std::string& list, SpliceNumbering& part, SpliceState& state) {
+    std::string result;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) comma = list.size();
+        std::string item = list.substr(start, comma - start);
+        if (start > 0) result += ",";
+        char* end = nullptr;
+        long label = std::strtol(item.c_str(), &end, 10);
+        if (!item.empty() && *end == '\0') {
+            result += std::to_string(renumberLabel(static_cast<int>(label), part, state));
+        } else {
+            result += item;
+        }
+        start = comma + 1;
+    }
+    return result;
+}
+
+void renumberInstruction(IRInstruction& instr, SpliceNumbering& part, SpliceState& state) {
+    switch (instr.opcode) {
+        case IROpcode::LABEL:
+        case IROpcode::JUMP:
+        case IROpcode::JUMP_IF_TRUE:
+        case IROpcode::JUMP_IF_FALSE:
+        case IROpcode::CALL_GOSUB:
+        case IROpcode::WHILE_START:
+        case IROpcode::WHILE_END:
+            if (std::holds_alternative<int>(instr.operand1)) {
+                instr.operand1 = renumberLabel(std::get<int>(instr.operand1), part, state);
+            }
+            break;
+
+        case IROpcode::ON_GOTO:
+        case IROpcode::ON_GOSUB:
+            if (std::holds_alternative<std::string>(instr.operand1)) {
+                instr.operand1 = renumberLabelList(std::get<std::string>(instr.operand1), part, state);
+            }
+            break;
+
+        case IROpcode::ON_EVENT:
+            // "event|goto|label|true" for a GOTO / GOSUB to a line
+            if (std::holds_alternative<std::string>(instr.operand1)) {
+                const std::string& operand = std::get<std::string>(instr.operand1);
+                size_t type = operand.find('|');
+                size_t target = type == std::string::npos ? type : operand.find('|', type + 1);
+                size_t flag = target == std::string::npos ? target : operand.find('|', target + 1);
+                if (flag != std::string::npos && operand.compare(flag + 1, std::string::npos, "true") == 0) {
+                    std::string label = operand.substr(target + 1, flag - target - 1);
+                    instr.operand1 = operand.substr(0, target + 1) +
+                                     renumberLabelList(label, part, state) + operand.substr(flag);
+                }
+            }
+            break;
+
+        case IROpcode::SWITCH_START:
+            if (std::holds_alternative<int>(instr.operand1)) {
+                int table = std::get<int>(instr.operand1);
+                instr.operand1 = static_cast<int>(state.switchTables.size());
+                state.switchTables.push_back((*part.switchTables)[table]);
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    // DEF FN argument temporaries: __fn_<function>_<parameter>_<n>
+    for (IROperand* op : {&instr.operand1, &instr.operand2, &instr.operand3}) {
+        if (!std::holds_alternative<std::string>(*op)) continue;
+        const std::string& name = std::get<std::string>(*op);
+        if (name.compare(0, 5, "__fn_") != 0) continue;
+        auto it = part.temps.find(name);
+        if (it == part.temps.end()) {
+            std::string renamed = name.substr(0, name.rfind('_') + 1) + std::to_string(state.nextTemp++);
+            it = part.temps.emplace(name, renamed).first;
+        }
+        *op = it->second;
+    }
+}
+
+} // anonymous namespace
+
+void IRGenerator::spliceDeferredBodies() {
+    std::vector<IRInstruction>& skeleton = m_code->instructions;
+    size_t total = skeleton.size();
+    for (const auto& body : m_deferredBodies) {
+        total += body.instructions.size();
+    }
+
+    SpliceState state;
+    state.nextLabel = m_firstDynamicLabel;
+    SpliceNumbering skeletonPart{m_firstDynamicLabel, m_nextLabel, &m_code->switchTables, {}, {}};
+
+    std::vector<IRInstruction> spliced;
+    spliced.reserve(total);
+    std::vector<int> newIndex(skeleton.size() + 1);
+    size_t nextBody = 0;
+
+    for (size_t i = 0; i <= skeleton.size(); i++) {
+        while (nextBody < m_deferredBodies.size() && m_deferredBodies[nextBody].insertAt == i) {
+            DeferredBody& body = m_deferredBodies[nextBody++];
+            SpliceNumbering bodyPart{DEFERRED_ID_BASE, INT_MAX, &body.switchTables, {}, {}};
+            for (auto& instr : body.instructions) {
+                renumberInstruction(instr, bodyPart, state);
+                spliced.push_back(std::move(instr));
+            }
+        }
+        newIndex[i] = static_cast<int>(spliced.size());
+        if (i < skeleton.size()) {
+            renumberInstruction(skeleton[i], skeletonPart, state);
+            spliced.push_back(std::move(skeleton[i]));
+        }
+    }
+
+    m_code->instructions = std::move(spliced);
+    m_code->switchTables = std::move(state.switchTables);
+    m_code->labelCount = state.nextLabel - 1;
+    for (auto& [label, address] : m_code->labelToAddress) {
+        address = newIndex[address];
+    }
+    for (auto& [line, address] : m_code->lineToAddress) {
+        address = newIndex[address];
+    }
+    m_deferredBodies.clear();
+}
+
 // =============================================================================
 // Block Code Generation
 // =============================================================================
 
 void IRGenerator::generateBlock(const BasicBlock& block) {
-    setSourceContext(block.getFirstLineNumber(), block.id);
+    int firstLine = block.getFirstLineNumber();
+    if (!block.statements.empty() && block.statements.front() &&
+        block.statements.front()->basicLine > 0) {
+        firstLine = block.statements.front()->basicLine;
+    }
+    setSourceContext(firstLine, block.id);
 
     // Emit label for this block
     int labelId = getLabelForBlock(block.id);
@@ -198,6 +481,11 @@ void IRGenerator::generateBlock(const BasicBlock& block) {
 void IRGenerator::generateStatement(const Statement* stmt, int lineNumber) {
     if (!stmt) return;
 
+    // Report the line the statement is written on, also inside a multi-line
+    // IF/CASE arm or SUB/FUNCTION body
+    if (stmt->basicLine > 0) {
+        lineNumber = stmt->basicLine;
+    }
     setSourceContext(lineNumber, m_currentBlockId);
 
     if (auto* s = dynamic_cast<const PrintStatement*>(stmt)) {
@@ -672,6 +960,10 @@ void IRGenerator::generateCase(const CaseStatement* stmt, int lineNumber) {
         return;
     }
 
+    if (generateSwitch(stmt, lineNumber)) {
+        return;
+    }
+
     // Helper function to generate OR condition for multiple values
     auto generateWhenCondition = [&](const CaseStatement::WhenClause& clause) {
         if (clause.values.empty()) return;
@@ -729,6 +1021,57 @@ void IRGenerator::generateCase(const CaseStatement* stmt, int lineNumber) {
     emit(IROpcode::IF_END);
 }
 
+bool IRGenerator::generateSwitch(const CaseStatement* stmt, int lineNumber) {
+    // A CASE whose arms all compare against constants dispatches through a
+    // table lookup: the selector is evaluated once and no arm is tested in
+    // turn. Short CASEs stay IF chains, which are as fast and simpler.
+    static const size_t MIN_SWITCH_VALUES = 4;
+
+    IRSwitchTable table;
+    table.armCount = static_cast<int>(stmt->whenClauses.size());
+    std::vector<IROperand> seen;
+    size_t valueCount = 0;
+    for (size_t arm = 0; arm < stmt->whenClauses.size(); arm++) {
+        for (const auto& valueExpr : stmt->whenClauses[arm].values) {
+            IROperand value;
+            if (!constantCaseValue(valueExpr.get(), m_symbols->unicodeMode, value)) {
+                return false;
+            }
+            valueCount++;
+            // The first arm listing a value is the one an IF chain would take
+            if (std::find(seen.begin(), seen.end(), value) != seen.end()) continue;
+            seen.push_back(value);
+            table.entries.push_back({value, static_cast<int>(arm) + 1});
+        }
+    }
+    if (valueCount < MIN_SWITCH_VALUES) {
+        return false;
+    }
+
+    int tableIndex = static_cast<int>(m_code->switchTables.size());
+    m_code->switchTables.push_back(std::move(table));
+
+    generateExpression(stmt->caseExpression.get());
+    emit(IROpcode::SWITCH_START, tableIndex);
+
+    for (size_t arm = 0; arm < stmt->whenClauses.size(); arm++) {
+        emit(IROpcode::SWITCH_CASE, static_cast<int>(arm) + 1);
+        for (const auto& whenStmt : stmt->whenClauses[arm].statements) {
+            generateStatement(whenStmt.get(), lineNumber);
+        }
+    }
+
+    if (!stmt->otherwiseStatements.empty()) {
+        emit(IROpcode::SWITCH_DEFAULT);
+        for (const auto& otherwiseStmt : stmt->otherwiseStatements) {
+            generateStatement(otherwiseStmt.get(), lineNumber);
+        }
+    }
+
+    emit(IROpcode::SWITCH_END);
+    return true;
+}
+
 void IRGenerator::generateFor(const ForStatement* stmt, int lineNumber) {
     setSourceContext(lineNumber, m_currentBlockId);
 
@@ -778,121 +1121,24 @@ void IRGenerator::generateNext(const NextStatement* stmt, int lineNumber) {
     }
 }
 
-// Helper function to serialize simple expressions to a string for deferred evaluation
-// Returns empty string for complex expressions (like function calls), which fall back to goto pattern
-std::string IRGenerator::serializeExpression(const Expression* expr) {
-    if (!expr) return "";
-    
-    ASTNodeType nodeType = expr->getType();
-    
-    switch (nodeType) {
-        case ASTNodeType::EXPR_NUMBER: {
-            auto* num = dynamic_cast<const NumberExpression*>(expr);
-            return std::to_string(num->value);
-        }
-        
-        case ASTNodeType::EXPR_STRING: {
-            auto* str = dynamic_cast<const StringExpression*>(expr);
-            std::string escaped = str->value;
-            // Escape quotes and backslashes
-            size_t pos = 0;
-            while ((pos = escaped.find('\\', pos)) != std::string::npos) {
-                escaped.replace(pos, 1, "\\\\");
-                pos += 2;
-            }
-            pos = 0;
-            while ((pos = escaped.find('"', pos)) != std::string::npos) {
-                escaped.replace(pos, 1, "\\\"");
-                pos += 2;
-            }
-            return "\"" + escaped + "\"";
-        }
-        
-        case ASTNodeType::EXPR_VARIABLE: {
-            auto* var = dynamic_cast<const VariableExpression*>(expr);
-            // Add var_ prefix to match Lua code generation
-            return "var_" + var->name;
-        }
-        
-        case ASTNodeType::EXPR_BINARY: {
-            auto* binop = dynamic_cast<const BinaryExpression*>(expr);
-            std::string left = serializeExpression(binop->left.get());
-            std::string right = serializeExpression(binop->right.get());
-            if (left.empty() || right.empty()) return ""; // Can't serialize if subexpr failed
-            
-            std::string op;
-            switch (binop->op) {
-                case TokenType::PLUS: op = "+"; break;
-                case TokenType::MINUS: op = "-"; break;
-                case TokenType::MULTIPLY: op = "*"; break;
-                case TokenType::DIVIDE: op = "/"; break;
-                case TokenType::INT_DIVIDE: op = "//"; break;
-                case TokenType::MOD: op = "%"; break;
-                case TokenType::POWER: op = "^"; break;
-                case TokenType::EQUAL: op = "=="; break;
-                case TokenType::NOT_EQUAL: op = "~="; break;
-                case TokenType::LESS_THAN: op = "<"; break;
-                case TokenType::LESS_EQUAL: op = "<="; break;
-                case TokenType::GREATER_THAN: op = ">"; break;
-                case TokenType::GREATER_EQUAL: op = ">="; break;
-                case TokenType::AND: op = "and"; break;
-                case TokenType::OR: op = "or"; break;
-                default: return ""; // Unknown operator, fall back
-            }
-            
-            return "(" + left + " " + op + " " + right + ")";
-        }
-        
-        case ASTNodeType::EXPR_UNARY: {
-            auto* unop = dynamic_cast<const UnaryExpression*>(expr);
-            std::string operand = serializeExpression(unop->expr.get());
-            if (operand.empty()) return "";
-            
-            if (unop->op == TokenType::MINUS) {
-                return "(-" + operand + ")";
-            } else if (unop->op == TokenType::NOT) {
-                return "(not " + operand + ")";
-            }
-            return operand;
-        }
-        
-        case ASTNodeType::EXPR_FUNCTION_CALL:
-            // Don't serialize function calls - they need to be re-evaluated via goto pattern
-            return "";
-        
-        default:
-            // For unsupported expressions, return empty to fall back to stack-based
-            return "";
-    }
-}
-
 void IRGenerator::generateWhile(const WhileStatement* stmt, int lineNumber) {
     setSourceContext(lineNumber, m_currentBlockId);
     
-    // Try to serialize the expression for deferred evaluation
-    std::string serializedExpr = serializeExpression(stmt->condition.get());
+    // Emit a label before the condition so we can jump back to re-evaluate it.
+    // The condition is generated as ordinary IR; the code generator folds it
+    // back into a native Lua while loop when it stays a pure expression.
+    int whileLabel = allocateLabel();
+    emit(IROpcode::LABEL, whileLabel);
     
-    if (!serializedExpr.empty()) {
-        // We can defer evaluation - pass the expression as a string
-        // The code generator will use a native while loop
-        emit(IROpcode::WHILE_START, serializedExpr);
-        m_whileLoopLabels.push_back(-1); // No label needed for deferred evaluation
-    } else {
-        // Fall back to the old method for complex expressions
-        // Emit a label before the condition so we can jump back to re-evaluate it
-        int whileLabel = allocateLabel();
-        emit(IROpcode::LABEL, whileLabel);
-        
-        // Push label onto stack so WEND knows where to jump back
-        m_whileLoopLabels.push_back(whileLabel);
-        
-        // Generate condition expression - this will be re-evaluated each iteration
-        generateExpression(stmt->condition.get());
-        
-        // WHILE_START: pops condition from stack, begins while loop
-        // Store the loop label in operand1 for the code generator
-        emit(IROpcode::WHILE_START, whileLabel);
-    }
+    // Push label onto stack so WEND knows where to jump back
+    m_whileLoopLabels.push_back(whileLabel);
+    
+    // Generate condition expression - this will be re-evaluated each iteration
+    generateExpression(stmt->condition.get());
+    
+    // WHILE_START: pops condition from stack, begins while loop
+    // Store the loop label in operand1 for the code generator
+    emit(IROpcode::WHILE_START, whileLabel);
 }
 
 void IRGenerator::generateWend(const WendStatement* stmt, int lineNumber) {
@@ -906,13 +1152,8 @@ void IRGenerator::generateWend(const WendStatement* stmt, int lineNumber) {
     m_whileLoopLabels.pop_back();
     
     // WHILE_END: marks end of while loop
-    // If whileLabel is -1, we used deferred evaluation (no jump needed)
-    // Otherwise, store the loop start label in operand1 so code generator can emit jump back
-    if (whileLabel >= 0) {
-        emit(IROpcode::WHILE_END, whileLabel);
-    } else {
-        emit(IROpcode::WHILE_END);
-    }
+    // Store the loop start label in operand1 so code generator can emit jump back
+    emit(IROpcode::WHILE_END, whileLabel);
 }
 
 void IRGenerator::generateRepeat(const RepeatStatement* stmt, int lineNumber) {
@@ -1345,6 +1586,7 @@ void IRGenerator::generateDef(const DefStatement* stmt, int lineNumber) {
     func.body = stmt->body.get();
 
     m_userFunctions[stmt->functionName] = func;
+    m_userFunctionDefs++;
 
     // No IR emitted here - function body is inlined at call sites
 }
@@ -1373,9 +1615,7 @@ void IRGenerator::generateFunction(const FunctionStatement* stmt, int lineNumber
     }
 
     // Generate function body
-    for (const auto& bodyStmt : stmt->body) {
-        generateStatement(bodyStmt.get(), lineNumber);
-    }
+    generateProcedureBody(stmt->body, lineNumber);
 
     // Emit function end
     emit(IROpcode::END_FUNCTION);
@@ -1403,9 +1643,7 @@ void IRGenerator::generateSub(const SubStatement* stmt, int lineNumber) {
     }
 
     // Generate sub body
-    for (const auto& bodyStmt : stmt->body) {
-        generateStatement(bodyStmt.get(), lineNumber);
-    }
+    generateProcedureBody(stmt->body, lineNumber);
 
     // Emit sub end
     emit(IROpcode::END_SUB);
@@ -1455,8 +1693,12 @@ void IRGenerator::generateExpression(const Expression* expr) {
             emit(IROpcode::LOAD_CONST, constValue.index);
         }
         // Load variable - check if it's a function parameter being inlined
+        else if (m_inFunctionInlining && m_parameterExprs.find(e->name) != m_parameterExprs.end()) {
+            // Function parameter bound to a literal argument - substitute it
+            generateExpression(m_parameterExprs[e->name]);
+        }
         else if (m_inFunctionInlining && m_parameterMap.find(e->name) != m_parameterMap.end()) {
-            // This is a function parameter - load from the temporary variable
+            // Function parameter - load the variable or temporary it is bound to
             emit(IROpcode::LOAD_VAR, m_parameterMap[e->name]);
         } else {
             // Regular variable
@@ -1642,24 +1884,48 @@ void IRGenerator::generateInlinedFunction(const std::string& funcName,
 
     const UserFunction& func = it->second;
 
-    // Strategy: Evaluate arguments and store in temporary variables,
-    // then set up parameter mapping for expression generation
-
-    // Save current parameter map
-    auto savedParamMap = m_parameterMap;
-    bool savedInlining = m_inFunctionInlining;
+    // Bind every parameter in the caller's context before any binding becomes
+    // visible. Literals, constants and plain variables are substituted; other
+    // arguments are evaluated once into a temporary unique to this call, so
+    // FN A(1) + FN A(2) does not share one slot between both expansions.
+    std::map<std::string, std::string> boundVars;
+    std::map<std::string, const Expression*> boundExprs;
 
-    // Evaluate all arguments and store in temporary variables
     for (size_t i = 0; i < arguments.size() && i < func.parameters.size(); i++) {
-        generateExpression(arguments[i]);
-        std::string tempVar = "__fn_" + funcName + "_" + func.parameters[i];
-        emit(IROpcode::STORE_VAR, tempVar);
+        const Expression* arg = arguments[i];
+        const std::string& param = func.parameters[i];
 
-        // Map parameter name to temp variable name
-        m_parameterMap[func.parameters[i]] = tempVar;
+        if (dynamic_cast<const NumberExpression*>(arg) || dynamic_cast<const StringExpression*>(arg)) {
+            boundExprs[param] = arg;
+            continue;
+        }
+
+        if (auto* var = dynamic_cast<const VariableExpression*>(arg)) {
+            if (m_symbols && m_symbols->constants.find(var->name) != m_symbols->constants.end()) {
+                boundExprs[param] = arg;
+            } else if (m_inFunctionInlining && m_parameterExprs.count(var->name)) {
+                boundExprs[param] = m_parameterExprs[var->name];
+            } else if (m_inFunctionInlining && m_parameterMap.count(var->name)) {
+                boundVars[param] = m_parameterMap[var->name];
+            } else {
+                boundVars[param] = var->name;
+            }
+            continue;
+        }
+
+        generateExpression(arg);
+        std::string tempVar = "__fn_" + funcName + "_" + param + "_" + std::to_string(m_nextInlineTemp++);
+        emit(IROpcode::STORE_VAR, tempVar);
+        boundVars[param] = tempVar;
     }
 
-    // Enable function inlining mode
+    // Save current parameter bindings; the body only sees its own parameters
+    auto savedParamMap = m_parameterMap;
+    auto savedParamExprs = m_parameterExprs;
+    bool savedInlining = m_inFunctionInlining;
+
+    m_parameterMap = boundVars;
+    m_parameterExprs = boundExprs;
     m_inFunctionInlining = true;
 
     // Evaluate the function body with parameter substitution
@@ -1667,6 +1933,7 @@ void IRGenerator::generateInlinedFunction(const std::string& funcName,
 
     // Restore previous state
     m_parameterMap = savedParamMap;
+    m_parameterExprs = savedParamExprs;
     m_inFunctionInlining = savedInlining;
 }
 
@@ -1859,6 +2126,11 @@ bool IRGenerator::isStringExpression(const Expression* expr) const {
         }
     }
     
+    // Check registry function (LEFT$, STR$, ... registered as modular commands)
+    if (auto* regExpr = dynamic_cast<const RegistryFunctionExpression*>(expr)) {
+        return regExpr->returnType == ModularCommands::ReturnType::STRING;
+    }
+    
     // Check binary expression - if either side is string, result is string
     if (auto* binExpr = dynamic_cast<const BinaryExpression*>(expr)) {
         if (binExpr->op == TokenType::PLUS) {
@@ -21,6 +21,9 @@
 #include <variant>
 #include <sstream>
 #include <iomanip>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 
 namespace FasterBASIC {
 
@@ -93,6 +96,10 @@ enum class IROpcode {
     ELSEIF_START,       // Begin ELSEIF block; condition on stack (will be popped)
     ELSE_START,         // Begin ELSE block
     IF_END,             // End IF/ELSEIF/ELSE block
+    SWITCH_START,       // Pop selector, dispatch on it (operand: index into IRCode::switchTables)
+    SWITCH_CASE,        // Begin arm of a SWITCH (operand: 1-based arm number)
+    SWITCH_DEFAULT,     // Begin the arm taken when no case value matches
+    SWITCH_END,         // End SWITCH block
 
     // === Function Calls ===
     CALL_BUILTIN,       // Call built-in function (operand: function name, arg count)
@@ -229,6 +236,10 @@ inline const char* opcodeToString(IROpcode op) {
         case IROpcode::ELSEIF_START: return "ELSEIF_START";
         case IROpcode::ELSE_START: return "ELSE_START";
         case IROpcode::IF_END: return "IF_END";
+        case IROpcode::SWITCH_START: return "SWITCH_START";
+        case IROpcode::SWITCH_CASE: return "SWITCH_CASE";
+        case IROpcode::SWITCH_DEFAULT: return "SWITCH_DEFAULT";
+        case IROpcode::SWITCH_END: return "SWITCH_END";
         case IROpcode::CALL_BUILTIN: return "CALL_BUILTIN";
         case IROpcode::CALL_USER_FN: return "CALL_USER_FN";
         case IROpcode::CALL_FUNCTION: return "CALL_FUNCTION";
@@ -294,6 +305,23 @@ inline const char* opcodeToString(IROpcode op) {
     return "UNKNOWN";
 }
 
+// =============================================================================
+// Number Literals
+// =============================================================================
+
+// Shortest decimal text that reads back as exactly `value`, valid as a Lua
+// number literal (std::to_string keeps only six decimals)
+inline std::string formatNumberLiteral(double value) {
+    if (std::isnan(value)) return "(0/0)";
+    if (std::isinf(value)) return value > 0 ? "math.huge" : "(-math.huge)";
+    char buffer[32];
+    for (int precision = 15; precision <= 17; precision++) {
+        std::snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+        if (std::strtod(buffer, nullptr) == value) break;
+    }
+    return buffer;
+}
+
 // =============================================================================
 // IR Operand (variant type)
 // =============================================================================
@@ -391,6 +419,70 @@ struct IRInstruction {
         return "???";
     }
 
+    // Exact stack effect of opcodes that only compute values: sets `pops`
+    // (each pushes one value) and returns true; false for any other opcode
+    bool valueStackEffect(int& pops) const {
+        switch (opcode) {
+            case IROpcode::PUSH_INT:
+            case IROpcode::PUSH_FLOAT:
+            case IROpcode::PUSH_DOUBLE:
+            case IROpcode::PUSH_STRING:
+            case IROpcode::LOAD_VAR:
+            case IROpcode::LOAD_CONST:
+                pops = 0;
+                return true;
+
+            case IROpcode::NEG:
+            case IROpcode::NOT:
+            case IROpcode::CONV_TO_INT:
+            case IROpcode::CONV_TO_FLOAT:
+            case IROpcode::CONV_TO_STRING:
+                pops = 1;
+                return true;
+
+            case IROpcode::ADD:
+            case IROpcode::SUB:
+            case IROpcode::MUL:
+            case IROpcode::DIV:
+            case IROpcode::IDIV:
+            case IROpcode::MOD:
+            case IROpcode::POW:
+            case IROpcode::EQ:
+            case IROpcode::NE:
+            case IROpcode::LT:
+            case IROpcode::LE:
+            case IROpcode::GT:
+            case IROpcode::GE:
+            case IROpcode::AND:
+            case IROpcode::OR:
+            case IROpcode::XOR:
+            case IROpcode::EQV:
+            case IROpcode::IMP:
+            case IROpcode::STR_CONCAT:
+            case IROpcode::UNICODE_CONCAT:
+            case IROpcode::STR_LEFT:
+            case IROpcode::STR_RIGHT:
+                pops = 2;
+                return true;
+
+            case IROpcode::STR_MID:
+                pops = 3;
+                return true;
+
+            case IROpcode::LOAD_ARRAY:
+            case IROpcode::CALL_BUILTIN:
+            case IROpcode::CALL_FUNCTION:
+                if (!std::holds_alternative<int>(operand2)) {
+                    return false;
+                }
+                pops = std::get<int>(operand2);
+                return true;
+
+            default:
+                return false;
+        }
+    }
+
     // Convert instruction to string for debugging
     std::string toString() const {
         std::ostringstream oss;
@@ -414,6 +506,14 @@ struct IRInstruction {
     }
 };
 
+// Dispatch table of a SWITCH: each constant case value and the arm it selects
+struct IRSwitchTable {
+    std::vector<std::pair<IROperand, int>> entries;  // (value, 1-based arm), first match only
+    int armCount;
+
+    IRSwitchTable() : armCount(0) {}
+};
+
 // =============================================================================
 // IR Code Container
 // =============================================================================
@@ -433,6 +533,13 @@ public:
     std::unordered_map<int, size_t> dataLineRestorePoints;      // Line number → index in dataValues
     std::unordered_map<std::string, size_t> dataLabelRestorePoints;  // Label name → index in dataValues
 
+    // SWITCH dispatch tables, indexed by the SWITCH_START operand
+    std::vector<IRSwitchTable> switchTables;
+
+    // BASIC lines of FUNCTION/SUB bodies the peephole inliner copied into a
+    // caller, with the procedure they belong to (its mangled name)
+    std::map<int, std::string> inlinedLines;
+
     // Constants (for inlining constant values in generated code)
     const class ConstantsManager* constantsManager;  // Pointer to constants for code generation
 
@@ -441,17 +548,20 @@ public:
     int labelCount;
     int arrayBase;  // OPTION BASE: 0 or 1 (default 1)
     bool unicodeMode;  // OPTION UNICODE: strings as codepoint arrays
-    bool errorTracking;  // OPTION ERROR: emit _LINE tracking for error messages
+    bool errorTracking;  // OPTION ERROR: emit a Lua line -> BASIC line map for error messages
     bool cancellableLoops;  // OPTION CANCELLABLE: inject script cancellation checks in loops
+    bool lineCounts;  // OPTION PROFILE COUNTS: count entries into every BASIC line
     bool eventsUsed;  // EVENT DETECTION: if true, program uses ON EVENT statements and needs event processing code
 
     IRCode()
-        : blockCount(0)
+        : constantsManager(nullptr)
+        , blockCount(0)
         , labelCount(0)
         , arrayBase(1)  // Default to 1 (matches Lua arrays)
         , unicodeMode(false)  // Default to standard byte strings
         , errorTracking(true)  // Default to line tracking enabled (better UX - shows BASIC line numbers in errors)
         , cancellableLoops(true)  // Default to cancellation checks enabled (better UX)
+        , lineCounts(false)  // Default to no counters (no overhead)
         , eventsUsed(false)  // Default to no events (zero overhead when not used)
     {}
 
@@ -500,6 +610,24 @@ public:
         return -1;
     }
 
+    // Index of the first instruction of the `values` expressions ending just
+    // before endIndex, or -1 if the range contains a non-expression opcode
+    int expressionStart(int endIndex, int values) const {
+        // Walk backwards until `values` complete expressions have been covered
+        int needed = values;
+        for (int i = endIndex - 1; i >= 0; i--) {
+            int pops = 0;
+            if (!instructions[i].valueStackEffect(pops)) {
+                return -1;
+            }
+            needed += pops - 1;
+            if (needed == 0) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
     // Generate human-readable listing
     std::string toString() const {
         std::ostringstream oss;
@@ -543,6 +671,10 @@ public:
     // Configuration
     void setTraceEnabled(bool enable) { m_traceEnabled = enable; }
 
+    // Threads generating SUB/FUNCTION bodies (0 = one per hardware thread,
+    // 1 = everything on the calling thread). The IR is the same either way
+    void setThreadCount(int threads) { m_threadCount = threads; }
+
     // Generate report
     std::string generateReport(const IRCode& code) const;
 
@@ -585,7 +717,9 @@ private:
 
     // Function inlining state
     bool m_inFunctionInlining;
-    std::map<std::string, std::string> m_parameterMap;  // param name -> temp var name
+    std::map<std::string, std::string> m_parameterMap;  // param name -> variable name
+    std::map<std::string, const Expression*> m_parameterExprs;  // param name -> literal argument
+    int m_nextInlineTemp;  // Numbers per-call argument temporaries
 
     // Configuration
     bool m_traceEnabled;
@@ -593,6 +727,35 @@ private:
     // Loop label stacks for proper jump-back handling
     std::vector<int> m_whileLoopLabels;  // Stack of WHILE loop start labels
 
+    // Parallel SUB/FUNCTION bodies: with more than one thread the program is
+    // generated without them, each body is generated on the pool by a worker
+    // generator and spliced in before its END_FUNCTION / END_SUB. Labels,
+    // DEF FN temporaries and switch tables a body allocates are numbered
+    // from DEFERRED_ID_BASE and renumbered in program order by the splice,
+    // so the result matches generating everything in one pass
+    static const int DEFERRED_ID_BASE = 1 << 24;
+    struct DeferredBody {
+        const std::vector<StatementPtr>* statements;
+        int lineNumber;
+        int blockId;
+        size_t insertAt;  // Skeleton index of the END_FUNCTION / END_SUB
+        std::map<std::string, UserFunction> userFunctions;  // DEF FNs visible at the definition
+
+        std::vector<IRInstruction> instructions;
+        std::vector<IRSwitchTable> switchTables;
+        bool escaped = false;  // Defined a DEF FN or left a WHILE open: needs the serial pass
+    };
+    int m_threadCount;
+    bool m_deferBodies;
+    std::vector<DeferredBody> m_deferredBodies;
+    int m_firstDynamicLabel;  // First label not allocated to a CFG block
+    int m_userFunctionDefs;   // DEF FN statements generated so far
+
+    void generateProcedureBody(const std::vector<StatementPtr>& body, int lineNumber);
+    void generateDeferredBody(DeferredBody& body);
+    bool generateDeferredBodies();
+    void spliceDeferredBodies();
+
     // === Code Generation Methods ===
 
     // Generate code for a basic block
@@ -615,6 +778,7 @@ private:
     void generateMidAssign(const MidAssignStatement* stmt, int lineNumber);
     void generateIf(const IfStatement* stmt, int lineNumber);
     void generateCase(const CaseStatement* stmt, int lineNumber);
+    bool generateSwitch(const CaseStatement* stmt, int lineNumber);
     void generateFor(const ForStatement* stmt, int lineNumber);
     void generateForIn(const ForInStatement* stmt, int lineNumber);
     void generateNext(const NextStatement* stmt, int lineNumber);
@@ -676,9 +840,6 @@ private:
     // Type checking helpers
     bool isStringExpression(const Expression* expr) const;
     
-    // Expression serialization helper (for deferred WHILE condition evaluation)
-    std::string serializeExpression(const Expression* expr);
-
     // Set current source context for emitted instructions
     void setSourceContext(int lineNumber, int blockId);
 
@@ -0,0 +1,316 @@
+//
+// fasterbasic_jitdiag.cpp
+// FasterBASIC - JIT Trace Diagnostics Implementation
+//
+// A small Lua collector attached with jit.attach records each trace event
+// as a tab-separated string: where the trace started, where it aborted and
+// why (formatted the way -jv does), or how a compiled trace links. Events
+// are rare compared to samples, so the collector resolves positions itself;
+// mapping them to BASIC happens after the run.
+//
+
+#include "fasterbasic_jitdiag.h"
+#include <iomanip>
+#include <algorithm>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+
+extern "C" {
+#include <lua.h>
+#include <lauxlib.h>
+}
+
+namespace FasterBASIC {
+
+static const char* const COLLECTOR_SOURCE =
+    "local jutil = require('jit.util')\n"
+    "local hasVmdef, vmdef = pcall(require, 'jit.vmdef')\n"
+    "local events, starts = {}, {}\n"
+    "local function where(func, pc)\n"
+    "    local fi = jutil.funcinfo(func, pc)\n"
+    "    return fi.source or '?', fi.currentline or 0\n"
+    "end\n"
+    "local function fmterr(err, info)\n"
+    "    if type(err) ~= 'number' then return tostring(err) end\n"
+    "    if type(info) == 'function' then\n"
+    "        local fi = jutil.funcinfo(info)\n"
+    "        if fi.loc then info = fi.loc\n"
+    "        elseif fi.ffid and hasVmdef then info = vmdef.ffnames[fi.ffid]\n"
+    "        elseif fi.ffid then info = 'builtin#' .. fi.ffid\n"
+    "        else info = '?' end\n"
+    "    end\n"
+    "    if not hasVmdef then\n"
+    "        return 'trace error ' .. err .. (info ~= nil and (' (' .. tostring(info) .. ')') or '')\n"
+    "    end\n"
+    "    local fmt = vmdef.traceerr[err] or ('trace error ' .. err)\n"
+    "    if fmt == 'NYI: bytecode %d' or fmt == 'NYI: bytecode %s' then\n"
+    "        fmt, info = 'NYI: bytecode %s', vmdef.bcnames:sub(6 * info + 1, 6 * info + 6):gsub(' +$', '')\n"
+    "    end\n"
+    "    local ok, msg = pcall(string.format, fmt, info)\n"
+    "    return ok and msg or fmt\n"
+    "end\n"
+    "local function trace(what, tr, func, pc, otr, oex)\n"
+    "    if what == 'start' then\n"
+    "        local src, line = where(func, pc)\n"
+    "        starts[tr] = src .. '\\t' .. line\n"
+    "        if oex == -1 then\n"
+    "            -- Stitched trace: it resumes right after an uncompiled call\n"
+    "            local csrc, cline = where(func, pc > 0 and pc - 1 or pc)\n"
+    "            events[#events + 1] = 'stitch\\t' .. csrc .. '\\t' .. cline .. '\\t' .. line\n"
+    "        end\n"
+    "    elseif what == 'stop' then\n"
+    "        local ti = jutil.traceinfo(tr)\n"
+    "        events[#events + 1] = 'stop\\t' .. (starts[tr] or '?\\t0') .. '\\t' .. (ti and ti.linktype or '?')\n"
+    "    elseif what == 'abort' then\n"
+    "        local src, line = where(func, pc)\n"
+    "        events[#events + 1] = 'abort\\t' .. (starts[tr] or '?\\t0') .. '\\t' .. src .. '\\t' .. line ..\n"
+    "            '\\t' .. fmterr(otr, oex)\n"
+    "    elseif what == 'flush' then\n"
+    "        events[#events + 1] = 'flush'\n"
+    "    end\n"
+    "end\n"
+    "return {\n"
+    "    start = function() jit.attach(trace, 'trace') end,\n"
+    "    stop = function() jit.attach(trace) return events end,\n"
+    "}\n";
+
+// Generated constructs that commonly stop traces, by the Lua they compile
+// to; first match wins, so specific runtime calls precede general ones
+static const struct {
+    const char* pattern;
+    const char* construct;
+} KNOWN_CONSTRUCTS[] = {
+    {"basic_read_data", "READ uses C binding"},
+    {"basic_restore", "RESTORE uses C binding"},
+    {"basic_print_file", "PRINT # uses C binding"},
+    {"basic_write_file", "WRITE # uses C binding"},
+    {"basic_input_file", "INPUT # uses C binding"},
+    {"basic_line_input_file", "LINE INPUT # uses C binding"},
+    {"basic_eof", "EOF uses C binding"},
+    {"basic_open", "OPEN uses C binding"},
+    {"basic_close", "CLOSE uses C binding"},
+    {"basic_print", "PRINT uses C binding"},
+    {"basic_input", "INPUT uses C binding"},
+    {"basic_cancel_poll", "loop cancellation poll"},
+    {"_gosub.", "table-dispatched GOSUB"},
+    {"vars[", "cold variable table access"},
+    {"string.format", "string formatting"},
+    {"goto ", "GOTO jump"},
+};
+
+// Link types of compiled traces that hand control back to the interpreter
+// instead of looping or linking to another trace
+static bool isFallbackLink(const std::string& linkType) {
+    return linkType == "interpreter" || linkType == "none";
+}
+
+static std::vector<std::string> splitFields(const std::string& text, char separator) {
+    std::vector<std::string> fields;
+    size_t pos = 0;
+    while (true) {
+        size_t end = text.find(separator, pos);
+        fields.push_back(text.substr(pos, end == std::string::npos ? std::string::npos : end - pos));
+        if (end == std::string::npos) break;
+        pos = end + 1;
+    }
+    return fields;
+}
+
+// =============================================================================
+// Collection
+// =============================================================================
+
+TraceDiagnostics::TraceDiagnostics()
+    : m_collectorRef(LUA_NOREF)
+    , m_traceCount(0)
+    , m_abortCount(0)
+    , m_flushCount(0)
+    , m_unattributedAborts(0)
+{
+}
+
+bool TraceDiagnostics::start(lua_State* L) {
+    if (luaL_loadbuffer(L, COLLECTOR_SOURCE, strlen(COLLECTOR_SOURCE), "=fbc_jitdiag") != 0 ||
+        lua_pcall(L, 0, 1, 0) != 0) {
+        m_error = std::string("jit.util unavailable: ") + lua_tostring(L, -1);
+        lua_pop(L, 1);
+        return false;
+    }
+    m_collectorRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, m_collectorRef);
+    lua_getfield(L, -1, "start");
+    if (lua_pcall(L, 0, 0, 0) != 0) {
+        m_error = std::string("Cannot attach to the trace compiler: ") + lua_tostring(L, -1);
+        lua_pop(L, 2);
+        luaL_unref(L, LUA_REGISTRYINDEX, m_collectorRef);
+        m_collectorRef = LUA_NOREF;
+        return false;
+    }
+    lua_pop(L, 1);
+    return true;
+}
+
+void TraceDiagnostics::stop(lua_State* L, const LuaSourceMap& sourceMap, const std::string& luaCode) {
+    if (m_collectorRef == LUA_NOREF) return;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, m_collectorRef);
+    lua_getfield(L, -1, "stop");
+    if (lua_pcall(L, 0, 1, 0) != 0) {
+        m_error = std::string("Cannot detach from the trace compiler: ") + lua_tostring(L, -1);
+        lua_pop(L, 2);
+        luaL_unref(L, LUA_REGISTRYINDEX, m_collectorRef);
+        m_collectorRef = LUA_NOREF;
+        return;
+    }
+
+    std::vector<std::string> luaLines = splitFields(luaCode, '\n');
+    const char* chunkName = LuaSourceMap::CHUNK_NAME;
+
+    size_t eventCount = lua_objlen(L, -1);
+    for (size_t i = 1; i <= eventCount; i++) {
+        lua_rawgeti(L, -1, (int)i);
+        std::string event = lua_tostring(L, -1) ? lua_tostring(L, -1) : "";
+        lua_pop(L, 1);
+
+        // kind, start source, start line[, abort source, abort line, reason | link type]
+        std::vector<std::string> fields = splitFields(event, '\t');
+        if (fields[0] == "flush") {
+            m_flushCount++;
+        } else if (fields[0] == "stitch" && fields.size() >= 3) {
+            // source, line of the call the trace was stitched around
+            if (fields[1] == chunkName) {
+                addFinding(m_fallbacks, atoi(fields[2].c_str()), false, "stitched around an uncompiled call",
+                           sourceMap, luaLines);
+            }
+        } else if (fields[0] == "stop" && fields.size() >= 4) {
+            m_traceCount++;
+            m_linkTypes[fields[3]]++;
+            if (isFallbackLink(fields[3]) && fields[1] == chunkName) {
+                addFinding(m_fallbacks, atoi(fields[2].c_str()), false, fields[3], sourceMap, luaLines);
+            }
+        } else if (fields[0] == "abort" && fields.size() >= 6) {
+            m_abortCount++;
+            // Blame the line that aborted; when that is inside a runtime
+            // helper, blame the program line the trace started from
+            if (fields[3] == chunkName && sourceMap.basicLineAt(atoi(fields[4].c_str())) > 0) {
+                addFinding(m_aborts, atoi(fields[4].c_str()), false, fields[5], sourceMap, luaLines);
+            } else if (fields[1] == chunkName && sourceMap.basicLineAt(atoi(fields[2].c_str())) > 0) {
+                addFinding(m_aborts, atoi(fields[2].c_str()), true, fields[5], sourceMap, luaLines);
+            } else {
+                m_unattributedAborts++;
+            }
+        }
+    }
+    lua_pop(L, 2);
+
+    luaL_unref(L, LUA_REGISTRYINDEX, m_collectorRef);
+    m_collectorRef = LUA_NOREF;
+}
+
+void TraceDiagnostics::addFinding(std::map<std::pair<int, std::string>, Finding>& findings,
+                                  int luaLine, bool inRuntime, const std::string& reason,
+                                  const LuaSourceMap& sourceMap, const std::vector<std::string>& luaLines) {
+    int basicLine = sourceMap.basicLineAt(luaLine);
+    if (basicLine <= 0) return;
+
+    Finding& finding = findings[{basicLine, reason}];
+    if (finding.count == 0) {
+        std::string function = sourceMap.functionAt(luaLine);
+        std::string code = luaLine >= 1 && luaLine <= (int)luaLines.size() ? luaLines[luaLine - 1] : "";
+        size_t first = code.find_first_not_of(" \t");
+        code = first == std::string::npos ? "" : code.substr(first);
+
+        finding.basicLine = basicLine;
+        finding.function = function.empty() ? "main" : function;
+        finding.reason = reason;
+        finding.construct = classifyConstruct(code);
+        finding.luaCode = code;
+        finding.inRuntime = inRuntime;
+    }
+    finding.count++;
+}
+
+std::string TraceDiagnostics::classifyConstruct(const std::string& luaLine) {
+    for (const auto& known : KNOWN_CONSTRUCTS) {
+        if (luaLine.find(known.pattern) != std::string::npos) return known.construct;
+    }
+
+    // Any other runtime helper call
+    size_t call = luaLine.find("basic_");
+    if (call != std::string::npos) {
+        size_t end = luaLine.find('(', call);
+        if (end != std::string::npos) return "runtime call " + luaLine.substr(call, end - call);
+    }
+    return "";
+}
+
+// =============================================================================
+// Reporting
+// =============================================================================
+
+void TraceDiagnostics::writeReport(std::ostream& out, size_t maxEntries) const {
+    out << "\n=== JIT Trace Diagnostics ===\n";
+    out << "  Traces: " << m_traceCount << " compiled";
+    if (!m_linkTypes.empty()) {
+        out << " (";
+        bool first = true;
+        for (const auto& [linkType, count] : m_linkTypes) {
+            out << (first ? "" : ", ") << count << " " << linkType;
+            first = false;
+        }
+        out << ")";
+    }
+    out << ", " << m_abortCount << " aborted, " << m_flushCount << " flushes\n";
+
+    if (m_aborts.empty() && m_fallbacks.empty()) {
+        out << "  No aborted traces or interpreter fallbacks in the program\n";
+    }
+    if (!m_aborts.empty()) {
+        out << "\n  Aborted traces (most frequent first):\n";
+        writeFindings(out, m_aborts, "Reason", maxEntries);
+        if (m_aborts.begin()->second.reason.compare(0, 12, "trace error ") == 0) {
+            out << "  (jit.vmdef is not on package.path, so abort reasons are shown as numbers)\n";
+        }
+    }
+    if (m_unattributedAborts > 0) {
+        out << "  (" << m_unattributedAborts << " aborts outside the program)\n";
+    }
+    if (!m_fallbacks.empty()) {
+        out << "\n  Traces leaving compiled code:\n";
+        writeFindings(out, m_fallbacks, "Link", maxEntries);
+    }
+    out << "\n";
+}
+
+void TraceDiagnostics::writeFindings(std::ostream& out,
+                                     const std::map<std::pair<int, std::string>, Finding>& findings,
+                                     const char* reasonHeading, size_t maxEntries) const {
+    std::vector<const Finding*> sorted;
+    for (const auto& entry : findings) sorted.push_back(&entry.second);
+    std::sort(sorted.begin(), sorted.end(), [](const Finding* a, const Finding* b) {
+        if (a->count != b->count) return a->count > b->count;
+        return a->basicLine < b->basicLine;
+    });
+
+    out << "     Count     Line  Function          " << reasonHeading << "\n";
+    for (size_t i = 0; i < sorted.size() && i < maxEntries; i++) {
+        const Finding& f = *sorted[i];
+        out << "  " << std::setw(8) << f.count
+            << " " << std::setw(8) << f.basicLine
+            << "  " << std::left << std::setw(16) << f.function << std::right
+            << "  " << f.reason << (f.inRuntime ? " (in a runtime helper)" : "") << "\n";
+        if (!f.construct.empty()) {
+            out << "                     construct: " << f.construct << "\n";
+        }
+        if (!f.luaCode.empty()) {
+            out << "                     lua: " << f.luaCode.substr(0, 100) << "\n";
+        }
+    }
+    if (sorted.size() > maxEntries) {
+        out << "  ... " << (sorted.size() - maxEntries) << " more\n";
+    }
+}
+
+} // namespace FasterBASIC
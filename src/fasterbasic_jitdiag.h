@@ -0,0 +1,78 @@
+//
+// fasterbasic_jitdiag.h
+// FasterBASIC - JIT Trace Diagnostics
+//
+// Watches LuaJIT's trace compiler through jit.attach while a program runs
+// and attributes every aborted trace, and every trace that falls back to
+// the interpreter, to the BASIC line and the generated construct behind
+// it, so slow hot loops come with an explanation.
+//
+
+#ifndef FASTERBASIC_JITDIAG_H
+#define FASTERBASIC_JITDIAG_H
+
+#include "fasterbasic_lua_codegen.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <ostream>
+
+struct lua_State;
+
+namespace FasterBASIC {
+
+// =============================================================================
+// Trace Diagnostics
+// =============================================================================
+
+class TraceDiagnostics {
+public:
+    TraceDiagnostics();
+
+    // Attach to the trace compiler; the program must be loaded under
+    // LuaSourceMap::CHUNK_NAME. False (see getError) without jit.attach
+    bool start(lua_State* L);
+
+    // Detach and attribute the recorded events; luaCode is the generated
+    // chunk, used to name the construct on each offending line
+    void stop(lua_State* L, const LuaSourceMap& sourceMap, const std::string& luaCode);
+
+    // Aborts and interpreter fallbacks, most frequent first
+    void writeReport(std::ostream& out, size_t maxEntries = 25) const;
+
+    int getAbortCount() const { return m_abortCount; }
+    const std::string& getError() const { return m_error; }
+
+private:
+    // Aborts (or fallbacks) with the same line and reason, counted together
+    struct Finding {
+        int basicLine = 0;
+        std::string function;
+        std::string reason;      // LuaJIT abort reason, or trace link type
+        std::string construct;   // Generated construct on the offending line
+        std::string luaCode;     // That line of generated Lua, trimmed
+        bool inRuntime = false;  // Aborted inside a runtime helper called from basicLine
+        int count = 0;
+    };
+
+    void addFinding(std::map<std::pair<int, std::string>, Finding>& findings,
+                    int luaLine, bool inRuntime, const std::string& reason,
+                    const LuaSourceMap& sourceMap, const std::vector<std::string>& luaLines);
+    static std::string classifyConstruct(const std::string& luaLine);
+    void writeFindings(std::ostream& out, const std::map<std::pair<int, std::string>, Finding>& findings,
+                       const char* reasonHeading, size_t maxEntries) const;
+
+    int m_collectorRef;
+    int m_traceCount;
+    int m_abortCount;
+    int m_flushCount;
+    int m_unattributedAborts;                          // Aborts outside the program chunk
+    std::map<std::string, int> m_linkTypes;            // Link type -> compiled traces
+    std::map<std::pair<int, std::string>, Finding> m_aborts;     // (BASIC line, reason)
+    std::map<std::pair<int, std::string>, Finding> m_fallbacks;  // (BASIC line, link type)
+    std::string m_error;
+};
+
+} // namespace FasterBASIC
+
+#endif // FASTERBASIC_JITDIAG_H
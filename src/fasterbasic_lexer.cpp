@@ -21,7 +21,9 @@ std::map<std::string, TokenType> Lexer::s_keywords;
 std::once_flag Lexer::s_keywordsInitFlag;
 
 // Registry-based dynamic commands
-std::map<std::string, TokenType> Lexer::s_dynamicCommands;
+std::shared_ptr<const Lexer::DynamicCommandTable> Lexer::s_dynamicCommands;
+uint64_t Lexer::s_dynamicCommandsGeneration = 0;
+std::mutex Lexer::s_dynamicCommandsMutex;
 
 void Lexer::initializeKeywords() {
     std::call_once(s_keywordsInitFlag, []() {
@@ -167,15 +169,20 @@ void Lexer::initializeKeywords() {
     });
 }
 
-void Lexer::initializeDynamicCommands() {
-    // Clear any existing dynamic commands
-    s_dynamicCommands.clear();
-    
+std::shared_ptr<const Lexer::DynamicCommandTable> Lexer::initializeDynamicCommands() {
+    std::lock_guard<std::mutex> lock(s_dynamicCommandsMutex);
+
     // Initialize the global registry if not already done
     FasterBASIC::ModularCommands::initializeGlobalRegistry();
     
     // Get all registered commands and functions and create tokens for them
     auto& registry = FasterBASIC::ModularCommands::getGlobalCommandRegistry();
+    uint64_t generation = registry.getGeneration();
+    if (s_dynamicCommands && s_dynamicCommandsGeneration == generation) {
+        return s_dynamicCommands;
+    }
+
+    auto table = std::make_shared<DynamicCommandTable>();
     auto commandNames = registry.getCommandNames();
     auto functionNames = registry.getFunctionNames();
     
@@ -188,12 +195,16 @@ void Lexer::initializeDynamicCommands() {
         if (commandName == "INPUT_AT") {
             continue;
         }
-        s_dynamicCommands[commandName] = TokenType::REGISTRY_COMMAND;
+        (*table)[commandName] = TokenType::REGISTRY_COMMAND;
     }
     
     for (const auto& functionName : functionNames) {
-        s_dynamicCommands[functionName] = TokenType::REGISTRY_FUNCTION;
+        (*table)[functionName] = TokenType::REGISTRY_FUNCTION;
     }
+
+    s_dynamicCommands = table;
+    s_dynamicCommandsGeneration = generation;
+    return s_dynamicCommands;
 }
 
 // =============================================================================
@@ -206,7 +217,7 @@ Lexer::Lexer()
     , m_column(1)
 {
     initializeKeywords();
-    initializeDynamicCommands();
+    m_dynamicCommands = initializeDynamicCommands();
 }
 
 Lexer::~Lexer() {
@@ -532,8 +543,8 @@ TokenType Lexer::getKeywordType(const std::string& text) const {
     }
     
     // Then check dynamic registry commands
-    auto dynIt = s_dynamicCommands.find(text);
-    if (dynIt != s_dynamicCommands.end()) {
+    auto dynIt = m_dynamicCommands->find(text);
+    if (dynIt != m_dynamicCommands->end()) {
         return dynIt->second;
     }
     
@@ -542,7 +553,7 @@ TokenType Lexer::getKeywordType(const std::string& text) const {
 
 bool Lexer::isKeyword(const std::string& text) const {
     return s_keywords.find(text) != s_keywords.end() || 
-           s_dynamicCommands.find(text) != s_dynamicCommands.end();
+           m_dynamicCommands->find(text) != m_dynamicCommands->end();
 }
 
 // =============================================================================
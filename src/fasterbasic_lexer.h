@@ -15,6 +15,8 @@
 #include <map>
 #include <cctype>
 #include <memory>
+#include <mutex>
+#include <cstdint>
 
 namespace FasterBASIC {
 
@@ -76,9 +78,15 @@ private:
     static std::once_flag s_keywordsInitFlag;
     static void initializeKeywords();
     
-    // Registry-based dynamic commands
-    static std::map<std::string, TokenType> s_dynamicCommands;
-    static void initializeDynamicCommands();
+    // Registry-based dynamic commands: one shared table, rebuilt only when
+    // the registry has changed since; each lexer keeps the table it was
+    // created with, so lexers on other threads never see it change
+    using DynamicCommandTable = std::map<std::string, TokenType>;
+    std::shared_ptr<const DynamicCommandTable> m_dynamicCommands;
+    static std::shared_ptr<const DynamicCommandTable> s_dynamicCommands;
+    static uint64_t s_dynamicCommandsGeneration;
+    static std::mutex s_dynamicCommandsMutex;
+    static std::shared_ptr<const DynamicCommandTable> initializeDynamicCommands();
     
     // Character inspection
     char currentChar() const;
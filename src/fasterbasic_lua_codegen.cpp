@@ -6,6 +6,7 @@
 #include "fasterbasic_lua_codegen.h"
 #include "../runtime/ConstantsManager.h"
 #include "modular_commands.h"
+#include "fasterbasic_threadpool.h"
 #include <chrono>
 #include <iostream>
 #include <iomanip>
@@ -14,6 +15,10 @@
 #include <unordered_set>
 #include <algorithm>
 #include <numeric>
+#include <cstdlib>
+#include <cctype>
+#include <cmath>
+#include <climits>
 
 namespace FasterBASIC {
 
@@ -31,6 +36,25 @@ void LuaCodeGenStats::print() const {
     std::cout << "Generation Time: " << generationTimeMs << " ms" << std::endl;
 }
 
+// =============================================================================
+// LuaSourceMap Implementation
+// =============================================================================
+
+const char* const LuaSourceMap::CHUNK_NAME = "=fbc_program";
+const char* const LuaSourceMap::COUNTERS_GLOBAL = "fbc_line_counts";
+
+int LuaSourceMap::basicLineAt(int luaLine) const {
+    // Last range starting at or before luaLine
+    auto it = std::upper_bound(lines.begin(), lines.end(), std::make_pair(luaLine, INT_MAX));
+    return it == lines.begin() ? 0 : std::prev(it)->second;
+}
+
+std::string LuaSourceMap::functionAt(int luaLine) const {
+    auto it = std::upper_bound(functions.begin(), functions.end(), luaLine,
+                               [](int line, const std::pair<int, std::string>& f) { return line < f.first; });
+    return it == functions.begin() ? std::string() : std::prev(it)->second;
+}
+
 // =============================================================================
 // Helper Functions
 // =============================================================================
@@ -63,17 +87,192 @@ static std::string mangleName(const std::string& name) {
     }
 }
 
+// Parse an integer literal as produced by the expression optimizer ("4", "-2", "(-2)")
+static bool parseIntegerLiteral(const std::string& expr, long long& value) {
+    std::string text = expr;
+    while (text.size() >= 2 && text.front() == '(' && text.back() == ')') {
+        text = text.substr(1, text.size() - 2);
+    }
+    if (text.empty()) return false;
+    char* end = nullptr;
+    value = std::strtoll(text.c_str(), &end, 10);
+    return end && *end == '\0';
+}
+
+// True for a numeric literal, integral or not, optionally parenthesized
+static bool isNumberLiteral(const std::string& expr) {
+    std::string text = expr;
+    while (text.size() >= 2 && text.front() == '(' && text.back() == ')') {
+        text = text.substr(1, text.size() - 2);
+    }
+    if (text.empty()) return false;
+    char* end = nullptr;
+    std::strtod(text.c_str(), &end);
+    return end && *end == '\0';
+}
+
+// True for the IR name of a string variable or string function (A$ or A_STRING)
+static bool isStringName(const std::string& name) {
+    return name.find("_STRING") != std::string::npos || (!name.empty() && name.back() == '$');
+}
+
+// Result facts of the builtins whose Lua lowering always yields an integer
+static bool builtinFacts(const std::string& name, const ValueFacts& arg, ValueFacts& result) {
+    if (name == "INT" || name == "FIX") {
+        // math.floor / basic_fix are monotonic, so a bounded argument stays bounded
+        if (arg.isInteger()) {
+            result = arg;
+        } else if (arg.isNumeric() && std::isfinite(arg.low) && std::isfinite(arg.high)) {
+            result = name == "INT" ? ValueFacts::integer(std::floor(arg.low), std::floor(arg.high))
+                                   : ValueFacts::integer(std::trunc(arg.low), std::trunc(arg.high));
+        } else {
+            result = ValueFacts::integer();
+        }
+        return true;
+    }
+    if (name == "LEN") {
+        result = ValueFacts::integer(0.0, HUGE_VAL);
+        return true;
+    }
+    if (name == "SGN") {
+        result = arg.isNumeric() ? ValueFacts::integer(-1.0, 1.0) : ValueFacts::unknown();
+        return true;
+    }
+    return false;
+}
+
+// Recover the text of a literal produced by quoteLuaString
+static bool unquoteLuaString(const std::string& quoted, std::string& text) {
+    if (quoted.size() < 2 || quoted.front() != '"' || quoted.back() != '"') return false;
+    text.clear();
+    for (size_t i = 1; i + 1 < quoted.size(); i++) {
+        char c = quoted[i];
+        if (c == '\\' && i + 2 < quoted.size()) {
+            c = quoted[++i];
+            switch (c) {
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                default: break;  // \" and \\ stand for themselves
+            }
+        }
+        text += c;
+    }
+    return true;
+}
+
+// Add every Lua identifier in text[begin, end) to names. Strings and
+// comments are scanned too, which can only keep a prelude section alive.
+static void collectLuaIdentifiers(const std::string& text, size_t begin, size_t end,
+                                  std::unordered_set<std::string>& names) {
+    size_t i = begin;
+    while (i < end) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (std::isalpha(c) || c == '_') {
+            size_t start = i;
+            while (i < end && (std::isalnum(static_cast<unsigned char>(text[i])) || text[i] == '_')) i++;
+            names.insert(text.substr(start, i - start));
+        } else if (std::isdigit(c)) {
+            // Skip numbers whole so 1e5 or 0x1F do not yield identifiers
+            while (i < end && (std::isalnum(static_cast<unsigned char>(text[i])) || text[i] == '.')) i++;
+        } else {
+            i++;
+        }
+    }
+}
+
+// Lower a constant PRINT USING template to a string.format pattern and its
+// converted arguments, matching basic_compile_using in the prelude. Returns
+// false if the field count differs from the value count (the runtime path
+// handles missing and surplus values).
+static bool compileUsingFormat(const std::string& format,
+                               const std::vector<std::string>& values,
+                               const std::vector<ValueFacts>& facts,
+                               std::string& pattern, std::vector<std::string>& args) {
+    auto text = [&](size_t v) {
+        return facts[v].kind == ValueFacts::Kind::STRING ? values[v] : "tostring(" + values[v] + ")";
+    };
+    auto number = [&](size_t v) {
+        return facts[v].isNumeric() ? values[v] : "(tonumber(" + values[v] + ") or 0)";
+    };
+
+    pattern.clear();
+    args.clear();
+    size_t i = 0;
+    while (i < format.size()) {
+        char ch = format[i];
+        size_t endSlash = ch == '\\' ? format.find('\\', i + 1) : std::string::npos;
+        bool isField = ch == '&' || ch == '!' || ch == '#' || endSlash != std::string::npos;
+        size_t v = args.size();
+        if (isField && v >= values.size()) return false;
+
+        if (ch == '&') {
+            pattern += "%s";
+            args.push_back(text(v));
+            i++;
+        } else if (ch == '!') {
+            pattern += "%.1s";
+            args.push_back(text(v));
+            i++;
+        } else if (endSlash != std::string::npos) {
+            std::string width = std::to_string(endSlash - i + 1);
+            pattern += "%-" + width + "." + width + "s";
+            args.push_back(text(v));
+            i = endSlash + 1;
+        } else if (ch == '#') {
+            int before = 0, after = 0;
+            bool hasDecimal = false, hasComma = false;
+            for (; i < format.size() && (format[i] == '#' || format[i] == '.' || format[i] == ','); i++) {
+                if (format[i] == '.') {
+                    hasDecimal = true;
+                } else if (format[i] == ',') {
+                    hasComma = true;
+                } else if (hasDecimal) {
+                    after++;
+                } else {
+                    before++;
+                }
+            }
+            if (hasDecimal) {
+                pattern += "%" + std::to_string(before + 1 + after) + "." + std::to_string(after) + "f";
+                args.push_back(number(v));
+            } else if (hasComma) {
+                pattern += "%" + std::to_string(before) + "s";
+                args.push_back("basic_using_commas(" + number(v) + ")");
+            } else {
+                pattern += "%" + std::to_string(before) + "d";
+                args.push_back(facts[v].isInteger() ? values[v] : "math.floor(" + number(v) + ")");
+            }
+        } else {
+            if (ch == '%') pattern += '%';
+            pattern += ch;
+            i++;
+        }
+    }
+    return args.size() == values.size();
+}
+
 // =============================================================================
 // LuaCodeGenerator Implementation
 // =============================================================================
 
 LuaCodeGenerator::LuaCodeGenerator()
-    : m_usesConstants(false) {
+    : m_usesConstants(false)
+    , m_cancellableLoops(false)
+    , m_lineCounts(false)
+    , m_counterSlots(0)
+    , m_runCounter(0)
+    , m_pendingLineCounter(0) {
 }
 
 LuaCodeGenerator::LuaCodeGenerator(const LuaCodeGenConfig& config)
     : m_config(config)
-    , m_usesConstants(false) {
+    , m_usesConstants(false)
+    , m_cancellableLoops(false)
+    , m_lineCounts(false)
+    , m_counterSlots(0)
+    , m_runCounter(0)
+    , m_pendingLineCounter(0) {
 }
 
 LuaCodeGenerator::~LuaCodeGenerator() {
@@ -93,7 +292,9 @@ std::string LuaCodeGenerator::generate(const IRCode& irCode) {
     m_exprStack.clear();
     m_labelAddresses.clear();
     m_forLoopStack.clear();
+    m_forInLoopStack.clear();
     m_doLoopStack.clear();
+    m_whileLoopStack.clear();
     m_tempVarCounter = 0;
     m_gosubReturnCounter = 0;
     m_gosubReturnIds.clear();
@@ -108,12 +309,28 @@ std::string LuaCodeGenerator::generate(const IRCode& irCode) {
     m_unicodeMode = irCode.unicodeMode;  // Copy OPTION UNICODE setting from IR
     m_bufferMode = m_config.enableBufferMode;  // Copy buffer mode setting from config
     m_errorTracking = irCode.errorTracking;  // Copy OPTION ERROR setting from IR
+    m_cancellableLoops = irCode.cancellableLoops;  // Copy OPTION CANCELLABLE setting from IR
+    m_lineCounts = irCode.lineCounts || m_config.countLines;  // OPTION PROFILE COUNTS, or forced by the host
+    m_lineCounterSlots.clear();
+    m_countedLines.clear();
+    m_counterSlots = 0;
+    m_runCounter = 0;
+    m_pendingLineCounter = 0;
+    m_counterFixups.clear();
+    m_sourceMap.counters.clear();
+    m_sourceMap.counterSlots = 0;
     m_lastEmittedLine = 0;  // Track last emitted line number
     m_constantsManager = irCode.constantsManager;  // Copy constants manager pointer for inlining
     m_variableAccess.clear();
     m_hotVariables.clear();
     m_coldVariableIDs.clear();
     m_usedLocalSlots = 0;
+    m_unicodeLiteralIds.clear();
+    m_unicodeLiterals.clear();
+    m_preludeSections.clear();
+    m_switchTables = &irCode.switchTables;
+    m_openSwitches.clear();
+    m_inlinedLines = &irCode.inlinedLines;
 
     m_stats.irInstructions = irCode.instructions.size();
 
@@ -123,6 +340,15 @@ std::string LuaCodeGenerator::generate(const IRCode& irCode) {
     // Second pass: collect function/sub definitions
     collectFunctionDefinitions(irCode);
 
+    // Prove which variables only ever hold integers, booleans or strings
+    inferVariableFacts(irCode);
+
+    // Decide which loops of each nest poll for cancellation
+    planLoopCancellation(irCode);
+
+    // Find loops that build a string by repeated appends
+    analyzeStringBuilders(irCode);
+
     // Third pass: analyze variable access patterns for hot/cold caching
     if (m_config.useVariableCache) {
         analyzeVariableAccess(irCode);
@@ -131,11 +357,29 @@ std::string LuaCodeGenerator::generate(const IRCode& irCode) {
 
     // Generate code sections
     emitHeader();
+    size_t literalPoolPos = m_output.str().size();
     emitVariableDeclarations();
     emitArrayDeclarations();
     emitDataSection(irCode);
     emitUserFunctions(irCode);
     emitMainFunction(irCode);
+
+    // The literal pool and the number of line counters are only known once
+    // the body has been generated, so splice them in directly after the header
+    if (!m_unicodeLiterals.empty() || !irCode.switchTables.empty() || !m_countedLines.empty()) {
+        std::string code = m_output.str();
+        code.insert(literalPoolPos, generateUnicodeLiteralPool() + generateSwitchTables() + generateLineCounters());
+        m_output.str(code);
+        m_output.seekp(0, std::ios_base::end);
+    }
+
+    // Drop (or import from the shared module) the runtime helpers; only
+    // the body says which of them the program needs
+    shakePrelude();
+
+    // The footer carries the line map, so it goes last, once every
+    // generated line is in its final position
+    buildSourceMap();
     emitFooter();
 
     auto endTime = std::chrono::high_resolution_clock::now();
@@ -149,6 +393,8 @@ std::string LuaCodeGenerator::generate(const IRCode& irCode) {
 // =============================================================================
 
 void LuaCodeGenerator::emitHeader() {
+    // Runtime helpers are emitted in prelude sections; shakePrelude() removes
+    // the ones the generated code never references
     emitLine("-- FasterBASIC Generated Lua Code");
     emitLine("-- Optimized for LuaJIT trace compilation");
     emitLine("");
@@ -158,10 +404,12 @@ void LuaCodeGenerator::emitHeader() {
         emitLine("local ffi = require('ffi')");
         emitLine("");
 
-        emitLine("-- Bitwise operations (check if already injected by runtime)");
-        emitLine("local bitwise = bitwise or require('runtime.bitwise_ffi_bindings')");
+        beginPreludeSection({"bit"}, false);
+        emitLine("local bit = require('bit')  -- Direct ops on values proven to be int32");
         emitLine("");
+        endPreludeSection();
         
+        beginPreludeSection({"string_ok", "string_lib"}, false);
         emitLine("-- String functions library (BCX-compatible extended functions)");
         emitLine("local string_ok, string_lib = pcall(require, 'runtime.string_functions')");
         emitLine("if not string_ok then");
@@ -169,7 +417,9 @@ void LuaCodeGenerator::emitHeader() {
         emitLine("    string_ok, string_lib = pcall(dofile, 'runtime/string_functions.lua')");
         emitLine("end");
         emitLine("");
+        endPreludeSection();
         
+        beginPreludeSection({"math_ok", "math_lib"}, false);
         emitLine("-- Math functions library (BCX-compatible extended functions)");
         emitLine("local math_ok, math_lib = pcall(require, 'runtime.math_functions')");
         emitLine("if not math_ok then");
@@ -177,6 +427,7 @@ void LuaCodeGenerator::emitHeader() {
         emitLine("    math_ok, math_lib = pcall(dofile, 'runtime/math_functions.lua')");
         emitLine("end");
         emitLine("");
+        endPreludeSection();
     }
 
     // Constants are now inlined directly, no runtime needed
@@ -192,12 +443,16 @@ void LuaCodeGenerator::emitHeader() {
         emitLine("    unicode = unicode_mod");
         emitLine("end");
         emitLine("");
+        emitLine("-- Codepoint tables shared from the literal pool (must not be mutated in place)");
+        emitLine("local _ustr_const = {}");
+        emitLine("");
     }
 
     emitLine("-- FFI support for high-performance numeric arrays");
     emitLine("local ffi_ok, ffi = pcall(require, 'ffi')");
     emitLine("local use_ffi = ffi_ok and ffi and jit and jit.status()");
     emitLine("");
+    beginPreludeSection({"create_ffi_array"});
     emitLine("-- FFI array creation helper");
     emitLine("local function create_ffi_array(size, element_type)");
     emitLine("    if not use_ffi then return nil end");
@@ -212,6 +467,8 @@ void LuaCodeGenerator::emitHeader() {
     emitLine("    return ok and result or nil");
     emitLine("end");
     emitLine("");
+    endPreludeSection();
+    beginPreludeSection({"detect_array_type"});
     emitLine("-- Array type detection helper");
     emitLine("local function detect_array_type(type_suffix)");
     emitLine("    if type_suffix == '%' then return 'int32_t' end  -- INTEGER");
@@ -222,9 +479,11 @@ void LuaCodeGenerator::emitHeader() {
     emitLine("    return 'double' -- Default to DOUBLE for untyped numeric");
     emitLine("end");
     emitLine("");
+    endPreludeSection();
     
     // Load string and math functions libraries even when not using LuaJIT hints
     if (!m_config.useLuaJITHints) {
+        beginPreludeSection({"string_ok", "string_lib"}, false);
         emitLine("-- String functions library (BCX-compatible extended functions)");
         emitLine("local string_ok, string_lib = pcall(require, 'runtime.string_functions')");
         emitLine("if not string_ok then");
@@ -232,7 +491,9 @@ void LuaCodeGenerator::emitHeader() {
         emitLine("    string_ok, string_lib = pcall(dofile, 'runtime/string_functions.lua')");
         emitLine("end");
         emitLine("");
+        endPreludeSection();
         
+        beginPreludeSection({"math_ok", "math_lib"}, false);
         emitLine("-- Math functions library (BCX-compatible extended functions)");
         emitLine("local math_ok, math_lib = pcall(require, 'runtime.math_functions')");
         emitLine("if not math_ok then");
@@ -240,6 +501,7 @@ void LuaCodeGenerator::emitHeader() {
         emitLine("    math_ok, math_lib = pcall(dofile, 'runtime/math_functions.lua')");
         emitLine("end");
         emitLine("");
+        endPreludeSection();
     }
     
     emitLine("-- Runtime support functions");
@@ -247,33 +509,89 @@ void LuaCodeGenerator::emitHeader() {
     emitLine("-- It prints to the runtime text grid at the current cursor position");
     emitLine("");
 
+    beginPreludeSection({"basic_input"});
     emitLine("local function basic_input()");
     emitLine("    return tonumber(io.read()) or 0");
     emitLine("end");
     emitLine("");
+    endPreludeSection();
 
+    beginPreludeSection({"basic_rnd"});
     emitLine("local function basic_rnd()");
     emitLine("    return math.random()");
     emitLine("end");
     emitLine("");
-
-    emitLine("-- BASIC Boolean Conversion Functions");
-    emitLine("-- BASIC uses 0 for FALSE and -1 for TRUE");
-    emitLine("-- Lua uses false and true, where ONLY false and nil are falsy (0 is truthy!)");
-    emitLine("");
-    emitLine("-- Convert BASIC boolean (0/-1 or any number) to Lua boolean");
-    emitLine("-- Also handles Lua booleans (true/false) from comparison operators");
-    emitLine("local function basicBoolToLua(val)");
-    emitLine("    if type(val) == 'boolean' then return val end");
-    emitLine("    return val ~= 0");
-    emitLine("end");
-    emitLine("");
-    emitLine("-- Convert Lua boolean to BASIC boolean (-1 for true, 0 for false)");
-    emitLine("local function luaBoolToBasic(val)");
-    emitLine("    return val and -1 or 0");
+    endPreludeSection();
+
+    beginPreludeSection({"sb_new", "sb_append", "sb_set", "sb_tostring", "sb_len"});
+    emitLine("-- String builder: appends go into an FFI byte buffer that doubles as it");
+    emitLine("-- fills (a table of pieces without FFI), so building a string is linear");
+    emitLine("-- in its length. sb_tostring caches the string until the next append.");
+    emitLine("local sb_new, sb_append, sb_set, sb_tostring, sb_len");
+    emitLine("if use_ffi then");
+    emitLine("    local sb_bytes = ffi.typeof('uint8_t[?]')");
+    emitLine("    sb_append = function(b, s)");
+    emitLine("        if type(s) ~= 'string' then s = tostring(s) end");
+    emitLine("        local len, n = b.len, #s");
+    emitLine("        if len + n > b.cap then");
+    emitLine("            local cap = b.cap * 2");
+    emitLine("            while cap < len + n do cap = cap * 2 end");
+    emitLine("            local buf = sb_bytes(cap)");
+    emitLine("            ffi.copy(buf, b.buf, len)");
+    emitLine("            b.buf, b.cap = buf, cap");
+    emitLine("        end");
+    emitLine("        ffi.copy(b.buf + len, s, n)");
+    emitLine("        b.len = len + n");
+    emitLine("        b.str = nil");
+    emitLine("    end");
+    emitLine("    sb_tostring = function(b)");
+    emitLine("        local s = b.str");
+    emitLine("        if s == nil then");
+    emitLine("            s = ffi.string(b.buf, b.len)");
+    emitLine("            b.str = s");
+    emitLine("        end");
+    emitLine("        return s");
+    emitLine("    end");
+    emitLine("    sb_len = function(b) return b.len end");
+    emitLine("    sb_set = function(b, s)");
+    emitLine("        b.len = 0");
+    emitLine("        sb_append(b, s)");
+    emitLine("        b.str = s  -- Reads give back the value itself until it is appended to");
+    emitLine("    end");
+    emitLine("    sb_new = function(s)");
+    emitLine("        local b = {buf = sb_bytes(64), cap = 64, len = 0}");
+    emitLine("        sb_set(b, s or '')");
+    emitLine("        return b");
+    emitLine("    end");
+    emitLine("else");
+    emitLine("    sb_append = function(b, s)");
+    emitLine("        local n = b.n + 1");
+    emitLine("        b[n] = tostring(s)");
+    emitLine("        b.n = n");
+    emitLine("        b.str = nil");
+    emitLine("    end");
+    emitLine("    sb_tostring = function(b)");
+    emitLine("        local s = b.str");
+    emitLine("        if s == nil then");
+    emitLine("            s = table.concat(b, '', 1, b.n)");
+    emitLine("            b[1], b.n, b.str = s, 1, s");
+    emitLine("        end");
+    emitLine("        return s");
+    emitLine("    end");
+    emitLine("    sb_len = function(b) return #sb_tostring(b) end");
+    emitLine("    sb_set = function(b, s)");
+    emitLine("        b[1], b.n, b.str = tostring(s), 1, s");
+    emitLine("    end");
+    emitLine("    sb_new = function(s)");
+    emitLine("        local b = {n = 0}");
+    emitLine("        sb_set(b, s or '')");
+    emitLine("        return b");
+    emitLine("    end");
     emitLine("end");
     emitLine("");
+    endPreludeSection();
 
+    beginPreludeSection({"create_string_buffer"});
     emitLine("-- String Buffer System for Efficient MID$ Assignment");
     emitLine("-- Creates a mutable character array for efficient string manipulation");
     emitLine("local function create_string_buffer(initial_string)");
@@ -288,6 +606,8 @@ void LuaCodeGenerator::emitHeader() {
     emitLine("    return buffer");
     emitLine("end");
     emitLine("");
+    endPreludeSection();
+    beginPreludeSection({"buffer_to_string"});
     emitLine("-- Convert string buffer back to regular string");
     emitLine("local function buffer_to_string(buffer)");
     emitLine("    if not buffer or not buffer._is_buffer then");
@@ -296,6 +616,8 @@ void LuaCodeGenerator::emitHeader() {
     emitLine("    return table.concat(buffer, '', 1, buffer._length)");
     emitLine("end");
     emitLine("");
+    endPreludeSection();
+    beginPreludeSection({"mid_assign_buffer"});
     emitLine("-- Efficient MID$ assignment using string buffer");
     emitLine("local function mid_assign_buffer(buffer, pos, len, replacement)");
     emitLine("    if not buffer._is_buffer then");
@@ -321,11 +643,15 @@ void LuaCodeGenerator::emitHeader() {
     emitLine("    end");
     emitLine("end");
     emitLine("");
+    endPreludeSection();
+    beginPreludeSection({"is_string_buffer"});
     emitLine("-- Check if a value is a string buffer");
     emitLine("local function is_string_buffer(value)");
     emitLine("    return type(value) == 'table' and value._is_buffer == true");
     emitLine("end");
     emitLine("");
+    endPreludeSection();
+    beginPreludeSection({"ensure_string_buffer"});
     emitLine("-- Ensure a string value is converted to a buffer if needed");
     emitLine("local function ensure_string_buffer(value)");
     emitLine("    if is_string_buffer(value) then");
@@ -335,6 +661,8 @@ void LuaCodeGenerator::emitHeader() {
     emitLine("    end");
     emitLine("end");
     emitLine("");
+    endPreludeSection();
+    beginPreludeSection({"auto_convert_to_buffer"}, false);
     emitLine("-- Auto-convert variable to buffer mode for efficient MID$ assignment");
     emitLine("local function auto_convert_to_buffer(value)");
     if (m_bufferMode) {
@@ -346,7 +674,9 @@ void LuaCodeGenerator::emitHeader() {
     }
     emitLine("end");
     emitLine("");
+    endPreludeSection();
 
+    beginPreludeSection({"basic_mid_assign"}, false);
     emitLine("-- MID$ assignment function with intelligent buffer support");
     emitLine("-- Simulates: MID$(original$, pos, len) = replacement$");
 
@@ -361,11 +691,19 @@ void LuaCodeGenerator::emitHeader() {
         emitLine("    -- If position is beyond the string, return original unchanged");
         emitLine("    if pos > #original then return original end");
         emitLine("    ");
+        emitLine("    -- Literals are shared pool entries: copy before the first write");
+        emitLine("    if _ustr_const[original] then");
+        emitLine("        local copy = {}");
+        emitLine("        for i = 1, #original do copy[i] = original[i] end");
+        emitLine("        original = copy");
+        emitLine("    end");
+        emitLine("    ");
         emitLine("    -- Modify the table IN PLACE (tables are mutable!)");
         emitLine("    local replaceLen = math.min(len, #replacement)");
         emitLine("    for i = 1, replaceLen do");
         emitLine("        original[pos + i - 1] = replacement[i]");
         emitLine("    end");
+        emitLine("    if unicode.invalidate then unicode.invalidate(original) end");
         emitLine("    ");
         emitLine("    -- Return the modified table (same reference)");
         emitLine("    return original");
@@ -399,38 +737,23 @@ void LuaCodeGenerator::emitHeader() {
         emitLine("    -- If position is beyond the string, return original unchanged");
         emitLine("    if startPos > #original then return original end");
         emitLine("    ");
-        emitLine("    -- Build the result string");
-        emitLine("    local result = ''");
-        emitLine("    ");
-        emitLine("    -- Part 1: Copy everything before the replacement position");
-        emitLine("    if startPos > 1 then");
-        emitLine("        result = original:sub(1, startPos - 1)");
-        emitLine("    end");
-        emitLine("    ");
-        emitLine("    -- Part 2: Replace characters (up to min of len or replacement length)");
+        emitLine("    -- Characters replaced (up to min of len or replacement length)");
         emitLine("    local replaceLen = math.min(len, #replacement)");
-        emitLine("    result = result .. replacement:sub(1, replaceLen)");
-        emitLine("    ");
-        emitLine("    -- Part 3: Keep unreplaced characters in the target range");
-        emitLine("    if replaceLen < len then");
-        emitLine("        local keepStart = startPos + replaceLen");
-        emitLine("        local keepEnd = math.min(startPos + len - 1, #original)");
-        emitLine("        if keepStart <= keepEnd then");
-        emitLine("            result = result .. original:sub(keepStart, keepEnd)");
-        emitLine("        end");
-        emitLine("    end");
-        emitLine("    ");
-        emitLine("    -- Part 4: Copy everything after the target range");
         emitLine("    local endPos = startPos + len");
-        emitLine("    if endPos <= #original then");
-        emitLine("        result = result .. original:sub(endPos)");
-        emitLine("    end");
+        emitLine("    ");
+        emitLine("    -- One concatenation: the part before, the replacement, the unreplaced");
+        emitLine("    -- rest of the target range and everything after it");
+        emitLine("    local result = original:sub(1, startPos - 1) .. replacement:sub(1, replaceLen) ..");
+        emitLine("                   original:sub(startPos + replaceLen, math.min(endPos - 1, #original)) ..");
+        emitLine("                   original:sub(endPos)");
         emitLine("    ");
         emitLine("    return result");
         emitLine("end");
     }
     emitLine("");
+    endPreludeSection();
 
+    beginPreludeSection({"basic_sgn"});
     emitLine("-- Custom math functions for BBC BASIC compatibility");
     emitLine("local function basic_sgn(x)");
     emitLine("    if x > 0 then return 1");
@@ -438,12 +761,38 @@ void LuaCodeGenerator::emitHeader() {
     emitLine("    else return 0 end");
     emitLine("end");
     emitLine("");
+    endPreludeSection();
+    beginPreludeSection({"basic_fix"});
     emitLine("local function basic_fix(x)");
     emitLine("    -- Truncate towards zero (different from math.floor)");
     emitLine("    if x >= 0 then return math.floor(x)");
     emitLine("    else return math.ceil(x) end");
     emitLine("end");
     emitLine("");
+    endPreludeSection();
+    beginPreludeSection({"basic_toint32"});
+    emitLine("-- Bitwise operand conversion: truncate towards zero and wrap to int32;");
+    emitLine("-- NaN is 0 and infinities saturate (as runtime/basic_bitwise.cpp).");
+    emitLine("-- tobit only wraps exactly below 2^51, so larger values are reduced first");
+    emitLine("local basic_toint32");
+    emitLine("do");
+    emitLine("    local tobit, floor, ceil, fmod, huge = require('bit').tobit, math.floor, math.ceil, math.fmod, math.huge");
+    emitLine("    basic_toint32 = function(x)");
+    emitLine("        if x >= 0 then");
+    emitLine("            if x == huge then return 2147483647 end");
+    emitLine("            if x >= 2251799813685248 then x = fmod(x, 4294967296) end");
+    emitLine("            return tobit(floor(x))");
+    emitLine("        elseif x < 0 then");
+    emitLine("            if x == -huge then return -2147483648 end");
+    emitLine("            if x <= -2251799813685248 then x = fmod(x, 4294967296) end");
+    emitLine("            return tobit(ceil(x))");
+    emitLine("        end");
+    emitLine("        return 0");
+    emitLine("    end");
+    emitLine("end");
+    emitLine("");
+    endPreludeSection();
+    beginPreludeSection({"basic_mod"});
     emitLine("local function basic_mod(x, y)");
     emitLine("    -- Enhanced MOD function");
     emitLine("    if y then");
@@ -461,154 +810,175 @@ void LuaCodeGenerator::emitHeader() {
     emitLine("    end");
     emitLine("end");
     emitLine("");
-
-    emitLine("-- PRINT USING formatter");
-    emitLine("local function basic_print_using(format, ...)");
-    emitLine("    local values = {...}");
-    emitLine("    local result = ''");
-    emitLine("    local valueIndex = 1");
-    emitLine("    local i = 1");
-    emitLine("    ");
-    emitLine("    while i <= #format do");
+    endPreludeSection();
+
+    beginPreludeSection({"basic_using_commas"});
+    emitLine("-- PRINT USING: a format string is compiled once into a string.format");
+    emitLine("-- pattern plus a converter per field, cached by value count and format.");
+    emitLine("-- Constant formats are compiled by the code generator instead.");
+    emitLine("local function basic_using_commas(num)");
+    emitLine("    local formatted, k = string.format('%d', math.floor(num)), 1");
+    emitLine("    while k > 0 do");
+    emitLine("        formatted, k = string.gsub(formatted, '^(-?%d+)(%d%d%d)', '%1,%2')");
+    emitLine("    end");
+    emitLine("    return formatted");
+    emitLine("end");
+    emitLine("");
+    endPreludeSection();
+    beginPreludeSection({"using_number", "using_integer", "using_commas", "using_unpack",
+                         "basic_using_cache", "basic_using_cached", "basic_compile_using"});
+    emitLine("local function using_number(v) return tonumber(v) or 0 end");
+    emitLine("local function using_integer(v) return math.floor(tonumber(v) or 0) end");
+    emitLine("local function using_commas(v) return basic_using_commas(tonumber(v) or 0) end");
+    emitLine("local using_unpack = table.unpack or unpack");
+    emitLine("local basic_using_cache = {}");
+    emitLine("local basic_using_cached = 0");
+    emitLine("");
+    emitLine("local function basic_compile_using(format, count)");
+    emitLine("    local pattern, converters, fields = {}, {}, 0");
+    emitLine("    local i, n = 1, #format");
+    emitLine("    while i <= n do");
     emitLine("        local ch = format:sub(i, i)");
-    emitLine("        ");
+    emitLine("        local spec, convert");
+    emitLine("        local endSlash = ch == '\\\\' and format:find('\\\\', i + 1, true)");
     emitLine("        if ch == '&' then");
-    emitLine("            -- Whole string");
-    emitLine("            if valueIndex <= #values then");
-    emitLine("                result = result .. tostring(values[valueIndex])");
-    emitLine("                valueIndex = valueIndex + 1");
-    emitLine("            end");
-    emitLine("            i = i + 1");
-    emitLine("            ");
+    emitLine("            spec, convert, i = '%s', tostring, i + 1");
     emitLine("        elseif ch == '!' then");
-    emitLine("            -- First character only");
-    emitLine("            if valueIndex <= #values then");
-    emitLine("                local s = tostring(values[valueIndex])");
-    emitLine("                result = result .. s:sub(1, 1)");
-    emitLine("                valueIndex = valueIndex + 1");
-    emitLine("            end");
-    emitLine("            i = i + 1");
-    emitLine("            ");
-    emitLine("        elseif ch == '\\\\' then");
+    emitLine("            spec, convert, i = '%.1s', tostring, i + 1");
+    emitLine("        elseif endSlash then");
     emitLine("            -- Fixed width string: \\  \\");
-    emitLine("            local endSlash = format:find('\\\\', i + 1)");
-    emitLine("            if endSlash then");
-    emitLine("                local width = endSlash - i + 1");
-    emitLine("                if valueIndex <= #values then");
-    emitLine("                    local s = tostring(values[valueIndex])");
-    emitLine("                    if #s > width then");
-    emitLine("                        result = result .. s:sub(1, width)");
-    emitLine("                    else");
-    emitLine("                        result = result .. s .. string.rep(' ', width - #s)");
-    emitLine("                    end");
-    emitLine("                    valueIndex = valueIndex + 1");
-    emitLine("                end");
-    emitLine("                i = endSlash + 1");
-    emitLine("            else");
-    emitLine("                result = result .. ch");
-    emitLine("                i = i + 1");
-    emitLine("            end");
-    emitLine("            ");
+    emitLine("            local width = endSlash - i + 1");
+    emitLine("            spec, convert, i = '%-' .. width .. '.' .. width .. 's', tostring, endSlash + 1");
     emitLine("        elseif ch == '#' then");
-    emitLine("            -- Numeric format: ###.##");
-    emitLine("            local beforeDecimal = 0");
-    emitLine("            local afterDecimal = 0");
-    emitLine("            local hasDecimal = false");
-    emitLine("            local hasComma = false");
-    emitLine("            ");
-    emitLine("            while i <= #format and (format:sub(i,i) == '#' or format:sub(i,i) == '.' or format:sub(i,i) == ',') do");
-    emitLine("                if format:sub(i,i) == '.' then");
-    emitLine("                    hasDecimal = true");
-    emitLine("                elseif format:sub(i,i) == ',' then");
-    emitLine("                    hasComma = true");
-    emitLine("                else");
-    emitLine("                    if hasDecimal then");
-    emitLine("                        afterDecimal = afterDecimal + 1");
-    emitLine("                    else");
-    emitLine("                        beforeDecimal = beforeDecimal + 1");
-    emitLine("                    end");
-    emitLine("                end");
+    emitLine("            -- Numeric field: ###.## or #,###");
+    emitLine("            local before, after, hasDecimal, hasComma = 0, 0, false, false");
+    emitLine("            while i <= n do");
+    emitLine("                local c = format:sub(i, i)");
+    emitLine("                if c == '.' then hasDecimal = true");
+    emitLine("                elseif c == ',' then hasComma = true");
+    emitLine("                elseif c ~= '#' then break");
+    emitLine("                elseif hasDecimal then after = after + 1");
+    emitLine("                else before = before + 1 end");
     emitLine("                i = i + 1");
     emitLine("            end");
-    emitLine("            ");
-    emitLine("            if valueIndex <= #values then");
-    emitLine("                local num = tonumber(values[valueIndex]) or 0");
-    emitLine("                local formatted");
-    emitLine("                if hasDecimal then");
-    emitLine("                    formatted = string.format('%.'..afterDecimal..'f', num)");
-    emitLine("                else");
-    emitLine("                    formatted = string.format('%d', math.floor(num))");
-    emitLine("                end");
-    emitLine("                ");
-    emitLine("                -- Add thousands separators if requested");
-    emitLine("                if hasComma and not hasDecimal then");
-    emitLine("                    local k");
-    emitLine("                    formatted, k = string.gsub(formatted, '^(-?%d+)(%d%d%d)', '%1,%2')");
-    emitLine("                    while k > 0 do");
-    emitLine("                        formatted, k = string.gsub(formatted, '^(-?%d+),(%d%d%d,)', '%1,%2')");
-    emitLine("                    end");
-    emitLine("                end");
-    emitLine("                ");
-    emitLine("                -- Right-align in field");
-    emitLine("                local totalWidth = beforeDecimal + (hasDecimal and 1 + afterDecimal or 0)");
-    emitLine("                if #formatted < totalWidth then");
-    emitLine("                    result = result .. string.rep(' ', totalWidth - #formatted)");
-    emitLine("                end");
-    emitLine("                result = result .. formatted");
-    emitLine("                valueIndex = valueIndex + 1");
+    emitLine("            if hasDecimal then");
+    emitLine("                spec, convert = '%' .. (before + 1 + after) .. '.' .. after .. 'f', using_number");
+    emitLine("            elseif hasComma then");
+    emitLine("                spec, convert = '%' .. before .. 's', using_commas");
+    emitLine("            else");
+    emitLine("                spec, convert = '%' .. before .. 'd', using_integer");
     emitLine("            end");
-    emitLine("            ");
     emitLine("        else");
-    emitLine("            -- Literal character");
-    emitLine("            result = result .. ch");
+    emitLine("            pattern[#pattern + 1] = ch == '%' and '%%' or ch");
     emitLine("            i = i + 1");
     emitLine("        end");
+    emitLine("        if spec then");
+    emitLine("            -- Fields without a value print nothing; surplus values are ignored");
+    emitLine("            fields = fields + 1");
+    emitLine("            if fields <= count then");
+    emitLine("                pattern[#pattern + 1] = spec");
+    emitLine("                converters[fields] = convert");
+    emitLine("            end");
+    emitLine("        end");
     emitLine("    end");
-    emitLine("    ");
-    emitLine("    return result");
+    emitLine("");
+    emitLine("    local spec = table.concat(pattern)");
+    emitLine("    local used = #converters");
+    emitLine("    local c1, c2, c3 = converters[1], converters[2], converters[3]");
+    emitLine("    local formatter");
+    emitLine("    if used == 0 then");
+    emitLine("        local text = string.format(spec)");
+    emitLine("        formatter = function() return text end");
+    emitLine("    elseif used == 1 then");
+    emitLine("        formatter = function(a) return string.format(spec, c1(a)) end");
+    emitLine("    elseif used == 2 then");
+    emitLine("        formatter = function(a, b) return string.format(spec, c1(a), c2(b)) end");
+    emitLine("    elseif used == 3 then");
+    emitLine("        formatter = function(a, b, c) return string.format(spec, c1(a), c2(b), c3(c)) end");
+    emitLine("    else");
+    emitLine("        formatter = function(...)");
+    emitLine("            local values = {...}");
+    emitLine("            for k = 1, used do values[k] = converters[k](values[k]) end");
+    emitLine("            return string.format(spec, using_unpack(values, 1, used))");
+    emitLine("        end");
+    emitLine("    end");
+    emitLine("");
+    emitLine("    -- Formats built at run time could grow the cache without bound");
+    emitLine("    basic_using_cached = basic_using_cached + 1");
+    emitLine("    if basic_using_cached > 1024 then");
+    emitLine("        basic_using_cache, basic_using_cached = {}, 1");
+    emitLine("    end");
+    emitLine("    local byFormat = basic_using_cache[count]");
+    emitLine("    if not byFormat then");
+    emitLine("        byFormat = {}");
+    emitLine("        basic_using_cache[count] = byFormat");
+    emitLine("    end");
+    emitLine("    byFormat[format] = formatter");
+    emitLine("    return formatter");
     emitLine("end");
     emitLine("");
+    endPreludeSection();
+    beginPreludeSection({"basic_print_using"});
+    emitLine("local function basic_print_using(format, ...)");
+    emitLine("    local count = select('#', ...)");
+    emitLine("    local byFormat = basic_using_cache[count]");
+    emitLine("    local formatter = byFormat and byFormat[format] or basic_compile_using(format, count)");
+    emitLine("    return formatter(...)");
+    emitLine("end");
+    emitLine("");
+    endPreludeSection();
 
+    beginPreludeSection({"native_find_bytes"});
     emitLine("-- INSTR function for string searching");
+    emitLine("-- Native substring search from the runtime (first/last-byte SIMD filter),");
+    emitLine("-- called through FFI via the pointer the unicode module publishes;");
+    emitLine("-- string.find otherwise");
+    emitLine("local native_find_bytes = nil");
+    emitLine("if ffi_ok and ffi and unicode and unicode.find_bytes then");
+    emitLine("    native_find_bytes = ffi.cast('int32_t (*)(const char*, int32_t, const char*, int32_t, int32_t)',");
+    emitLine("                                 unicode.find_bytes)");
+    emitLine("end");
+    emitLine("");
+    endPreludeSection();
+    beginPreludeSection({"string_instr"}, !m_unicodeMode);
     emitLine("local function string_instr(haystack, needle, start)");
     emitLine("    start = start or 1");
     emitLine("    if start < 1 then start = 1 end");
+    if (m_unicodeMode) {
+        emitLine("    -- Unicode mode: strings are codepoint tables");
+        emitLine("    if type(haystack) == 'table' then");
+        emitLine("        return unicode.instr_start(start, haystack, needle)");
+        emitLine("    end");
+    }
+    emitLine("    -- Single-byte needles are a memchr either way; skip the FFI call");
+    emitLine("    if native_find_bytes and #needle > 1 then");
+    emitLine("        return native_find_bytes(haystack, #haystack, needle, #needle, start)");
+    emitLine("    end");
     emitLine("    local pos = string.find(haystack, needle, start, true)");
     emitLine("    return pos or 0");
     emitLine("end");
     emitLine("");
+    endPreludeSection();
 
+    beginPreludeSection({"string_join"});
     emitLine("-- JOIN$ function for joining string arrays");
     emitLine("local function string_join(array, separator)");
     emitLine("    if not array then return '' end");
-    emitLine("    local result = ''");
-    emitLine("    local first = true");
     emitLine("    -- Handle both 0-based and 1-based arrays");
-    emitLine("    local hasZero = array[0] ~= nil");
-    emitLine("    local hasOne = array[1] ~= nil");
-    emitLine("    if hasZero and not hasOne then");
-    emitLine("        -- 0-based array");
-    emitLine("        local i = 0");
-    emitLine("        while array[i] ~= nil do");
-    emitLine("            if not first then result = result .. separator end");
-    emitLine("            result = result .. tostring(array[i])");
-    emitLine("            first = false");
-    emitLine("            i = i + 1");
-    emitLine("        end");
-    emitLine("    else");
-    emitLine("        -- 1-based array or mixed");
-    emitLine("        local i = 1");
-    emitLine("        while array[i] ~= nil do");
-    emitLine("            if not first then result = result .. separator end");
-    emitLine("            result = result .. tostring(array[i])");
-    emitLine("            first = false");
-    emitLine("            i = i + 1");
-    emitLine("        end");
+    emitLine("    local first = (array[0] ~= nil and array[1] == nil) and 0 or 1");
+    emitLine("    local b = sb_new('')");
+    emitLine("    local i = first");
+    emitLine("    while array[i] ~= nil do");
+    emitLine("        if i > first then sb_append(b, separator) end");
+    emitLine("        sb_append(b, tostring(array[i]))");
+    emitLine("        i = i + 1");
     emitLine("    end");
-    emitLine("    return result");
+    emitLine("    return sb_tostring(b)");
     emitLine("end");
     emitLine("");
+    endPreludeSection();
 
+    beginPreludeSection({"string_split"});
     emitLine("-- SPLIT$ function for splitting strings into arrays");
     emitLine("local function string_split(str, delimiter)");
     emitLine("    if not str or str == '' then return {} end");
@@ -636,28 +1006,37 @@ void LuaCodeGenerator::emitHeader() {
     emitLine("    return result");
     emitLine("end");
     emitLine("");
+    endPreludeSection();
 
+    beginPreludeSection({"stack", "sp"}, false);
     emitLine("-- Stack for expression evaluation");
     emitLine("local stack = {}");
     emitLine("local sp = 0");
     emitLine("");
+    endPreludeSection();
 
+    beginPreludeSection({"push"}, false);
     emitLine("local function push(v)");
     emitLine("    sp = sp + 1");
     emitLine("    stack[sp] = v");
     emitLine("end");
     emitLine("");
+    endPreludeSection();
 
+    beginPreludeSection({"pop"}, false);
     emitLine("local function pop()");
     emitLine("    local v = stack[sp]");
     emitLine("    sp = sp - 1");
     emitLine("    return v");
     emitLine("end");
     emitLine("");
+    endPreludeSection();
 
+    beginPreludeSection({"constants"}, false);
     emitLine("-- Constants table");
     emitLine("local constants = {}");
     emitLine("");
+    endPreludeSection();
     emitLine("-- Temp variables for operations (declared at function scope to avoid goto issues)");
     emitLine("local _on_temp = 0  -- For ON GOTO/GOSUB/CALL selector");
     emitLine("local a, b, done, dim, idx, val, ret_label");
@@ -673,11 +1052,24 @@ void LuaCodeGenerator::emitHeader() {
     emitLine("local _cursor_x, _cursor_y = 0, 0");
     emitLine("");
 
-    // Error tracking variable (if enabled)
-    if (m_errorTracking) {
-        emitLine("-- BASIC line number tracker (for error reporting)");
-        emitLine("-- Enable with: OPTION ERROR");
-        emitLine("local _LINE = 0");
+    // Script cancellation (OPTION CANCELLABLE, on by default)
+    if (shouldInjectCancellationCheck()) {
+        emitLine("-- Script cancellation: the host publishes its stop flag as __fbc_stop_flag;");
+        emitLine("-- loops poll it every " + std::to_string(CANCEL_POLL_INTERVAL) + " iterations through basic_cancel_poll()");
+        emitLine("local basic_cancel_poll");
+        emitLine("do");
+        emitLine("    local stop_flag = nil");
+        emitLine("    if ffi_ok and ffi and __fbc_stop_flag then");
+        emitLine("        stop_flag = ffi.cast('volatile int32_t*', __fbc_stop_flag)");
+        emitLine("    end");
+        emitLine("    basic_cancel_poll = function()");
+        emitLine("        if stop_flag then");
+        emitLine("            if stop_flag[0] ~= 0 then error('Interrupted by user', 0) end");
+        emitLine("        elseif shouldStopScript and shouldStopScript() then");
+        emitLine("            error('Interrupted by user', 0)");
+        emitLine("        end");
+        emitLine("    end");
+        emitLine("end");
         emitLine("");
     }
 
@@ -688,26 +1080,312 @@ void LuaCodeGenerator::emitHeader() {
     
     // Emit parameter pool for modular commands (reduces local variable usage)
     emitParameterPoolDeclaration();
+
+    if (!m_builderRegions.empty()) {
+        std::set<std::string> builders;
+        for (const auto& region : m_builderRegions) {
+            builders.insert(region.builder);
+        }
+        std::string decl = "local ";
+        for (const auto& builder : builders) {
+            if (decl.size() > 6) decl += ", ";
+            decl += builder;
+        }
+        emitLine("-- String builders for loops that append to a string variable");
+        emitLine(decl);
+        emitLine("");
+    }
+}
+
+void LuaCodeGenerator::beginPreludeSection(const std::vector<std::string>& names, bool shareable) {
+    PreludeSection section;
+    section.names = names;
+    section.shareable = shareable;
+    section.begin = static_cast<size_t>(m_output.tellp());
+    section.end = section.begin;
+    m_preludeSections.push_back(section);
+}
+
+void LuaCodeGenerator::endPreludeSection() {
+    m_preludeSections.back().end = static_cast<size_t>(m_output.tellp());
+}
+
+void LuaCodeGenerator::shakePrelude() {
+    if (m_preludeSections.empty()) return;
+
+    std::string code = m_output.str();
+    bool shared = !m_config.preludeModule.empty();
+
+    // Everything outside the sections is always emitted, so the names it
+    // references are the roots
+    std::unordered_set<std::string> used;
+    size_t pos = 0;
+    for (const auto& section : m_preludeSections) {
+        collectLuaIdentifiers(code, pos, section.begin, used);
+        pos = section.end;
+    }
+    collectLuaIdentifiers(code, pos, code.size(), used);
+
+    // Helpers call helpers: keep adding sections until nothing new is referenced.
+    // References from a section that lives in the shared module resolve there.
+    std::vector<bool> kept(m_preludeSections.size(), false);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < m_preludeSections.size(); i++) {
+            const auto& section = m_preludeSections[i];
+            if (kept[i]) continue;
+            bool referenced = false;
+            for (const auto& name : section.names) {
+                if (used.count(name)) {
+                    referenced = true;
+                    break;
+                }
+            }
+            if (!referenced) continue;
+            kept[i] = true;
+            changed = true;
+            if (!(shared && section.shareable)) {
+                collectLuaIdentifiers(code, section.begin, section.end, used);
+            }
+        }
+    }
+
+    // With a prelude module, the shared helpers the program uses are bound
+    // to locals once at load time
+    std::string imports;
+    if (shared) {
+        std::ostringstream oss;
+        for (size_t i = 0; i < m_preludeSections.size(); i++) {
+            const auto& section = m_preludeSections[i];
+            if (!kept[i] || !section.shareable) continue;
+            std::string locals, fields;
+            for (const auto& name : section.names) {
+                if (!used.count(name)) continue;
+                locals += (locals.empty() ? "" : ", ") + name;
+                fields += (fields.empty() ? "" : ", ") + ("__prelude." + name);
+            }
+            oss << "local " << locals << " = " << fields << "\n";
+        }
+        if (!oss.str().empty()) {
+            imports = "-- Shared runtime helpers (loaded once per Lua state)\n"
+                      "local __prelude = require(" + quoteLuaString(m_config.preludeModule) + ")\n" +
+                      oss.str() + "\n";
+        }
+    }
+
+    std::string result;
+    result.reserve(code.size());
+    pos = 0;
+    bool importsPlaced = false;
+    for (size_t i = 0; i < m_preludeSections.size(); i++) {
+        const auto& section = m_preludeSections[i];
+        result.append(code, pos, section.begin - pos);
+        if (shared && section.shareable) {
+            // The first shared section marks where the imports go: ahead of
+            // any inline helper that calls a shared one
+            if (!importsPlaced) {
+                result += imports;
+                importsPlaced = true;
+            }
+        } else if (kept[i]) {
+            result.append(code, section.begin, section.end - section.begin);
+        }
+        pos = section.end;
+    }
+    result.append(code, pos, std::string::npos);
+
+    m_stats.linesGenerated -= std::count(code.begin(), code.end(), '\n');
+    m_stats.linesGenerated += std::count(result.begin(), result.end(), '\n');
+    m_preludeSections.clear();
+    m_output.str(result);
+    m_output.seekp(0, std::ios_base::end);
+}
+
+std::string LuaCodeGenerator::generatePreludeModule() {
+    // Build an ordinary header without program-specific options and keep
+    // only the sections every program shares
+    LuaCodeGenConfig savedConfig = m_config;
+    m_config.preludeModule.clear();
+    m_output.str("");
+    m_output.clear();
+    m_preludeSections.clear();
+    m_unicodeMode = false;
+    m_bufferMode = false;
+    m_cancellableLoops = false;
+    m_builderRegions.clear();
+    emitHeader();
+    std::string header = m_output.str();
+
+    std::ostringstream module;
+    module << "-- FasterBASIC shared runtime prelude\n";
+    module << "-- Runtime helpers common to every program, for programs compiled with a\n";
+    module << "-- prelude module; load once per Lua state with require()\n";
+    module << "\n";
+    module << "local ffi_ok, ffi = pcall(require, 'ffi')\n";
+    module << "local use_ffi = ffi_ok and ffi and jit and jit.status()\n";
+    module << "\n";
+    std::vector<std::string> exports;
+    for (const auto& section : m_preludeSections) {
+        if (!section.shareable) continue;
+        module << header.substr(section.begin, section.end - section.begin);
+        exports.insert(exports.end(), section.names.begin(), section.names.end());
+    }
+    module << "return {\n";
+    for (const auto& name : exports) {
+        module << "    " << name << " = " << name << ",\n";
+    }
+    module << "}\n";
+
+    m_output.str("");
+    m_output.clear();
+    m_preludeSections.clear();
+    m_config = savedConfig;
+    return module.str();
 }
 
 void LuaCodeGenerator::emitFooter() {
     emitLine("");
     emitLine("-- Entry point with error handling");
-    emitLine("local success, err = pcall(main)");
-    emitLine("if not success then");
     if (m_errorTracking) {
-        emitLine("    if _LINE > 0 then");
-        emitLine("        io.stderr:write(\"Runtime error at BASIC line \" .. _LINE .. \": \" .. tostring(err) .. \"\\n\")");
-        emitLine("    else");
-        emitLine("        io.stderr:write(\"Runtime error: \" .. tostring(err) .. \"\\n\")");
-        emitLine("    end");
-        emitLine("    os.exit(1)");
+        emitLineMap();
+        emitLine("local success, err = xpcall(main, basic_error_handler)");
+        emitLine("if not success then");
+        emitLine("    error(err, 0)");
     } else {
+        emitLine("local success, err = pcall(main)");
+        emitLine("if not success then");
         emitLine("    error(err)");
     }
     emitLine("end");
 }
 
+// Scan the generated chunk for the "-- LINE n" markers and the SUB/FUNCTION
+// headers. Runs once the chunk is in its final shape (after the literal pool
+// splice and shakePrelude) so the Lua line numbers are the ones LuaJIT sees.
+// Lines of an inlined SUB/FUNCTION body are credited to that procedure, not
+// to the Lua function the body was copied into.
+void LuaCodeGenerator::buildSourceMap() {
+    m_sourceMap.lines.clear();
+    m_sourceMap.functions.clear();
+    m_sourceMap.counters.clear();
+    m_sourceMap.counterSlots = m_counterSlots;
+    std::vector<std::string> slotFunctions(m_counterSlots + 1);
+
+    auto inlinedInto = [this](int basicLine) -> const std::string* {
+        if (!m_inlinedLines) return nullptr;
+        auto it = m_inlinedLines->find(basicLine);
+        return it == m_inlinedLines->end() ? nullptr : &it->second;
+    };
+
+    // Lua numbers chunk lines from 1
+    std::string code = m_output.str();
+    std::string enclosing;  // Lua function being scanned: SUB/FUNCTION name, "main" or ""
+    int luaLine = 1;
+    size_t pos = 0;
+    while (pos < code.size()) {
+        size_t end = code.find('\n', pos);
+        if (end == std::string::npos) end = code.size();
+        size_t first = code.find_first_not_of(' ', pos);
+        if (first < end && code.compare(first, 8, "-- LINE ") == 0) {
+            size_t digits = first + 8;
+            size_t digitsEnd = digits;
+            while (digitsEnd < end && isdigit((unsigned char)code[digitsEnd])) digitsEnd++;
+            if (digitsEnd > digits && digitsEnd == end) {
+                int basicLine = std::stoi(code.substr(digits, digitsEnd - digits));
+                m_sourceMap.lines.emplace_back(luaLine, basicLine);
+
+                const std::string* owner = inlinedInto(basicLine);
+                const std::string& function = owner ? *owner : enclosing;
+                if (!m_sourceMap.functions.empty() && m_sourceMap.functions.back().second != function) {
+                    m_sourceMap.functions.emplace_back(luaLine, function);
+                }
+            }
+        } else if (first < end && code.compare(first, 4, "_lc[") == 0) {
+            // OPTION PROFILE COUNTS: the slot belongs to the enclosing function
+            size_t slot = std::strtoul(code.c_str() + first + 4, nullptr, 10);
+            if (slot >= 1 && slot < slotFunctions.size()) {
+                slotFunctions[slot] = enclosing;
+            }
+        } else if (first == pos) {
+            // Functions are emitted unindented and closed by an unindented "end"
+            if (code.compare(pos, 20, "local function func_") == 0) {
+                size_t nameEnd = code.find('(', pos + 20);
+                if (nameEnd < end) {
+                    enclosing = code.substr(pos + 20, nameEnd - pos - 20);
+                    m_sourceMap.functions.emplace_back(luaLine, enclosing);
+                }
+            } else if (code.compare(pos, 20, "local function main(") == 0) {
+                enclosing = "main";
+                m_sourceMap.functions.emplace_back(luaLine, enclosing);
+            } else if (end - pos == 3 && code.compare(pos, 3, "end") == 0 && !enclosing.empty()) {
+                enclosing.clear();
+                m_sourceMap.functions.emplace_back(luaLine + 1, enclosing);
+            }
+        }
+        luaLine++;
+        pos = end + 1;
+    }
+
+    // Lines from here on (the footer) belong to no BASIC line
+    m_sourceMap.lines.emplace_back(luaLine, 0);
+
+    for (const auto& [basicLine, slot] : m_countedLines) {
+        const std::string* owner = inlinedInto(basicLine);
+        const std::string& function = owner ? *owner : slotFunctions[slot];
+        m_sourceMap.counters.push_back({basicLine, slot, function.empty() ? "main" : function});
+    }
+}
+
+// OPTION ERROR: instead of storing _LINE before every statement, each BASIC
+// line is marked with a "-- LINE n" comment and the footer carries a sorted
+// table of (Lua line, BASIC line) pairs built from those markers. The error
+// handler runs before the stack unwinds, finds the innermost frame in this
+// chunk and looks its current line up in the table, so the hot path carries
+// no bookkeeping at all.
+void LuaCodeGenerator::emitLineMap() {
+    const auto& ranges = m_sourceMap.lines;
+
+    emitLine("-- Lua line -> BASIC line map for runtime errors (OPTION ERROR):");
+    emitLine("-- pairs of (first Lua line, BASIC line), sorted by Lua line; 0 = no BASIC line");
+    emitLine("local basic_error_handler");
+    emitLine("do");
+    std::string map = "    local _LINE_MAP = {";
+    for (size_t i = 0; i < ranges.size(); i++) {
+        if (i > 0) map += ", ";
+        map += std::to_string(ranges[i].first) + ", " + std::to_string(ranges[i].second);
+    }
+    map += "}";
+    emitLine(map);
+    emitLine("    basic_error_handler = function(err)");
+    emitLine("        local source = debug.getinfo(1, 'S').source");
+    emitLine("        local level = 2");
+    emitLine("        while true do");
+    emitLine("            local info = debug.getinfo(level, 'Sl')");
+    emitLine("            if not info then break end");
+    emitLine("            if info.source == source and info.currentline > 0 then");
+    emitLine("                -- Binary search for the last range starting at or before currentline");
+    emitLine("                local lo, hi, line = 1, #_LINE_MAP / 2, 0");
+    emitLine("                while lo <= hi do");
+    emitLine("                    local mid = math.floor((lo + hi) / 2)");
+    emitLine("                    if _LINE_MAP[mid * 2 - 1] <= info.currentline then");
+    emitLine("                        line = _LINE_MAP[mid * 2]");
+    emitLine("                        lo = mid + 1");
+    emitLine("                    else");
+    emitLine("                        hi = mid - 1");
+    emitLine("                    end");
+    emitLine("                end");
+    emitLine("                if line > 0 then");
+    emitLine("                    return \"Runtime error at BASIC line \" .. line .. \": \" .. tostring(err)");
+    emitLine("                end");
+    emitLine("            end");
+    emitLine("            level = level + 1");
+    emitLine("        end");
+    emitLine("        return \"Runtime error: \" .. tostring(err)");
+    emitLine("    end");
+    emitLine("end");
+}
+
 void LuaCodeGenerator::emitVariableDeclarations() {
     if (m_variables.empty()) return;
 
@@ -739,41 +1417,158 @@ void LuaCodeGenerator::emitDataSection(const IRCode& irCode) {
     (void)irCode;
 }
 
+// First instruction of a SUB/FUNCTION body: DEFINE_* is followed by the
+// parameter count and one PUSH_STRING per parameter name
+static size_t functionBodyStart(const IRCode& irCode, size_t defineIndex) {
+    size_t i = defineIndex + 1;
+    if (i < irCode.instructions.size() &&
+        irCode.instructions[i].opcode == IROpcode::PUSH_INT &&
+        std::holds_alternative<int>(irCode.instructions[i].operand1)) {
+        i += 1 + std::get<int>(irCode.instructions[i].operand1);
+    }
+    return i;
+}
+
 void LuaCodeGenerator::emitUserFunctions(const IRCode& irCode) {
     // Emit all FUNCTION and SUB definitions at module level
     emitLine("-- User-defined functions and subroutines");
 
-    bool inFunctionDef = false;
-    size_t funcStartIndex = 0;
-
+    std::vector<FunctionBody> bodies;
     for (size_t i = 0; i < irCode.instructions.size(); i++) {
         const auto& instr = irCode.instructions[i];
+        if (instr.opcode != IROpcode::DEFINE_FUNCTION && instr.opcode != IROpcode::DEFINE_SUB) {
+            continue;
+        }
+        FunctionBody body;
+        body.begin = i;
+        body.end = functionBodyStart(irCode, i);
+        while (body.end < irCode.instructions.size() &&
+               irCode.instructions[body.end].opcode != IROpcode::END_FUNCTION &&
+               irCode.instructions[body.end].opcode != IROpcode::END_SUB) {
+            body.end++;
+        }
+        bodies.push_back(std::move(body));
+        i = bodies.back().end;
+    }
 
-        if (instr.opcode == IROpcode::DEFINE_FUNCTION || instr.opcode == IROpcode::DEFINE_SUB) {
-            inFunctionDef = true;
-            funcStartIndex = i;
-            emitFunctionDefinition(instr);
+    // Bodies are independent, so each is emitted by a copy of the generator
+    // on a worker thread and appended here in program order. The copies only
+    // read what the bodies share: literal pool entries are handed out in
+    // program order up front, and counter slots and arrays are numbered per
+    // body and renumbered as the bodies are appended
+    if (m_unicodeMode) {
+        for (const auto& body : bodies) {
+            for (size_t i = functionBodyStart(irCode, body.begin); i < body.end; i++) {
+                const auto& instr = irCode.instructions[i];
+                if (instr.opcode == IROpcode::PUSH_STRING && std::holds_alternative<std::string>(instr.operand1)) {
+                    escapeString(std::get<std::string>(instr.operand1));
+                } else if (instr.opcode == IROpcode::LOAD_CONST && std::holds_alternative<int>(instr.operand1) &&
+                           m_constantsManager && m_config.inlineConstants) {
+                    ConstantValue value = m_constantsManager->getConstant(std::get<int>(instr.operand1));
+                    if (std::holds_alternative<std::string>(value)) {
+                        escapeString(std::get<std::string>(value));
+                    }
+                }
+            }
+        }
+    }
+    FasterBASIC::ModularCommands::initializeGlobalRegistry();  // Created on first use
 
-            // Skip param count and param names
-            if (i + 1 < irCode.instructions.size() &&
-                irCode.instructions[i + 1].opcode == IROpcode::PUSH_INT &&
-                std::holds_alternative<int>(irCode.instructions[i + 1].operand1)) {
-                int paramCount = std::get<int>(irCode.instructions[i + 1].operand1);
-                i += 1 + paramCount; // Skip PUSH_INT and all PUSH_STRING param names
-            }
-        } else if (inFunctionDef && (instr.opcode == IROpcode::END_FUNCTION ||
-                                      instr.opcode == IROpcode::END_SUB)) {
-            emitFunctionDefinition(instr);
-            inFunctionDef = false;
-        } else if (inFunctionDef) {
-            // Emit instructions inside the function body
-            emitInstruction(instr, i);
+    int threads = std::min(ThreadPool::resolveThreadCount(m_config.threads),
+                           static_cast<int>(bodies.size()));
+    ThreadPool pool(std::max(threads, 1));
+    std::vector<std::unique_ptr<LuaCodeGenerator>> workers(pool.getThreadCount());
+    pool.run(bodies.size(), [&](size_t job, int worker) {
+        if (!workers[worker]) {
+            workers[worker] = std::make_unique<LuaCodeGenerator>(*this);
         }
+        workers[worker]->emitFunctionBody(irCode, bodies[job]);
+    });
+
+    for (const auto& body : bodies) {
+        appendFunctionBody(body);
     }
+    m_lastEmittedOpcode = IROpcode::NOP;
+    m_runCounter = 0;
+    m_pendingLineCounter = 0;
 
     emitLine("");
 }
 
+void LuaCodeGenerator::emitFunctionBody(const IRCode& irCode, FunctionBody& body) {
+    m_output.str("");
+    m_output.clear();
+    m_stats.linesGenerated = 0;
+    m_lastEmittedLine = 0;
+    m_lastEmittedOpcode = IROpcode::NOP;
+    m_lineCounterSlots.clear();
+    m_countedLines.clear();
+    m_counterSlots = 0;
+    m_runCounter = 0;
+    m_pendingLineCounter = 0;
+    m_counterFixups.clear();
+    size_t knownArrays = m_arrays.size();
+
+    emitFunctionDefinition(irCode.instructions[body.begin]);
+    for (size_t i = functionBodyStart(irCode, body.begin); i < body.end; i++) {
+        emitInstruction(irCode.instructions[i], i);
+    }
+    if (body.end < irCode.instructions.size()) {
+        emitFunctionDefinition(irCode.instructions[body.end]);
+    }
+
+    body.code = m_output.str();
+    body.lines = m_stats.linesGenerated;
+    body.counterFixups = m_counterFixups;
+    body.countedLines = m_countedLines;
+    body.counterSlots = m_counterSlots;
+    body.lastEmittedLine = m_lastEmittedLine;
+
+    // Arrays this body registered go back out, so the next body this
+    // worker emits starts from the same arrays as every other body
+    std::vector<std::pair<int, std::string>> added;
+    for (const auto& [name, index] : m_arrays) {
+        if (index >= static_cast<int>(knownArrays)) {
+            added.emplace_back(index, name);
+        }
+    }
+    std::sort(added.begin(), added.end());
+    for (const auto& entry : added) {
+        body.arrays.push_back(entry.second);
+        body.arrayInfo[entry.second] = m_arrayInfo[entry.second];
+        m_arrays.erase(entry.second);
+        m_arrayInfo.erase(entry.second);
+    }
+}
+
+void LuaCodeGenerator::appendFunctionBody(const FunctionBody& body) {
+    // Counter slots were numbered from 1 within the body
+    int slotBase = m_counterSlots;
+    size_t copied = 0;
+    for (const auto& [offset, slot] : body.counterFixups) {
+        size_t counter = body.code.find("_lc[", offset);
+        size_t lineEnd = body.code.find('\n', offset);
+        m_output << body.code.substr(copied, counter - copied) << lineCounterIncrement(slot + slotBase);
+        copied = lineEnd;
+    }
+    m_output << body.code.substr(copied);
+
+    for (const auto& [basicLine, slot] : body.countedLines) {
+        m_lineCounterSlots.emplace(basicLine, slot + slotBase);
+        m_countedLines.emplace_back(basicLine, slot + slotBase);
+    }
+    m_counterSlots += body.counterSlots;
+    m_stats.linesGenerated += body.lines;
+
+    for (const auto& name : body.arrays) {
+        if (m_arrays.find(name) == m_arrays.end()) {
+            m_arrays[name] = m_arrays.size();
+            m_arrayInfo[name] = body.arrayInfo.at(name);
+        }
+    }
+    m_lastEmittedLine = body.lastEmittedLine;
+}
+
 void LuaCodeGenerator::emitMainFunction(const IRCode& irCode) {
     emitLine("-- Main program");
     emitLine("local function main()");
@@ -883,6 +1678,8 @@ void LuaCodeGenerator::emitMainFunction(const IRCode& irCode) {
                 if (instr.opcode == IROpcode::RETURN_GOSUB) {
                     // End of subroutine
                     emitLine("        return");
+                    m_pendingLineCounter = 0;
+                    m_runCounter = 0;
                     break;
                 }
 
@@ -1045,17 +1842,32 @@ void LuaCodeGenerator::collectFunctionDefinitions(const IRCode& irCode) {
 // =============================================================================
 
 void LuaCodeGenerator::emitInstruction(const IRInstruction& instr, size_t index) {
-    // Emit line number tracking if enabled and line changed
-    if (m_errorTracking && instr.sourceLineNumber > 0 && instr.sourceLineNumber != m_lastEmittedLine) {
+    // Mark BASIC line changes for the line map (see buildSourceMap)
+    if ((m_errorTracking || m_config.emitLineNumbers || m_lineCounts) &&
+        instr.sourceLineNumber > 0 && instr.sourceLineNumber != m_lastEmittedLine) {
         emitLine("    -- LINE " + std::to_string(instr.sourceLineNumber));
-        emitLine("    _LINE = " + std::to_string(instr.sourceLineNumber));
         m_lastEmittedLine = instr.sourceLineNumber;
+
+        if (m_lineCounts) {
+            m_pendingLineCounter = instr.sourceLineNumber;
+        }
+    }
+
+    // A GOTO to the line lands on its label, so the counter goes after it;
+    // a label also starts a new straight-line run
+    if (instr.opcode == IROpcode::LABEL) {
+        m_runCounter = 0;
+    } else if (m_pendingLineCounter != 0) {
+        emitLineCounter();
     }
 
     if (m_config.emitComments) {
         emitComment("IR[" + std::to_string(index) + "]");
     }
 
+    // Move string variables into their builders ahead of the loop
+    enterStringBuilders(index);
+
     // Save previous opcode before processing current instruction
     IROpcode previousOpcode = m_lastEmittedOpcode;
 
@@ -1143,6 +1955,10 @@ void LuaCodeGenerator::emitInstruction(const IRInstruction& instr, size_t index)
         case IROpcode::ELSEIF_START:
         case IROpcode::ELSE_START:
         case IROpcode::IF_END:
+        case IROpcode::SWITCH_START:
+        case IROpcode::SWITCH_CASE:
+        case IROpcode::SWITCH_DEFAULT:
+        case IROpcode::SWITCH_END:
             emitControlFlow(instr, index);
             break;
 
@@ -1163,7 +1979,7 @@ void LuaCodeGenerator::emitInstruction(const IRInstruction& instr, size_t index)
         case IROpcode::DO_LOOP_WHILE:
         case IROpcode::DO_LOOP_UNTIL:
         case IROpcode::DO_LOOP_END:
-            emitLoop(instr);
+            emitLoop(instr, index);
             break;
 
         // I/O
@@ -1189,9 +2005,21 @@ void LuaCodeGenerator::emitInstruction(const IRInstruction& instr, size_t index)
             break;
 
         // Built-in functions
-        case IROpcode::CALL_BUILTIN:
+        case IROpcode::CALL_BUILTIN: {
+            size_t depth = m_exprOptimizer.size();
             emitBuiltinFunction(instr);
+            // String functions return byte strings outside Unicode mode; record
+            // it so ADD lowering can tell concatenation from addition
+            int argCount = std::holds_alternative<int>(instr.operand2) ? std::get<int>(instr.operand2) : 0;
+            if (canUseExpressionMode() && !m_unicodeMode &&
+                std::holds_alternative<std::string>(instr.operand1) &&
+                isStringName(std::get<std::string>(instr.operand1)) &&
+                m_exprOptimizer.size() + argCount == depth + 1 &&
+                m_exprOptimizer.peek()->facts.kind == ValueFacts::Kind::UNKNOWN) {
+                m_exprOptimizer.peek()->facts = ValueFacts::string();
+            }
             break;
+        }
 
         // User-defined functions and subs
         case IROpcode::DEFINE_FUNCTION:
@@ -1232,8 +2060,16 @@ void LuaCodeGenerator::emitInstruction(const IRInstruction& instr, size_t index)
             break;
     }
 
+    // Write builders back once their loop is complete
+    leaveStringBuilders(index);
+
     // Track what opcode was just emitted for unreachable code detection
     m_lastEmittedOpcode = instr.opcode;
+
+    // Branches, loops and returns end the straight-line run
+    if (m_runCounter != 0 && !isStraightLineOpcode(instr.opcode)) {
+        m_runCounter = 0;
+    }
 }
 
 void LuaCodeGenerator::emitStackOp(const IRInstruction& instr) {
@@ -1250,7 +2086,7 @@ void LuaCodeGenerator::emitStackOp(const IRInstruction& instr) {
 
             case IROpcode::PUSH_DOUBLE:
                 if (std::holds_alternative<double>(instr.operand1)) {
-                    m_exprOptimizer.pushLiteral(std::to_string(std::get<double>(instr.operand1)));
+                    m_exprOptimizer.pushLiteral(formatNumberLiteral(std::get<double>(instr.operand1)));
                 } else {
                     m_exprOptimizer.pushLiteral("0.0");
                 }
@@ -1281,7 +2117,7 @@ void LuaCodeGenerator::emitStackOp(const IRInstruction& instr) {
 
         case IROpcode::PUSH_DOUBLE:
             if (std::holds_alternative<double>(instr.operand1)) {
-                emitLine("    push(" + std::to_string(std::get<double>(instr.operand1)) + ")");
+                emitLine("    push(" + formatNumberLiteral(std::get<double>(instr.operand1)) + ")");
             } else {
                 emitLine("    push(0.0)");
             }
@@ -1445,25 +2281,25 @@ void LuaCodeGenerator::emitLogical(const IRInstruction& instr) {
     }
 
     // Fallback to stack-based emission
-    // Use bitwise operations by default for BASIC compatibility
+    // Use int32 bitwise operations by default for BASIC compatibility
     switch (instr.opcode) {
         case IROpcode::AND:
-            emitLine("    b = pop(); a = pop(); push(bitwise.band(a, b))");
+            emitLine("    b = pop(); a = pop(); push(bit.band(basic_toint32(a), basic_toint32(b)))");
             break;
         case IROpcode::OR:
-            emitLine("    b = pop(); a = pop(); push(bitwise.bor(a, b))");
+            emitLine("    b = pop(); a = pop(); push(bit.bor(basic_toint32(a), basic_toint32(b)))");
             break;
         case IROpcode::XOR:
-            emitLine("    b = pop(); a = pop(); push(bitwise.bxor(a, b))");
+            emitLine("    b = pop(); a = pop(); push(bit.bxor(basic_toint32(a), basic_toint32(b)))");
             break;
         case IROpcode::EQV:
-            emitLine("    b = pop(); a = pop(); push(bitwise.beqv(a, b))");
+            emitLine("    b = pop(); a = pop(); push(bit.bnot(bit.bxor(basic_toint32(a), basic_toint32(b))))");
             break;
         case IROpcode::IMP:
-            emitLine("    b = pop(); a = pop(); push(bitwise.bimp(a, b))");
+            emitLine("    b = pop(); a = pop(); push(bit.bor(bit.bnot(basic_toint32(a)), basic_toint32(b)))");
             break;
         case IROpcode::NOT:
-            emitLine("    push(bitwise.bnot(pop()))");
+            emitLine("    push(bit.bnot(basic_toint32(pop())))");
             break;
         default:
             break;
@@ -1488,8 +2324,21 @@ void LuaCodeGenerator::emitVariable(const IRInstruction& instr) {
             std::string varRef = m_config.useVariableCache ?
                                  getVariableReference(varName) : luaVarName;
 
+            // Inside a builder loop the value is materialized on read
+            auto active = m_activeBuilders.find(varName);
+            if (active != m_activeBuilders.end()) {
+                std::string read = "sb_tostring(" + active->second + ")";
+                if (canUseExpressionMode()) {
+                    m_exprOptimizer.pushVariable(read, ValueFacts::string());
+                    m_builderChains.push_back({m_exprOptimizer.peek(), active->second, {}});
+                } else {
+                    emitLine("    push(" + read + ")");
+                }
+                break;
+            }
+
             if (canUseExpressionMode()) {
-                m_exprOptimizer.pushVariable(varRef);
+                m_exprOptimizer.pushVariable(varRef, variableFacts(varName));
             } else {
                 emitLine("    push(" + varRef + ")");
             }
@@ -1532,6 +2381,28 @@ void LuaCodeGenerator::emitVariable(const IRInstruction& instr) {
             std::string varRef = m_config.useVariableCache ?
                                  getVariableReference(varName) : luaVarName;
 
+            // Inside a builder loop, V$ = V$ + X appends X; anything else
+            // replaces the builder contents
+            auto active = m_activeBuilders.find(varName);
+            if (active != m_activeBuilders.end()) {
+                const std::string& builder = active->second;
+                if (canUseExpressionMode() && !m_exprOptimizer.isEmpty()) {
+                    auto expr = m_exprOptimizer.pop();
+                    const BuilderChain* chain = expr ? findBuilderChain(expr) : nullptr;
+                    if (chain && chain->builder == builder && !chain->pieces.empty()) {
+                        for (const auto& piece : chain->pieces) {
+                            emitLine("    sb_append(" + builder + ", " + piece + ")");
+                        }
+                    } else {
+                        emitLine("    sb_set(" + builder + ", " +
+                                 (expr ? m_exprOptimizer.toString(expr) : "pop()") + ")");
+                    }
+                } else {
+                    emitLine("    sb_set(" + builder + ", pop())");
+                }
+                break;
+            }
+
             if (canUseExpressionMode() && !m_exprOptimizer.isEmpty()) {
                 auto expr = m_exprOptimizer.pop();
                 if (expr) {
@@ -1564,9 +2435,9 @@ void LuaCodeGenerator::emitConstant(const IRInstruction& instr) {
             literalValue = std::to_string(std::get<int64_t>(value));
         } else if (std::holds_alternative<double>(value)) {
             double dval = std::get<double>(value);
-            literalValue = std::to_string(dval);
+            literalValue = formatNumberLiteral(dval);
         } else if (std::holds_alternative<std::string>(value)) {
-            literalValue = "\"" + escapeString(std::get<std::string>(value)) + "\"";
+            literalValue = escapeString(std::get<std::string>(value));
         }
 
         if (canUseExpressionMode()) {
@@ -2048,13 +2919,13 @@ void LuaCodeGenerator::emitControlFlow(const IRInstruction& instr, size_t index)
                 if (canUseExpressionMode() && !m_exprOptimizer.isEmpty()) {
                     auto condExpr = m_exprOptimizer.pop();
                     if (condExpr) {
-                        std::string condCode = m_exprOptimizer.toString(condExpr);
-                        emitLine("    if not basicBoolToLua(" + condCode + ") then goto " + getLabelName(labelStr) + " end");
+                        std::string condCode = m_exprOptimizer.toCondition(condExpr);
+                        emitLine("    if not (" + condCode + ") then goto " + getLabelName(labelStr) + " end");
                     } else {
-                        emitLine("    if not basicBoolToLua(pop()) then goto " + getLabelName(labelStr) + " end");
+                        emitLine("    if pop() == 0 then goto " + getLabelName(labelStr) + " end");
                     }
                 } else {
-                    emitLine("    if not basicBoolToLua(pop()) then goto " + getLabelName(labelStr) + " end");
+                    emitLine("    if pop() == 0 then goto " + getLabelName(labelStr) + " end");
                 }
             }
             break;
@@ -2070,13 +2941,13 @@ void LuaCodeGenerator::emitControlFlow(const IRInstruction& instr, size_t index)
                 if (canUseExpressionMode() && !m_exprOptimizer.isEmpty()) {
                     auto condExpr = m_exprOptimizer.pop();
                     if (condExpr) {
-                        std::string condCode = m_exprOptimizer.toString(condExpr);
-                        emitLine("    if basicBoolToLua(" + condCode + ") then goto " + getLabelName(labelStr) + " end");
+                        std::string condCode = m_exprOptimizer.toCondition(condExpr);
+                        emitLine("    if " + condCode + " then goto " + getLabelName(labelStr) + " end");
                     } else {
-                        emitLine("    if basicBoolToLua(pop()) then goto " + getLabelName(labelStr) + " end");
+                        emitLine("    if pop() ~= 0 then goto " + getLabelName(labelStr) + " end");
                     }
                 } else {
-                    emitLine("    if basicBoolToLua(pop()) then goto " + getLabelName(labelStr) + " end");
+                    emitLine("    if pop() ~= 0 then goto " + getLabelName(labelStr) + " end");
                 }
             }
             break;
@@ -2264,13 +3135,13 @@ void LuaCodeGenerator::emitControlFlow(const IRInstruction& instr, size_t index)
             if (canUseExpressionMode() && !m_exprOptimizer.isEmpty()) {
                 auto condExpr = m_exprOptimizer.pop();
                 if (condExpr) {
-                    std::string condCode = m_exprOptimizer.toString(condExpr);
-                    emitLine("    if basicBoolToLua(" + condCode + ") then");
+                    std::string condCode = m_exprOptimizer.toCondition(condExpr);
+                    emitLine("    if " + condCode + " then");
                 } else {
-                    emitLine("    if basicBoolToLua(pop()) then");
+                    emitLine("    if pop() ~= 0 then");
                 }
             } else {
-                emitLine("    if basicBoolToLua(pop()) then");
+                emitLine("    if pop() ~= 0 then");
             }
             break;
         }
@@ -2281,13 +3152,13 @@ void LuaCodeGenerator::emitControlFlow(const IRInstruction& instr, size_t index)
             if (canUseExpressionMode() && !m_exprOptimizer.isEmpty()) {
                 auto condExpr = m_exprOptimizer.pop();
                 if (condExpr) {
-                    std::string condCode = m_exprOptimizer.toString(condExpr);
-                    emitLine("    elseif basicBoolToLua(" + condCode + ") then");
+                    std::string condCode = m_exprOptimizer.toCondition(condExpr);
+                    emitLine("    elseif " + condCode + " then");
                 } else {
-                    emitLine("    elseif basicBoolToLua(pop()) then");
+                    emitLine("    elseif pop() ~= 0 then");
                 }
             } else {
-                emitLine("    elseif basicBoolToLua(pop()) then");
+                emitLine("    elseif pop() ~= 0 then");
             }
             break;
         }
@@ -2304,12 +3175,64 @@ void LuaCodeGenerator::emitControlFlow(const IRInstruction& instr, size_t index)
             break;
         }
 
+        case IROpcode::SWITCH_START: {
+            // Evaluate the selector once and look its arm up; a miss selects
+            // the slot after the last arm, which is OTHERWISE (or nothing)
+            int tableIndex = std::get<int>(instr.operand1);
+            const auto& table = (*m_switchTables)[tableIndex];
+            std::string selector = "pop()";
+            if (canUseExpressionMode() && !m_exprOptimizer.isEmpty()) {
+                auto selectorExpr = m_exprOptimizer.pop();
+                if (selectorExpr) {
+                    selector = m_exprOptimizer.toString(selectorExpr);
+                }
+            }
+            int otherwise = table.armCount + 1;
+            emitLine("    do");
+            emitLine("    local _arm = _switch[" + std::to_string(tableIndex + 1) + "][" + selector +
+                     "] or " + std::to_string(otherwise));
+
+            SwitchDispatch dispatch;
+            dispatch.armLines.resize(otherwise + 1);
+            std::vector<std::string> pending;
+            buildSwitchDispatch(1, otherwise, dispatch, pending);
+            dispatch.tailLines = std::move(pending);
+            m_openSwitches.push_back(std::move(dispatch));
+            break;
+        }
+
+        case IROpcode::SWITCH_CASE: {
+            for (const auto& line : m_openSwitches.back().armLines[std::get<int>(instr.operand1)]) {
+                emitLine(line);
+            }
+            break;
+        }
+
+        case IROpcode::SWITCH_DEFAULT:
+        case IROpcode::SWITCH_END: {
+            auto& dispatch = m_openSwitches.back();
+            if (!dispatch.defaultEmitted) {
+                for (const auto& line : dispatch.armLines.back()) {
+                    emitLine(line);
+                }
+                dispatch.defaultEmitted = true;
+            }
+            if (instr.opcode == IROpcode::SWITCH_END) {
+                for (const auto& line : dispatch.tailLines) {
+                    emitLine(line);
+                }
+                emitLine("    end");
+                m_openSwitches.pop_back();
+            }
+            break;
+        }
+
         default:
             break;
     }
 }
 
-void LuaCodeGenerator::emitLoop(const IRInstruction& instr) {
+void LuaCodeGenerator::emitLoop(const IRInstruction& instr, size_t index) {
     switch (instr.opcode) {
         case IROpcode::FOR_INIT: {
             // FOR loops need a variable name
@@ -2363,11 +3286,81 @@ void LuaCodeGenerator::emitLoop(const IRInstruction& instr) {
             info.nativeLoopEmitted = false;
             info.loopBodyStartIndex = -1;
 
-            if (canUseNative) {
+            // planLoopCancellation() decided whether this loop polls; nested loops
+            // it does not see polled separately shrink its blocks by their weight
+            LoopPollPlan pollPlan = loopPollPlan(index);
+            bool cancelCheck = shouldInjectCancellationCheck() && pollPlan.polls;
+            long long blockIterations = std::max(1, CANCEL_POLL_INTERVAL / pollPlan.weight);
+            long long stepLiteral = 0;
+            bool literalStep = canUseNative &&
+                               parseIntegerLiteral(stepExpr, stepLiteral) && stepLiteral != 0;
+
+            if (literalStep && cancelCheck) {
+                // Strip-mine: an outer loop walks blocks of CANCEL_POLL_INTERVAL / weight
+                // iterations and polls once per block, the inner loop is the original native loop
+                std::string blockStep = std::to_string(stepLiteral * blockIterations);
+                std::string blockSpan = std::to_string(std::llabs(stepLiteral) * (blockIterations - 1));
+                info.stripMined = true;
+                info.exitLabel = "for_exit_" + std::to_string(index);
+                emitLine("    do");
+                emitLine("    local _climit = " + endExpr);
+                emitLine("    for _cblk = " + startExpr + ", _climit, " + blockStep + " do");
+                emitLine("    basic_cancel_poll()");
+                emitLine(std::string("    local _cstop = _cblk ") + (stepLiteral > 0 ? "+ " : "- ") + blockSpan);
+                emitLine(std::string("    if _cstop ") + (stepLiteral > 0 ? ">" : "<") +
+                         " _climit then _cstop = _climit end");
+                emitLine("    for " + luaVarName + " = _cblk, _cstop, " + stepExpr + " do");
+                info.nativeLoopEmitted = true;
+                info.endValue = endExpr;
+                info.stepValue = stepExpr;
+                info.startAddress = -1;
+            } else if (canUseNative && cancelCheck && !isNumberLiteral(stepExpr)) {
+                // Variable step: same strip-mining, with the block direction taken from
+                // the step's sign at runtime. With a whole start and step every value is
+                // exact, so the next block starts one step past _cstop. Otherwise each
+                // block resumes from the last value the previous one reached plus the
+                // step, so a fractional step accumulates exactly as in one plain loop;
+                // only then does the loop keep _clast, since the extra loop-carried
+                // value costs LuaJIT up to half the speed of a short body. A zero step
+                // never leaves its first block and counts down instead. The tests on
+                // _cfrac and _ctick are loop invariant, so LuaJIT hoists them out of
+                // the trace. Nested loops are often entered with no iterations to run,
+                // so everything past the loop test is computed per block rather than
+                // on entry.
+                std::string interval = std::to_string(blockIterations - 1);
+                info.stripMined = true;
+                info.variableStep = true;
+                info.exitLabel = "for_exit_" + std::to_string(index);
+                emitLine("    do");
+                emitLine("    local _climit, _cstep, _cnext, _clast = " + endExpr + ", " + stepExpr + ", " +
+                         startExpr + ", nil");
+                emitLine("    local _cc = " + std::to_string(CANCEL_POLL_INTERVAL));
+                emitLine("    while (_cstep >= 0 and _cnext <= _climit) or (_cstep < 0 and _cnext >= _climit) do");
+                emitLine("    basic_cancel_poll()");
+                emitLine("    local _cstop, _ctick = _cnext + _cstep * " + interval + ", _cstep == 0");
+                emitLine("    local _cfrac = _cstep % 1 ~= 0 or _cnext % 1 ~= 0");
+                emitLine("    if (_cstep >= 0 and _cstop > _climit) or (_cstep < 0 and _cstop < _climit) then _cstop = _climit end");
+                emitLine("    for " + luaVarName + " = _cnext, _cstop, _cstep do");
+                emitLine("    if _cfrac then _clast = " + luaVarName + " end");
+                emitLine("    if _ctick then");
+                emitCancellationCheck(pollPlan.weight);
+                emitLine("    end");
+                info.nativeLoopEmitted = true;
+                info.endValue = endExpr;
+                info.stepValue = stepExpr;
+                info.startAddress = -1;
+            } else if (canUseNative) {
                 // Emit native loop immediately (don't wait for LABEL - structured IFs have no labels!)
                 std::string luaVarName = getVarName(varName);
+                if (cancelCheck) {
+                    info.cancelScope = true;
+                    emitCancellationScopeBegin();
+                }
                 emitLine("    for " + luaVarName + " = " + startExpr + ", " +
                          endExpr + ", " + stepExpr + " do");
+                if (info.cancelScope) {
+                    emitCancellationCheck(pollPlan.weight);
+                }
                 info.nativeLoopEmitted = true;
                 info.endValue = endExpr;      // Preserve for potential fallback
                 info.stepValue = stepExpr;    // Preserve for potential fallback
@@ -2427,6 +3420,17 @@ void LuaCodeGenerator::emitLoop(const IRInstruction& instr) {
             if (loopInfo.canUseNativeLoop && loopInfo.nativeLoopEmitted) {
                 // Close the native for loop
                 emitLine("    end");
+                if (loopInfo.stripMined) {
+                    // Close the block loop and its scope; EXIT FOR lands after them
+                    if (loopInfo.variableStep) {
+                        emitLine("    if _cfrac then _cnext = _clast + _cstep else _cnext = _cstop + _cstep end");
+                    }
+                    emitLine("    end");
+                    emitLine("    end");
+                    emitLine("    ::" + loopInfo.exitLabel + "::");
+                } else if (loopInfo.cancelScope) {
+                    emitCancellationScopeEnd();
+                }
                 m_forLoopStack.pop_back();
             } else {
                 // Manual loop - emit increment and check
@@ -2557,21 +3561,6 @@ void LuaCodeGenerator::emitLoop(const IRInstruction& instr) {
         case IROpcode::WHILE_START: {
             // Begin WHILE loop with condition on stack or in optimizer
             // CRITICAL: We must re-evaluate the condition each iteration!
-            
-            // Check if operand1 contains a serialized expression string (for deferred evaluation)
-            if (std::holds_alternative<std::string>(instr.operand1)) {
-                std::string serializedExpr = std::get<std::string>(instr.operand1);
-                if (!serializedExpr.empty()) {
-                    // Use native Lua while loop with the serialized expression
-                    // Lua will re-evaluate this expression each iteration automatically
-                    // Use basicBoolToLua to convert BASIC boolean (0/-1) to Lua boolean
-                    emitLine("    while basicBoolToLua(" + serializedExpr + ") do");
-                    m_whileLoopStack.push_back({WhileLoopType::WITH_CONDITION});
-                    break;
-                }
-            }
-            
-            // Fall back to stack-based evaluation with goto pattern
             // Get the loop start label from operand1 (added by IR generator)
             int loopLabel = -1;
             if (std::holds_alternative<int>(instr.operand1)) {
@@ -2583,26 +3572,20 @@ void LuaCodeGenerator::emitLoop(const IRInstruction& instr) {
                 if (condExpr) {
                     // Condition expression available - use native Lua while loop
                     // Lua will re-evaluate this expression each iteration automatically
-                    // Use basicBoolToLua to convert BASIC boolean (0/-1) to Lua boolean
-                    std::string cond = m_exprOptimizer.toString(condExpr);
-                    emitLine("    while basicBoolToLua(" + cond + ") do");
+                    std::string cond = m_exprOptimizer.toCondition(condExpr);
+                    if (shouldInjectCancellationCheck()) emitCancellationScopeBegin();
+                    emitLine("    while " + cond + " do");
+                    if (shouldInjectCancellationCheck()) emitCancellationCheck(loopPollPlan(index).weight);
                     m_whileLoopStack.push_back({WhileLoopType::WITH_CONDITION});
-                } else {
-                    // Optimizer returned null - must use goto pattern
-                    // Check for BASIC false: 0, false, or nil (use helper to handle both int 0 and boolean false)
-                    emitLine("    local __cond = pop()");
-                    emitLine("    if __cond == 0 or __cond == false or __cond == nil then goto " + getLabelName(std::to_string(loopLabel)) + "_end end");
-                    m_whileLoopStack.push_back({WhileLoopType::FROM_STACK});
+                    break;
                 }
-            } else {
-                // Condition was pushed to stack - can't use native while loop
-                // The IR emitted a LABEL before the condition, so we use goto pattern
-                // to jump back and re-evaluate the condition code
-                // Check for BASIC false: 0, false, or nil
-                emitLine("    local __cond = pop()");
-                emitLine("    if __cond == 0 or __cond == false or __cond == nil then goto " + getLabelName(std::to_string(loopLabel)) + "_end end");
-                m_whileLoopStack.push_back({WhileLoopType::FROM_STACK});
             }
+            
+            // Condition was pushed to stack - can't use native while loop
+            // The IR emitted a LABEL before the condition, so we use goto pattern
+            // to jump back and re-evaluate the condition code
+            emitLine("    if pop() == 0 then goto " + getLabelName(std::to_string(loopLabel)) + "_end end");
+            m_whileLoopStack.push_back({WhileLoopType::FROM_STACK});
             break;
         }
 
@@ -2618,6 +3601,7 @@ void LuaCodeGenerator::emitLoop(const IRInstruction& instr) {
             if (loopInfo.type == WhileLoopType::WITH_CONDITION) {
                 // Used native while loop - just close it
                 emitLine("    end");
+                if (shouldInjectCancellationCheck()) emitCancellationScopeEnd();
             } else {
                 // Used goto pattern - need to jump back to label to re-evaluate condition
                 int loopLabel = -1;
@@ -2632,7 +3616,9 @@ void LuaCodeGenerator::emitLoop(const IRInstruction& instr) {
 
         case IROpcode::REPEAT_START: {
             // Begin REPEAT loop
+            if (shouldInjectCancellationCheck()) emitCancellationScopeBegin();
             emitLine("    repeat");
+            if (shouldInjectCancellationCheck()) emitCancellationCheck(loopPollPlan(index).weight);
             break;
         }
 
@@ -2641,30 +3627,33 @@ void LuaCodeGenerator::emitLoop(const IRInstruction& instr) {
             if (!m_exprOptimizer.isEmpty()) {
                 auto condExpr = m_exprOptimizer.pop();
                 if (condExpr) {
-                    std::string cond = m_exprOptimizer.toString(condExpr);
-                    emitLine("    until basicBoolToLua(" + cond + ")");
+                    std::string cond = m_exprOptimizer.toCondition(condExpr);
+                    emitLine("    until " + cond);
                 } else {
-                    emitLine("    until basicBoolToLua(pop())");
+                    emitLine("    until pop() ~= 0");
                 }
             } else {
-                emitLine("    until basicBoolToLua(pop())");
+                emitLine("    until pop() ~= 0");
             }
+            if (shouldInjectCancellationCheck()) emitCancellationScopeEnd();
             break;
         }
 
         case IROpcode::DO_WHILE_START: {
             // DO WHILE (pre-test) - same as WHILE
+            if (shouldInjectCancellationCheck()) emitCancellationScopeBegin();
             if (!m_exprOptimizer.isEmpty()) {
                 auto condExpr = m_exprOptimizer.pop();
                 if (condExpr) {
-                    std::string cond = m_exprOptimizer.toString(condExpr);
-                    emitLine("    while basicBoolToLua(" + cond + ") do");
+                    std::string cond = m_exprOptimizer.toCondition(condExpr);
+                    emitLine("    while " + cond + " do");
                 } else {
-                    emitLine("    while basicBoolToLua(pop()) do");
+                    emitLine("    while pop() ~= 0 do");
                 }
             } else {
                 emitLine("    while pop() ~= 0 do");
             }
+            if (shouldInjectCancellationCheck()) emitCancellationCheck(loopPollPlan(index).weight);
             // Track that we're in a pre-test WHILE loop
             DoLoopInfo info;
             info.type = DoLoopType::PRE_TEST_WHILE;
@@ -2674,17 +3663,19 @@ void LuaCodeGenerator::emitLoop(const IRInstruction& instr) {
 
         case IROpcode::DO_UNTIL_START: {
             // DO UNTIL (pre-test) - while NOT condition
+            if (shouldInjectCancellationCheck()) emitCancellationScopeBegin();
             if (!m_exprOptimizer.isEmpty()) {
                 auto condExpr = m_exprOptimizer.pop();
                 if (condExpr) {
-                    std::string cond = m_exprOptimizer.toString(condExpr);
-                    emitLine("    while not basicBoolToLua(" + cond + ") do");
+                    std::string cond = m_exprOptimizer.toCondition(condExpr);
+                    emitLine("    while not (" + cond + ") do");
                 } else {
-                    emitLine("    while not basicBoolToLua(pop()) do");
+                    emitLine("    while pop() == 0 do");
                 }
             } else {
                 emitLine("    while pop() == 0 do");
             }
+            if (shouldInjectCancellationCheck()) emitCancellationCheck(loopPollPlan(index).weight);
             // Track that we're in a pre-test UNTIL loop
             DoLoopInfo info;
             info.type = DoLoopType::PRE_TEST_UNTIL;
@@ -2695,7 +3686,9 @@ void LuaCodeGenerator::emitLoop(const IRInstruction& instr) {
         case IROpcode::DO_START: {
             // Plain DO - always emit 'repeat' since all post-test loops use it
             // For infinite loops, DO_LOOP_END will emit 'until false'
+            if (shouldInjectCancellationCheck()) emitCancellationScopeBegin();
             emitLine("    repeat");
+            if (shouldInjectCancellationCheck()) emitCancellationCheck(loopPollPlan(index).weight);
             // Track that we're in a post-test or infinite loop
             // We'll determine which when we see the LOOP opcode
             DoLoopInfo info;
@@ -2709,14 +3702,15 @@ void LuaCodeGenerator::emitLoop(const IRInstruction& instr) {
             if (!m_exprOptimizer.isEmpty()) {
                 auto condExpr = m_exprOptimizer.pop();
                 if (condExpr) {
-                    std::string cond = m_exprOptimizer.toString(condExpr);
-                    emitLine("    until not basicBoolToLua(" + cond + ")");
+                    std::string cond = m_exprOptimizer.toCondition(condExpr);
+                    emitLine("    until not (" + cond + ")");
                 } else {
-                    emitLine("    until not basicBoolToLua(pop())");
+                    emitLine("    until pop() == 0");
                 }
             } else {
-                emitLine("    until not basicBoolToLua(pop())");
+                emitLine("    until pop() == 0");
             }
+            if (shouldInjectCancellationCheck()) emitCancellationScopeEnd();
             // Mark the current loop as post-test
             if (!m_doLoopStack.empty()) {
                 m_doLoopStack.back().type = DoLoopType::POST_TEST;
@@ -2730,14 +3724,15 @@ void LuaCodeGenerator::emitLoop(const IRInstruction& instr) {
             if (!m_exprOptimizer.isEmpty()) {
                 auto condExpr = m_exprOptimizer.pop();
                 if (condExpr) {
-                    std::string cond = m_exprOptimizer.toString(condExpr);
-                    emitLine("    until basicBoolToLua(" + cond + ")");
+                    std::string cond = m_exprOptimizer.toCondition(condExpr);
+                    emitLine("    until " + cond);
                 } else {
-                    emitLine("    until basicBoolToLua(pop())");
+                    emitLine("    until pop() ~= 0");
                 }
             } else {
-                emitLine("    until basicBoolToLua(pop())");
+                emitLine("    until pop() ~= 0");
             }
+            if (shouldInjectCancellationCheck()) emitCancellationScopeEnd();
             // Mark the current loop as post-test
             if (!m_doLoopStack.empty()) {
                 m_doLoopStack.back().type = DoLoopType::POST_TEST;
@@ -2763,6 +3758,7 @@ void LuaCodeGenerator::emitLoop(const IRInstruction& instr) {
                 // No loop info - default to 'until false' for safety
                 emitLine("    until false");
             }
+            if (shouldInjectCancellationCheck()) emitCancellationScopeEnd();
             break;
         }
 
@@ -2799,12 +3795,15 @@ void LuaCodeGenerator::emitIO(const IRInstruction& instr) {
             if (canUseExpressionMode() && m_exprOptimizer.size() >= argCount + 1) {
                 // Pop values in reverse order (they're on the stack)
                 std::vector<std::string> values;
+                std::vector<ValueFacts> valueFacts;
                 for (int i = 0; i < argCount; i++) {
                     auto expr = m_exprOptimizer.pop();
                     if (expr) {
                         values.insert(values.begin(), m_exprOptimizer.toString(expr));
+                        valueFacts.insert(valueFacts.begin(), expr->facts);
                     } else {
                         values.insert(values.begin(), "pop()");
+                        valueFacts.insert(valueFacts.begin(), ValueFacts());
                     }
                 }
 
@@ -2817,6 +3816,23 @@ void LuaCodeGenerator::emitIO(const IRInstruction& instr) {
                     formatStr = "pop()";
                 }
 
+                // A constant format compiles straight to string.format
+                std::string format, pattern;
+                std::vector<std::string> formatArgs;
+                if (!m_unicodeMode && formatExpr && formatExpr->type == ExprType::LITERAL &&
+                    unquoteLuaString(formatStr, format) &&
+                    compileUsingFormat(format, values, valueFacts, pattern, formatArgs)) {
+                    std::string call = formatArgs.empty() ? quoteLuaString(format)
+                                                          : "string.format(" + quoteLuaString(pattern);
+                    for (const auto& arg : formatArgs) {
+                        call += ", " + arg;
+                    }
+                    if (!formatArgs.empty()) call += ")";
+                    emitLine("    basic_print(" + call + ")");
+                    emitLine("    basic_print_newline()");
+                    break;
+                }
+
                 // Emit call to basic_print_using
                 std::string args = formatStr;
                 for (const auto& val : values) {
@@ -2845,7 +3861,7 @@ void LuaCodeGenerator::emitIO(const IRInstruction& instr) {
             // Print the prompt without newline
             if (std::holds_alternative<std::string>(instr.operand1)) {
                 std::string prompt = std::get<std::string>(instr.operand1);
-                emitLine("    io.write(" + escapeString(prompt) + ")");
+                emitLine("    io.write(" + quoteLuaString(prompt) + ")");
             }
             break;
 
@@ -2996,7 +4012,7 @@ void LuaCodeGenerator::emitIO(const IRInstruction& instr) {
             } else if (std::holds_alternative<std::string>(instr.operand1)) {
                 // RESTORE to label name
                 std::string labelName = std::get<std::string>(instr.operand1);
-                emitLine("    basic_restore(" + escapeString(labelName) + ")");
+                emitLine("    basic_restore(" + quoteLuaString(labelName) + ")");
             } else {
                 // RESTORE with no argument - restore to beginning
                 emitLine("    basic_restore()");
@@ -3037,13 +4053,13 @@ void LuaCodeGenerator::emitIO(const IRInstruction& instr) {
                     std::string code = m_exprOptimizer.toString(expr);
                     std::string filenum = std::get<std::string>(instr.operand1);
                     std::string separator = std::get<std::string>(instr.operand2);
-                    emitLine("    basic_print_file(" + filenum + ", " + code + ", " + escapeString(separator) + ")");
+                    emitLine("    basic_print_file(" + filenum + ", " + code + ", " + quoteLuaString(separator) + ")");
                 }
             } else {
                 flushExpressionToStack();
                 std::string filenum = std::get<std::string>(instr.operand1);
                 std::string separator = std::get<std::string>(instr.operand2);
-                emitLine("    basic_print_file(" + filenum + ", pop(), " + escapeString(separator) + ")");
+                emitLine("    basic_print_file(" + filenum + ", pop(), " + quoteLuaString(separator) + ")");
             }
             break;
 
@@ -3114,10 +4130,9 @@ void LuaCodeGenerator::emitBuiltinFunction(const IRInstruction& instr) {
             auto condExpr = m_exprOptimizer.pop();
             
             if (condExpr && trueExpr && falseExpr) {
-                // Emit proper ternary using basicBoolToLua for correct BASIC boolean handling
-                // This handles BASIC booleans (0/-1) and Lua booleans correctly
-                std::string iifExpr = "(function() if basicBoolToLua(" + m_exprOptimizer.toString(condExpr) + 
-                                      ") then return (" + m_exprOptimizer.toString(trueExpr) + 
+                // Emit proper ternary; toCondition handles BASIC booleans (0/-1) and Lua booleans
+                std::string iifExpr = "(function() if " + m_exprOptimizer.toCondition(condExpr) +
+                                      " then return (" + m_exprOptimizer.toString(trueExpr) + 
                                       ") else return (" + m_exprOptimizer.toString(falseExpr) + 
                                       ") end end)()";
                 m_exprOptimizer.pushVariable(iifExpr);
@@ -3127,7 +4142,7 @@ void LuaCodeGenerator::emitBuiltinFunction(const IRInstruction& instr) {
                 emitLine("        local __iif_false = pop()");
                 emitLine("        local __iif_true = pop()");
                 emitLine("        local __iif_cond = pop()");
-                emitLine("        if basicBoolToLua(__iif_cond) then push(__iif_true) else push(__iif_false) end");
+                emitLine("        if __iif_cond ~= 0 then push(__iif_true) else push(__iif_false) end");
                 emitLine("    end");
             }
         } else {
@@ -3136,7 +4151,7 @@ void LuaCodeGenerator::emitBuiltinFunction(const IRInstruction& instr) {
             emitLine("        local __iif_false = pop()");
             emitLine("        local __iif_true = pop()");
             emitLine("        local __iif_cond = pop()");
-            emitLine("        if basicBoolToLua(__iif_cond) then push(__iif_true) else push(__iif_false) end");
+            emitLine("        if __iif_cond ~= 0 then push(__iif_true) else push(__iif_false) end");
             emitLine("    end");
         }
         return;
@@ -3268,7 +4283,9 @@ void LuaCodeGenerator::emitBuiltinFunction(const IRInstruction& instr) {
         if (canUseExpressionMode() && !m_exprOptimizer.isEmpty()) {
             auto argExpr = m_exprOptimizer.pop();
             if (argExpr) {
-                m_exprOptimizer.pushVariable("basic_sgn(" + m_exprOptimizer.toString(argExpr) + ")");
+                ValueFacts facts;
+                builtinFacts(funcName, argExpr->facts, facts);
+                m_exprOptimizer.pushVariable("basic_sgn(" + m_exprOptimizer.toString(argExpr) + ")", facts);
             } else {
                 emitLine("    push(basic_sgn(pop()))");
             }
@@ -3280,8 +4297,12 @@ void LuaCodeGenerator::emitBuiltinFunction(const IRInstruction& instr) {
     else if (funcName == "FIX") {
         if (canUseExpressionMode() && !m_exprOptimizer.isEmpty()) {
             auto argExpr = m_exprOptimizer.pop();
-            if (argExpr) {
-                m_exprOptimizer.pushVariable("basic_fix(" + m_exprOptimizer.toString(argExpr) + ")");
+            ValueFacts facts;
+            if (argExpr && argExpr->facts.isInteger()) {
+                m_exprOptimizer.push(argExpr);  // Already integral: no basic_fix needed
+            } else if (argExpr) {
+                builtinFacts(funcName, argExpr->facts, facts);
+                m_exprOptimizer.pushVariable("basic_fix(" + m_exprOptimizer.toString(argExpr) + ")", facts);
             } else {
                 emitLine("    push(basic_fix(pop()))");
             }
@@ -3330,8 +4351,12 @@ void LuaCodeGenerator::emitBuiltinFunction(const IRInstruction& instr) {
     else if (funcName == "INT") {
         if (canUseExpressionMode() && !m_exprOptimizer.isEmpty()) {
             auto argExpr = m_exprOptimizer.pop();
-            if (argExpr) {
-                m_exprOptimizer.pushVariable("math.floor(" + m_exprOptimizer.toString(argExpr) + ")");
+            ValueFacts facts;
+            if (argExpr && argExpr->facts.isInteger()) {
+                m_exprOptimizer.push(argExpr);  // Already integral: no math.floor needed
+            } else if (argExpr) {
+                builtinFacts(funcName, argExpr->facts, facts);
+                m_exprOptimizer.pushVariable("math.floor(" + m_exprOptimizer.toString(argExpr) + ")", facts);
             } else {
                 emitLine("    push(math.floor(pop()))");
             }
@@ -3501,8 +4526,14 @@ void LuaCodeGenerator::emitBuiltinFunction(const IRInstruction& instr) {
         // LEN(s) returns length of string
         if (canUseExpressionMode() && !m_exprOptimizer.isEmpty()) {
             auto argExpr = m_exprOptimizer.pop();
-            if (argExpr) {
-                m_exprOptimizer.pushVariable("string.len(" + m_exprOptimizer.toString(argExpr) + ")");
+            const BuilderChain* chain = argExpr ? findBuilderChain(argExpr) : nullptr;
+            if (chain && chain->pieces.empty()) {
+                // A builder knows its length without materializing the string
+                m_exprOptimizer.pushVariable("sb_len(" + chain->builder + ")",
+                                             ValueFacts::integer(0.0, HUGE_VAL));
+            } else if (argExpr) {
+                m_exprOptimizer.pushVariable("string.len(" + m_exprOptimizer.toString(argExpr) + ")",
+                                             ValueFacts::integer(0.0, HUGE_VAL));
             } else {
                 emitLine("    push(string.len(pop()))");
             }
@@ -3722,13 +4753,13 @@ void LuaCodeGenerator::emitBuiltinFunction(const IRInstruction& instr) {
             auto fileExpr = m_exprOptimizer.pop();
             if (fileExpr) {
                 std::string fileStr = m_exprOptimizer.toString(fileExpr);
-                std::string result = "basic_eof_hash(" + fileStr + ")";
-                m_exprOptimizer.pushVariable(result);
+                // basic_eof_hash returns a Lua boolean; keep it native for conditions
+                m_exprOptimizer.pushPredicate("basic_eof_hash(" + fileStr + ")");
             } else {
-                emitLine("    push(basic_eof_hash(pop()))");
+                emitLine("    push(basic_eof_hash(pop()) and -1 or 0)");
             }
         } else {
-            emitLine("    push(basic_eof_hash(pop()))");
+            emitLine("    push(basic_eof_hash(pop()) and -1 or 0)");
         }
         return;
     }
@@ -3821,6 +4852,9 @@ void LuaCodeGenerator::emitBuiltinFunction(const IRInstruction& instr) {
             }
         }
 
+        // BOOL functions return Lua booleans; BASIC values must stay -1/0
+        bool returnsLuaBoolean = def->returnType == FasterBASIC::ModularCommands::ReturnType::BOOL;
+
         // Check if we have custom code generation
         if (def->hasCustomCodeGen) {
             // Use custom code template - simple substitution for now
@@ -3839,7 +4873,13 @@ void LuaCodeGenerator::emitBuiltinFunction(const IRInstruction& instr) {
             if (def->isFunction) {
                 if (usedExpressionMode && canUseExpressionMode()) {
                     // Push result to expression optimizer so subsequent operators can use it
-                    m_exprOptimizer.pushVariable(customCode);
+                    if (returnsLuaBoolean) {
+                        m_exprOptimizer.pushPredicate(customCode);
+                    } else {
+                        m_exprOptimizer.pushVariable(customCode);
+                    }
+                } else if (returnsLuaBoolean) {
+                    emitLine("    push(" + customCode + " and -1 or 0)");
                 } else {
                     emitLine("    push(" + customCode + ")");
                 }
@@ -3859,7 +4899,13 @@ void LuaCodeGenerator::emitBuiltinFunction(const IRInstruction& instr) {
                 std::string functionCall = def->luaFunction + "(" + callParams + ")";
                 if (usedExpressionMode && canUseExpressionMode()) {
                     // Push result to expression optimizer so subsequent operators can use it
-                    m_exprOptimizer.pushVariable(functionCall);
+                    if (returnsLuaBoolean) {
+                        m_exprOptimizer.pushPredicate(functionCall);
+                    } else {
+                        m_exprOptimizer.pushVariable(functionCall);
+                    }
+                } else if (returnsLuaBoolean) {
+                    emitLine("    push(" + functionCall + " and -1 or 0)");
                 } else {
                     emitLine("    push(" + functionCall + ")");
                 }
@@ -4656,7 +5702,7 @@ void LuaCodeGenerator::emitBuiltinFunction(const IRInstruction& instr) {
     else if (funcName == "EOF") {
         flushExpressionToStack();
         emitLine("    local filenum = pop()");
-        emitLine("    push(basic_eof(filenum) and 1 or 0)");
+        emitLine("    push(basic_eof(filenum) and -1 or 0)");
         return;
     } else if (funcName == "LOC") {
         flushExpressionToStack();
@@ -4762,10 +5808,13 @@ void LuaCodeGenerator::emitFunctionDefinition(const IRInstruction& instr) {
         case IROpcode::END_SUB: {
             // Just close the function - no cleanup code here
             // All RETURN statements handle SAMM exit_scope before returning
+            m_pendingLineCounter = 0;
+            m_runCounter = 0;
             emitLine("end");
             emitLine("");
 
             m_currentFunction = nullptr;
+            m_lastEmittedOpcode = IROpcode::NOP;  // A return here does not end the next function's block
             break;
         }
 
@@ -4934,6 +5983,12 @@ void LuaCodeGenerator::emitExit(const IRInstruction& instr) {
         case IROpcode::EXIT_DO:
         case IROpcode::EXIT_WHILE:
         case IROpcode::EXIT_REPEAT: {
+            // A strip-mined FOR is two nested loops; break would only leave the inner one
+            if (instr.opcode == IROpcode::EXIT_FOR &&
+                !m_forLoopStack.empty() && m_forLoopStack.back().stripMined) {
+                emitLine("    goto " + m_forLoopStack.back().exitLabel);
+                break;
+            }
             // Exit from loop - emit break statement
             emitLine("    break");
             break;
@@ -5028,6 +6083,149 @@ void LuaCodeGenerator::emitLabel(const std::string& label) {
     emitLine("    ::" + getLabelName(label) + "::");
 }
 
+// =============================================================================
+// Cancellation Checks
+// =============================================================================
+//
+// Polling the stop flag on every iteration would put a load and a branch on
+// the hot path of every trace, and LuaJIT hoists a loop-invariant FFI load out
+// of the loop anyway. Instead each loop keeps a countdown and only calls
+// basic_cancel_poll() when it reaches zero, so the poll runs on a side exit
+// once every CANCEL_POLL_INTERVAL iterations. Native FOR loops with an integer
+// literal or variable step are strip-mined instead, which leaves the inner
+// loop untouched.
+//
+// Which loops poll is decided for the whole loop nest before code generation.
+// A FOR loop with literal bounds goes without a check only when one run of it,
+// nested loops included, stays under CANCEL_POLL_INTERVAL iterations; that
+// work is then charged to the enclosing loop, whose blocks shrink (or whose
+// countdown steps faster) to match. Every other loop polls for itself at any
+// depth, since an enclosing loop only polls between runs of its body. So a
+// short FOR whose bounds are only known at runtime polls on every entry: the
+// 100-iteration inner loop of loop_cancel_bench.lua's for-grid runs 5-8%
+// slower for it, the one kernel there over the 1% budget. Loops
+// built from gotos (GOTO, stack-based FOR/WHILE) are not compiled by LuaJIT,
+// so they run in the interpreter where the host's SIGINT count hook already
+// reaches them.
+
+bool LuaCodeGenerator::shouldInjectCancellationCheck() const {
+    return m_cancellableLoops;
+}
+
+// Numeric literal operand, as PUSH_INT/PUSH_FLOAT/PUSH_DOUBLE optionally negated
+static bool literalOperand(const IRCode& irCode, int first, int end, double& value) {
+    const auto& code = irCode.instructions;
+    if (first < 0 || end - first < 1 || end - first > 2) return false;
+    const IRInstruction& push = code[first];
+    if (push.opcode != IROpcode::PUSH_INT && push.opcode != IROpcode::PUSH_FLOAT &&
+        push.opcode != IROpcode::PUSH_DOUBLE) {
+        return false;
+    }
+    if (std::holds_alternative<int>(push.operand1)) {
+        value = std::get<int>(push.operand1);
+    } else if (std::holds_alternative<double>(push.operand1)) {
+        value = std::get<double>(push.operand1);
+    } else {
+        return false;
+    }
+    if (end - first == 2) {
+        if (code[first + 1].opcode != IROpcode::NEG) return false;
+        value = -value;
+    }
+    return true;
+}
+
+void LuaCodeGenerator::planLoopCancellation(const IRCode& irCode) {
+    m_loopPolls.clear();
+    if (!m_cancellableLoops) return;
+
+    const auto& code = irCode.instructions;
+    const double interval = CANCEL_POLL_INTERVAL;
+
+    struct OpenLoop {
+        size_t index;
+        double trips;     // Literal trip count, or -1 when only known at runtime
+        double weight;    // Work per iteration, unpolled nested loops included
+    };
+    std::vector<OpenLoop> open;
+
+    for (size_t i = 0; i < code.size(); i++) {
+        switch (code[i].opcode) {
+            case IROpcode::FOR_INIT: {
+                double trips = -1;
+                int stepStart = irCode.expressionStart(static_cast<int>(i), 1);
+                int endStart = stepStart > 0 ? irCode.expressionStart(stepStart, 1) : -1;
+                int startStart = endStart > 0 ? irCode.expressionStart(endStart, 1) : -1;
+                double start, limit, step;
+                if (literalOperand(irCode, startStart, endStart, start) &&
+                    literalOperand(irCode, endStart, stepStart, limit) &&
+                    literalOperand(irCode, stepStart, static_cast<int>(i), step) && step != 0) {
+                    trips = std::max(0.0, std::floor((limit - start) / step) + 1);
+                }
+                open.push_back({i, trips, 1});
+                break;
+            }
+            case IROpcode::FOR_IN_INIT:
+            case IROpcode::WHILE_START:
+            case IROpcode::REPEAT_START:
+            case IROpcode::DO_WHILE_START:
+            case IROpcode::DO_UNTIL_START:
+            case IROpcode::DO_START:
+                open.push_back({i, -1, 1});
+                break;
+            case IROpcode::FOR_NEXT:
+            case IROpcode::FOR_IN_NEXT:
+            case IROpcode::WHILE_END:
+            case IROpcode::REPEAT_END:
+            case IROpcode::DO_LOOP_WHILE:
+            case IROpcode::DO_LOOP_UNTIL:
+            case IROpcode::DO_LOOP_END: {
+                if (open.empty()) break;
+                OpenLoop loop = open.back();
+                open.pop_back();
+                LoopPollPlan plan;
+                plan.weight = static_cast<int>(std::min(loop.weight, interval));
+                double work = loop.trips * loop.weight;
+                if (code[loop.index].opcode == IROpcode::FOR_INIT && loop.trips >= 0 && work < interval) {
+                    // Bounded: the enclosing loop counts this run as part of its own iteration
+                    plan.polls = false;
+                    if (!open.empty()) open.back().weight += work;
+                }
+                m_loopPolls[loop.index] = plan;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+LuaCodeGenerator::LoopPollPlan LuaCodeGenerator::loopPollPlan(size_t index) const {
+    auto it = m_loopPolls.find(index);
+    return it != m_loopPolls.end() ? it->second : LoopPollPlan{};
+}
+
+// Open a scope holding the countdown for a structured loop
+void LuaCodeGenerator::emitCancellationScopeBegin() {
+    emitLine("    do local _cc = " + std::to_string(CANCEL_POLL_INTERVAL));
+}
+
+void LuaCodeGenerator::emitCancellationScopeEnd() {
+    emitLine("    end");
+}
+
+// Countdown tick at the top of a structured loop body; weight is how many
+// iterations one pass of the body counts as
+void LuaCodeGenerator::emitCancellationCheck(int weight) {
+    if (weight <= 1) {
+        emitLine("    _cc = _cc - 1");
+        emitLine("    if _cc == 0 then _cc = " + std::to_string(CANCEL_POLL_INTERVAL) + " basic_cancel_poll() end");
+    } else {
+        emitLine("    _cc = _cc - " + std::to_string(weight));
+        emitLine("    if _cc <= 0 then _cc = " + std::to_string(CANCEL_POLL_INTERVAL) + " basic_cancel_poll() end");
+    }
+}
+
 std::string LuaCodeGenerator::getVarName(const std::string& name) {
     // Convert BASIC variable name to valid Lua identifier
     std::string luaName = "var_" + name;
@@ -5061,15 +6259,29 @@ std::string LuaCodeGenerator::getLabelName(const std::string& label) {
 }
 
 std::string LuaCodeGenerator::escapeString(const std::string& str) {
-    std::ostringstream oss;
-
-    // In OPTION UNICODE mode, wrap string literals with unicode.from_utf8()
+    // In OPTION UNICODE mode, string literals are decoded once into the
+    // literal pool and referenced by index, so a literal inside a loop
+    // does not re-run unicode.from_utf8() on every iteration
     if (m_unicodeMode) {
-        oss << "unicode.from_utf8(\"";
-    } else {
-        oss << "\"";
+        auto it = m_unicodeLiteralIds.find(str);
+        int id;
+        if (it != m_unicodeLiteralIds.end()) {
+            id = it->second;
+        } else {
+            m_unicodeLiterals.push_back(str);
+            id = static_cast<int>(m_unicodeLiterals.size());
+            m_unicodeLiteralIds[str] = id;
+        }
+        return "_ustr[" + std::to_string(id) + "]";
     }
 
+    return quoteLuaString(str);
+}
+
+std::string LuaCodeGenerator::quoteLuaString(const std::string& str) {
+    std::ostringstream oss;
+    oss << "\"";
+
     for (char c : str) {
         switch (c) {
             case '"': oss << "\\\""; break;
@@ -5081,15 +6293,192 @@ std::string LuaCodeGenerator::escapeString(const std::string& str) {
         }
     }
 
-    if (m_unicodeMode) {
-        oss << "\")";
-    } else {
-        oss << "\"";
-    }
+    oss << "\"";
+    return oss.str();
+}
+
+std::string LuaCodeGenerator::generateUnicodeLiteralPool() {
+    if (m_unicodeLiterals.empty()) return "";
+    std::ostringstream oss;
+    oss << "-- Unicode string literal pool (decoded once at load time)\n";
+    oss << "local _ustr = {\n";
+    for (const auto& literal : m_unicodeLiterals) {
+        oss << "    unicode.from_utf8(" << quoteLuaString(literal) << "),\n";
+    }
+    oss << "}\n";
+    oss << "for i = 1, #_ustr do _ustr_const[_ustr[i]] = true end\n";
+    oss << "\n";
+    return oss.str();
+}
+
+std::string LuaCodeGenerator::generateSwitchTables() {
+    if (!m_switchTables || m_switchTables->empty()) return "";
+    std::ostringstream oss;
+    oss << "-- SELECT CASE dispatch tables (case value -> arm)\n";
+    oss << "local _switch = {\n";
+    for (const auto& table : *m_switchTables) {
+        oss << "    {";
+        for (size_t i = 0; i < table.entries.size(); i++) {
+            const auto& [value, arm] = table.entries[i];
+            std::string key = std::holds_alternative<std::string>(value)
+                                  ? quoteLuaString(std::get<std::string>(value))
+                                  : formatNumberLiteral(std::get<double>(value));
+            oss << (i > 0 ? ", " : "") << "[" << key << "] = " << arm;
+        }
+        oss << "},\n";
+    }
+    oss << "}\n";
+    oss << "\n";
+    return oss.str();
+}
 
+// OPTION PROFILE COUNTS: lines that always run together share one counter,
+// so a straight-line run of BASIC lines costs a single increment. Slots are
+// numbered in first-use order so the array stays dense. An FFI uint64_t
+// array keeps every bump a plain load/add/store on the trace, with no table
+// lookup once compiled; the host reads it back through COUNTERS_GLOBAL.
+std::string LuaCodeGenerator::generateLineCounters() {
+    if (m_counterSlots == 0) return "";
+    std::ostringstream oss;
+    oss << "-- Line execution counters (OPTION PROFILE COUNTS), one _lc slot per straight-line run\n";
+    oss << "local _lc = (function(n)\n";
+    oss << "    local ok, ffi = pcall(require, 'ffi')\n";
+    oss << "    if ok then return ffi.new('uint64_t[?]', n + 1) end\n";
+    oss << "    local t = {}\n";
+    oss << "    for i = 1, n do t[i] = 0 end\n";
+    oss << "    return t\n";
+    oss << "end)(" << m_counterSlots << ")\n";
+    oss << LuaSourceMap::COUNTERS_GLOBAL << " = _lc\n";
+    oss << "\n";
     return oss.str();
 }
 
+void LuaCodeGenerator::emitLineCounter() {
+    int basicLine = m_pendingLineCounter;
+    m_pendingLineCounter = 0;
+
+    // Nothing may follow a return in its block, and nothing after it runs
+    if (m_lastEmittedOpcode == IROpcode::RETURN_VALUE ||
+        m_lastEmittedOpcode == IROpcode::RETURN_VOID ||
+        m_lastEmittedOpcode == IROpcode::EXIT_FUNCTION ||
+        m_lastEmittedOpcode == IROpcode::EXIT_SUB) {
+        return;
+    }
+
+    // Lines that only hold a label never get here, so they are not
+    // reported as unexecuted
+    auto it = m_lineCounterSlots.find(basicLine);
+    if (it == m_lineCounterSlots.end()) {
+        // Nothing since the run's increment can branch away, so a new line
+        // in the run runs exactly as often
+        int slot = m_runCounter != 0 ? m_runCounter : ++m_counterSlots;
+        it = m_lineCounterSlots.emplace(basicLine, slot).first;
+        m_countedLines.emplace_back(basicLine, slot);
+        if (slot == m_runCounter) return;
+    } else if (it->second == m_runCounter) {
+        return;
+    }
+    m_runCounter = it->second;
+    m_counterFixups.emplace_back(static_cast<size_t>(m_output.tellp()), m_runCounter);
+    emitLine("    " + lineCounterIncrement(m_runCounter));
+}
+
+std::string LuaCodeGenerator::lineCounterIncrement(int slot) {
+    std::string counter = "_lc[" + std::to_string(slot) + "]";
+    return counter + " = " + counter + " + 1";
+}
+
+// Opcodes that always fall through to the next instruction. A runtime error
+// can still stop a run part way, which only matters for a run that failed
+bool LuaCodeGenerator::isStraightLineOpcode(IROpcode opcode) {
+    switch (opcode) {
+        case IROpcode::LABEL:
+        case IROpcode::JUMP:
+        case IROpcode::JUMP_IF_TRUE:
+        case IROpcode::JUMP_IF_FALSE:
+        case IROpcode::RETURN_GOSUB:
+        case IROpcode::ON_GOTO:
+        case IROpcode::ON_GOSUB:
+        case IROpcode::ON_CALL:
+        case IROpcode::ON_EVENT:
+        case IROpcode::IF_START:
+        case IROpcode::ELSEIF_START:
+        case IROpcode::ELSE_START:
+        case IROpcode::IF_END:
+        case IROpcode::SWITCH_START:
+        case IROpcode::SWITCH_CASE:
+        case IROpcode::SWITCH_DEFAULT:
+        case IROpcode::SWITCH_END:
+        case IROpcode::DEFINE_FUNCTION:
+        case IROpcode::DEFINE_SUB:
+        case IROpcode::END_FUNCTION:
+        case IROpcode::END_SUB:
+        case IROpcode::RETURN_VALUE:
+        case IROpcode::RETURN_VOID:
+        case IROpcode::EXIT_FOR:
+        case IROpcode::EXIT_DO:
+        case IROpcode::EXIT_WHILE:
+        case IROpcode::EXIT_REPEAT:
+        case IROpcode::EXIT_FUNCTION:
+        case IROpcode::EXIT_SUB:
+        case IROpcode::FOR_INIT:
+        case IROpcode::FOR_CHECK:
+        case IROpcode::FOR_NEXT:
+        case IROpcode::FOR_IN_INIT:
+        case IROpcode::FOR_IN_CHECK:
+        case IROpcode::FOR_IN_NEXT:
+        case IROpcode::WHILE_START:
+        case IROpcode::WHILE_END:
+        case IROpcode::REPEAT_START:
+        case IROpcode::REPEAT_END:
+        case IROpcode::DO_WHILE_START:
+        case IROpcode::DO_UNTIL_START:
+        case IROpcode::DO_START:
+        case IROpcode::DO_LOOP_WHILE:
+        case IROpcode::DO_LOOP_UNTIL:
+        case IROpcode::DO_LOOP_END:
+        case IROpcode::HALT:
+        case IROpcode::END:
+            return false;
+        default:
+            return true;
+    }
+}
+
+// Lines of a binary search over the arm numbers first..last, split at the
+// arms: `pending` collects the lines up to the next arm
+void LuaCodeGenerator::buildSwitchDispatch(int first, int last, SwitchDispatch& dispatch,
+                                           std::vector<std::string>& pending) {
+    if (first == last) {
+        dispatch.armLines[first] = std::move(pending);
+        pending.clear();
+        return;
+    }
+
+    // A few equality tests beat another level of range tests
+    if (last - first < 4) {
+        for (int arm = first; arm <= last; arm++) {
+            if (arm == first) {
+                pending.push_back("    if _arm == " + std::to_string(arm) + " then");
+            } else if (arm < last) {
+                pending.push_back("    elseif _arm == " + std::to_string(arm) + " then");
+            } else {
+                pending.push_back("    else");
+            }
+            buildSwitchDispatch(arm, arm, dispatch, pending);
+        }
+        pending.push_back("    end");
+        return;
+    }
+
+    int middle = first + (last - first) / 2;
+    pending.push_back("    if _arm <= " + std::to_string(middle) + " then");
+    buildSwitchDispatch(first, middle, dispatch, pending);
+    pending.push_back("    else");
+    buildSwitchDispatch(middle + 1, last, dispatch, pending);
+    pending.push_back("    end");
+}
+
 void LuaCodeGenerator::emitStringConcat(const IRInstruction& instr) {
     // String concatenation: pop 2 strings, push concatenation
     // Check IR opcode to determine which type of concat
@@ -5116,9 +6505,19 @@ void LuaCodeGenerator::emitStringConcat(const IRInstruction& instr) {
             auto rightExpr = m_exprOptimizer.pop();
             auto leftExpr = m_exprOptimizer.pop();
             if (rightExpr && leftExpr) {
-                std::string result = "(" + m_exprOptimizer.toString(leftExpr) + " .. " +
-                                    m_exprOptimizer.toString(rightExpr) + ")";
-                m_exprOptimizer.pushVariable(result);
+                std::string right = m_exprOptimizer.toString(rightExpr);
+                std::string result = "(" + m_exprOptimizer.toString(leftExpr) + " .. " + right + ")";
+                m_exprOptimizer.pushVariable(result, ValueFacts::string());
+
+                // Builder contents with appended pieces: a store back to the
+                // same variable becomes sb_append calls
+                const BuilderChain* chain = findBuilderChain(leftExpr);
+                if (chain && right.find("sb_tostring(" + chain->builder + ")") == std::string::npos) {
+                    BuilderChain extended = *chain;
+                    extended.expr = m_exprOptimizer.peek();
+                    extended.pieces.push_back(right);
+                    m_builderChains.push_back(extended);
+                }
             } else {
                 emitLine("    b = pop(); a = pop(); push(a .. b)");
             }
@@ -5283,6 +6682,424 @@ void LuaCodeGenerator::analyzeVariableAccess(const IRCode& irCode) {
     }
 }
 
+// Whole-program facts for scalar variables. Each variable is a single Lua
+// slot, so its facts are the join over every definition in the program:
+// the initial 0, STORE_VAR values (evaluated symbolically over the
+// expression code in front of them) and FOR loop ranges. Variables written
+// any other way (INPUT, READ, MID$, FOR...IN, parameters) stay unknown.
+// Solved optimistically to a fixed point; ranges that keep growing are
+// widened to unbounded integers.
+void LuaCodeGenerator::inferVariableFacts(const IRCode& irCode) {
+    m_variableFacts.clear();
+
+    std::unordered_set<std::string> opaque;
+    for (const auto& instr : irCode.instructions) {
+        switch (instr.opcode) {
+            case IROpcode::LOAD_VAR:
+            case IROpcode::STORE_VAR:
+            case IROpcode::FOR_INIT:
+            case IROpcode::FOR_CHECK:   // Name the counter; stepping stays within the FOR range
+            case IROpcode::FOR_NEXT:
+            case IROpcode::PUSH_STRING:
+                continue;
+            default:
+                break;
+        }
+        for (const IROperand* operand : {&instr.operand1, &instr.operand2, &instr.operand3}) {
+            if (std::holds_alternative<std::string>(*operand)) {
+                opaque.insert(std::get<std::string>(*operand));
+            }
+        }
+    }
+    for (const auto& def : m_functionDefs) {
+        opaque.insert(def.second.parameters.begin(), def.second.parameters.end());
+    }
+
+    std::unordered_map<std::string, ValueFacts> facts;
+    std::unordered_map<std::string, int> widenings;
+    auto factsOf = [&](const std::string& name) {
+        if (opaque.count(name)) return ValueFacts::unknown();
+        auto it = facts.find(name);
+        return it != facts.end() ? it->second : ValueFacts::constant(0.0);
+    };
+
+    const int maxRounds = 32;
+    bool changed = true;
+    int round = 0;
+    for (; changed && round < maxRounds; round++) {
+        changed = false;
+        std::vector<ValueFacts> stack;
+        auto pop = [&stack]() {
+            if (stack.empty()) return ValueFacts::unknown();
+            ValueFacts top = stack.back();
+            stack.pop_back();
+            return top;
+        };
+        auto define = [&](const std::string& name, const ValueFacts& value) {
+            if (opaque.count(name)) return;
+            ValueFacts current = factsOf(name);
+            ValueFacts joined = current.join(value);
+            if (joined == current) return;
+            if (current.isInteger() && joined.isInteger() && ++widenings[name] > 2) {
+                joined = ValueFacts::integer();
+            }
+            facts[name] = joined;
+            changed = true;
+        };
+
+        for (const auto& instr : irCode.instructions) {
+            const std::string* name = std::holds_alternative<std::string>(instr.operand1)
+                                          ? &std::get<std::string>(instr.operand1) : nullptr;
+            switch (instr.opcode) {
+                case IROpcode::PUSH_INT:
+                    stack.push_back(std::holds_alternative<int>(instr.operand1)
+                                        ? ValueFacts::constant(std::get<int>(instr.operand1))
+                                        : ValueFacts::constant(0.0));
+                    break;
+                case IROpcode::PUSH_FLOAT:
+                case IROpcode::PUSH_DOUBLE:
+                    stack.push_back(std::holds_alternative<double>(instr.operand1)
+                                        ? ValueFacts::constant(std::get<double>(instr.operand1))
+                                        : ValueFacts::number());
+                    break;
+                case IROpcode::PUSH_STRING:
+                    stack.push_back(m_unicodeMode ? ValueFacts::unknown() : ValueFacts::string());
+                    break;
+                case IROpcode::LOAD_VAR:
+                    stack.push_back(name ? factsOf(*name) : ValueFacts::unknown());
+                    break;
+                case IROpcode::DUP:
+                    stack.push_back(stack.empty() ? ValueFacts::unknown() : stack.back());
+                    break;
+                case IROpcode::POP:
+                    pop();
+                    break;
+
+                case IROpcode::ADD: case IROpcode::SUB: case IROpcode::MUL: case IROpcode::DIV:
+                case IROpcode::IDIV: case IROpcode::MOD: case IROpcode::POW:
+                case IROpcode::EQ: case IROpcode::NE: case IROpcode::LT: case IROpcode::LE:
+                case IROpcode::GT: case IROpcode::GE:
+                case IROpcode::AND: case IROpcode::OR: case IROpcode::XOR:
+                case IROpcode::EQV: case IROpcode::IMP: {
+                    static const std::unordered_map<int, BinaryOp> binaryOps = {
+                        {(int)IROpcode::ADD, BinaryOp::ADD}, {(int)IROpcode::SUB, BinaryOp::SUB},
+                        {(int)IROpcode::MUL, BinaryOp::MUL}, {(int)IROpcode::DIV, BinaryOp::DIV},
+                        {(int)IROpcode::IDIV, BinaryOp::IDIV}, {(int)IROpcode::MOD, BinaryOp::MOD},
+                        {(int)IROpcode::POW, BinaryOp::POW}, {(int)IROpcode::EQ, BinaryOp::EQ},
+                        {(int)IROpcode::NE, BinaryOp::NE}, {(int)IROpcode::LT, BinaryOp::LT},
+                        {(int)IROpcode::LE, BinaryOp::LE}, {(int)IROpcode::GT, BinaryOp::GT},
+                        {(int)IROpcode::GE, BinaryOp::GE}, {(int)IROpcode::AND, BinaryOp::AND},
+                        {(int)IROpcode::OR, BinaryOp::OR}, {(int)IROpcode::XOR, BinaryOp::XOR},
+                        {(int)IROpcode::EQV, BinaryOp::EQV}, {(int)IROpcode::IMP, BinaryOp::IMP}};
+                    ValueFacts right = pop();
+                    ValueFacts left = pop();
+                    stack.push_back(ValueFacts::binary(binaryOps.at((int)instr.opcode), left, right));
+                    break;
+                }
+                case IROpcode::NEG:
+                    stack.push_back(ValueFacts::unary(UnaryOp::NEG, pop()));
+                    break;
+                case IROpcode::NOT:
+                    stack.push_back(ValueFacts::unary(UnaryOp::NOT, pop()));
+                    break;
+                case IROpcode::STR_CONCAT:
+                    pop();
+                    pop();
+                    stack.push_back(ValueFacts::string());
+                    break;
+
+                case IROpcode::CALL_BUILTIN: {
+                    int argCount = std::holds_alternative<int>(instr.operand2) ? std::get<int>(instr.operand2) : 0;
+                    ValueFacts result;
+                    if (name && argCount == 1 && builtinFacts(*name, stack.empty() ? ValueFacts::unknown() : stack.back(), result)) {
+                        pop();
+                        stack.push_back(result);
+                    } else {
+                        // Unmodelled calls may not push a result; nothing below is trusted
+                        stack.clear();
+                        stack.push_back(ValueFacts::unknown());
+                    }
+                    break;
+                }
+
+                case IROpcode::STORE_VAR:
+                    if (name) define(*name, pop());
+                    break;
+
+                case IROpcode::FOR_INIT: {
+                    ValueFacts step = pop();
+                    ValueFacts end = pop();
+                    ValueFacts start = pop();
+                    ValueFacts counter;
+                    if (start.isBounded() && end.isBounded() && step.isBounded()) {
+                        // Every value lies between start and the first one past end
+                        counter = ValueFacts::integer(std::min(start.low, end.low + std::min(step.low, 0.0)),
+                                                      std::max(start.high, end.high + std::max(step.high, 0.0)));
+                    } else if (start.isInteger() && step.isInteger()) {
+                        counter = ValueFacts::integer();
+                    } else if (start.isNumeric() && step.isNumeric()) {
+                        counter = ValueFacts::number();
+                    }
+                    if (name) define(*name, counter);
+                    break;
+                }
+
+                default:
+                    // Anything else consumes or produces values this pass doesn't model
+                    stack.clear();
+                    break;
+            }
+        }
+    }
+
+    if (changed) {
+        return;  // Did not converge: claim nothing
+    }
+    for (const auto& entry : facts) {
+        if (entry.second.kind != ValueFacts::Kind::UNKNOWN) {
+            m_variableFacts[entry.first] = entry.second;
+        }
+    }
+}
+
+// A loop qualifies for a string builder when it appends to a string
+// variable (V$ = V$ + ...) and control can only leave it by falling off its
+// end: no GOTO, EXIT, RETURN or END inside, no user code that could see the
+// variable (GOSUB, SUB, FUNCTION, event handlers) and no jump into it from
+// outside. The variable is moved into a builder before the loop (ahead of a
+// pre-test condition) and written back after it; the outermost such loop
+// is used so nested loops share one builder.
+void LuaCodeGenerator::analyzeStringBuilders(const IRCode& irCode) {
+    m_builderRegions.clear();
+    m_activeBuilders.clear();
+    m_builderChains.clear();
+    if (m_unicodeMode || irCode.eventsUsed) return;
+
+    const auto& code = irCode.instructions;
+    const size_t none = static_cast<size_t>(-1);
+
+    // Loop extents, outermost first
+    std::vector<std::pair<size_t, size_t>> loops;
+    std::vector<size_t> open;
+    for (size_t i = 0; i < code.size(); i++) {
+        switch (code[i].opcode) {
+            case IROpcode::FOR_INIT:
+            case IROpcode::FOR_IN_INIT:
+            case IROpcode::DO_START:
+            case IROpcode::REPEAT_START:
+                open.push_back(i);
+                break;
+            case IROpcode::WHILE_START: {
+                // The condition follows the LABEL that WEND jumps back to
+                int start = irCode.expressionStart(static_cast<int>(i), 1);
+                bool labelled = start > 0 && code[start - 1].opcode == IROpcode::LABEL;
+                open.push_back(labelled ? static_cast<size_t>(start - 1) : none);
+                break;
+            }
+            case IROpcode::DO_WHILE_START:
+            case IROpcode::DO_UNTIL_START: {
+                int start = irCode.expressionStart(static_cast<int>(i), 1);
+                open.push_back(start >= 0 ? static_cast<size_t>(start) : none);
+                break;
+            }
+            case IROpcode::FOR_NEXT:
+            case IROpcode::FOR_IN_NEXT:
+            case IROpcode::WHILE_END:
+            case IROpcode::REPEAT_END:
+            case IROpcode::DO_LOOP_WHILE:
+            case IROpcode::DO_LOOP_UNTIL:
+            case IROpcode::DO_LOOP_END:
+                if (!open.empty()) {
+                    if (open.back() != none) loops.push_back({open.back(), i});
+                    open.pop_back();
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    std::sort(loops.begin(), loops.end(), [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first < b.first : a.second > b.second;
+    });
+
+    auto labelText = [](const IROperand& op) {
+        if (std::holds_alternative<int>(op)) return std::to_string(std::get<int>(op));
+        if (std::holds_alternative<std::string>(op)) return std::get<std::string>(op);
+        return std::string();
+    };
+
+    // Labels reached by jumps, with the jump's position
+    std::vector<std::pair<std::string, size_t>> jumps;
+    for (size_t i = 0; i < code.size(); i++) {
+        switch (code[i].opcode) {
+            case IROpcode::JUMP:
+            case IROpcode::JUMP_IF_TRUE:
+            case IROpcode::JUMP_IF_FALSE:
+            case IROpcode::CALL_GOSUB:
+                jumps.push_back({labelText(code[i].operand1), i});
+                break;
+            case IROpcode::ON_GOTO:
+            case IROpcode::ON_GOSUB: {
+                std::stringstream targets(labelText(code[i].operand1));
+                std::string target;
+                while (std::getline(targets, target, ',')) {
+                    jumps.push_back({target, i});
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    std::unordered_set<std::string> parameters;
+    for (const auto& def : m_functionDefs) {
+        parameters.insert(def.second.parameters.begin(), def.second.parameters.end());
+    }
+
+    int nextBuilder = 1;
+    for (const auto& [begin, end] : loops) {
+        bool contained = true;
+        std::unordered_set<std::string> labels;
+        std::set<std::string> appended;
+        for (size_t i = begin; i <= end && contained; i++) {
+            const auto& instr = code[i];
+            int pops = 0;
+            switch (instr.opcode) {
+                case IROpcode::STORE_VAR: {
+                    // V$ = V$ + ...: the value starts by loading V$ and ends in a concatenation
+                    int start = irCode.expressionStart(static_cast<int>(i), 1);
+                    if (code[i - 1].opcode == IROpcode::STR_CONCAT && start >= static_cast<int>(begin) &&
+                        code[start].opcode == IROpcode::LOAD_VAR && code[start].operand1 == instr.operand1 &&
+                        std::holds_alternative<std::string>(instr.operand1)) {
+                        appended.insert(std::get<std::string>(instr.operand1));
+                    }
+                    break;
+                }
+                case IROpcode::LABEL:
+                    labels.insert(labelText(instr.operand1));
+                    break;
+                case IROpcode::CALL_FUNCTION:
+                    contained = false;
+                    break;
+                case IROpcode::NOP:
+                case IROpcode::POP:
+                case IROpcode::STORE_ARRAY:
+                case IROpcode::MID_ASSIGN:
+                case IROpcode::IF_START:
+                case IROpcode::ELSEIF_START:
+                case IROpcode::ELSE_START:
+                case IROpcode::IF_END:
+                case IROpcode::SWITCH_START:
+                case IROpcode::SWITCH_CASE:
+                case IROpcode::SWITCH_DEFAULT:
+                case IROpcode::SWITCH_END:
+                case IROpcode::FOR_INIT:
+                case IROpcode::FOR_CHECK:
+                case IROpcode::FOR_NEXT:
+                case IROpcode::FOR_IN_INIT:
+                case IROpcode::FOR_IN_CHECK:
+                case IROpcode::FOR_IN_NEXT:
+                case IROpcode::WHILE_START:
+                case IROpcode::WHILE_END:
+                case IROpcode::REPEAT_START:
+                case IROpcode::REPEAT_END:
+                case IROpcode::DO_WHILE_START:
+                case IROpcode::DO_UNTIL_START:
+                case IROpcode::DO_START:
+                case IROpcode::DO_LOOP_WHILE:
+                case IROpcode::DO_LOOP_UNTIL:
+                case IROpcode::DO_LOOP_END:
+                case IROpcode::PRINT:
+                case IROpcode::CONSOLE:
+                case IROpcode::PRINT_NEWLINE:
+                case IROpcode::PRINT_TAB:
+                case IROpcode::PRINT_USING:
+                    break;
+                default:
+                    contained = instr.valueStackEffect(pops);
+                    break;
+            }
+        }
+        if (!contained || appended.empty()) continue;
+        for (const auto& [label, from] : jumps) {
+            if ((from < begin || from > end) && labels.count(label)) {
+                contained = false;
+                break;
+            }
+        }
+        if (!contained) continue;
+
+        for (const auto& varName : appended) {
+            if (!isStringName(varName) || parameters.count(varName)) continue;
+
+            // Already held by an enclosing loop's builder
+            bool enclosed = false;
+            for (const auto& region : m_builderRegions) {
+                if (region.varName == varName && region.begin <= begin && end <= region.end) {
+                    enclosed = true;
+                    break;
+                }
+            }
+            if (enclosed) continue;
+
+            // Every other use of the variable must be a plain load or store
+            bool plain = true;
+            for (size_t i = begin; i <= end && plain; i++) {
+                const auto& instr = code[i];
+                if (instr.opcode == IROpcode::LOAD_VAR || instr.opcode == IROpcode::STORE_VAR) continue;
+                for (const IROperand* operand : {&instr.operand1, &instr.operand2, &instr.operand3}) {
+                    if (std::holds_alternative<std::string>(*operand) &&
+                        std::get<std::string>(*operand) == varName) {
+                        plain = false;
+                    }
+                }
+            }
+            if (!plain || nextBuilder > MAX_STRING_BUILDERS) continue;
+
+            m_builderRegions.push_back({varName, "_sb" + std::to_string(nextBuilder++), begin, end});
+        }
+    }
+}
+
+void LuaCodeGenerator::enterStringBuilders(size_t index) {
+    for (const auto& region : m_builderRegions) {
+        if (region.begin != index) continue;
+        std::string varRef = m_config.useVariableCache ?
+                             getVariableReference(region.varName) : getVarName(region.varName);
+        emitLine("    " + region.builder + " = sb_new(" + varRef + ")");
+        m_activeBuilders[region.varName] = region.builder;
+    }
+}
+
+void LuaCodeGenerator::leaveStringBuilders(size_t index) {
+    for (const auto& region : m_builderRegions) {
+        if (region.end != index || !m_activeBuilders.count(region.varName)) continue;
+        std::string varRef = m_config.useVariableCache ?
+                             getVariableReference(region.varName) : getVarName(region.varName);
+        emitLine("    " + varRef + " = sb_tostring(" + region.builder + ")");
+        m_activeBuilders.erase(region.varName);
+        if (m_activeBuilders.empty()) {
+            m_builderChains.clear();
+        }
+    }
+}
+
+const LuaCodeGenerator::BuilderChain* LuaCodeGenerator::findBuilderChain(
+        const std::shared_ptr<Expr>& expr) const {
+    for (auto it = m_builderChains.rbegin(); it != m_builderChains.rend(); ++it) {
+        if (it->expr == expr) return &*it;
+    }
+    return nullptr;
+}
+
+ValueFacts LuaCodeGenerator::variableFacts(const std::string& varName) const {
+    auto it = m_variableFacts.find(varName);
+    if (it != m_variableFacts.end()) return it->second;
+    // Whatever writes it, a string variable holds a byte string outside Unicode mode
+    return !m_unicodeMode && isStringName(varName) ? ValueFacts::string() : ValueFacts::unknown();
+}
+
 void LuaCodeGenerator::selectHotVariables() {
     // Build list of candidates sorted by access count
     std::vector<std::pair<std::string, int>> candidates;
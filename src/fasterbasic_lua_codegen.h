@@ -34,7 +34,8 @@ namespace FasterBASIC {
 
 struct LuaCodeGenConfig {
     bool emitComments = true;        // Include IR instruction comments
-    bool emitLineNumbers = false;     // Include line number tracking
+    bool emitLineNumbers = false;     // Mark BASIC lines even under OPTION ERROR OFF (see getSourceMap)
+    bool countLines = false;          // Count entries into every BASIC line, as OPTION PROFILE COUNTS
     bool optimizeLocals = true;       // Use local variables where possible
     bool inlineConstants = true;      // Inline constant values
     bool generateDebugInfo = false;   // Generate debug metadata
@@ -42,6 +43,8 @@ struct LuaCodeGenConfig {
     bool useVariableCache = true;     // Use hot/cold variable caching (unlimited vars)
     bool enableBufferMode = false;    // Use string buffers for efficient MID$ assignment
     int maxLocalVariables = 150;      // Max locals to use (under 200 limit, leaving room for temps)
+    std::string preludeModule;        // require() shared runtime helpers from this module ("" = inline them)
+    int threads = 0;                  // Threads emitting SUB/FUNCTION bodies (0 = one per hardware thread)
 
     LuaCodeGenConfig() = default;
 };
@@ -61,6 +64,40 @@ struct LuaCodeGenStats {
     void print() const;
 };
 
+// =============================================================================
+// Lua Source Map
+// =============================================================================
+
+// Where each line of the generated chunk came from, for hosts that map Lua
+// positions (profiler samples, tracebacks) back to the BASIC program.
+// Built from the "-- LINE n" markers, so BASIC lines are only known when
+// OPTION ERROR or OPTION PROFILE COUNTS is on, or config.emitLineNumbers is set.
+struct LuaSourceMap {
+    // Chunk name hosts load the program under when a tool (profiler, trace
+    // diagnostics) must tell its frames apart from runtime modules
+    static const char* const CHUNK_NAME;
+
+    // Global holding the line counters under OPTION PROFILE COUNTS: an FFI
+    // uint64_t array (a Lua table without FFI) indexed by counter slot
+    static const char* const COUNTERS_GLOBAL;
+
+    // A BASIC line counted under OPTION PROFILE COUNTS. Lines that always
+    // run together (one straight-line run) share a slot
+    struct LineCounter {
+        int basicLine;
+        int slot;              // Index into COUNTERS_GLOBAL, from 1
+        std::string function;  // SUB/FUNCTION name or "main"
+    };
+
+    std::vector<std::pair<int, int>> lines;              // (first Lua line, BASIC line), sorted; 0 = no BASIC line
+    std::vector<std::pair<int, std::string>> functions;  // (first Lua line, SUB/FUNCTION name or "main"), sorted; "" = outside
+    std::vector<LineCounter> counters;                   // Counted lines, in generation order
+    int counterSlots = 0;
+
+    int basicLineAt(int luaLine) const;
+    std::string functionAt(int luaLine) const;
+};
+
 // =============================================================================
 // Lua Code Generator
 // =============================================================================
@@ -74,27 +111,53 @@ public:
     // Main API: Generate Lua source from IR
     std::string generate(const IRCode& irCode);
 
+    // Shared runtime prelude: the option-independent helpers as a Lua module,
+    // loaded once per lua_State by programs built with config.preludeModule
+    std::string generatePreludeModule();
+
     // Get generation statistics
     const LuaCodeGenStats& getStats() const { return m_stats; }
 
+    // Lua line -> BASIC line / SUB map of the last generated chunk
+    const LuaSourceMap& getSourceMap() const { return m_sourceMap; }
+
     // Configuration
     void setConfig(const LuaCodeGenConfig& config) { m_config = config; }
     const LuaCodeGenConfig& getConfig() const { return m_config; }
 
 private:
+    // Output buffer that a copy of the generator starts empty (see
+    // emitUserFunctions, which runs one copy per worker thread). The copy
+    // constructor names the virtual std::basic_ios base, which the most
+    // derived class initializes.
+    struct OutputBuffer : std::ostringstream {
+        OutputBuffer() = default;
+        OutputBuffer(const OutputBuffer&) : std::basic_ios<char>(), std::ostringstream() {}
+        OutputBuffer& operator=(const OutputBuffer&) { str(""); clear(); return *this; }
+    };
+
     // Code generation state
-    std::ostringstream m_output;
+    OutputBuffer m_output;
     LuaCodeGenConfig m_config;
     LuaCodeGenStats m_stats;
+    LuaSourceMap m_sourceMap;
     int m_arrayBase;  // OPTION BASE: 0 or 1 (from IRCode metadata)
     bool m_unicodeMode;  // OPTION UNICODE: strings as codepoint arrays (from IRCode metadata)
     bool m_bufferMode;   // Buffer mode: use string buffers for efficient MID$ assignment
-    bool m_errorTracking;  // OPTION ERROR: emit _LINE tracking for error messages (from IRCode metadata)
-    int m_lastEmittedLine;  // Track last emitted line number to avoid duplicate _LINE assignments
+    bool m_errorTracking;  // OPTION ERROR: emit a Lua line -> BASIC line map for error messages (from IRCode metadata)
+    int m_lastEmittedLine;  // Track last emitted line number to avoid duplicate -- LINE markers
     int m_indentOffset;  // Additional indentation spaces for nested contexts (e.g., subroutines)
     bool m_usesConstants;  // True if program uses CONSTANT statement or predefined constants
     const class ConstantsManager* m_constantsManager;  // Pointer to constants for inlining values
     bool m_cancellableLoops;  // OPTION CANCELLABLE: inject script cancellation checks in loops
+    bool m_lineCounts;  // OPTION PROFILE COUNTS: count entries into every BASIC line
+    std::unordered_map<int, int> m_lineCounterSlots;  // BASIC line -> counter slot
+    std::vector<std::pair<int, int>> m_countedLines;  // (BASIC line, slot) in generation order
+    const std::map<int, std::string>* m_inlinedLines = nullptr;  // BASIC line -> procedure inlined into a caller (IRCode::inlinedLines)
+    int m_counterSlots;        // Slots allocated so far
+    int m_runCounter;          // Slot of the straight-line run being emitted (0 = none)
+    int m_pendingLineCounter;  // BASIC line to count before the next non-label instruction (0 = none)
+    std::vector<std::pair<size_t, int>> m_counterFixups;  // (m_output offset, slot) of each counter increment
     bool m_eventsUsed;  // EVENT DETECTION: if true, program uses ON EVENT statements and needs event processing code
 
     // Symbol tables
@@ -102,6 +165,8 @@ private:
     std::unordered_map<std::string, int> m_arrays;      // arrayName -> index
     std::unordered_map<std::string, int> m_labels;      // labelName -> index
     std::unordered_map<int, std::string> m_stringTable; // stringId -> literal
+    std::unordered_map<std::string, int> m_unicodeLiteralIds;  // literal -> 1-based pool index (OPTION UNICODE)
+    std::vector<std::string> m_unicodeLiterals;  // Pool entries in first-use order
     
     // Variable access tracking for hot/cold caching
     struct VariableAccessInfo {
@@ -113,7 +178,47 @@ private:
     std::unordered_map<std::string, VariableAccessInfo> m_variableAccess;
     std::vector<std::string> m_hotVariables;   // Variables cached as locals
     std::unordered_map<std::string, int> m_coldVariableIDs;  // Cold var -> integer ID mapping
+    std::unordered_map<std::string, ValueFacts> m_variableFacts;  // Proven kind/range per variable
     int m_usedLocalSlots = 0;  // Track how many local slots we've used
+
+    // String builders: a string variable self-appended inside a loop lives
+    // in a builder (sb_new/sb_append in the prelude) while the loop runs and
+    // is written back when the loop is left
+    static const int MAX_STRING_BUILDERS = 32;
+    struct StringBuilderRegion {
+        std::string varName;   // BASIC variable held in the builder
+        std::string builder;   // Module-level Lua local holding the builder
+        size_t begin;          // First IR instruction of the loop (condition included)
+        size_t end;            // Last IR instruction of the loop
+    };
+    std::vector<StringBuilderRegion> m_builderRegions;
+    std::unordered_map<std::string, std::string> m_activeBuilders;  // varName -> builder
+    struct BuilderChain {
+        std::shared_ptr<Expr> expr;       // Builder contents followed by `pieces`
+        std::string builder;
+        std::vector<std::string> pieces;  // Lua expressions still to append
+    };
+    std::vector<BuilderChain> m_builderChains;
+
+    // SWITCH dispatch: the IR's case tables become the _switch pool, and each
+    // open SWITCH holds the Lua lines that open each of its arms
+    const std::vector<IRSwitchTable>* m_switchTables = nullptr;
+    struct SwitchDispatch {
+        std::vector<std::vector<std::string>> armLines;  // [arm] lines before it; last is OTHERWISE
+        std::vector<std::string> tailLines;              // Lines closing the dispatch
+        bool defaultEmitted = false;
+    };
+    std::vector<SwitchDispatch> m_openSwitches;
+
+    // Runtime prelude: each helper group in the header is a section that is
+    // dropped when the program never references any name it defines
+    struct PreludeSection {
+        std::vector<std::string> names;  // Lua names the section defines
+        bool shareable;                  // Same text for every program (may live in the shared module)
+        size_t begin;                    // Offsets into m_output
+        size_t end;
+    };
+    std::vector<PreludeSection> m_preludeSections;
     
     // Array metadata for SAMM FFI integration
     struct ArrayInfo {
@@ -137,10 +242,31 @@ private:
     // Code generation helpers
     void emitHeader();
     void emitFooter();
+    void beginPreludeSection(const std::vector<std::string>& names, bool shareable = true);
+    void endPreludeSection();
+    void shakePrelude();
+    void buildSourceMap();
+    void emitLineMap();
     void emitVariableDeclarations();
     void emitArrayDeclarations();
     void emitDataSection(const IRCode& irCode);
     void emitUserFunctions(const IRCode& irCode);
+
+    // One SUB/FUNCTION body emitted by a worker copy of the generator
+    struct FunctionBody {
+        size_t begin;  // DEFINE_* instruction
+        size_t end;    // END_* instruction (or the end of the IR)
+        std::string code;
+        size_t lines = 0;
+        std::vector<std::pair<size_t, int>> counterFixups;
+        std::vector<std::pair<int, int>> countedLines;  // Slots numbered from 1 within the body
+        int counterSlots = 0;
+        std::vector<std::string> arrays;  // Arrays first seen in this body, in order
+        std::unordered_map<std::string, ArrayInfo> arrayInfo;
+        int lastEmittedLine = 0;
+    };
+    void emitFunctionBody(const IRCode& irCode, FunctionBody& body);
+    void appendFunctionBody(const FunctionBody& body);
     void emitMainFunction(const IRCode& irCode);
     
     // Event processing helpers
@@ -158,7 +284,7 @@ private:
     void emitConstant(const IRInstruction& instr);
     void emitArray(const IRInstruction& instr);
     void emitControlFlow(const IRInstruction& instr, size_t index);
-    void emitLoop(const IRInstruction& instr);
+    void emitLoop(const IRInstruction& instr, size_t index);
     void emitIO(const IRInstruction& instr);
     void emitBuiltinFunction(const IRInstruction& instr);
     void emitFunctionDefinition(const IRInstruction& instr);
@@ -176,17 +302,42 @@ private:
     void emitLabel(const std::string& label);
     
     // Cancellation check helpers
+    // Loops poll the host's stop flag once every CANCEL_POLL_INTERVAL iterations
+    // through a countdown, so the check stays off the hot path of a trace
+    static const int CANCEL_POLL_INTERVAL = 4096;
+    struct LoopPollPlan {
+        bool polls = true;    // Loop checks for itself (strip-mined or countdown)
+        int weight = 1;       // Iterations one pass of the body counts as, unpolled nested loops included
+    };
+    std::map<size_t, LoopPollPlan> m_loopPolls;  // IR index of the opening instruction -> plan
     bool shouldInjectCancellationCheck() const;
-    void emitCancellationCheck();
-    void emitLoopJumpCancellationCheck();
+    void planLoopCancellation(const IRCode& irCode);
+    LoopPollPlan loopPollPlan(size_t index) const;
+    void emitCancellationCheck(int weight = 1);
+    void emitCancellationScopeBegin();
+    void emitCancellationScopeEnd();
 
     std::string getVarName(const std::string& name);
     std::string getArrayName(const std::string& name);
     std::string getLabelName(const std::string& label);
-    std::string escapeString(const std::string& str);
+    std::string escapeString(const std::string& str);    // BASIC string literal (pooled in Unicode mode)
+    std::string quoteLuaString(const std::string& str);  // Plain quoted Lua string
+    std::string generateUnicodeLiteralPool();
+    std::string generateSwitchTables();
+    std::string generateLineCounters();
+    void emitLineCounter();
+    static std::string lineCounterIncrement(int slot);
+    static bool isStraightLineOpcode(IROpcode opcode);
+    void buildSwitchDispatch(int first, int last, SwitchDispatch& dispatch, std::vector<std::string>& pending);
     
     // Variable access tracking and hot/cold management
     void analyzeVariableAccess(const IRCode& irCode);
+    void inferVariableFacts(const IRCode& irCode);
+    void analyzeStringBuilders(const IRCode& irCode);
+    void enterStringBuilders(size_t index);
+    void leaveStringBuilders(size_t index);
+    const BuilderChain* findBuilderChain(const std::shared_ptr<Expr>& expr) const;
+    ValueFacts variableFacts(const std::string& varName) const;
     void selectHotVariables();
     bool isHotVariable(const std::string& varName);
     std::string getVariableReference(const std::string& varName);
@@ -245,6 +396,12 @@ private:
         std::string stepExpr;       // Step value expression
         bool nativeLoopEmitted;     // Have we emitted the native loop start?
         int loopBodyStartIndex;     // IR index where loop body starts
+
+        // Cancellation support
+        bool stripMined = false;    // Native loop split into blocks with a poll per block
+        bool variableStep = false;  // Strip-mined with the step known only at runtime
+        bool cancelScope = false;   // Native loop wrapped in a countdown scope
+        std::string exitLabel;      // EXIT FOR target when strip-mined (break only leaves the inner loop)
     };
     std::vector<ForLoopInfo> m_forLoopStack;
     
@@ -5,9 +5,166 @@
 
 #include "fasterbasic_lua_expr.h"
 #include <sstream>
+#include <algorithm>
+#include <cstdlib>
 
 namespace FasterBASIC {
 
+static bool isComparisonOp(BinaryOp op) {
+    return op == BinaryOp::EQ || op == BinaryOp::NE || op == BinaryOp::LT ||
+           op == BinaryOp::LE || op == BinaryOp::GT || op == BinaryOp::GE;
+}
+
+static bool isLogicalOp(BinaryOp op) {
+    return op == BinaryOp::AND || op == BinaryOp::OR || op == BinaryOp::XOR ||
+           op == BinaryOp::EQV || op == BinaryOp::IMP;
+}
+
+// =============================================================================
+// Value Facts
+// =============================================================================
+
+ValueFacts ValueFacts::integer(double low, double high) {
+    ValueFacts f;
+    f.kind = Kind::INTEGER;
+    f.low = low;
+    f.high = high;
+    return f;
+}
+
+ValueFacts ValueFacts::constant(double value) {
+    if (std::isfinite(value) && std::floor(value) == value) {
+        return integer(value, value);
+    }
+    return number();
+}
+
+ValueFacts ValueFacts::fromLiteral(const std::string& literal) {
+    if (literal.empty()) return unknown();
+    if (literal[0] == '"' || literal[0] == '\'') return string();
+
+    std::string text = literal;
+    while (text.size() >= 2 && text.front() == '(' && text.back() == ')') {
+        text = text.substr(1, text.size() - 2);
+    }
+    char* end = nullptr;
+    double value = std::strtod(text.c_str(), &end);
+    if (text.empty() || !end || *end != '\0' || !std::isfinite(value)) {
+        return unknown();
+    }
+    return constant(value);
+}
+
+ValueFacts ValueFacts::join(const ValueFacts& other) const {
+    if (kind == Kind::NONE) return other;
+    if (other.kind == Kind::NONE) return *this;
+    if (kind == Kind::INTEGER && other.kind == Kind::INTEGER) {
+        return integer(std::min(low, other.low), std::max(high, other.high));
+    }
+    if (isNumeric() && other.isNumeric()) return number();
+    if (kind == Kind::STRING && other.kind == Kind::STRING) return string();
+    return unknown();
+}
+
+// Integer range of an add/subtract/multiply; unbounded unless both inputs are bounded
+static ValueFacts integerArithmetic(BinaryOp op, const ValueFacts& a, const ValueFacts& b) {
+    if (!a.isBounded() || !b.isBounded()) {
+        return ValueFacts::integer();
+    }
+    double low, high;
+    if (op == BinaryOp::ADD) {
+        low = a.low + b.low;
+        high = a.high + b.high;
+    } else if (op == BinaryOp::SUB) {
+        low = a.low - b.high;
+        high = a.high - b.low;
+    } else {
+        double products[] = {a.low * b.low, a.low * b.high, a.high * b.low, a.high * b.high};
+        low = *std::min_element(products, products + 4);
+        high = *std::max_element(products, products + 4);
+    }
+    // Beyond 2^53 neighbouring integers are no longer distinct doubles
+    const double exact = 9007199254740992.0;
+    if (low < -exact || high > exact) {
+        return ValueFacts::integer();
+    }
+    return ValueFacts::integer(low, high);
+}
+
+ValueFacts ValueFacts::binary(BinaryOp op, const ValueFacts& a, const ValueFacts& b) {
+    if (a.kind == Kind::NONE || b.kind == Kind::NONE) {
+        return none();
+    }
+
+    switch (op) {
+        case BinaryOp::ADD:
+            if (a.kind == Kind::STRING && b.kind == Kind::STRING) return string();
+            // Fall through
+        case BinaryOp::SUB:
+        case BinaryOp::MUL:
+            if (a.isInteger() && b.isInteger()) return integerArithmetic(op, a, b);
+            return a.isNumeric() && b.isNumeric() ? number() : unknown();
+
+        case BinaryOp::DIV:
+        case BinaryOp::POW:
+            return a.isNumeric() && b.isNumeric() ? number() : unknown();
+
+        case BinaryOp::IDIV:
+            return a.isNumeric() && b.isNumeric() ? integer() : unknown();
+
+        case BinaryOp::MOD:
+            // Lua's % takes the sign of the divisor: [0, b) for a positive b
+            if (a.isBounded() && b.isBounded() && b.low > 0.0) return integer(0.0, b.high - 1.0);
+            if (a.isInteger() && b.isInteger()) return integer();
+            return a.isNumeric() && b.isNumeric() ? number() : unknown();
+
+        case BinaryOp::EQ:
+        case BinaryOp::NE:
+        case BinaryOp::LT:
+        case BinaryOp::LE:
+        case BinaryOp::GT:
+        case BinaryOp::GE:
+            return boolean();
+
+        case BinaryOp::AND:
+        case BinaryOp::OR:
+        case BinaryOp::XOR:
+        case BinaryOp::EQV:
+        case BinaryOp::IMP:
+            // Bitwise on int32; -1/0 operands give -1/0 back
+            return a.isBoolean() && b.isBoolean() ? boolean() : int32();
+
+        case BinaryOp::CONCAT:
+            return string();
+    }
+    return unknown();
+}
+
+ValueFacts ValueFacts::unary(UnaryOp op, const ValueFacts& a) {
+    if (a.kind == Kind::NONE) {
+        return none();
+    }
+
+    switch (op) {
+        case UnaryOp::NEG:
+            if (a.isInteger()) return integer(-a.high, -a.low);
+            return a.isNumeric() ? number() : unknown();
+
+        case UnaryOp::NOT:
+            return a.isBoolean() ? boolean() : int32();
+
+        case UnaryOp::ABS:
+            if (a.isBounded()) {
+                double high = std::max(std::fabs(a.low), std::fabs(a.high));
+                double low = (a.low <= 0.0 && a.high >= 0.0) ? 0.0 : std::min(std::fabs(a.low), std::fabs(a.high));
+                return integer(low, high);
+            }
+            if (a.isInteger()) return integer();
+            return a.isNumeric() ? number() : unknown();
+    }
+    return unknown();
+}
+
 // =============================================================================
 // Expression to String Conversion
 // =============================================================================
@@ -101,6 +258,11 @@ std::string ExpressionOptimizer::toString(std::shared_ptr<Expr> expr) const {
         case ExprType::BINARY_OP: {
             int precedence = getPrecedence(expr->binaryOp);
 
+            // Logic over truth values is done natively and materialized once
+            if (isLogicalOp(expr->binaryOp) && hasConditionForm(expr)) {
+                return "(" + conditionTerm(expr) + " and -1 or 0)";
+            }
+
             // Special handling for integer division - use math.floor for LuaJIT compatibility
             if (expr->binaryOp == BinaryOp::IDIV) {
                 std::string leftStr = maybeParenthesize(expr->left, precedence);
@@ -117,39 +279,30 @@ std::string ExpressionOptimizer::toString(std::shared_ptr<Expr> expr) const {
                                 expr->binaryOp == BinaryOp::GT ||
                                 expr->binaryOp == BinaryOp::GE);
 
-            // Use bitwise FFI functions for AND, OR, XOR, EQV, IMP (BASIC compatibility)
+            // AND, OR, XOR, EQV and IMP are bitwise on int32 (BASIC compatibility)
+            // and lower straight to LuaJIT's bit library
             if (expr->binaryOp == BinaryOp::AND) {
-                std::string leftStr = maybeParenthesize(expr->left, precedence);
-                std::string rightStr = maybeParenthesize(expr->right, precedence);
-                oss << "bitwise.band(" << leftStr << ", " << rightStr << ")";
+                oss << "bit.band(" << int32Term(expr->left) << ", " << int32Term(expr->right) << ")";
                 return oss.str();
             }
             
             if (expr->binaryOp == BinaryOp::OR) {
-                std::string leftStr = maybeParenthesize(expr->left, precedence);
-                std::string rightStr = maybeParenthesize(expr->right, precedence);
-                oss << "bitwise.bor(" << leftStr << ", " << rightStr << ")";
+                oss << "bit.bor(" << int32Term(expr->left) << ", " << int32Term(expr->right) << ")";
                 return oss.str();
             }
             
             if (expr->binaryOp == BinaryOp::XOR) {
-                std::string leftStr = maybeParenthesize(expr->left, precedence);
-                std::string rightStr = maybeParenthesize(expr->right, precedence);
-                oss << "bitwise.bxor(" << leftStr << ", " << rightStr << ")";
+                oss << "bit.bxor(" << int32Term(expr->left) << ", " << int32Term(expr->right) << ")";
                 return oss.str();
             }
             
             if (expr->binaryOp == BinaryOp::EQV) {
-                std::string leftStr = maybeParenthesize(expr->left, precedence);
-                std::string rightStr = maybeParenthesize(expr->right, precedence);
-                oss << "bitwise.beqv(" << leftStr << ", " << rightStr << ")";
+                oss << "bit.bnot(bit.bxor(" << int32Term(expr->left) << ", " << int32Term(expr->right) << "))";
                 return oss.str();
             }
             
             if (expr->binaryOp == BinaryOp::IMP) {
-                std::string leftStr = maybeParenthesize(expr->left, precedence);
-                std::string rightStr = maybeParenthesize(expr->right, precedence);
-                oss << "bitwise.bimp(" << leftStr << ", " << rightStr << ")";
+                oss << "bit.bor(bit.bnot(" << int32Term(expr->left) << "), " << int32Term(expr->right) << ")";
                 return oss.str();
             }
 
@@ -157,22 +310,16 @@ std::string ExpressionOptimizer::toString(std::shared_ptr<Expr> expr) const {
             std::string rightStr = maybeParenthesize(expr->right, precedence);
             std::string opStr = getBinaryOpStr(expr->binaryOp);
 
-            // Check if this is string concatenation (ADD with _STRING operands)
-            if (expr->binaryOp == BinaryOp::ADD) {
-                // Check if either operand has _STRING suffix (indicating string type)
-                bool leftIsString = (leftStr.find("_STRING") != std::string::npos) ||
-                                   (leftStr[0] == '"');  // String literal
-                bool rightIsString = (rightStr.find("_STRING") != std::string::npos) ||
-                                    (rightStr[0] == '"');  // String literal
-
-                if (leftIsString || rightIsString) {
-                    opStr = "..";  // Use Lua string concatenation operator
-                }
+            // ADD of a byte string is concatenation; the operands' facts say which
+            if (expr->binaryOp == BinaryOp::ADD &&
+                (expr->left->facts.kind == ValueFacts::Kind::STRING ||
+                 expr->right->facts.kind == ValueFacts::Kind::STRING)) {
+                opStr = "..";
             }
 
             if (isComparison) {
                 // Wrap comparison in ternary to return -1/0 for BASIC compatibility
-                oss << "((" << leftStr << " " << opStr << " " << rightStr << ") and -1 or 0)";
+                oss << "(" << bareComparison(expr) << " and -1 or 0)";
             } else {
                 oss << leftStr << " " << opStr << " " << rightStr;
             }
@@ -185,8 +332,11 @@ std::string ExpressionOptimizer::toString(std::shared_ptr<Expr> expr) const {
                 // Function-style
                 return "math.abs(" + toString(expr->operand) + ")";
             } else if (expr->unaryOp == UnaryOp::NOT) {
+                if (hasConditionForm(expr)) {
+                    return "(" + conditionTerm(expr->operand) + " and 0 or -1)";
+                }
                 // Use bitwise NOT for BASIC compatibility
-                return "bitwise.bnot(" + toString(expr->operand) + ")";
+                return "bit.bnot(" + int32Term(expr->operand) + ")";
             } else {
                 // Prefix operator
                 return getUnaryOpStr(expr->unaryOp) + toString(expr->operand);
@@ -212,4 +362,82 @@ std::string ExpressionOptimizer::toString(std::shared_ptr<Expr> expr) const {
     }
 }
 
+std::string ExpressionOptimizer::int32Term(std::shared_ptr<Expr> expr) const {
+    // Operands proven to be int32 need no conversion
+    if (expr && expr->facts.fitsInt32()) {
+        return toString(expr);
+    }
+    return "basic_toint32(" + toString(expr) + ")";
+}
+
+std::string ExpressionOptimizer::bareComparison(std::shared_ptr<Expr> expr) const {
+    int precedence = getPrecedence(expr->binaryOp);
+    return "(" + maybeParenthesize(expr->left, precedence) + " " + getBinaryOpStr(expr->binaryOp) +
+           " " + maybeParenthesize(expr->right, precedence) + ")";
+}
+
+bool ExpressionOptimizer::hasConditionForm(std::shared_ptr<Expr> expr) const {
+    if (!expr) return false;
+    if (!expr->predicate.empty()) return true;
+
+    if (expr->type == ExprType::BINARY_OP) {
+        if (isComparisonOp(expr->binaryOp)) return true;
+        if (!isLogicalOp(expr->binaryOp) || !expr->left || !expr->right) return false;
+
+        // On -1/0 the bitwise operators agree with the logical ones
+        if (!expr->left->facts.isBoolean() || !expr->right->facts.isBoolean()) return false;
+
+        // Lua's and/or skip the right operand, BASIC evaluates both
+        bool shortCircuits = expr->binaryOp == BinaryOp::AND ||
+                             expr->binaryOp == BinaryOp::OR ||
+                             expr->binaryOp == BinaryOp::IMP;
+        return !shortCircuits || !hasSideEffects(expr->right);
+    }
+
+    if (expr->type == ExprType::UNARY_OP && expr->unaryOp == UnaryOp::NOT) {
+        return expr->operand && expr->operand->facts.isBoolean();
+    }
+
+    return false;
+}
+
+std::string ExpressionOptimizer::conditionTerm(std::shared_ptr<Expr> expr) const {
+    if (!hasConditionForm(expr)) {
+        return "(" + toString(expr) + " ~= 0)";
+    }
+    if (!expr->predicate.empty()) {
+        return "(" + expr->predicate + ")";
+    }
+
+    if (expr->type == ExprType::UNARY_OP) {
+        return "(not " + conditionTerm(expr->operand) + ")";
+    }
+
+    if (isComparisonOp(expr->binaryOp)) {
+        return bareComparison(expr);
+    }
+
+    std::string l = conditionTerm(expr->left);
+    std::string r = conditionTerm(expr->right);
+    switch (expr->binaryOp) {
+        case BinaryOp::AND: return "(" + l + " and " + r + ")";
+        case BinaryOp::OR:  return "(" + l + " or " + r + ")";
+        case BinaryOp::XOR: return "(" + l + " ~= " + r + ")";
+        case BinaryOp::EQV: return "(" + l + " == " + r + ")";
+        default:            return "(not " + l + " or " + r + ")";
+    }
+}
+
+std::string ExpressionOptimizer::toCondition(std::shared_ptr<Expr> expr) const {
+    if (!expr) return "false";
+
+    if (hasConditionForm(expr)) {
+        return conditionTerm(expr);
+    }
+
+    // Generated code only ever holds numbers and strings, never Lua booleans,
+    // so a BASIC value is false exactly when it is 0
+    return toString(expr) + " ~= 0";
+}
+
 } // namespace FasterBASIC
@@ -17,6 +17,7 @@
 #include <vector>
 #include <memory>
 #include <sstream>
+#include <cmath>
 
 namespace FasterBASIC {
 
@@ -45,6 +46,54 @@ enum class UnaryOp {
     NEG, NOT, ABS
 };
 
+// =============================================================================
+// Value Facts
+// =============================================================================
+//
+// What the generator can prove about a value: its kind and, for integers,
+// a closed range. Booleans are integers in [-1, 0]. An unbounded integer
+// may also be +/-inf or NaN after overflow; a bounded one is always finite.
+
+struct ValueFacts {
+    enum class Kind {
+        NONE,       // No value yet (bottom, used while inferring)
+        INTEGER,    // Integral number within [low, high]
+        NUMBER,     // Any number
+        STRING,     // Byte string
+        UNKNOWN     // Anything
+    };
+
+    Kind kind = Kind::UNKNOWN;
+    double low = -HUGE_VAL;
+    double high = HUGE_VAL;
+
+    static ValueFacts none() { ValueFacts f; f.kind = Kind::NONE; return f; }
+    static ValueFacts unknown() { return ValueFacts(); }
+    static ValueFacts number() { ValueFacts f; f.kind = Kind::NUMBER; return f; }
+    static ValueFacts string() { ValueFacts f; f.kind = Kind::STRING; return f; }
+    static ValueFacts integer(double low = -HUGE_VAL, double high = HUGE_VAL);
+    static ValueFacts boolean() { return integer(-1.0, 0.0); }
+    static ValueFacts int32() { return integer(-2147483648.0, 2147483647.0); }
+    static ValueFacts constant(double value);
+    static ValueFacts fromLiteral(const std::string& literal);
+
+    bool isNumeric() const { return kind == Kind::INTEGER || kind == Kind::NUMBER; }
+    bool isInteger() const { return kind == Kind::INTEGER; }
+    bool isBounded() const { return isInteger() && std::isfinite(low) && std::isfinite(high); }
+    bool isBoolean() const { return isInteger() && low >= -1.0 && high <= 0.0; }
+    bool fitsInt32() const { return isInteger() && low >= -2147483648.0 && high <= 2147483647.0; }
+
+    ValueFacts join(const ValueFacts& other) const;
+    bool operator==(const ValueFacts& other) const {
+        return kind == other.kind && low == other.low && high == other.high;
+    }
+    bool operator!=(const ValueFacts& other) const { return !(*this == other); }
+
+    // Facts of an operator's result from the facts of its operands
+    static ValueFacts binary(BinaryOp op, const ValueFacts& a, const ValueFacts& b);
+    static ValueFacts unary(UnaryOp op, const ValueFacts& a);
+};
+
 // =============================================================================
 // Expression Node
 // =============================================================================
@@ -77,6 +126,12 @@ struct Expr {
     
     // For stack references
     int stackPos;
+
+    // What is known about the value
+    ValueFacts facts;
+
+    // Native Lua boolean form of a BASIC truth value (empty if none)
+    std::string predicate;
     
     Expr() : type(ExprType::LITERAL), binaryOp(BinaryOp::ADD), 
              unaryOp(UnaryOp::NEG), stackPos(-1) {}
@@ -85,13 +140,16 @@ struct Expr {
         auto e = std::make_shared<Expr>();
         e->type = ExprType::LITERAL;
         e->literal = value;
+        e->facts = ValueFacts::fromLiteral(value);
         return e;
     }
     
-    static std::shared_ptr<Expr> makeVariable(const std::string& name) {
+    static std::shared_ptr<Expr> makeVariable(const std::string& name,
+                                                const ValueFacts& facts = ValueFacts()) {
         auto e = std::make_shared<Expr>();
         e->type = ExprType::VARIABLE;
         e->varName = name;
+        e->facts = facts;
         return e;
     }
     
@@ -112,6 +170,7 @@ struct Expr {
         e->binaryOp = op;
         e->left = l;
         e->right = r;
+        if (l && r) e->facts = ValueFacts::binary(op, l->facts, r->facts);
         return e;
     }
     
@@ -121,6 +180,7 @@ struct Expr {
         e->type = ExprType::UNARY_OP;
         e->unaryOp = op;
         e->operand = operand;
+        if (operand) e->facts = ValueFacts::unary(op, operand->facts);
         return e;
     }
     
@@ -152,7 +212,9 @@ public:
     
     // Push an expression onto the symbolic stack
     void pushLiteral(const std::string& value);
-    void pushVariable(const std::string& name);
+    void pushVariable(const std::string& name, const ValueFacts& facts = ValueFacts());
+    void push(std::shared_ptr<Expr> expr);
+    void pushPredicate(const std::string& luaBool);
     void pushArrayAccess(const std::string& arrayName, std::shared_ptr<Expr> index);
     
     // Pop expression from stack
@@ -174,6 +236,11 @@ public:
     
     // Convert expression to Lua code
     std::string toString(std::shared_ptr<Expr> expr) const;
+
+    // Convert expression to a Lua boolean for IF/loop conditions. Comparisons,
+    // predicates and AND/OR/XOR/EQV/IMP/NOT over truth values stay native Lua
+    // booleans; any other value is tested against 0
+    std::string toCondition(std::shared_ptr<Expr> expr) const;
     
     // Check if expression is simple enough to inline
     bool isSimple(std::shared_ptr<Expr> expr) const;
@@ -199,6 +266,19 @@ private:
     
     // Helper to add parentheses if needed
     std::string maybeParenthesize(std::shared_ptr<Expr> expr, int parentPrecedence) const;
+
+    // Operand of a bitwise operator: truncated to int32 unless already known to fit
+    std::string int32Term(std::shared_ptr<Expr> expr) const;
+
+    // Comparison as a parenthesized Lua boolean expression
+    std::string bareComparison(std::shared_ptr<Expr> expr) const;
+
+    // True if the expression can be lowered to Lua and/or/not without
+    // changing which operands are evaluated
+    bool hasConditionForm(std::shared_ptr<Expr> expr) const;
+
+    // Parenthesized Lua boolean for use inside and/or/not
+    std::string conditionTerm(std::shared_ptr<Expr> expr) const;
 };
 
 // =============================================================================
@@ -219,8 +299,19 @@ inline void ExpressionOptimizer::pushLiteral(const std::string& value) {
     m_stack.push_back(Expr::makeLiteral(value));
 }
 
-inline void ExpressionOptimizer::pushVariable(const std::string& name) {
-    m_stack.push_back(Expr::makeVariable(name));
+inline void ExpressionOptimizer::pushVariable(const std::string& name, const ValueFacts& facts) {
+    m_stack.push_back(Expr::makeVariable(name, facts));
+}
+
+inline void ExpressionOptimizer::push(std::shared_ptr<Expr> expr) {
+    m_stack.push_back(expr);
+}
+
+inline void ExpressionOptimizer::pushPredicate(const std::string& luaBool) {
+    // Materialized as -1/0 only if the value is stored, printed or used in arithmetic
+    auto e = Expr::makeVariable("(" + luaBool + " and -1 or 0)", ValueFacts::boolean());
+    e->predicate = luaBool;
+    m_stack.push_back(e);
 }
 
 inline void ExpressionOptimizer::pushArrayAccess(const std::string& arrayName, 
@@ -288,9 +379,23 @@ inline bool ExpressionOptimizer::isSimple(std::shared_ptr<Expr> expr) const {
 }
 
 inline bool ExpressionOptimizer::hasSideEffects(std::shared_ptr<Expr> expr) const {
-    // Currently our expressions don't have side effects
-    // This would change if we add function calls with side effects
-    return false;
+    if (!expr) return false;
+    
+    switch (expr->type) {
+        case ExprType::LITERAL:
+            return false;
+        case ExprType::VARIABLE:
+            // Builtin and user function results are pushed as call text
+            return expr->varName.find('(') != std::string::npos;
+        case ExprType::ARRAY_ACCESS:
+            return hasSideEffects(expr->arrayIndex);
+        case ExprType::BINARY_OP:
+            return hasSideEffects(expr->left) || hasSideEffects(expr->right);
+        case ExprType::UNARY_OP:
+            return hasSideEffects(expr->operand);
+        default:
+            return true;
+    }
 }
 
 } // namespace FasterBASIC
@@ -3,14 +3,18 @@
 // FasterBASIC - AST Optimizer Implementation
 //
 // Implements multi-pass optimization framework for AST.
-// Currently all passes are no-ops (placeholders for future optimizations).
+// Level 1 folds constants and drops dead code; level 2 adds strength
+// reduction and value-numbering common-subexpression elimination.
 // This is Phase 3.5 in the compilation pipeline.
 //
 
 #include "fasterbasic_optimizer.h"
+#include "modular_commands.h"
 #include <algorithm>
+#include <functional>
 #include <sstream>
 #include <cmath>
+#include <cstdio>
 
 namespace FasterBASIC {
 
@@ -187,19 +191,8 @@ static ExpressionPtr optimizeBinaryExpression(BinaryExpression* binExpr, Optimiz
                     stats.strengthReductions++;
                     stats.totalOptimizations++;
                     return std::move(binExpr->left);
-                } else if (rightVal == 2.0) {
-                    // X * 2 -> X + X (strength reduction)
-                    stats.strengthReductions++;
-                    stats.totalOptimizations++;
-                    auto leftCopy = std::make_unique<BinaryExpression>(
-                        std::move(binExpr->left),
-                        TokenType::PLUS,
-                        nullptr
-                    );
-                    // We need to clone the left expression, but for now just keep multiplication
-                    // (proper cloning would require a deep copy mechanism)
-                    return nullptr;  // Skip this optimization for now
                 }
+                // X * 2 -> X + X is done by StrengthReductionPass, which can clone X
                 break;
             case TokenType::DIVIDE:
                 if (rightVal == 1.0) {
@@ -451,6 +444,309 @@ static bool optimizeStatement(Statement* stmt, OptimizationStats& stats) {
     return changed;
 }
 
+// =============================================================================
+// Expression Cloning and Statement Traversal
+// =============================================================================
+
+// Deep copy of an expression tree (nullptr for node kinds not handled here)
+static ExpressionPtr cloneExpression(const Expression* expr) {
+    if (!expr) return nullptr;
+
+    if (auto* num = dynamic_cast<const NumberExpression*>(expr)) {
+        return makeNumber(num->value);
+    }
+    if (auto* str = dynamic_cast<const StringExpression*>(expr)) {
+        return makeString(str->value);
+    }
+    if (auto* var = dynamic_cast<const VariableExpression*>(expr)) {
+        return std::make_unique<VariableExpression>(var->name, var->typeSuffix);
+    }
+    if (auto* bin = dynamic_cast<const BinaryExpression*>(expr)) {
+        auto left = cloneExpression(bin->left.get());
+        auto right = cloneExpression(bin->right.get());
+        if (!left || !right) return nullptr;
+        return std::make_unique<BinaryExpression>(std::move(left), bin->op, std::move(right));
+    }
+    if (auto* unary = dynamic_cast<const UnaryExpression*>(expr)) {
+        auto operand = cloneExpression(unary->expr.get());
+        if (!operand) return nullptr;
+        return std::make_unique<UnaryExpression>(unary->op, std::move(operand));
+    }
+    if (auto* arr = dynamic_cast<const ArrayAccessExpression*>(expr)) {
+        auto copy = std::make_unique<ArrayAccessExpression>(arr->name, arr->typeSuffix);
+        for (const auto& idx : arr->indices) {
+            auto index = cloneExpression(idx.get());
+            if (!index) return nullptr;
+            copy->addIndex(std::move(index));
+        }
+        return copy;
+    }
+    if (auto* reg = dynamic_cast<const RegistryFunctionExpression*>(expr)) {
+        auto copy = std::make_unique<RegistryFunctionExpression>(reg->name, reg->returnType);
+        for (const auto& arg : reg->arguments) {
+            auto argument = cloneExpression(arg.get());
+            if (!argument) return nullptr;
+            copy->addArgument(std::move(argument));
+        }
+        return copy;
+    }
+    return nullptr;
+}
+
+// True if the expression can run FUNCTION, SUB or DEF FN code, which may
+// assign any global variable
+static bool callsUserCode(const Expression* expr, const SymbolTable& symbols) {
+    if (!expr) return false;
+
+    switch (expr->getType()) {
+        case ASTNodeType::EXPR_BINARY: {
+            auto* bin = static_cast<const BinaryExpression*>(expr);
+            return callsUserCode(bin->left.get(), symbols) || callsUserCode(bin->right.get(), symbols);
+        }
+        case ASTNodeType::EXPR_UNARY:
+            return callsUserCode(static_cast<const UnaryExpression*>(expr)->expr.get(), symbols);
+        case ASTNodeType::EXPR_ARRAY_ACCESS: {
+            auto* arr = static_cast<const ArrayAccessExpression*>(expr);
+            if (symbols.functions.count(arr->name)) return true;
+            for (const auto& idx : arr->indices) {
+                if (callsUserCode(idx.get(), symbols)) return true;
+            }
+            return false;
+        }
+        case ASTNodeType::EXPR_FUNCTION_CALL: {
+            if (auto* reg = dynamic_cast<const RegistryFunctionExpression*>(expr)) {
+                for (const auto& arg : reg->arguments) {
+                    if (callsUserCode(arg.get(), symbols)) return true;
+                }
+                return false;
+            }
+            return true;  // FN name(...) or a FUNCTION call
+        }
+        case ASTNodeType::EXPR_IIF: {
+            auto* iif = static_cast<const IIFExpression*>(expr);
+            return callsUserCode(iif->condition.get(), symbols) ||
+                   callsUserCode(iif->trueValue.get(), symbols) ||
+                   callsUserCode(iif->falseValue.get(), symbols);
+        }
+        default:
+            return false;
+    }
+}
+
+static bool isStringVariableName(const std::string& name, const SymbolTable& symbols) {
+    auto it = symbols.variables.find(name);
+    if (it != symbols.variables.end()) {
+        return it->second.type == VariableType::STRING || it->second.type == VariableType::UNICODE;
+    }
+    return (!name.empty() && name.back() == '$') ||
+           (name.size() > 7 && name.compare(name.size() - 7, 7, "_STRING") == 0);
+}
+
+// Call `fn` on each expression a statement evaluates itself (not those of
+// nested statements). Returns false for statement kinds not modelled here.
+static bool forEachExpressionSlot(Statement* stmt, const std::function<void(ExpressionPtr&)>& fn) {
+    auto visit = [&fn](ExpressionPtr& expr) {
+        if (expr) fn(expr);
+    };
+
+    switch (stmt->getType()) {
+        case ASTNodeType::STMT_LET: {
+            auto* letStmt = static_cast<LetStatement*>(stmt);
+            visit(letStmt->value);
+            for (auto& idx : letStmt->indices) visit(idx);
+            return true;
+        }
+        case ASTNodeType::STMT_PRINT: {
+            auto* printStmt = static_cast<PrintStatement*>(stmt);
+            for (auto& item : printStmt->items) visit(item.expr);
+            if (printStmt->hasUsing) {
+                visit(printStmt->formatExpr);
+                for (auto& value : printStmt->usingValues) visit(value);
+            }
+            return true;
+        }
+        case ASTNodeType::STMT_CONSOLE: {
+            auto* consoleStmt = static_cast<ConsoleStatement*>(stmt);
+            for (auto& item : consoleStmt->items) visit(item.expr);
+            return true;
+        }
+        case ASTNodeType::STMT_IF: {
+            auto* ifStmt = static_cast<IfStatement*>(stmt);
+            visit(ifStmt->condition);
+            for (auto& clause : ifStmt->elseIfClauses) visit(clause.condition);
+            return true;
+        }
+        case ASTNodeType::STMT_CASE: {
+            auto* caseStmt = static_cast<CaseStatement*>(stmt);
+            visit(caseStmt->caseExpression);
+            for (auto& clause : caseStmt->whenClauses) {
+                for (auto& value : clause.values) visit(value);
+            }
+            return true;
+        }
+        case ASTNodeType::STMT_FOR: {
+            auto* forStmt = static_cast<ForStatement*>(stmt);
+            visit(forStmt->start);
+            visit(forStmt->end);
+            visit(forStmt->step);
+            return true;
+        }
+        case ASTNodeType::STMT_WHILE:
+            visit(static_cast<WhileStatement*>(stmt)->condition);
+            return true;
+        case ASTNodeType::STMT_UNTIL:
+            visit(static_cast<UntilStatement*>(stmt)->condition);
+            return true;
+        case ASTNodeType::STMT_DO:
+            visit(static_cast<DoStatement*>(stmt)->condition);
+            return true;
+        case ASTNodeType::STMT_LOOP:
+            visit(static_cast<LoopStatement*>(stmt)->condition);
+            return true;
+        case ASTNodeType::STMT_RETURN:
+            visit(static_cast<ReturnStatement*>(stmt)->returnValue);
+            return true;
+        case ASTNodeType::STMT_DIM: {
+            auto* dimStmt = static_cast<DimStatement*>(stmt);
+            for (auto& array : dimStmt->arrays) {
+                for (auto& dim : array.dimensions) visit(dim);
+            }
+            return true;
+        }
+        case ASTNodeType::STMT_REM:
+        case ASTNodeType::STMT_LABEL:
+        case ASTNodeType::STMT_GOTO:
+        case ASTNodeType::STMT_GOSUB:
+        case ASTNodeType::STMT_END:
+        case ASTNodeType::STMT_EXIT:
+        case ASTNodeType::STMT_NEXT:
+        case ASTNodeType::STMT_WEND:
+        case ASTNodeType::STMT_REPEAT:
+        case ASTNodeType::STMT_DATA:
+        case ASTNodeType::STMT_OPTION:
+            return true;
+        default:
+            break;
+    }
+
+    // Graphics and text commands: fixed argument lists, no assignments
+    if (auto* exprStmt = dynamic_cast<ExpressionStatement*>(stmt)) {
+        for (auto& arg : exprStmt->arguments) visit(arg);
+        return true;
+    }
+    return dynamic_cast<SimpleStatement*>(stmt) != nullptr;
+}
+
+// Call `fn` on each statement list nested directly inside a statement
+static void forEachNestedList(Statement* stmt, const std::function<void(std::vector<StatementPtr>&)>& fn) {
+    switch (stmt->getType()) {
+        case ASTNodeType::STMT_IF: {
+            auto* ifStmt = static_cast<IfStatement*>(stmt);
+            fn(ifStmt->thenStatements);
+            for (auto& clause : ifStmt->elseIfClauses) fn(clause.statements);
+            fn(ifStmt->elseStatements);
+            break;
+        }
+        case ASTNodeType::STMT_CASE: {
+            auto* caseStmt = static_cast<CaseStatement*>(stmt);
+            for (auto& clause : caseStmt->whenClauses) fn(clause.statements);
+            fn(caseStmt->otherwiseStatements);
+            break;
+        }
+        case ASTNodeType::STMT_FUNCTION:
+            fn(static_cast<FunctionStatement*>(stmt)->body);
+            break;
+        case ASTNodeType::STMT_SUB:
+            fn(static_cast<SubStatement*>(stmt)->body);
+            break;
+        default:
+            break;
+    }
+}
+
+// Call `fn` on every statement in a list, including nested ones
+static void forEachStatement(std::vector<StatementPtr>& list, const std::function<void(Statement*)>& fn) {
+    for (auto& stmt : list) {
+        fn(stmt.get());
+        forEachNestedList(stmt.get(), [&fn](std::vector<StatementPtr>& nested) {
+            forEachStatement(nested, fn);
+        });
+    }
+}
+
+static void forEachStatement(Program& program, const std::function<void(Statement*)>& fn) {
+    for (auto& line : program.lines) {
+        forEachStatement(line->statements, fn);
+    }
+}
+
+// Numeric line targets of GOTO/GOSUB/ON...GOTO/IF...THEN n; labelled
+// targets are LabelStatements and are seen directly
+static std::set<int> collectJumpTargetLines(Program& program) {
+    std::set<int> targets;
+    forEachStatement(program, [&targets](Statement* stmt) {
+        switch (stmt->getType()) {
+            case ASTNodeType::STMT_GOTO: {
+                auto* gotoStmt = static_cast<GotoStatement*>(stmt);
+                if (!gotoStmt->isLabel) targets.insert(gotoStmt->lineNumber);
+                break;
+            }
+            case ASTNodeType::STMT_GOSUB: {
+                auto* gosubStmt = static_cast<GosubStatement*>(stmt);
+                if (!gosubStmt->isLabel) targets.insert(gosubStmt->lineNumber);
+                break;
+            }
+            case ASTNodeType::STMT_ON_GOTO: {
+                auto* onGoto = static_cast<OnGotoStatement*>(stmt);
+                for (size_t i = 0; i < onGoto->lineNumbers.size(); i++) {
+                    if (!onGoto->isLabelList[i]) targets.insert(onGoto->lineNumbers[i]);
+                }
+                break;
+            }
+            case ASTNodeType::STMT_ON_GOSUB: {
+                auto* onGosub = static_cast<OnGosubStatement*>(stmt);
+                for (size_t i = 0; i < onGosub->lineNumbers.size(); i++) {
+                    if (!onGosub->isLabelList[i]) targets.insert(onGosub->lineNumbers[i]);
+                }
+                break;
+            }
+            case ASTNodeType::STMT_IF: {
+                auto* ifStmt = static_cast<IfStatement*>(stmt);
+                if (ifStmt->hasGoto) targets.insert(ifStmt->gotoLine);
+                break;
+            }
+            default:
+                break;
+        }
+    });
+    return targets;
+}
+
+// Highest N among existing "<prefix>N" assignment targets, so a rerun of
+// the optimizer never reuses a temporary that is already live
+static int highestTempIndex(Program& program, const std::string& prefix) {
+    int highest = 0;
+    forEachStatement(program, [&](Statement* stmt) {
+        if (stmt->getType() != ASTNodeType::STMT_LET) return;
+        const std::string& name = static_cast<LetStatement*>(stmt)->variable;
+        if (name.compare(0, prefix.size(), prefix) == 0) {
+            highest = std::max(highest, std::atoi(name.c_str() + prefix.size()));
+        }
+    });
+    return highest;
+}
+
+// Applied in order, so an insertion may target an earlier inserted statement
+static void applyInsertions(std::vector<StatementInsertion>& insertions) {
+    for (auto& insertion : insertions) {
+        auto& list = *insertion.list;
+        auto it = std::find_if(list.begin(), list.end(),
+                               [&](const StatementPtr& stmt) { return stmt.get() == insertion.before; });
+        list.insert(it, std::move(insertion.statement));
+    }
+    insertions.clear();
+}
+
 // =============================================================================
 // Optimization Pass Implementations
 // =============================================================================
@@ -517,34 +813,942 @@ bool DeadCodeEliminationPass::run(Program& program, const SymbolTable& symbols,
     return changed;
 }
 
+// =============================================================================
+// Common Subexpression Elimination
+// =============================================================================
+
+static const char* const kCSETempPrefix = "_CSE";
+
+static bool isPureFunction(const std::string& name) {
+    auto& registry = ModularCommands::getGlobalCommandRegistry();
+    const auto* def = registry.getFunction(name);
+    return def && def->isPure && !registry.hasCommand(name);
+}
+
+static bool returnsString(const std::string& name) {
+    const auto* def = ModularCommands::getGlobalCommandRegistry().getFunction(name);
+    if (def) {
+        return def->returnType == ModularCommands::ReturnType::STRING;
+    }
+    return (!name.empty() && name.back() == '$') ||
+           (name.size() > 7 && name.compare(name.size() - 7, 7, "_STRING") == 0);
+}
+
+// Operand slots of an expression node, in evaluation order
+static std::vector<ExpressionPtr*> expressionChildren(Expression* expr) {
+    std::vector<ExpressionPtr*> children;
+    if (auto* bin = dynamic_cast<BinaryExpression*>(expr)) {
+        children.push_back(&bin->left);
+        children.push_back(&bin->right);
+    } else if (auto* unary = dynamic_cast<UnaryExpression*>(expr)) {
+        children.push_back(&unary->expr);
+    } else if (auto* arr = dynamic_cast<ArrayAccessExpression*>(expr)) {
+        for (auto& idx : arr->indices) children.push_back(&idx);
+    } else if (auto* call = dynamic_cast<FunctionCallExpression*>(expr)) {
+        for (auto& arg : call->arguments) children.push_back(&arg);
+    } else if (auto* reg = dynamic_cast<RegistryFunctionExpression*>(expr)) {
+        for (auto& arg : reg->arguments) children.push_back(&arg);
+    } else if (auto* iif = dynamic_cast<IIFExpression*>(expr)) {
+        children.push_back(&iif->condition);
+        children.push_back(&iif->trueValue);
+        children.push_back(&iif->falseValue);
+    }
+    return children;
+}
+
 bool CommonSubexpressionPass::run(Program& program, const SymbolTable& symbols,
                                   OptimizationStats& stats) {
-    // Common subexpression elimination is complex and requires:
-    // 1. Expression hashing/comparison
-    // 2. Tracking variable definitions and uses
-    // 3. Dataflow analysis to ensure safety
-    // 
-    // This is a more advanced optimization that would require significant
-    // infrastructure. For now, we skip it as constant folding and strength
-    // reduction provide most of the benefit.
-    
-    // No-op for now
-    return false;  // No changes made
+    // ON EVENT handlers run between statements and may assign anything
+    if (symbols.eventsUsed) {
+        return false;
+    }
+
+    m_symbols = &symbols;
+    m_stats = &stats;
+    m_state = State();
+    m_frames.assign(1, Frame());
+    m_valueTable.clear();
+    m_valueIsString.clear();
+    m_nextArrayVersion = 0;
+    m_sites.clear();
+    m_insertions.clear();
+    m_jumpTargetLines = collectJumpTargetLines(program);
+    m_nextTemp = highestTempIndex(program, kCSETempPrefix);
+
+    int before = stats.commonSubexpressions;
+    for (auto& line : program.lines) {
+        if (line->lineNumber > 0 && m_jumpTargetLines.count(line->lineNumber)) {
+            forget();
+        }
+        processList(line->statements);
+    }
+
+    applyInsertions(m_insertions);
+    m_sites.clear();
+    return stats.commonSubexpressions != before;
+}
+
+void CommonSubexpressionPass::processList(std::vector<StatementPtr>& list) {
+    // Insertions are deferred, so the list does not change while walking it
+    for (size_t i = 0; i < list.size(); i++) {
+        processStatement(list, list[i].get());
+    }
+}
+
+void CommonSubexpressionPass::processStatement(std::vector<StatementPtr>& list, Statement* stmt) {
+    Context ctx{&list, stmt, true};
+
+    switch (stmt->getType()) {
+        case ASTNodeType::STMT_FUNCTION:
+        case ASTNodeType::STMT_SUB:
+            forEachNestedList(stmt, [this](std::vector<StatementPtr>& body) {
+                processRoutine(body);
+            });
+            return;
+        case ASTNodeType::STMT_DEF:
+            return;
+        case ASTNodeType::STMT_LABEL:
+        case ASTNodeType::STMT_GOSUB:
+            forget();
+            return;
+        default:
+            break;
+    }
+
+    // User code may assign any variable part way through the statement
+    bool userCall = false;
+    bool modelled = forEachExpressionSlot(stmt, [&](ExpressionPtr& expr) {
+        userCall = userCall || callsUserCode(expr.get(), *m_symbols);
+    });
+
+    if (stmt->getType() == ASTNodeType::STMT_IF) {
+        processIf(list, static_cast<IfStatement*>(stmt), userCall);
+        return;
+    }
+    if (stmt->getType() == ASTNodeType::STMT_CASE) {
+        processCase(list, static_cast<CaseStatement*>(stmt), userCall);
+        return;
+    }
+    if (!modelled || userCall) {
+        forget();
+        return;
+    }
+
+    switch (stmt->getType()) {
+        case ASTNodeType::STMT_WHILE:
+        case ASTNodeType::STMT_DO:
+            // Condition is retested at the loop head on every iteration
+        case ASTNodeType::STMT_REPEAT:
+        case ASTNodeType::STMT_NEXT:
+        case ASTNodeType::STMT_WEND:
+            forget();
+            return;
+
+        case ASTNodeType::STMT_FOR:
+        case ASTNodeType::STMT_UNTIL:
+        case ASTNodeType::STMT_LOOP:
+            // Operands are evaluated once here; a loop head or exit follows
+            forEachExpressionSlot(stmt, [&](ExpressionPtr& expr) {
+                numberExpression(expr, ctx);
+            });
+            forget();
+            return;
+
+        case ASTNodeType::STMT_LET: {
+            auto* letStmt = static_cast<LetStatement*>(stmt);
+            int value = letStmt->value ? numberExpression(letStmt->value, ctx) : -1;
+            for (auto& idx : letStmt->indices) {
+                numberExpression(idx, ctx);
+            }
+            if (letStmt->indices.empty()) {
+                noteStore(letStmt->variable, value);
+            } else {
+                noteArrayStore(letStmt->variable);
+            }
+            return;
+        }
+
+        case ASTNodeType::STMT_DIM: {
+            auto* dimStmt = static_cast<DimStatement*>(stmt);
+            forEachExpressionSlot(stmt, [&](ExpressionPtr& expr) {
+                numberExpression(expr, ctx);
+            });
+            for (const auto& array : dimStmt->arrays) {
+                if (array.dimensions.empty()) {
+                    noteStore(array.name, -1);
+                } else {
+                    noteArrayStore(array.name);
+                }
+            }
+            return;
+        }
+
+        default:
+            forEachExpressionSlot(stmt, [&](ExpressionPtr& expr) {
+                numberExpression(expr, ctx);
+            });
+            return;
+    }
+}
+
+void CommonSubexpressionPass::processIf(std::vector<StatementPtr>& list, IfStatement* stmt,
+                                        bool userCall) {
+    if (userCall) {
+        forget();
+    } else {
+        numberExpression(stmt->condition, Context{&list, stmt, true});
+    }
+
+    State entry = m_state;
+    Frame merged;
+    processArm(stmt->thenStatements, entry, merged);
+    for (auto& clause : stmt->elseIfClauses) {
+        // Only tested when earlier conditions fail: reuse values, define none
+        m_state = entry;
+        if (!userCall) {
+            numberExpression(clause.condition, Context{&list, stmt, false});
+        }
+        processArm(clause.statements, entry, merged);
+    }
+    processArm(stmt->elseStatements, entry, merged);
+    mergeArms(entry, merged);
+}
+
+void CommonSubexpressionPass::processCase(std::vector<StatementPtr>& list, CaseStatement* stmt,
+                                          bool userCall) {
+    if (userCall) {
+        forget();
+    } else if (stmt->caseExpression) {
+        numberExpression(stmt->caseExpression, Context{&list, stmt, true});
+    }
+
+    State entry = m_state;
+    Frame merged;
+    for (auto& clause : stmt->whenClauses) {
+        m_state = entry;
+        if (!userCall) {
+            for (auto& value : clause.values) {
+                numberExpression(value, Context{&list, stmt, false});
+            }
+        }
+        processArm(clause.statements, entry, merged);
+    }
+    processArm(stmt->otherwiseStatements, entry, merged);
+    mergeArms(entry, merged);
+}
+
+void CommonSubexpressionPass::processArm(std::vector<StatementPtr>& arm, const State& entry,
+                                         Frame& merged) {
+    m_state = entry;
+    m_frames.emplace_back();
+    processList(arm);
+
+    Frame& frame = m_frames.back();
+    merged.writes.insert(frame.writes.begin(), frame.writes.end());
+    merged.arrayWrites.insert(frame.arrayWrites.begin(), frame.arrayWrites.end());
+    merged.forgot = merged.forgot || frame.forgot;
+    m_frames.pop_back();
+}
+
+void CommonSubexpressionPass::mergeArms(const State& entry, const Frame& merged) {
+    // Values from inside an arm do not dominate the join; values from
+    // before the IF survive unless some arm stored to their operands
+    m_state = entry;
+    if (merged.forgot) {
+        forget();
+        return;
+    }
+    for (const auto& name : merged.writes) {
+        m_state.variableValues.erase(name);
+        m_frames.back().writes.insert(name);
+    }
+    for (const auto& name : merged.arrayWrites) {
+        noteArrayStore(name);
+    }
+}
+
+void CommonSubexpressionPass::processRoutine(std::vector<StatementPtr>& body) {
+    // A FUNCTION/SUB body is only entered through a call
+    State saved = std::move(m_state);
+    std::vector<Frame> savedFrames = std::move(m_frames);
+    m_state = State();
+    m_frames.assign(1, Frame());
+
+    processList(body);
+
+    m_state = std::move(saved);
+    m_frames = std::move(savedFrames);
+}
+
+int CommonSubexpressionPass::numberExpression(ExpressionPtr& slot, const Context& ctx) {
+    Expression* expr = slot.get();
+
+    switch (expr->getType()) {
+        case ASTNodeType::EXPR_NUMBER:
+            return internValue(valueKey(expr, {}), false);
+        case ASTNodeType::EXPR_STRING:
+            return internValue(valueKey(expr, {}), true);
+        case ASTNodeType::EXPR_VARIABLE:
+            return variableValue(static_cast<VariableExpression*>(expr)->name);
+        default:
+            break;
+    }
+
+    if (!isCandidate(expr)) {
+        // Impure call or IIF: no value number, but operands can be shared.
+        // IIF arms are evaluated lazily, so nothing is hoisted out of them.
+        if (auto* iif = dynamic_cast<IIFExpression*>(expr)) {
+            numberExpression(iif->condition, ctx);
+            Context conditional{ctx.list, ctx.anchor, false};
+            numberExpression(iif->trueValue, conditional);
+            numberExpression(iif->falseValue, conditional);
+        } else {
+            for (ExpressionPtr* child : expressionChildren(expr)) {
+                numberExpression(*child, ctx);
+            }
+        }
+        return -1;
+    }
+
+    // Whole expression already available: no need to look inside
+    int known = lookupValue(expr);
+    if (known >= 0 && reuse(slot, known)) {
+        return known;
+    }
+
+    int siteIndex = -1;
+    if (ctx.define) {
+        siteIndex = static_cast<int>(m_sites.size());
+        m_sites.push_back(Site{&slot, ctx.list, ctx.anchor, 0, false, ""});
+    }
+
+    std::vector<int> operands;
+    bool opaque = false;
+    for (ExpressionPtr* child : expressionChildren(expr)) {
+        int value = numberExpression(*child, ctx);
+        opaque = opaque || value < 0;
+        operands.push_back(value);
+    }
+
+    // Unicode strings are codepoint tables; keep them unshared
+    bool isString = !opaque && candidateIsString(expr, operands);
+    if (opaque || (isString && m_symbols->unicodeMode)) {
+        if (siteIndex >= 0) {
+            m_sites[siteIndex].slot = nullptr;
+        }
+        return -1;
+    }
+
+    if (auto* arr = dynamic_cast<ArrayAccessExpression*>(expr)) {
+        if (m_symbols->arrays.count(arr->name)) {
+            arrayVersion(arr->name);
+        }
+    }
+    int value = internValue(valueKey(expr, operands), isString);
+    if (siteIndex >= 0) {
+        Site& site = m_sites[siteIndex];
+        site.end = m_sites.size();
+        site.isString = isString;
+        m_state.holders[value].site = siteIndex;
+    }
+    return value;
+}
+
+int CommonSubexpressionPass::lookupValue(Expression* expr) const {
+    switch (expr->getType()) {
+        case ASTNodeType::EXPR_NUMBER:
+        case ASTNodeType::EXPR_STRING: {
+            auto it = m_valueTable.find(valueKey(expr, {}));
+            return it != m_valueTable.end() ? it->second : -1;
+        }
+        case ASTNodeType::EXPR_VARIABLE: {
+            auto it = m_state.variableValues.find(static_cast<VariableExpression*>(expr)->name);
+            return it != m_state.variableValues.end() ? it->second : -1;
+        }
+        default:
+            break;
+    }
+
+    if (!isCandidate(expr)) {
+        return -1;
+    }
+    if (auto* arr = dynamic_cast<ArrayAccessExpression*>(expr)) {
+        if (m_symbols->arrays.count(arr->name) && !m_state.arrayVersions.count(arr->name)) {
+            return -1;
+        }
+    }
+
+    std::vector<int> operands;
+    for (ExpressionPtr* child : expressionChildren(expr)) {
+        int value = lookupValue(child->get());
+        if (value < 0) {
+            return -1;
+        }
+        operands.push_back(value);
+    }
+    auto it = m_valueTable.find(valueKey(expr, operands));
+    return it != m_valueTable.end() ? it->second : -1;
+}
+
+bool CommonSubexpressionPass::isCandidate(const Expression* expr) const {
+    switch (expr->getType()) {
+        case ASTNodeType::EXPR_BINARY:
+        case ASTNodeType::EXPR_UNARY:
+            return true;
+        case ASTNodeType::EXPR_ARRAY_ACCESS: {
+            // Parsed as array access: a real array, or a builtin call
+            const std::string& name = static_cast<const ArrayAccessExpression*>(expr)->name;
+            if (m_symbols->arrays.count(name)) {
+                return true;
+            }
+            return !m_symbols->functions.count(name) && isPureFunction(name);
+        }
+        case ASTNodeType::EXPR_FUNCTION_CALL:
+            if (auto* reg = dynamic_cast<const RegistryFunctionExpression*>(expr)) {
+                return isPureFunction(reg->name);
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+bool CommonSubexpressionPass::candidateIsString(const Expression* expr,
+                                                const std::vector<int>& operands) const {
+    if (auto* bin = dynamic_cast<const BinaryExpression*>(expr)) {
+        return bin->op == TokenType::PLUS &&
+               (m_valueIsString[operands[0]] || m_valueIsString[operands[1]]);
+    }
+    if (auto* arr = dynamic_cast<const ArrayAccessExpression*>(expr)) {
+        auto it = m_symbols->arrays.find(arr->name);
+        if (it != m_symbols->arrays.end()) {
+            return it->second.type == VariableType::STRING || it->second.type == VariableType::UNICODE;
+        }
+        return returnsString(arr->name);
+    }
+    if (auto* reg = dynamic_cast<const RegistryFunctionExpression*>(expr)) {
+        return reg->returnType == ModularCommands::ReturnType::STRING;
+    }
+    return false;
+}
+
+std::string CommonSubexpressionPass::valueKey(const Expression* expr,
+                                              const std::vector<int>& operands) const {
+    std::ostringstream key;
+
+    switch (expr->getType()) {
+        case ASTNodeType::EXPR_NUMBER: {
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.17g",
+                          static_cast<const NumberExpression*>(expr)->value);
+            key << "N" << buffer;
+            return key.str();
+        }
+        case ASTNodeType::EXPR_STRING:
+            key << "S" << static_cast<const StringExpression*>(expr)->value;
+            return key.str();
+        case ASTNodeType::EXPR_BINARY: {
+            auto* bin = static_cast<const BinaryExpression*>(expr);
+            int left = operands[0];
+            int right = operands[1];
+            bool commutative = bin->op == TokenType::MULTIPLY || bin->op == TokenType::AND ||
+                               bin->op == TokenType::OR || bin->op == TokenType::EQUAL ||
+                               bin->op == TokenType::NOT_EQUAL ||
+                               (bin->op == TokenType::PLUS &&
+                                !m_valueIsString[left] && !m_valueIsString[right]);
+            if (commutative && left > right) {
+                std::swap(left, right);
+            }
+            key << "B" << static_cast<int>(bin->op) << ":" << left << "," << right;
+            return key.str();
+        }
+        case ASTNodeType::EXPR_UNARY:
+            key << "U" << static_cast<int>(static_cast<const UnaryExpression*>(expr)->op)
+                << ":" << operands[0];
+            return key.str();
+        default:
+            break;
+    }
+
+    // Array element or builtin call
+    if (auto* arr = dynamic_cast<const ArrayAccessExpression*>(expr)) {
+        auto version = m_state.arrayVersions.find(arr->name);
+        if (m_symbols->arrays.count(arr->name)) {
+            key << "A" << arr->name << "#" << version->second;
+        } else {
+            key << "C" << arr->name;
+        }
+    } else {
+        key << "C" << static_cast<const RegistryFunctionExpression*>(expr)->name;
+    }
+    for (int operand : operands) {
+        key << ":" << operand;
+    }
+    return key.str();
+}
+
+int CommonSubexpressionPass::internValue(const std::string& key, bool isString) {
+    auto it = m_valueTable.find(key);
+    if (it != m_valueTable.end()) {
+        return it->second;
+    }
+    int value = freshValue(isString);
+    m_valueTable.emplace(key, value);
+    return value;
+}
+
+int CommonSubexpressionPass::freshValue(bool isString) {
+    m_valueIsString.push_back(isString);
+    return static_cast<int>(m_valueIsString.size()) - 1;
+}
+
+int CommonSubexpressionPass::variableValue(const std::string& name) {
+    auto it = m_state.variableValues.find(name);
+    if (it != m_state.variableValues.end()) {
+        return it->second;
+    }
+    int value = freshValue(isStringVariableName(name, *m_symbols));
+    m_state.variableValues.emplace(name, value);
+    return value;
+}
+
+int CommonSubexpressionPass::arrayVersion(const std::string& name) {
+    auto it = m_state.arrayVersions.find(name);
+    if (it != m_state.arrayVersions.end()) {
+        return it->second;
+    }
+    int version = ++m_nextArrayVersion;
+    m_state.arrayVersions.emplace(name, version);
+    return version;
+}
+
+bool CommonSubexpressionPass::reuse(ExpressionPtr& slot, int value) {
+    auto it = m_state.holders.find(value);
+    if (it == m_state.holders.end()) {
+        return false;
+    }
+
+    const Holder& holder = it->second;
+    std::string name;
+    auto held = m_state.variableValues.find(holder.variable);
+    if (!holder.variable.empty() && held != m_state.variableValues.end() && held->second == value) {
+        name = holder.variable;
+    } else if (holder.site >= 0 && m_sites[holder.site].slot) {
+        name = materialize(holder.site);
+    } else {
+        return false;
+    }
+
+    TokenType suffix = m_valueIsString[value] ? TokenType::TYPE_STRING : TokenType::UNKNOWN;
+    slot = std::make_unique<VariableExpression>(name, suffix);
+    m_stats->commonSubexpressions++;
+    m_stats->totalOptimizations++;
+    return true;
+}
+
+std::string CommonSubexpressionPass::materialize(int siteIndex) {
+    Site& site = m_sites[siteIndex];
+    if (!site.temp.empty()) {
+        return site.temp;
+    }
+
+    TokenType suffix = site.isString ? TokenType::TYPE_STRING : TokenType::UNKNOWN;
+    site.temp = kCSETempPrefix + std::to_string(++m_nextTemp) + (site.isString ? "_STRING" : "");
+
+    auto let = std::make_unique<LetStatement>(site.temp, suffix);
+    let->value = std::move(*site.slot);
+    *site.slot = std::make_unique<VariableExpression>(site.temp, suffix);
+
+    // Sites nested in the moved expression are now evaluated by the new LET
+    Statement* letStmt = let.get();
+    for (size_t i = siteIndex + 1; i < site.end; i++) {
+        if (m_sites[i].anchor == site.anchor) {
+            m_sites[i].anchor = letStmt;
+        }
+    }
+    m_insertions.push_back(StatementInsertion{site.list, site.anchor, std::move(let)});
+    return site.temp;
+}
+
+void CommonSubexpressionPass::noteStore(const std::string& variable, int value) {
+    m_frames.back().writes.insert(variable);
+
+    // Typed numeric targets may narrow what is stored; FUNCTION names are
+    // return slots rather than ordinary variables
+    bool isString = isStringVariableName(variable, *m_symbols);
+    bool narrows = (variable.size() > 4 && variable.compare(variable.size() - 4, 4, "_INT") == 0) ||
+                   (variable.size() > 5 && variable.compare(variable.size() - 5, 5, "_LONG") == 0) ||
+                   (variable.size() > 6 && variable.compare(variable.size() - 6, 6, "_FLOAT") == 0);
+    if (value < 0 || m_valueIsString[value] != isString || narrows ||
+        m_symbols->functions.count(variable)) {
+        m_state.variableValues[variable] = freshValue(isString);
+        return;
+    }
+
+    m_state.variableValues[variable] = value;
+    m_state.holders[value].variable = variable;
+}
+
+void CommonSubexpressionPass::noteArrayStore(const std::string& array) {
+    m_frames.back().arrayWrites.insert(array);
+    m_state.arrayVersions[array] = ++m_nextArrayVersion;
+}
+
+void CommonSubexpressionPass::forget() {
+    m_state = State();
+    m_frames.back().forgot = true;
+}
+
+// =============================================================================
+// Strength Reduction
+// =============================================================================
+
+static const char* const kInductionTempPrefix = "_IV";
+
+// |value| is 2^k with k >= 1, so its reciprocal is exact
+static bool isPowerOfTwo(double value) {
+    int exponent = 0;
+    double mantissa = std::frexp(std::fabs(value), &exponent);
+    return mantissa == 0.5 && exponent > 1 && exponent < 1000;
+}
+
+// Integer constant small enough that sums of multiples stay exact
+static bool isIntegralConstant(const Expression* expr, double& value) {
+    return isConstantNumber(expr, value) && std::floor(value) == value &&
+           std::fabs(value) < 9007199254740992.0;
 }
 
 bool StrengthReductionPass::run(Program& program, const SymbolTable& symbols,
                                 OptimizationStats& stats) {
-    // Most strength reduction is already handled in the constant folding pass
-    // as algebraic simplifications (X*1->X, X+0->X, etc.)
-    // 
-    // More complex strength reductions like X*2->X+X would require expression
-    // cloning infrastructure, which we don't have yet.
-    // 
-    // Additional strength reductions (like replacing X^2 with X*X) could be
-    // added here in the future.
-    
-    // No-op for now (handled in ConstantFoldingPass)
-    return false;  // No changes made
+    m_symbols = &symbols;
+    m_stats = &stats;
+    m_changed = false;
+    m_insertions.clear();
+    m_jumpTargetLines = collectJumpTargetLines(program);
+    m_nextTemp = highestTempIndex(program, kInductionTempPrefix);
+
+    // Induction variables: an ON EVENT handler could change a FOR variable
+    // behind the derived one's back
+    if (!symbols.eventsUsed) {
+        std::vector<Position> sequence;
+        for (auto& line : program.lines) {
+            for (size_t i = 0; i < line->statements.size(); i++) {
+                sequence.push_back(Position{&line->statements, i, i == 0 ? line->lineNumber : 0});
+            }
+        }
+        reduceLoops(sequence);
+
+        forEachStatement(program, [this](Statement* stmt) {
+            forEachNestedList(stmt, [this](std::vector<StatementPtr>& list) {
+                std::vector<Position> nested;
+                for (size_t i = 0; i < list.size(); i++) {
+                    nested.push_back(Position{&list, i, 0});
+                }
+                reduceLoops(nested);
+            });
+        });
+
+        applyInsertions(m_insertions);
+    }
+
+    // Single operations, after the loops so I * 2 still reads as affine
+    forEachStatement(program, [this](Statement* stmt) {
+        forEachExpressionSlot(stmt, [this](ExpressionPtr& expr) {
+            reduceExpression(expr);
+        });
+    });
+
+    return m_changed;
+}
+
+bool StrengthReductionPass::reduceExpression(ExpressionPtr& expr) {
+    for (ExpressionPtr* child : expressionChildren(expr.get())) {
+        reduceExpression(*child);
+    }
+
+    auto* bin = dynamic_cast<BinaryExpression*>(expr.get());
+    if (!bin) {
+        return false;
+    }
+
+    double value = 0.0;
+    switch (bin->op) {
+        case TokenType::POWER:
+            // X ^ 2 -> X * X
+            if (isConstantNumber(bin->right.get(), value) && value == 2.0 &&
+                bin->left->getType() == ASTNodeType::EXPR_VARIABLE) {
+                auto copy = cloneExpression(bin->left.get());
+                expr = std::make_unique<BinaryExpression>(std::move(bin->left), TokenType::MULTIPLY,
+                                                          std::move(copy));
+                noteReduction();
+                return true;
+            }
+            break;
+
+        case TokenType::MULTIPLY: {
+            // X * 2 -> X + X
+            ExpressionPtr* operand = nullptr;
+            if (isConstantNumber(bin->right.get(), value) && value == 2.0) {
+                operand = &bin->left;
+            } else if (isConstantNumber(bin->left.get(), value) && value == 2.0) {
+                operand = &bin->right;
+            }
+            if (operand && (*operand)->getType() == ASTNodeType::EXPR_VARIABLE &&
+                !isStringVariableName(static_cast<VariableExpression*>(operand->get())->name, *m_symbols)) {
+                auto copy = cloneExpression(operand->get());
+                auto original = std::move(*operand);
+                expr = std::make_unique<BinaryExpression>(std::move(original), TokenType::PLUS,
+                                                          std::move(copy));
+                noteReduction();
+                return true;
+            }
+            break;
+        }
+
+        case TokenType::DIVIDE:
+            // X / 2^k -> X * 2^-k (exact in binary floating point)
+            if (!isConstantNumber(bin->left.get(), value) &&
+                isConstantNumber(bin->right.get(), value) && isPowerOfTwo(value)) {
+                bin->op = TokenType::MULTIPLY;
+                bin->right = makeNumber(1.0 / value);
+                noteReduction();
+                return true;
+            }
+            break;
+
+        case TokenType::INT_DIVIDE: {
+            // X \ 2^k -> INT(X * 2^-k): the same floor without a division
+            const auto* intDef = ModularCommands::getGlobalCommandRegistry().getFunction("INT");
+            if (intDef && !isConstantNumber(bin->left.get(), value) &&
+                isConstantNumber(bin->right.get(), value) && isPowerOfTwo(value)) {
+                auto scaled = std::make_unique<BinaryExpression>(std::move(bin->left), TokenType::MULTIPLY,
+                                                                 makeNumber(1.0 / value));
+                auto call = std::make_unique<RegistryFunctionExpression>("INT", intDef->returnType);
+                call->addArgument(std::move(scaled));
+                expr = std::move(call);
+                noteReduction();
+                return true;
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+    return false;
+}
+
+void StrengthReductionPass::reduceLoops(const std::vector<Position>& sequence) {
+    for (size_t f = 0; f < sequence.size(); f++) {
+        Statement* stmt = (*sequence[f].list)[sequence[f].index].get();
+        if (stmt->getType() != ASTNodeType::STMT_FOR) continue;
+        const std::string& variable = static_cast<ForStatement*>(stmt)->variable;
+
+        // Matching NEXT at the same nesting depth
+        int depth = 0;
+        for (size_t n = f + 1; n < sequence.size(); n++) {
+            Statement* inner = (*sequence[n].list)[sequence[n].index].get();
+            if (inner->getType() == ASTNodeType::STMT_FOR) {
+                depth++;
+            } else if (inner->getType() == ASTNodeType::STMT_NEXT) {
+                if (depth == 0) {
+                    const std::string& nextVariable = static_cast<NextStatement*>(inner)->variable;
+                    if (nextVariable.empty() || nextVariable == variable) {
+                        reduceLoop(sequence, f, n);
+                    }
+                    break;
+                }
+                depth--;
+            }
+        }
+    }
+}
+
+bool StrengthReductionPass::reduceLoop(const std::vector<Position>& sequence,
+                                       size_t forIndex, size_t nextIndex) {
+    auto at = [&sequence](size_t i) {
+        return (*sequence[i].list)[sequence[i].index].get();
+    };
+    auto* loop = static_cast<ForStatement*>(at(forIndex));
+
+    // Integral start and step keep every derived value an exact integer
+    double start = 0.0;
+    double step = 1.0;
+    if (!isIntegralConstant(loop->start.get(), start) ||
+        (loop->step && (!isIntegralConstant(loop->step.get(), step) || step == 0.0)) ||
+        isStringVariableName(loop->variable, *m_symbols)) {
+        return false;
+    }
+
+    // The derived variable only stays in step if the body is entered
+    // through the FOR and never assigns the FOR variable
+    for (size_t k = forIndex + 1; k <= nextIndex; k++) {
+        if (sequence[k].lineNumber > 0 && m_jumpTargetLines.count(sequence[k].lineNumber)) {
+            return false;
+        }
+        if (k < nextIndex && disturbsInduction(at(k), loop->variable)) {
+            return false;
+        }
+    }
+
+    std::vector<DerivedInduction> derived;
+    std::function<void(Statement*)> visit = [&](Statement* stmt) {
+        forEachExpressionSlot(stmt, [&](ExpressionPtr& expr) {
+            replaceAffine(expr, loop->variable, derived);
+        });
+        forEachNestedList(stmt, [&](std::vector<StatementPtr>& list) {
+            for (auto& nested : list) visit(nested.get());
+        });
+    };
+    for (size_t k = forIndex + 1; k < nextIndex; k++) {
+        visit(at(k));
+    }
+    if (derived.empty()) {
+        return false;
+    }
+
+    // Initialise before the FOR, step just before the NEXT
+    for (const auto& induction : derived) {
+        auto init = std::make_unique<LetStatement>(induction.name);
+        init->value = makeNumber(induction.coefficient * start + induction.offset);
+        m_insertions.push_back(StatementInsertion{sequence[forIndex].list, at(forIndex), std::move(init)});
+
+        auto bump = std::make_unique<LetStatement>(induction.name);
+        bump->value = std::make_unique<BinaryExpression>(
+            std::make_unique<VariableExpression>(induction.name), TokenType::PLUS,
+            makeNumber(induction.coefficient * step));
+        m_insertions.push_back(StatementInsertion{sequence[nextIndex].list, at(nextIndex), std::move(bump)});
+    }
+    return true;
+}
+
+bool StrengthReductionPass::disturbsInduction(Statement* stmt, const std::string& variable) const {
+    switch (stmt->getType()) {
+        case ASTNodeType::STMT_LABEL:
+        case ASTNodeType::STMT_GOSUB:
+            return true;  // Jump into the loop, or code that may assign anything
+        case ASTNodeType::STMT_LET: {
+            auto* letStmt = static_cast<LetStatement*>(stmt);
+            if (letStmt->indices.empty() && letStmt->variable == variable) return true;
+            break;
+        }
+        case ASTNodeType::STMT_FOR:
+            if (static_cast<ForStatement*>(stmt)->variable == variable) return true;
+            break;
+        case ASTNodeType::STMT_DIM:
+            for (const auto& array : static_cast<DimStatement*>(stmt)->arrays) {
+                if (array.name == variable) return true;
+            }
+            break;
+        default:
+            break;
+    }
+
+    bool userCall = false;
+    bool modelled = forEachExpressionSlot(stmt, [&](ExpressionPtr& expr) {
+        userCall = userCall || callsUserCode(expr.get(), *m_symbols);
+    });
+    if (!modelled || userCall) {
+        return true;
+    }
+
+    bool disturbed = false;
+    forEachNestedList(stmt, [&](std::vector<StatementPtr>& list) {
+        for (auto& nested : list) {
+            disturbed = disturbed || disturbsInduction(nested.get(), variable);
+        }
+    });
+    return disturbed;
+}
+
+bool StrengthReductionPass::affineIn(const Expression* expr, const std::string& variable,
+                                     double& coefficient, double& offset, bool& multiplies) const {
+    double value = 0.0;
+    if (isIntegralConstant(expr, value)) {
+        coefficient = 0.0;
+        offset = value;
+        return true;
+    }
+
+    switch (expr->getType()) {
+        case ASTNodeType::EXPR_VARIABLE:
+            if (static_cast<const VariableExpression*>(expr)->name != variable) return false;
+            coefficient = 1.0;
+            offset = 0.0;
+            return true;
+
+        case ASTNodeType::EXPR_UNARY: {
+            auto* unary = static_cast<const UnaryExpression*>(expr);
+            if (unary->op != TokenType::MINUS && unary->op != TokenType::PLUS) return false;
+            if (!affineIn(unary->expr.get(), variable, coefficient, offset, multiplies)) return false;
+            if (unary->op == TokenType::MINUS) {
+                coefficient = -coefficient;
+                offset = -offset;
+            }
+            return true;
+        }
+
+        case ASTNodeType::EXPR_BINARY: {
+            auto* bin = static_cast<const BinaryExpression*>(expr);
+            double leftCoefficient, leftOffset, rightCoefficient, rightOffset;
+            if (bin->op != TokenType::PLUS && bin->op != TokenType::MINUS &&
+                bin->op != TokenType::MULTIPLY) {
+                return false;
+            }
+            if (!affineIn(bin->left.get(), variable, leftCoefficient, leftOffset, multiplies) ||
+                !affineIn(bin->right.get(), variable, rightCoefficient, rightOffset, multiplies)) {
+                return false;
+            }
+
+            if (bin->op == TokenType::PLUS) {
+                coefficient = leftCoefficient + rightCoefficient;
+                offset = leftOffset + rightOffset;
+            } else if (bin->op == TokenType::MINUS) {
+                coefficient = leftCoefficient - rightCoefficient;
+                offset = leftOffset - rightOffset;
+            } else {
+                if (leftCoefficient != 0.0 && rightCoefficient != 0.0) return false;  // Quadratic
+                multiplies = true;
+                coefficient = leftCoefficient * rightOffset + rightCoefficient * leftOffset;
+                offset = leftOffset * rightOffset;
+            }
+            return std::fabs(coefficient) < 9007199254740992.0 && std::fabs(offset) < 9007199254740992.0;
+        }
+
+        default:
+            return false;
+    }
+}
+
+void StrengthReductionPass::replaceAffine(ExpressionPtr& expr, const std::string& variable,
+                                          std::vector<DerivedInduction>& derived) {
+    double coefficient = 0.0;
+    double offset = 0.0;
+    bool multiplies = false;
+    if (affineIn(expr.get(), variable, coefficient, offset, multiplies) &&
+        multiplies && coefficient != 0.0) {
+        auto it = std::find_if(derived.begin(), derived.end(), [&](const DerivedInduction& d) {
+            return d.coefficient == coefficient && d.offset == offset;
+        });
+        if (it == derived.end()) {
+            derived.push_back(DerivedInduction{coefficient, offset,
+                                               kInductionTempPrefix + std::to_string(++m_nextTemp)});
+            it = derived.end() - 1;
+        }
+        expr = std::make_unique<VariableExpression>(it->name);
+        noteReduction();
+        return;
+    }
+
+    for (ExpressionPtr* child : expressionChildren(expr.get())) {
+        replaceAffine(*child, variable, derived);
+    }
+}
+
+void StrengthReductionPass::noteReduction() {
+    m_stats->strengthReductions++;
+    m_stats->totalOptimizations++;
+    m_changed = true;
 }
 
 // =============================================================================
@@ -572,9 +1776,10 @@ void ASTOptimizer::registerPasses() {
     }
     
     if (m_optimizationLevel >= 2) {
-        // Aggressive optimizations
-        m_passes.push_back(std::make_unique<CommonSubexpressionPass>());
+        // Aggressive optimizations; strength reduction first so that CSE
+        // sees the rewritten forms (X * X, INT(X * 0.25)) and can share them
         m_passes.push_back(std::make_unique<StrengthReductionPass>());
+        m_passes.push_back(std::make_unique<CommonSubexpressionPass>());
     }
 }
 
@@ -673,7 +1878,7 @@ std::string ASTOptimizer::generateReport() const {
     
     // Summary
     if (m_stats.totalOptimizations == 0) {
-        oss << "Status: No optimizations applied (all passes are currently no-op)\n";
+        oss << "Status: No optimizations applied\n";
     } else {
         oss << "Status: " << m_stats.totalOptimizations << " optimization(s) applied\n";
     }
@@ -2,8 +2,9 @@
 // fasterbasic_optimizer.h
 // FasterBASIC - AST Optimizer
 //
-// Performs optimization passes on the validated AST before CFG construction.
-// Currently a no-op framework ready for future optimization passes.
+// Performs optimization passes on the validated AST before CFG construction:
+// constant folding and dead code at level 1, strength reduction and
+// common-subexpression elimination at level 2.
 // This is Phase 3.5 in the compilation pipeline.
 //
 
@@ -16,6 +17,8 @@
 #include <vector>
 #include <memory>
 #include <sstream>
+#include <set>
+#include <unordered_map>
 
 namespace FasterBASIC {
 
@@ -54,6 +57,14 @@ struct OptimizationStats {
 // Optimization Pass Base Class
 // =============================================================================
 
+// A statement to splice into `list` just before `before`; passes queue these
+// while walking the AST and apply them once the walk is done
+struct StatementInsertion {
+    std::vector<StatementPtr>* list;
+    Statement* before;
+    StatementPtr statement;
+};
+
 class OptimizationPass {
 public:
     virtual ~OptimizationPass() = default;
@@ -96,21 +107,134 @@ public:
 };
 
 // Pass 3: Common Subexpression Elimination
-// Identifies and eliminates redundant calculations
+// Value-numbers pure expressions along straight-line code and into the arms
+// of IF and CASE, so a repeated computation reads the variable that already
+// holds its value, or a _CSEn temporary assigned just before the first one.
+// Stores give the target a fresh value number; labels, loop heads, user
+// calls and statements the pass does not model forget everything known.
 class CommonSubexpressionPass : public OptimizationPass {
 public:
     std::string getName() const override { return "Common Subexpression Elimination"; }
     bool run(Program& program, const SymbolTable& symbols, 
              OptimizationStats& stats) override;
+    bool requiresSymbols() const override { return true; }
+
+private:
+    // First computation of a value; materialized into a temp on reuse
+    struct Site {
+        ExpressionPtr* slot;                  // Null once the node proved opaque
+        std::vector<StatementPtr>* list;      // Statement list owning the anchor
+        Statement* anchor;                    // Temp assignment goes before this
+        size_t end;                           // Sites in (index, end) are nested in this one
+        bool isString;
+        std::string temp;                     // Set once materialized
+    };
+
+    // Where a value number can be read from
+    struct Holder {
+        std::string variable;                 // Valid while it still has the value
+        int site = -1;
+    };
+
+    struct State {
+        std::unordered_map<std::string, int> variableValues;
+        std::unordered_map<std::string, int> arrayVersions;  // Bumped by element stores
+        std::unordered_map<int, Holder> holders;
+    };
+
+    // Effects of an IF/CASE arm, merged back when the arms rejoin
+    struct Frame {
+        std::set<std::string> writes;
+        std::set<std::string> arrayWrites;
+        bool forgot = false;
+    };
+
+    struct Context {
+        std::vector<StatementPtr>* list;
+        Statement* anchor;
+        bool define;                          // False where evaluation is conditional
+    };
+
+    void processList(std::vector<StatementPtr>& list);
+    void processStatement(std::vector<StatementPtr>& list, Statement* stmt);
+    void processIf(std::vector<StatementPtr>& list, IfStatement* stmt, bool userCall);
+    void processCase(std::vector<StatementPtr>& list, CaseStatement* stmt, bool userCall);
+    void processArm(std::vector<StatementPtr>& arm, const State& entry, Frame& merged);
+    void processRoutine(std::vector<StatementPtr>& body);
+    void mergeArms(const State& entry, const Frame& merged);
+
+    int numberExpression(ExpressionPtr& slot, const Context& ctx);
+    int lookupValue(Expression* expr) const;
+    bool isCandidate(const Expression* expr) const;
+    bool candidateIsString(const Expression* expr, const std::vector<int>& operands) const;
+    std::string valueKey(const Expression* expr, const std::vector<int>& operands) const;
+    int internValue(const std::string& key, bool isString);
+    int freshValue(bool isString);
+    int variableValue(const std::string& name);
+    int arrayVersion(const std::string& name);
+    bool reuse(ExpressionPtr& slot, int value);
+    std::string materialize(int siteIndex);
+
+    void noteStore(const std::string& variable, int value);
+    void noteArrayStore(const std::string& array);
+    void forget();
+
+    const SymbolTable* m_symbols = nullptr;
+    OptimizationStats* m_stats = nullptr;
+    State m_state;
+    std::vector<Frame> m_frames;
+    std::unordered_map<std::string, int> m_valueTable;  // Structural key -> value number
+    std::vector<bool> m_valueIsString;
+    int m_nextArrayVersion = 0;
+    std::vector<Site> m_sites;
+    std::vector<StatementInsertion> m_insertions;
+    std::set<int> m_jumpTargetLines;
+    int m_nextTemp = 0;
 };
 
 // Pass 4: Strength Reduction
-// Replaces expensive operations with cheaper ones (e.g., X * 2 -> X + X)
+// Replaces expensive operations with cheaper ones: X^2 -> X*X, X*2 -> X+X,
+// division by a power of two -> multiplication by its reciprocal, and
+// constant multiples of a FOR variable -> a derived induction variable
+// (_IVn) bumped by a constant before each NEXT.
 class StrengthReductionPass : public OptimizationPass {
 public:
     std::string getName() const override { return "Strength Reduction"; }
     bool run(Program& program, const SymbolTable& symbols, 
              OptimizationStats& stats) override;
+    bool requiresSymbols() const override { return true; }
+
+private:
+    // A statement in a flattened sequence (program lines, or one body)
+    struct Position {
+        std::vector<StatementPtr>* list;
+        size_t index;
+        int lineNumber;                       // Set on the first statement of a line
+    };
+
+    // coefficient * FOR variable + offset, tracked in a temp
+    struct DerivedInduction {
+        double coefficient;
+        double offset;
+        std::string name;
+    };
+
+    bool reduceExpression(ExpressionPtr& expr);
+    void reduceLoops(const std::vector<Position>& sequence);
+    bool reduceLoop(const std::vector<Position>& sequence, size_t forIndex, size_t nextIndex);
+    bool disturbsInduction(Statement* stmt, const std::string& variable) const;
+    bool affineIn(const Expression* expr, const std::string& variable,
+                  double& coefficient, double& offset, bool& multiplies) const;
+    void replaceAffine(ExpressionPtr& expr, const std::string& variable,
+                       std::vector<DerivedInduction>& derived);
+    void noteReduction();
+
+    const SymbolTable* m_symbols = nullptr;
+    OptimizationStats* m_stats = nullptr;
+    std::vector<StatementInsertion> m_insertions;
+    std::set<int> m_jumpTargetLines;
+    int m_nextTemp = 0;
+    bool m_changed = false;
 };
 
 // =============================================================================
@@ -31,10 +31,15 @@ struct CompilerOptions {
     bool cancellableLoops = true;
     
     // Error tracking: OPTION ERROR
-    // When true, emit _LINE tracking for better error messages
+    // When true, emit a Lua line -> BASIC line map for better error messages
     // Default is true for better UX (shows BASIC line numbers in runtime errors)
     bool errorTracking = true;
     
+    // Line execution counters: OPTION PROFILE COUNTS / OPTION PROFILE OFF
+    // When true, count every entry into each BASIC line for a hit-count and
+    // coverage report at exit
+    bool lineCounts = false;
+    
     // Operator behavior: OPTION BITWISE vs OPTION LOGICAL
     // When true, AND/OR/XOR are bitwise operators
     // When false, AND/OR/XOR are logical operators (default BASIC behavior)
@@ -54,6 +59,7 @@ struct CompilerOptions {
         unicodeMode = false;
         cancellableLoops = true;   // Default to enabled for safety
         errorTracking = true;      // Default to enabled for better UX
+        lineCounts = false;
         bitwiseOperators = false;
         explicitDeclarations = false;
     }
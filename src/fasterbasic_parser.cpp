@@ -16,6 +16,7 @@
 #include <fstream>
 #include <set>
 #include <climits>
+#include <cctype>
 
 // For realpath()
 #ifndef _WIN32
@@ -101,6 +102,26 @@ bool Parser::match(const std::vector<TokenType>& types) {
     return false;
 }
 
+// Words such as PROFILE and COUNTS only mean something after OPTION, so they
+// are matched as identifiers rather than reserved as keywords
+bool Parser::matchWord(const char* word) {
+    if (!check(TokenType::IDENTIFIER)) {
+        return false;
+    }
+    const std::string& text = current().value;
+    size_t i = 0;
+    for (; i < text.size() && word[i] != '\0'; i++) {
+        if (std::toupper(static_cast<unsigned char>(text[i])) != word[i]) {
+            return false;
+        }
+    }
+    if (i != text.size() || word[i] != '\0') {
+        return false;
+    }
+    advance();
+    return true;
+}
+
 const Token& Parser::consume(TokenType type, const std::string& errorMsg) {
     if (check(type)) {
         return advance();
@@ -257,6 +278,7 @@ void Parser::preprocessLineNumbers(std::vector<Token>& tokens) {
                 // This is a BASIC line number - record it and skip it
                 int lineNum = static_cast<int>(token.numberValue);
                 m_lineNumberMapping.addMapping(currentPhysicalLine, lineNum);
+                m_sourceLineNumbers[token.location.line] = lineNum;
                 expectingLineNumber = false;
                 continue; // Skip this token
             }
@@ -325,6 +347,14 @@ void Parser::collectOptionsFromTokens() {
                 } else {
                     error("Expected ON or OFF after OPTION CANCELLABLE");
                 }
+            } else if (matchWord("PROFILE")) {
+                if (matchWord("COUNTS")) {
+                    m_options.lineCounts = true;
+                } else if (match(TokenType::OFF)) {
+                    m_options.lineCounts = false;
+                } else {
+                    error("Expected COUNTS or OFF after OPTION PROFILE");
+                }
             } else {
                 error("Unknown OPTION type");
             }
@@ -522,6 +552,23 @@ std::unique_ptr<ProgramLine> Parser::parseProgramLine(size_t physicalLine) {
 // =============================================================================
 
 StatementPtr Parser::parseStatement() {
+    // Errors, the profiler and line counts name a statement by the line it
+    // is written on: the user's line number if the line had one, else the
+    // source line
+    int lineNumber = current().location.line;
+    auto numbered = m_sourceLineNumbers.find(lineNumber);
+    if (numbered != m_sourceLineNumbers.end()) {
+        lineNumber = numbered->second;
+    }
+
+    StatementPtr stmt = parseStatementOnLine();
+    if (stmt) {
+        stmt->basicLine = lineNumber;
+    }
+    return stmt;
+}
+
+StatementPtr Parser::parseStatementOnLine() {
     // Skip any leading colons (statement separators)
     while (current().type == TokenType::COLON) {
         advance();
@@ -2778,8 +2825,18 @@ StatementPtr Parser::parseOptionStatement() {
             error("Expected ON or OFF after OPTION CANCELLABLE");
             return nullptr;
         }
+    } else if (matchWord("PROFILE")) {
+        // Parse COUNTS/OFF for OPTION PROFILE
+        if (matchWord("COUNTS")) {
+            return std::make_unique<OptionStatement>(OptionStatement::OptionType::PROFILE_COUNTS, 1);
+        } else if (match(TokenType::OFF)) {
+            return std::make_unique<OptionStatement>(OptionStatement::OptionType::PROFILE_COUNTS, 0);
+        } else {
+            error("Expected COUNTS or OFF after OPTION PROFILE");
+            return nullptr;
+        }
     } else {
-        error("Unknown OPTION type. Expected BITWISE, LOGICAL, BASE, EXPLICIT, UNICODE, ERROR, or CANCELLABLE");
+        error("Unknown OPTION type. Expected BITWISE, LOGICAL, BASE, EXPLICIT, UNICODE, ERROR, CANCELLABLE, or PROFILE");
         return nullptr;
     }
 }
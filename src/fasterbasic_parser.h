@@ -92,6 +92,10 @@ public:
     
     // Set include search paths (for -I command line option)
     void setIncludePaths(const std::vector<std::string>& paths) { m_includePaths = paths; }
+
+    // Line numbers DataPreprocessor stripped, keyed by source line. Numbers
+    // the parser strips itself are added as it goes
+    void setSourceLineNumbers(const std::map<int, int>& numbers) { m_sourceLineNumbers = numbers; }
     
     // Get compiler options collected from OPTION statements
     const CompilerOptions& getOptions() const { return m_options; }
@@ -115,6 +119,7 @@ private:
     
     // Line number preprocessing
     LineNumberMapping m_lineNumberMapping;  // Maps physical lines to BASIC line numbers
+    std::map<int, int> m_sourceLineNumbers; // Source line -> the user's line number
     
     // Include file handling
     struct IncludeContext {
@@ -185,6 +190,7 @@ private:
     bool check(TokenType type) const;
     bool match(TokenType type);
     bool match(const std::vector<TokenType>& types);
+    bool matchWord(const char* word);  // Contextual keyword: an identifier spelled word (any case)
     const Token& consume(TokenType type, const std::string& errorMsg);
     
     // Skip to end of line (for error recovery)
@@ -208,7 +214,8 @@ private:
     std::unique_ptr<ProgramLine> parseProgramLine(size_t physicalLine);
     
     // Statement parsing
-    StatementPtr parseStatement();
+    StatementPtr parseStatement();        // Stamps the statement with the line it starts on
+    StatementPtr parseStatementOnLine();
     StatementPtr parsePrintStatement();
     StatementPtr parseConsoleStatement();
     StatementPtr parseInputStatement();
@@ -7,6 +7,7 @@
 //
 
 #include "fasterbasic_peephole.h"
+#include "modular_commands.h"
 #include <algorithm>
 #include <chrono>
 #include <iomanip>
@@ -382,6 +383,1179 @@ bool PeepholeNopEliminationPass::optimize(IRCode& code) {
     return changed;
 }
 
+// =============================================================================
+// Loop-Invariant Code Motion Pass
+// =============================================================================
+//
+// Works on the structured loop opcodes (FOR_INIT ... FOR_NEXT, WHILE_START ...
+// WHILE_END, REPEAT_START ... REPEAT_END, DO_* ... DO_LOOP_*). In the stack IR
+// every subexpression is a contiguous run of instructions, so an invariant
+// expression is hoisted by copying its run in front of the loop followed by a
+// STORE_VAR to a compiler temporary, and replacing the run in the body with a
+// LOAD_VAR of that temporary. Each run moves out one loop per iteration of the
+// optimizer; the next iteration moves it further out when the enclosing loop
+// does not change its operands either.
+//
+// A loop is left alone when control can enter it without passing the
+// preheader, when it calls user code (GOSUB, SUB, FUNCTION) that may change
+// its operands, or when the program uses ON EVENT handlers. Array elements
+// are never hoisted: an out-of-range index must not fault ahead of a loop
+// that would not have executed it.
+//
+
+namespace {
+
+// Compiler temporaries created by this pass
+const char* const kHoistTempPrefix = "_LICM";
+
+bool isHoistTemp(const IROperand& op) {
+    return std::holds_alternative<std::string>(op) &&
+           std::get<std::string>(op).rfind(kHoistTempPrefix, 0) == 0;
+}
+
+bool isStringVariable(const std::string& name) {
+    return name.find("_STRING") != std::string::npos ||
+           (!name.empty() && name.back() == '$');
+}
+
+int labelOperand(const IROperand& op) {
+    if (std::holds_alternative<int>(op)) {
+        return std::get<int>(op);
+    }
+    return -1;
+}
+
+// Registry functions with no side effects (and no command of the same name)
+bool isPureRegistryFunction(const std::string& name) {
+    auto& registry = ModularCommands::getGlobalCommandRegistry();
+    const auto* def = registry.getFunction(name);
+    return def && def->isPure && !registry.hasCommand(name);
+}
+
+} // anonymous namespace
+
+void PeepholeLoopInvariantCodeMotionPass::resetStats() {
+    PeepholePass::resetStats();
+    m_loopRecords.clear();
+    m_nextTemp = 1;
+}
+
+bool PeepholeLoopInvariantCodeMotionPass::isPureBuiltin(const std::string& name) const {
+    return isPureRegistryFunction(name);
+}
+
+bool PeepholeLoopInvariantCodeMotionPass::returnsString(const std::string& name) const {
+    const auto* def = ModularCommands::getGlobalCommandRegistry().getFunction(name);
+    if (def) {
+        return def->returnType == ModularCommands::ReturnType::STRING;
+    }
+    return !name.empty() && name.back() == '$';
+}
+
+bool PeepholeLoopInvariantCodeMotionPass::findLoops(const IRCode& code,
+                                                    std::vector<LoopRegion>& loops) const {
+    std::vector<int> open;
+    int count = static_cast<int>(code.instructions.size());
+
+    for (int i = 0; i < count; i++) {
+        const auto& instr = code.instructions[i];
+        LoopRegion loop;
+
+        switch (instr.opcode) {
+            case IROpcode::FOR_INIT:
+                loop.kind = "FOR";
+                loop.preheader = code.expressionStart(i, 3);
+                break;
+            case IROpcode::FOR_IN_INIT:
+                loop.kind = "FOR IN";
+                loop.preheader = code.expressionStart(i, 1);
+                break;
+            case IROpcode::WHILE_START:
+                loop.kind = "WHILE";
+                if (std::holds_alternative<int>(instr.operand1)) {
+                    // WEND jumps back to the label in front of the condition
+                    int start = code.expressionStart(i, 1);
+                    if (start > 0 &&
+                        code.instructions[start - 1].opcode == IROpcode::LABEL &&
+                        labelOperand(code.instructions[start - 1].operand1) ==
+                            std::get<int>(instr.operand1)) {
+                        loop.preheader = start - 1;
+                    }
+                } else {
+                    // Condition is deferred into the opener itself
+                    loop.preheader = i;
+                }
+                break;
+            case IROpcode::REPEAT_START:
+                loop.kind = "REPEAT";
+                loop.preheader = i;
+                break;
+            case IROpcode::DO_START:
+                loop.kind = "DO";
+                loop.preheader = i;
+                break;
+            case IROpcode::DO_WHILE_START:
+            case IROpcode::DO_UNTIL_START:
+                loop.kind = "DO";
+                loop.preheader = code.expressionStart(i, 1);
+                break;
+            default:
+                break;
+        }
+
+        if (!loop.kind.empty()) {
+            if (std::holds_alternative<std::string>(instr.operand1) &&
+                (instr.opcode == IROpcode::FOR_INIT || instr.opcode == IROpcode::FOR_IN_INIT)) {
+                loop.variable = std::get<std::string>(instr.operand1);
+            }
+            loop.opener = i;
+            loop.sourceLineNumber = instr.sourceLineNumber;
+            loop.parent = open.empty() ? -1 : open.back();
+            loop.depth = open.empty() ? 1 : loops[open.back()].depth + 1;
+            open.push_back(static_cast<int>(loops.size()));
+            loops.push_back(loop);
+            continue;
+        }
+
+        std::string closes;
+        switch (instr.opcode) {
+            case IROpcode::FOR_NEXT:      closes = "FOR"; break;
+            case IROpcode::FOR_IN_NEXT:   closes = "FOR IN"; break;
+            case IROpcode::WHILE_END:     closes = "WHILE"; break;
+            case IROpcode::REPEAT_END:    closes = "REPEAT"; break;
+            case IROpcode::DO_LOOP_WHILE:
+            case IROpcode::DO_LOOP_UNTIL:
+            case IROpcode::DO_LOOP_END:   closes = "DO"; break;
+            default:
+                continue;
+        }
+
+        // Closers that do not pair with the innermost opener (NEXT I,J or
+        // NEXT inside IF) mean the loop nest cannot be trusted
+        if (open.empty() || loops[open.back()].kind != closes) {
+            return false;
+        }
+        LoopRegion& top = loops[open.back()];
+        if (instr.opcode == IROpcode::FOR_NEXT &&
+            std::holds_alternative<std::string>(instr.operand1)) {
+            const std::string& var = std::get<std::string>(instr.operand1);
+            if (!var.empty() && var != top.variable) {
+                return false;
+            }
+        }
+        top.closer = i;
+        open.pop_back();
+    }
+
+    return open.empty();
+}
+
+bool PeepholeLoopInvariantCodeMotionPass::isHoistable(
+        const IRCode& code, const LoopRegion& loop,
+        const std::map<int, std::vector<int>>& jumpSources) const {
+    if (loop.preheader < 0 || loop.closer < 0) {
+        return false;
+    }
+
+    for (int i = loop.preheader; i <= loop.closer; i++) {
+        const auto& instr = code.instructions[i];
+        switch (instr.opcode) {
+            // User code may assign any global
+            case IROpcode::CALL_GOSUB:
+            case IROpcode::ON_GOSUB:
+            case IROpcode::ON_CALL:
+            case IROpcode::CALL_SUB:
+            case IROpcode::CALL_FUNCTION:
+            case IROpcode::CALL_USER_FN:
+            case IROpcode::DEFINE_FUNCTION:
+            case IROpcode::DEFINE_SUB:
+                return false;
+
+            case IROpcode::LABEL: {
+                // Entering the region other than through the preheader would
+                // skip the hoisted computations
+                auto sources = jumpSources.find(labelOperand(instr.operand1));
+                if (sources == jumpSources.end()) {
+                    break;
+                }
+                for (int from : sources->second) {
+                    if (from < loop.preheader || from > loop.closer) {
+                        return false;
+                    }
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    return true;
+}
+
+void PeepholeLoopInvariantCodeMotionPass::collectStores(const IRCode& code,
+                                                        const LoopRegion& loop,
+                                                        std::unordered_set<std::string>& stored,
+                                                        bool& unknownStores) const {
+    auto add = [&stored](const IROperand& op) {
+        if (std::holds_alternative<std::string>(op)) {
+            stored.insert(std::get<std::string>(op));
+        }
+    };
+
+    for (int i = loop.preheader; i <= loop.closer; i++) {
+        const auto& instr = code.instructions[i];
+        switch (instr.opcode) {
+            case IROpcode::STORE_VAR:
+            case IROpcode::MID_ASSIGN:
+            case IROpcode::FOR_INIT:
+            case IROpcode::FOR_NEXT:
+            case IROpcode::READ_DATA:
+                add(instr.operand1);
+                break;
+            case IROpcode::FOR_IN_INIT:
+            case IROpcode::INPUT:
+                add(instr.operand1);
+                add(instr.operand2);
+                break;
+            case IROpcode::INPUT_FILE:
+            case IROpcode::LINE_INPUT_FILE:
+                add(instr.operand2);
+                break;
+            case IROpcode::INPUT_AT:
+            case IROpcode::INPUT_PROMPT:
+                // Target named in source form rather than mangled form
+                unknownStores = true;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+bool PeepholeLoopInvariantCodeMotionPass::optimize(IRCode& code) {
+    m_stats.passName = getName();
+    m_stats.reset();
+
+    // Event handlers run between statements and may assign anything
+    if (code.eventsUsed) {
+        return false;
+    }
+
+    std::vector<LoopRegion> loops;
+    if (!findLoops(code, loops) || loops.empty()) {
+        return false;
+    }
+
+    int count = static_cast<int>(code.instructions.size());
+
+    // Jump edges into labels
+    std::map<int, std::vector<int>> jumpSources;
+    for (int i = 0; i < count; i++) {
+        const auto& instr = code.instructions[i];
+        switch (instr.opcode) {
+            case IROpcode::JUMP:
+            case IROpcode::JUMP_IF_TRUE:
+            case IROpcode::JUMP_IF_FALSE:
+            case IROpcode::CALL_GOSUB:
+            case IROpcode::WHILE_END:
+                if (std::holds_alternative<int>(instr.operand1)) {
+                    jumpSources[std::get<int>(instr.operand1)].push_back(i);
+                }
+                break;
+            case IROpcode::ON_GOTO:
+            case IROpcode::ON_GOSUB:
+                if (std::holds_alternative<std::string>(instr.operand1)) {
+                    std::istringstream targets(std::get<std::string>(instr.operand1));
+                    std::string target;
+                    while (std::getline(targets, target, ',')) {
+                        try {
+                            jumpSources[std::stoi(target)].push_back(i);
+                        } catch (...) {
+                        }
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Per-loop legality and the variables each loop assigns
+    std::vector<bool> hoistable(loops.size(), false);
+    std::vector<std::unordered_set<std::string>> stored(loops.size());
+    std::vector<bool> unknownStores(loops.size(), false);
+    for (size_t l = 0; l < loops.size(); l++) {
+        hoistable[l] = isHoistable(code, loops[l], jumpSources);
+        if (hoistable[l]) {
+            bool unknown = false;
+            collectStores(code, loops[l], stored[l], unknown);
+            unknownStores[l] = unknown;
+        }
+    }
+
+    // Innermost loop owning each body instruction; a nested loop's preheader
+    // code belongs to the enclosing body
+    std::vector<int> owner(count, -1);
+    for (size_t l = 0; l < loops.size(); l++) {
+        for (int i = loops[l].opener + 1; i <= loops[l].closer; i++) {
+            owner[i] = static_cast<int>(l);
+        }
+    }
+
+    // Simulate the operand stack over loop bodies. Every entry is a complete
+    // expression [start, end]; entries invariant in their loop become
+    // candidates once consumed by something that is not.
+    struct Value {
+        int start;
+        int end;
+        bool invariant;
+        bool isString;
+        int cost;       // Binary operations and calls in the expression
+    };
+    struct Candidate {
+        int loop;
+        int start;
+        int end;
+        bool isString;
+        bool movesStore;    // Run ends in the STORE_VAR of an inner loop's temp
+    };
+    std::vector<Candidate> candidates;
+    std::vector<Value> stack;
+    int currentLoop = -1;
+
+    auto release = [&](const Value& v) {
+        if (currentLoop < 0 || !hoistable[currentLoop]) return;
+        if (!v.invariant || v.cost == 0) return;
+        // Unicode strings are shared codepoint tables; keep them per-iteration
+        if (v.isString && code.unicodeMode) return;
+        candidates.push_back({currentLoop, v.start, v.end, v.isString, false});
+    };
+    auto flush = [&]() {
+        for (const auto& v : stack) release(v);
+        stack.clear();
+    };
+    auto pop = [&](int index) -> Value {
+        if (stack.empty()) {
+            return Value{index, index, false, false, 0};
+        }
+        Value v = stack.back();
+        stack.pop_back();
+        return v;
+    };
+
+    for (int i = 0; i < count; i++) {
+        if (owner[i] != currentLoop) {
+            flush();
+            currentLoop = owner[i];
+        }
+        if (currentLoop < 0 || !hoistable[currentLoop]) {
+            continue;
+        }
+
+        const auto& instr = code.instructions[i];
+        int pops = 0;
+        if (!instr.valueStackEffect(pops)) {
+            if (instr.opcode == IROpcode::DUP) {
+                release(pop(i));
+                stack.push_back({i, i, false, false, 0});
+                stack.push_back({i, i, false, false, 0});
+            } else if (instr.opcode == IROpcode::STORE_VAR && isHoistTemp(instr.operand1) &&
+                       !stack.empty() && stack.back().invariant) {
+                // An inner loop's preheader moves out whole instead of
+                // being copied into yet another temp
+                Value v = pop(i);
+                candidates.push_back({currentLoop, v.start, i, v.isString, true});
+                flush();
+            } else {
+                // Statements consume whatever is left
+                flush();
+            }
+            continue;
+        }
+
+        Value result{i, i, true, false, 0};
+        switch (instr.opcode) {
+            case IROpcode::LOAD_VAR: {
+                if (!std::holds_alternative<std::string>(instr.operand1)) {
+                    result.invariant = false;
+                    break;
+                }
+                const std::string& name = std::get<std::string>(instr.operand1);
+                result.invariant = !unknownStores[currentLoop] &&
+                                   stored[currentLoop].count(name) == 0;
+                result.isString = isStringVariable(name);
+                break;
+            }
+            case IROpcode::PUSH_STRING:
+            case IROpcode::CONV_TO_STRING:
+            case IROpcode::STR_CONCAT:
+            case IROpcode::STR_LEFT:
+            case IROpcode::STR_RIGHT:
+            case IROpcode::STR_MID:
+                result.isString = true;
+                break;
+            case IROpcode::UNICODE_CONCAT:
+            case IROpcode::LOAD_ARRAY:
+            case IROpcode::CALL_FUNCTION:
+                result.invariant = false;
+                result.isString = instr.opcode == IROpcode::UNICODE_CONCAT;
+                break;
+            case IROpcode::CALL_BUILTIN: {
+                auto& registry = ModularCommands::getGlobalCommandRegistry();
+                const std::string name = std::holds_alternative<std::string>(instr.operand1) ?
+                                         std::get<std::string>(instr.operand1) : std::string();
+                if (!registry.hasFunction(name) || registry.hasCommand(name)) {
+                    // Commands and unregistered helpers: unknown result count
+                    flush();
+                    continue;
+                }
+                result.invariant = isPureBuiltin(name);
+                result.isString = returnsString(name);
+                break;
+            }
+            default:
+                break;
+        }
+
+        if (pops > 0) {
+            std::vector<Value> operands(pops);
+            for (int k = pops - 1; k >= 0; k--) {
+                operands[k] = pop(i);
+            }
+            bool operandsInvariant = true;
+            for (const auto& v : operands) {
+                operandsInvariant = operandsInvariant && v.invariant;
+                result.cost += v.cost;
+            }
+            result.start = operands.front().start;
+            result.invariant = result.invariant && operandsInvariant;
+            if (!result.invariant) {
+                for (const auto& v : operands) release(v);
+            }
+        }
+        if (pops >= 2 || (pops == 1 && instr.opcode == IROpcode::CALL_BUILTIN)) {
+            result.cost++;
+        }
+        stack.push_back(result);
+    }
+    currentLoop = -1;
+    stack.clear();
+
+    // A run must not straddle another loop's preheader
+    std::vector<int> preheaders;
+    for (const auto& loop : loops) {
+        preheaders.push_back(loop.preheader);
+    }
+    std::sort(preheaders.begin(), preheaders.end());
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+        [&preheaders](const Candidate& cand) {
+            auto it = std::upper_bound(preheaders.begin(), preheaders.end(), cand.start);
+            return it != preheaders.end() && *it <= cand.end;
+        }), candidates.end());
+
+    if (candidates.empty()) {
+        return false;
+    }
+
+    // Rewrite: hoisted runs go in front of their loop, the body loads the temp
+    std::map<int, std::vector<const Candidate*>> hoistAt;
+    std::unordered_map<int, const Candidate*> replaceAt;
+    std::vector<std::string> tempNames(candidates.size());
+    for (size_t c = 0; c < candidates.size(); c++) {
+        const Candidate& cand = candidates[c];
+        hoistAt[loops[cand.loop].preheader].push_back(&cand);
+        replaceAt[cand.start] = &cand;
+        if (!cand.movesStore) {
+            tempNames[c] = kHoistTempPrefix + std::to_string(m_nextTemp++) +
+                           (cand.isString ? "_STRING" : "");
+        }
+    }
+    auto tempOf = [&](const Candidate* cand) -> const std::string& {
+        return tempNames[cand - candidates.data()];
+    };
+
+    std::vector<IRInstruction> rewritten;
+    rewritten.reserve(code.instructions.size() + candidates.size() * 4);
+    std::vector<int> newIndex(count, 0);
+
+    for (int i = 0; i < count; i++) {
+        auto hoist = hoistAt.find(i);
+        if (hoist != hoistAt.end()) {
+            for (const Candidate* cand : hoist->second) {
+                for (int k = cand->start; k <= cand->end; k++) {
+                    rewritten.push_back(code.instructions[k]);
+                }
+                int length = cand->end - cand->start + 1;
+                if (!cand->movesStore) {
+                    IRInstruction store(IROpcode::STORE_VAR, tempOf(cand));
+                    store.sourceLineNumber = code.instructions[cand->end].sourceLineNumber;
+                    store.blockId = code.instructions[cand->end].blockId;
+                    rewritten.push_back(store);
+                }
+
+                m_stats.optimizationsApplied++;
+                m_stats.patternsMatched++;
+                m_stats.instructionsRemoved += length;
+                m_stats.instructionsAdded += cand->movesStore ? length : length + 2;
+
+                const LoopRegion& loop = loops[cand->loop];
+                LoopHoistRecord& record = m_loopRecords[cand->loop];
+                record.loopKind = loop.kind;
+                record.loopVariable = loop.variable;
+                record.sourceLineNumber = loop.sourceLineNumber;
+                record.depth = loop.depth;
+                record.expressionsHoisted++;
+                record.instructionsHoisted += length;
+            }
+        }
+
+        newIndex[i] = static_cast<int>(rewritten.size());
+        auto replace = replaceAt.find(i);
+        if (replace != replaceAt.end()) {
+            const Candidate* cand = replace->second;
+            if (!cand->movesStore) {
+                IRInstruction load(IROpcode::LOAD_VAR, tempOf(cand));
+                load.sourceLineNumber = code.instructions[cand->end].sourceLineNumber;
+                load.blockId = code.instructions[cand->end].blockId;
+                rewritten.push_back(load);
+            }
+            for (int k = i + 1; k <= cand->end; k++) {
+                newIndex[k] = newIndex[i];
+            }
+            i = cand->end;
+            continue;
+        }
+        rewritten.push_back(code.instructions[i]);
+    }
+
+    code.instructions = std::move(rewritten);
+
+    // Rebuild address maps
+    code.labelToAddress.clear();
+    for (size_t i = 0; i < code.instructions.size(); i++) {
+        if (code.instructions[i].opcode == IROpcode::LABEL) {
+            int labelId = labelOperand(code.instructions[i].operand1);
+            if (labelId >= 0) {
+                code.labelToAddress[labelId] = static_cast<int>(i);
+            }
+        }
+    }
+    for (auto& [line, address] : code.lineToAddress) {
+        if (address >= 0 && address < count) {
+            address = newIndex[address];
+        }
+    }
+
+    return true;
+}
+
+// =============================================================================
+// Procedure Inlining Pass
+// =============================================================================
+//
+// Replaces CALL_FUNCTION / CALL_SUB of small procedures with a copy of the
+// body. Parameters are renamed per call site: an argument that is a literal,
+// constant or plain variable bound to a parameter the body never assigns is
+// substituted directly, and every other argument is stored into a fresh
+// _INL<n>_<param> temporary, so two expansions inside one expression never
+// share state.
+//
+// A FUNCTION body must be a single expression over its parameters (stores
+// only to parameters, pure builtins, one trailing RETURN_VALUE) because the
+// expansion lands in the middle of the caller's expression. A SUB body may
+// also assign globals, print and use IF blocks. Bodies that call user code
+// are never inlined, which rules out recursion; helpers that call helpers
+// collapse bottom-up over successive optimizer iterations. A procedure left
+// without callers is removed.
+//
+
+namespace {
+
+const char* const kInlineTempPrefix = "_INL";
+
+bool isStringOperand(const IROperand& op, std::string& value) {
+    if (!std::holds_alternative<std::string>(op)) {
+        return false;
+    }
+    value = std::get<std::string>(op);
+    return true;
+}
+
+bool isSimpleArgument(const IRInstruction& instr) {
+    switch (instr.opcode) {
+        case IROpcode::PUSH_INT:
+        case IROpcode::PUSH_FLOAT:
+        case IROpcode::PUSH_DOUBLE:
+        case IROpcode::PUSH_STRING:
+        case IROpcode::LOAD_CONST:
+        case IROpcode::LOAD_VAR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// True if instr names `name` as a procedure it calls or registers
+bool referencesProcedure(const IRInstruction& instr, const std::string& name) {
+    std::string value;
+    for (const IROperand* op : {&instr.operand1, &instr.operand2, &instr.operand3}) {
+        if (!isStringOperand(*op, value)) {
+            continue;
+        }
+        if (value == name) {
+            return true;
+        }
+        // ON CALL and ON EVENT carry lists / handler descriptions
+        if ((instr.opcode == IROpcode::ON_CALL || instr.opcode == IROpcode::ON_EVENT) &&
+            value.find(name) != std::string::npos) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// True if the value computed at index belongs to the condition of a
+// WHILE / DO WHILE / DO UNTIL header or an ELSEIF
+bool feedsRetestedCondition(const IRCode& code, int index) {
+    int count = static_cast<int>(code.instructions.size());
+    for (int i = index + 1; i < count; i++) {
+        int pops = 0;
+        if (code.instructions[i].valueStackEffect(pops)) {
+            continue;
+        }
+        switch (code.instructions[i].opcode) {
+            case IROpcode::WHILE_START:
+            case IROpcode::DO_WHILE_START:
+            case IROpcode::DO_UNTIL_START:
+            case IROpcode::ELSEIF_START:
+                return true;
+            default:
+                return false;
+        }
+    }
+    return false;
+}
+
+} // anonymous namespace
+
+void PeepholeInliningPass::resetStats() {
+    PeepholePass::resetStats();
+    m_inlinedCalls.clear();
+    m_nextTemp = 1;
+}
+
+void PeepholeInliningPass::collectProcedures(const IRCode& code,
+                                             std::map<std::string, Procedure>& procs) const {
+    int count = static_cast<int>(code.instructions.size());
+
+    for (int i = 0; i < count; i++) {
+        const auto& instr = code.instructions[i];
+        std::string name;
+        if ((instr.opcode != IROpcode::DEFINE_FUNCTION && instr.opcode != IROpcode::DEFINE_SUB) ||
+            !isStringOperand(instr.operand1, name)) {
+            continue;
+        }
+
+        Procedure proc;
+        proc.name = name;
+        proc.isFunction = (instr.opcode == IROpcode::DEFINE_FUNCTION);
+        proc.defineIndex = i;
+
+        // DEFINE_* is followed by PUSH_INT count and one PUSH_STRING per parameter
+        int j = i + 1;
+        if (j < count && code.instructions[j].opcode == IROpcode::PUSH_INT &&
+            std::holds_alternative<int>(code.instructions[j].operand1)) {
+            int paramCount = std::get<int>(code.instructions[j].operand1);
+            j++;
+            for (int p = 0; p < paramCount && j < count; p++, j++) {
+                std::string param;
+                if (code.instructions[j].opcode != IROpcode::PUSH_STRING ||
+                    !isStringOperand(code.instructions[j].operand1, param)) {
+                    break;
+                }
+                proc.parameters.push_back(param);
+            }
+        }
+        proc.bodyStart = j;
+
+        IROpcode closer = proc.isFunction ? IROpcode::END_FUNCTION : IROpcode::END_SUB;
+        for (int k = j; k < count; k++) {
+            if (code.instructions[k].opcode == closer) {
+                proc.endIndex = k;
+                break;
+            }
+        }
+        if (proc.endIndex < 0) {
+            continue;
+        }
+
+        procs[name] = proc;
+        i = proc.endIndex;
+    }
+
+    // Operands name a procedure exactly, so look them up instead of testing
+    // every instruction against every procedure; only the ON CALL / ON EVENT
+    // descriptions need the substring scan
+    for (const auto& instr : code.instructions) {
+        if (instr.opcode == IROpcode::DEFINE_FUNCTION || instr.opcode == IROpcode::DEFINE_SUB) {
+            continue;
+        }
+        if (instr.opcode == IROpcode::ON_CALL || instr.opcode == IROpcode::ON_EVENT) {
+            for (auto& [name, proc] : procs) {
+                if (referencesProcedure(instr, name)) {
+                    proc.callSites++;
+                }
+            }
+            continue;
+        }
+        const Procedure* counted[3] = {nullptr, nullptr, nullptr};
+        int countedCount = 0;
+        std::string value;
+        for (const IROperand* op : {&instr.operand1, &instr.operand2, &instr.operand3}) {
+            if (!isStringOperand(*op, value)) {
+                continue;
+            }
+            auto it = procs.find(value);
+            if (it == procs.end() ||
+                std::find(counted, counted + countedCount, &it->second) != counted + countedCount) {
+                continue;
+            }
+            it->second.callSites++;
+            counted[countedCount++] = &it->second;
+        }
+    }
+}
+
+bool PeepholeInliningPass::isInlinable(const IRCode& code, Procedure& proc) const {
+    if (m_sizeBudget <= 0 || proc.callSites == 0) {
+        return false;
+    }
+
+    std::unordered_set<std::string> params(proc.parameters.begin(), proc.parameters.end());
+    if (params.size() != proc.parameters.size()) {
+        return false;
+    }
+
+    int returns = 0;
+    for (int i = proc.bodyStart; i < proc.endIndex; i++) {
+        const auto& instr = code.instructions[i];
+        if (instr.opcode == IROpcode::NOP) {
+            continue;
+        }
+        proc.size++;
+
+        // RETURN_VALUE must be the last instruction of a FUNCTION body
+        if (returns > 0) {
+            return false;
+        }
+
+        std::string name;
+        int pops = 0;
+        switch (instr.opcode) {
+            case IROpcode::LOAD_VAR:
+                if (isStringOperand(instr.operand1, name) && !params.count(name)) {
+                    proc.globals.insert(name);
+                }
+                break;
+
+            case IROpcode::STORE_VAR:
+            case IROpcode::MID_ASSIGN:
+                if (!isStringOperand(instr.operand1, name)) {
+                    return false;
+                }
+                proc.stored.insert(name);
+                if (!params.count(name)) {
+                    if (proc.isFunction) {
+                        return false;
+                    }
+                    proc.globals.insert(name);
+                }
+                break;
+
+            case IROpcode::LOAD_ARRAY:
+            case IROpcode::STORE_ARRAY:
+                // Array parameters are passed by reference; leave them to the call
+                if (!isStringOperand(instr.operand1, name) || params.count(name)) {
+                    return false;
+                }
+                if (instr.opcode == IROpcode::STORE_ARRAY && proc.isFunction) {
+                    return false;
+                }
+                break;
+
+            case IROpcode::CALL_BUILTIN:
+                if (proc.isFunction &&
+                    (!isStringOperand(instr.operand1, name) || !isPureRegistryFunction(name))) {
+                    return false;
+                }
+                break;
+
+            case IROpcode::RETURN_VALUE:
+                if (!proc.isFunction) {
+                    return false;
+                }
+                returns++;
+                break;
+
+            case IROpcode::PRINT:
+            case IROpcode::PRINT_NEWLINE:
+            case IROpcode::PRINT_TAB:
+            case IROpcode::CONSOLE:
+            case IROpcode::IF_START:
+            case IROpcode::ELSEIF_START:
+            case IROpcode::ELSE_START:
+            case IROpcode::IF_END:
+            case IROpcode::SWITCH_START:
+            case IROpcode::SWITCH_CASE:
+            case IROpcode::SWITCH_DEFAULT:
+            case IROpcode::SWITCH_END:
+                if (proc.isFunction) {
+                    return false;
+                }
+                break;
+
+            case IROpcode::POP:
+            case IROpcode::DUP:
+                break;
+
+            case IROpcode::CALL_FUNCTION:
+                return false;
+
+            default:
+                if (!instr.valueStackEffect(pops)) {
+                    return false;
+                }
+                break;
+        }
+    }
+
+    if (proc.isFunction && returns != 1) {
+        return false;
+    }
+
+    // Cost model: code growth is size * (callSites - 1); a single caller only
+    // trades the call for the body
+    int budget = proc.callSites == 1 ? 2 * m_sizeBudget : m_sizeBudget;
+    return proc.size <= budget;
+}
+
+std::vector<std::string> PeepholeInliningPass::bindArguments(
+        const IRCode& code, int callIndex, const Procedure& callee,
+        std::map<std::string, IRInstruction>& substituted,
+        std::unordered_set<int>& removed) const {
+    int argc = static_cast<int>(callee.parameters.size());
+
+    // Argument ranges; argStart[a + 1] (or the call) ends argument a
+    std::vector<int> argStart(argc + 1, -1);
+    argStart[argc] = callIndex;
+    bool rangesKnown = true;
+    for (int a = argc - 1; a >= 0; a--) {
+        argStart[a] = code.expressionStart(argStart[a + 1], 1);
+        if (argStart[a] < 0) {
+            rangesKnown = false;
+            break;
+        }
+    }
+
+    std::vector<std::string> unbound;
+    for (int a = 0; a < argc; a++) {
+        const std::string& param = callee.parameters[a];
+
+        if (rangesKnown && argStart[a + 1] - argStart[a] == 1 && !callee.stored.count(param)) {
+            const auto& arg = code.instructions[argStart[a]];
+            std::string var;
+            bool stable = arg.opcode != IROpcode::LOAD_VAR ||
+                          (isStringOperand(arg.operand1, var) && !callee.stored.count(var));
+            if (isSimpleArgument(arg) && stable) {
+                substituted[param] = arg;
+                removed.insert(argStart[a]);
+                continue;
+            }
+        }
+        unbound.push_back(param);
+    }
+    return unbound;
+}
+
+void PeepholeInliningPass::expandCall(const IRCode& code, int callIndex, const Procedure& callee,
+                                      std::vector<IRInstruction>& out,
+                                      std::unordered_set<int>& removed) {
+    const auto& call = code.instructions[callIndex];
+
+    std::map<std::string, IRInstruction> substituted;
+    std::map<std::string, std::string> renamed;
+    std::vector<std::string> temps;
+    for (const auto& param : bindArguments(code, callIndex, callee, substituted, removed)) {
+        std::string temp = kInlineTempPrefix + std::to_string(m_nextTemp++) + "_" + param;
+        renamed[param] = temp;
+        temps.push_back(temp);
+    }
+
+    // Body instructions keep the callee's source line, so runtime errors,
+    // line counts and profiles still point into the procedure
+    auto place = [&](IRInstruction instr) {
+        if (instr.sourceLineNumber <= 0) {
+            instr.sourceLineNumber = call.sourceLineNumber;
+        }
+        instr.blockId = call.blockId;
+        out.push_back(instr);
+    };
+
+    // The remaining argument values are on the stack in parameter order
+    for (auto it = temps.rbegin(); it != temps.rend(); ++it) {
+        IRInstruction store(IROpcode::STORE_VAR, *it);
+        store.sourceLineNumber = call.sourceLineNumber;
+        place(store);
+    }
+
+    for (int i = callee.bodyStart; i < callee.endIndex; i++) {
+        IRInstruction instr = code.instructions[i];
+        if (instr.opcode == IROpcode::NOP || instr.opcode == IROpcode::RETURN_VALUE) {
+            // A FUNCTION's result simply stays on the stack
+            continue;
+        }
+
+        std::string name;
+        if ((instr.opcode == IROpcode::LOAD_VAR || instr.opcode == IROpcode::STORE_VAR ||
+             instr.opcode == IROpcode::MID_ASSIGN) &&
+            isStringOperand(instr.operand1, name)) {
+            auto sub = substituted.find(name);
+            if (sub != substituted.end() && instr.opcode == IROpcode::LOAD_VAR) {
+                IRInstruction arg = sub->second;
+                arg.sourceLineNumber = instr.sourceLineNumber;
+                place(arg);
+                continue;
+            }
+            auto ren = renamed.find(name);
+            if (ren != renamed.end()) {
+                instr.operand1 = ren->second;
+            }
+        }
+        place(instr);
+    }
+}
+
+bool PeepholeInliningPass::optimize(IRCode& code) {
+    m_stats.passName = getName();
+    m_stats.reset();
+
+    if (m_sizeBudget <= 0) {
+        return false;
+    }
+
+    std::map<std::string, Procedure> procs;
+    collectProcedures(code, procs);
+
+    bool anyInlinable = false;
+    for (auto& [name, proc] : procs) {
+        proc.inlinable = isInlinable(code, proc);
+        anyInlinable = anyInlinable || proc.inlinable;
+    }
+    if (!anyInlinable) {
+        return false;
+    }
+
+    int count = static_cast<int>(code.instructions.size());
+
+    // Procedure enclosing each instruction
+    std::vector<const Procedure*> owner(count, nullptr);
+    for (const auto& [name, proc] : procs) {
+        for (int i = proc.defineIndex; i <= proc.endIndex; i++) {
+            owner[i] = &proc;
+        }
+    }
+
+    // Pick call sites right to left so that expansions never overlap; a call
+    // whose arguments hold another inlinable call waits for the next iteration
+    struct Site {
+        int first;   // First instruction of the arguments (or the call)
+        int call;
+        const Procedure* callee;
+    };
+    std::vector<Site> sites;
+    std::unordered_set<int> siteCalls;
+    int limit = count;
+
+    for (int i = count - 1; i >= 0; i--) {
+        const auto& instr = code.instructions[i];
+        std::string name;
+        if ((instr.opcode != IROpcode::CALL_FUNCTION && instr.opcode != IROpcode::CALL_SUB) ||
+            !isStringOperand(instr.operand1, name)) {
+            continue;
+        }
+
+        auto it = procs.find(name);
+        if (it == procs.end() || !it->second.inlinable || i >= limit) {
+            continue;
+        }
+        const Procedure& callee = it->second;
+
+        int argc = std::holds_alternative<int>(instr.operand2) ? std::get<int>(instr.operand2) : 0;
+        if (argc != static_cast<int>(callee.parameters.size()) ||
+            callee.isFunction != (instr.opcode == IROpcode::CALL_FUNCTION)) {
+            continue;
+        }
+
+        // Inside another procedure the caller's parameters shadow globals
+        // the body refers to
+        const Procedure* enclosing = owner[i];
+        if (enclosing) {
+            bool shadowed = false;
+            for (const auto& param : enclosing->parameters) {
+                if (callee.globals.count(param)) {
+                    shadowed = true;
+                    break;
+                }
+            }
+            if (shadowed) {
+                continue;
+            }
+        }
+
+        // Argument temporaries are assigned by statements, which would run
+        // only once ahead of a pre-test loop header or in the wrong branch
+        // ahead of an ELSEIF
+        if (callee.isFunction && feedsRetestedCondition(code, i)) {
+            std::map<std::string, IRInstruction> substituted;
+            std::unordered_set<int> removed;
+            if (!bindArguments(code, i, callee, substituted, removed).empty()) {
+                continue;
+            }
+        }
+
+        int first = argc > 0 ? code.expressionStart(i, argc) : i;
+        if (first < 0) {
+            first = i;
+        }
+
+        // Expand inner calls first so their results can be substituted
+        bool innerCall = false;
+        for (int k = first; k < i && !innerCall; k++) {
+            std::string inner;
+            if (code.instructions[k].opcode == IROpcode::CALL_FUNCTION &&
+                isStringOperand(code.instructions[k].operand1, inner)) {
+                auto innerIt = procs.find(inner);
+                innerCall = innerIt != procs.end() && innerIt->second.inlinable;
+            }
+        }
+        if (innerCall) {
+            continue;
+        }
+
+        sites.push_back({first, i, &callee});
+        siteCalls.insert(i);
+        limit = first;
+    }
+
+    if (sites.empty()) {
+        return false;
+    }
+    std::reverse(sites.begin(), sites.end());
+
+    // Procedures that lose their last caller
+    std::unordered_set<std::string> inlinedNow;
+    for (const auto& site : sites) {
+        inlinedNow.insert(site.callee->name);
+    }
+    std::vector<const Procedure*> dead;
+    for (const auto& name : inlinedNow) {
+        const Procedure& proc = procs[name];
+        bool referenced = false;
+        for (int i = 0; i < count && !referenced; i++) {
+            if (i >= proc.defineIndex && i <= proc.endIndex) {
+                continue;
+            }
+            referenced = !siteCalls.count(i) && referencesProcedure(code.instructions[i], name);
+        }
+        if (!referenced) {
+            dead.push_back(&proc);
+        }
+    }
+
+    std::vector<IRInstruction> rewritten;
+    rewritten.reserve(count);
+    std::vector<int> newIndex(count + 1, 0);
+    size_t nextSite = 0;
+
+    for (int i = 0; i < count; i++) {
+        newIndex[i] = static_cast<int>(rewritten.size());
+
+        const Procedure* removedProc = nullptr;
+        for (const auto* proc : dead) {
+            if (proc->defineIndex == i) {
+                removedProc = proc;
+            }
+        }
+        if (removedProc) {
+            for (int k = i + 1; k <= removedProc->endIndex; k++) {
+                newIndex[k] = newIndex[i];
+            }
+            m_stats.instructionsRemoved += removedProc->endIndex - i + 1;
+            i = removedProc->endIndex;
+            continue;
+        }
+
+        if (nextSite < sites.size() && sites[nextSite].first == i) {
+            const Site& site = sites[nextSite++];
+
+            std::vector<IRInstruction> expansion;
+            std::unordered_set<int> removed;
+            expandCall(code, site.call, *site.callee, expansion, removed);
+
+            for (int k = site.first; k < site.call; k++) {
+                newIndex[k] = static_cast<int>(rewritten.size());
+                if (!removed.count(k)) {
+                    rewritten.push_back(code.instructions[k]);
+                }
+            }
+            newIndex[site.call] = static_cast<int>(rewritten.size());
+            rewritten.insert(rewritten.end(), expansion.begin(), expansion.end());
+
+            // Lines already inlined into the callee keep their own procedure
+            for (int k = site.callee->bodyStart; k < site.callee->endIndex; k++) {
+                int line = code.instructions[k].sourceLineNumber;
+                if (line > 0) {
+                    code.inlinedLines.emplace(line, site.callee->name);
+                }
+            }
+
+            m_stats.optimizationsApplied++;
+            m_stats.patternsMatched++;
+            m_stats.instructionsRemoved += 1 + static_cast<int>(removed.size());
+            m_stats.instructionsAdded += static_cast<int>(expansion.size());
+            m_inlinedCalls[site.callee->name]++;
+
+            i = site.call;
+            continue;
+        }
+
+        rewritten.push_back(code.instructions[i]);
+    }
+    newIndex[count] = static_cast<int>(rewritten.size());
+
+    code.instructions = std::move(rewritten);
+
+    // Rebuild address maps
+    code.labelToAddress.clear();
+    for (size_t i = 0; i < code.instructions.size(); i++) {
+        if (code.instructions[i].opcode == IROpcode::LABEL) {
+            int labelId = labelOperand(code.instructions[i].operand1);
+            if (labelId >= 0) {
+                code.labelToAddress[labelId] = static_cast<int>(i);
+            }
+        }
+    }
+    for (auto& [line, address] : code.lineToAddress) {
+        if (address >= 0 && address <= count) {
+            address = newIndex[address];
+        }
+    }
+
+    return true;
+}
+
 // =============================================================================
 // Peephole Optimizer (Main Class)
 // =============================================================================
@@ -402,6 +1576,8 @@ void PeepholeOptimizer::registerPasses() {
     m_passes.push_back(std::make_unique<PeepholeConstantFoldingPass>());
     m_passes.push_back(std::make_unique<PeepholeRedundantLoadStorePass>());
     m_passes.push_back(std::make_unique<PeepholeJumpOptimizationPass>());
+    m_passes.push_back(std::make_unique<PeepholeInliningPass>());
+    m_passes.push_back(std::make_unique<PeepholeLoopInvariantCodeMotionPass>());
     
     // Aggressive optimizations (O2+)
     m_passes.push_back(std::make_unique<PeepholeDeadCodeEliminationPass>());
@@ -495,6 +1671,13 @@ void PeepholeOptimizer::setOptimizationLevel(int level) {
     m_optimizationLevel = level;
 }
 
+void PeepholeOptimizer::setInlineBudget(int budget) {
+    auto* pass = static_cast<PeepholeInliningPass*>(getPass("PeepholeInlining"));
+    if (pass) {
+        pass->setSizeBudget(budget < 0 ? 0 : budget);
+    }
+}
+
 void PeepholeOptimizer::enablePass(const std::string& passName) {
     auto* pass = getPass(passName);
     if (pass) {
@@ -589,6 +1772,56 @@ std::string PeepholeOptimizer::generateReport() const {
         oss << "\n";
     }
     
+    // Per-loop hoisting
+    auto licmIt = m_passMap.find("PeepholeLoopInvariantCodeMotion");
+    if (licmIt != m_passMap.end()) {
+        const auto* licm = static_cast<const PeepholeLoopInvariantCodeMotionPass*>(licmIt->second);
+        const auto& records = licm->getLoopRecords();
+        if (!records.empty()) {
+            oss << "Loop-Invariant Code Motion:\n";
+            oss << "  " << std::left << std::setw(30) << "Loop"
+                << std::right << std::setw(8) << "Line"
+                << std::setw(8) << "Depth"
+                << std::setw(12) << "Hoisted"
+                << std::setw(14) << "Instructions"
+                << "\n";
+            oss << "  " << std::string(72, '-') << "\n";
+            for (const auto& [ordinal, record] : records) {
+                std::string name = record.loopKind;
+                if (!record.loopVariable.empty()) {
+                    name += " " + record.loopVariable;
+                }
+                oss << "  " << std::left << std::setw(30) << name
+                    << std::right << std::setw(8) << record.sourceLineNumber
+                    << std::setw(8) << record.depth
+                    << std::setw(12) << record.expressionsHoisted
+                    << std::setw(14) << record.instructionsHoisted
+                    << "\n";
+            }
+            oss << "\n";
+        }
+    }
+
+    // Per-procedure inlining
+    auto inlineIt = m_passMap.find("PeepholeInlining");
+    if (inlineIt != m_passMap.end()) {
+        const auto* inliner = static_cast<const PeepholeInliningPass*>(inlineIt->second);
+        const auto& calls = inliner->getInlinedCalls();
+        if (!calls.empty()) {
+            oss << "Procedure Inlining (budget " << inliner->getSizeBudget() << " instructions):\n";
+            oss << "  " << std::left << std::setw(30) << "Procedure"
+                << std::right << std::setw(12) << "Call Sites"
+                << "\n";
+            oss << "  " << std::string(42, '-') << "\n";
+            for (const auto& [name, sites] : calls) {
+                oss << "  " << std::left << std::setw(30) << name
+                    << std::right << std::setw(12) << sites
+                    << "\n";
+            }
+            oss << "\n";
+        }
+    }
+    
     // Pass descriptions
     oss << "Available Passes:\n";
     for (const auto& pass : m_passes) {
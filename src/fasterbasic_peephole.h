@@ -13,6 +13,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_set>
 #include <memory>
 #include <functional>
 #include <sstream>
@@ -304,6 +305,136 @@ public:
     bool optimize(IRCode& code) override;
 };
 
+// =============================================================================
+// Procedure Inlining Pass
+// =============================================================================
+
+class PeepholeInliningPass : public PeepholePass {
+public:
+    std::string getName() const override { return "PeepholeInlining"; }
+
+    std::string getDescription() const override {
+        return "Copies small non-recursive FUNCTION/SUB bodies into their call sites";
+    }
+
+    bool optimize(IRCode& code) override;
+
+    void resetStats() override;
+
+    // Largest body, in IR instructions, copied into a call site (0 = off).
+    // A procedure with a single call site may use twice the budget since its
+    // definition goes away.
+    void setSizeBudget(int budget) { m_sizeBudget = budget; }
+    int getSizeBudget() const { return m_sizeBudget; }
+
+    // Call sites replaced, keyed by procedure name
+    const std::map<std::string, int>& getInlinedCalls() const { return m_inlinedCalls; }
+
+private:
+    struct Procedure {
+        std::string name;
+        bool isFunction = false;
+        int defineIndex = -1;
+        int bodyStart = -1;
+        int endIndex = -1;                       // END_FUNCTION / END_SUB
+        int size = 0;                            // Body instructions, NOPs excluded
+        int callSites = 0;
+        bool inlinable = false;
+        std::vector<std::string> parameters;
+        std::unordered_set<std::string> stored;  // Variables the body assigns
+        std::unordered_set<std::string> globals; // Non-parameter variables used
+    };
+
+    // Find DEFINE_FUNCTION/DEFINE_SUB ... END_* regions and their parameters
+    void collectProcedures(const IRCode& code, std::map<std::string, Procedure>& procs) const;
+
+    // Body shape and cost checks
+    bool isInlinable(const IRCode& code, Procedure& proc) const;
+
+    // Substitute simple arguments (recorded in `substituted` / `removed`);
+    // returns the parameters that still need a temporary
+    std::vector<std::string> bindArguments(const IRCode& code, int callIndex,
+                                           const Procedure& callee,
+                                           std::map<std::string, IRInstruction>& substituted,
+                                           std::unordered_set<int>& removed) const;
+
+    // Append the expansion of the call at callIndex; `removed` receives the
+    // argument instructions folded into the body
+    void expandCall(const IRCode& code, int callIndex, const Procedure& callee,
+                    std::vector<IRInstruction>& out, std::unordered_set<int>& removed);
+
+    int m_sizeBudget = 32;
+    int m_nextTemp = 1;
+    std::map<std::string, int> m_inlinedCalls;
+};
+
+// =============================================================================
+// Loop-Invariant Code Motion Pass
+// =============================================================================
+
+// Hoisting result for one loop, reported under --opt-stats
+struct LoopHoistRecord {
+    std::string loopKind;        // "FOR", "FOR IN", "WHILE", "REPEAT", "DO"
+    std::string loopVariable;    // Counter variable (FOR / FOR IN only)
+    int sourceLineNumber;        // BASIC line of the loop opener
+    int depth;                   // Nesting depth (1 = outermost)
+    int expressionsHoisted;      // Invariant expressions moved to the preheader
+    int instructionsHoisted;     // IR instructions moved to the preheader
+
+    LoopHoistRecord()
+        : sourceLineNumber(0)
+        , depth(0)
+        , expressionsHoisted(0)
+        , instructionsHoisted(0)
+    {}
+};
+
+class PeepholeLoopInvariantCodeMotionPass : public PeepholePass {
+public:
+    std::string getName() const override { return "PeepholeLoopInvariantCodeMotion"; }
+
+    std::string getDescription() const override {
+        return "Hoists pure loop-invariant expressions (e.g., SQR(K) / W) into loop preheaders";
+    }
+
+    bool optimize(IRCode& code) override;
+
+    void resetStats() override;
+
+    // Per-loop results keyed by loop ordinal (opener order in the program)
+    const std::map<int, LoopHoistRecord>& getLoopRecords() const { return m_loopRecords; }
+
+private:
+    // A structured loop in the IR: [preheader, closer] is re-entered on
+    // every iteration except the opener's one-time setup
+    struct LoopRegion {
+        std::string kind;
+        std::string variable;
+        int sourceLineNumber = 0;
+        int preheader = -1;      // Insertion point for hoisted code (-1 = unknown)
+        int opener = -1;         // FOR_INIT / WHILE_START / ...
+        int closer = -1;         // FOR_NEXT / WEND / ...
+        int parent = -1;
+        int depth = 1;
+    };
+
+    // Match loop openers and closers; returns false on unstructured IR
+    bool findLoops(const IRCode& code, std::vector<LoopRegion>& loops) const;
+
+    // Loop-wide checks: control entering from outside, user code, stores
+    bool isHoistable(const IRCode& code, const LoopRegion& loop,
+                     const std::map<int, std::vector<int>>& jumpSources) const;
+    void collectStores(const IRCode& code, const LoopRegion& loop,
+                       std::unordered_set<std::string>& stored, bool& unknownStores) const;
+
+    // Registry lookup: known-pure builtin functions
+    bool isPureBuiltin(const std::string& name) const;
+    bool returnsString(const std::string& name) const;
+
+    int m_nextTemp = 1;
+    std::map<int, LoopHoistRecord> m_loopRecords;
+};
+
 // =============================================================================
 // Peephole Optimizer (Main Class)
 // =============================================================================
@@ -325,6 +456,9 @@ public:
     
     void setTraceEnabled(bool enabled) { m_traceEnabled = enabled; }
     bool isTraceEnabled() const { return m_traceEnabled; }
+
+    // Size budget for FUNCTION/SUB inlining (0 disables it)
+    void setInlineBudget(int budget);
     
     // Pass management
     void enablePass(const std::string& passName);
@@ -0,0 +1,254 @@
+//
+// fasterbasic_profiler.cpp
+// FasterBASIC - Sampling Profiler Implementation
+//
+// The sampler itself is a few lines of Lua around jit.profile: every sample
+// records the VM state and the Lua stack (outermost frame first) as one
+// string, counted in a table. Mapping Lua lines to BASIC lines happens once,
+// after the run, so the sampling callback stays cheap.
+//
+
+#include "fasterbasic_profiler.h"
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <set>
+#include <cstring>
+#include <cstdlib>
+
+extern "C" {
+#include <lua.h>
+#include <lauxlib.h>
+}
+
+namespace FasterBASIC {
+
+// Records at most the 64 innermost frames per sample, outermost first
+static const char* const COLLECTOR_SOURCE =
+    "local profile = require('jit.profile')\n"
+    "local dumpstack = profile.dumpstack\n"
+    "local counts = {}\n"
+    "local function sample(thread, samples, vmstate)\n"
+    "    local key = vmstate .. dumpstack(thread, 'l;', -64)\n"
+    "    counts[key] = (counts[key] or 0) + samples\n"
+    "end\n"
+    "return {\n"
+    "    start = function(mode) profile.start(mode, sample) end,\n"
+    "    stop = function() profile.stop() return counts end,\n"
+    "}\n";
+
+// =============================================================================
+// Sampling
+// =============================================================================
+
+SampleProfiler::SampleProfiler(int intervalMs)
+    : m_intervalMs(intervalMs > 0 ? intervalMs : 1)
+    , m_collectorRef(LUA_NOREF)
+    , m_totalSamples(0)
+    , m_outsideSamples(0)
+{
+}
+
+bool SampleProfiler::start(lua_State* L) {
+    if (luaL_loadbuffer(L, COLLECTOR_SOURCE, strlen(COLLECTOR_SOURCE), "=fbc_profiler") != 0 ||
+        lua_pcall(L, 0, 1, 0) != 0) {
+        m_error = std::string("jit.profile unavailable: ") + lua_tostring(L, -1);
+        lua_pop(L, 1);
+        return false;
+    }
+    m_collectorRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    // "l": attribute samples to lines, "i<n>": sampling interval in ms
+    std::string mode = "li" + std::to_string(m_intervalMs);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, m_collectorRef);
+    lua_getfield(L, -1, "start");
+    lua_pushstring(L, mode.c_str());
+    if (lua_pcall(L, 1, 0, 0) != 0) {
+        m_error = std::string("Cannot start profiler: ") + lua_tostring(L, -1);
+        lua_pop(L, 2);
+        luaL_unref(L, LUA_REGISTRYINDEX, m_collectorRef);
+        m_collectorRef = LUA_NOREF;
+        return false;
+    }
+    lua_pop(L, 1);
+    return true;
+}
+
+void SampleProfiler::stop(lua_State* L, const LuaSourceMap& sourceMap) {
+    if (m_collectorRef == LUA_NOREF) return;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, m_collectorRef);
+    lua_getfield(L, -1, "stop");
+    if (lua_pcall(L, 0, 1, 0) != 0) {
+        m_error = std::string("Cannot stop profiler: ") + lua_tostring(L, -1);
+        lua_pop(L, 2);
+        luaL_unref(L, LUA_REGISTRYINDEX, m_collectorRef);
+        m_collectorRef = LUA_NOREF;
+        return;
+    }
+
+    lua_pushnil(L);
+    while (lua_next(L, -2) != 0) {
+        size_t len = 0;
+        const char* key = lua_tolstring(L, -2, &len);
+        int count = (int)lua_tointeger(L, -1);
+        lua_pop(L, 1);
+        if (!key || len == 0 || count <= 0) continue;
+
+        char vmState = key[0];
+        bool inRuntime = false;
+        std::vector<Frame> frames = mapStack(std::string(key + 1, len - 1), sourceMap, inRuntime);
+
+        m_totalSamples += count;
+        m_vmStates[vmState] += count;
+
+        if (frames.empty()) {
+            m_outsideSamples += count;
+            m_folded["[outside program]"] += count;
+            continue;
+        }
+
+        // Self time goes to the innermost BASIC line, including time spent
+        // in runtime helpers it called
+        const Frame& leaf = frames.back();
+        LineStats& self = m_lines[leaf.line];
+        self.function = leaf.function;
+        self.selfSamples += count;
+        if (vmState == 'N') self.compiledSamples += count;
+        m_functionSelf[leaf.function] += count;
+
+        // Inclusive time counts each line once per sample, however deep
+        // the recursion
+        std::set<int> seen;
+        std::string folded;
+        for (const auto& frame : frames) {
+            if (seen.insert(frame.line).second) {
+                LineStats& stats = m_lines[frame.line];
+                if (stats.function.empty()) stats.function = frame.function;
+                stats.totalSamples += count;
+            }
+            if (!folded.empty()) folded += ";";
+            folded += frameName(frame);
+        }
+        if (inRuntime) folded += ";[runtime]";
+        m_folded[folded] += count;
+    }
+    lua_pop(L, 2);
+
+    luaL_unref(L, LUA_REGISTRYINDEX, m_collectorRef);
+    m_collectorRef = LUA_NOREF;
+}
+
+// Turn "chunk:line;chunk:line;..." (outermost first) into BASIC frames.
+// Frames outside the program chunk, or on lines that belong to no BASIC
+// line (prelude helpers), are runtime code: they are dropped, and
+// inRuntime records whether the sample was taken inside one.
+std::vector<SampleProfiler::Frame> SampleProfiler::mapStack(const std::string& stack,
+                                                            const LuaSourceMap& sourceMap,
+                                                            bool& inRuntime) const {
+    // Frames of the program chunk appear as "fbc_program:<line>"
+    std::vector<Frame> frames;
+    std::string prefix = std::string(LuaSourceMap::CHUNK_NAME + 1) + ":";
+    size_t pos = 0;
+    inRuntime = false;
+    while (pos < stack.size()) {
+        size_t end = stack.find(';', pos);
+        if (end == std::string::npos) end = stack.size();
+        int basicLine = 0;
+        std::string function;
+        if (stack.compare(pos, prefix.size(), prefix) == 0) {
+            int luaLine = atoi(stack.c_str() + pos + prefix.size());
+            basicLine = sourceMap.basicLineAt(luaLine);
+            function = sourceMap.functionAt(luaLine);
+        }
+        if (basicLine > 0) {
+            frames.push_back({function.empty() ? "main" : function, basicLine});
+            inRuntime = false;
+        } else if (!frames.empty()) {
+            inRuntime = true;
+        }
+        pos = end + 1;
+    }
+    return frames;
+}
+
+std::string SampleProfiler::frameName(const Frame& frame) {
+    return frame.function + ":" + std::to_string(frame.line);
+}
+
+// =============================================================================
+// Reporting
+// =============================================================================
+
+void SampleProfiler::writeReport(std::ostream& out, size_t maxLines) const {
+    out << "\n=== Profile: " << m_totalSamples << " samples (" << m_intervalMs << " ms interval) ===\n";
+    if (m_totalSamples == 0) {
+        out << "  No samples collected (program finished too quickly)\n";
+        return;
+    }
+
+    auto percent = [this](int samples) { return 100.0 * samples / m_totalSamples; };
+    out << std::fixed << std::setprecision(1);
+
+    // jit.profile VM states
+    static const std::pair<char, const char*> stateNames[] = {
+        {'N', "compiled"}, {'I', "interpreted"}, {'C', "C code"}, {'G', "GC"}, {'J', "JIT compiler"}
+    };
+    out << "  VM state:";
+    for (const auto& [state, name] : stateNames) {
+        auto it = m_vmStates.find(state);
+        if (it != m_vmStates.end()) {
+            out << "  " << percent(it->second) << "% " << name;
+        }
+    }
+    out << "\n\n";
+
+    // Hot lines, by self time
+    std::vector<std::pair<int, const LineStats*>> lines;
+    for (const auto& [line, stats] : m_lines) {
+        if (stats.selfSamples > 0) lines.emplace_back(line, &stats);
+    }
+    std::sort(lines.begin(), lines.end(), [](const auto& a, const auto& b) {
+        if (a.second->selfSamples != b.second->selfSamples) return a.second->selfSamples > b.second->selfSamples;
+        return a.first < b.first;
+    });
+
+    out << "   Self%  Total%  Samples   JIT%    Line  Function\n";
+    for (size_t i = 0; i < lines.size() && i < maxLines; i++) {
+        const LineStats& stats = *lines[i].second;
+        out << "  " << std::setw(6) << percent(stats.selfSamples) << "%"
+            << " " << std::setw(6) << percent(stats.totalSamples) << "%"
+            << " " << std::setw(8) << stats.selfSamples
+            << " " << std::setw(6) << (100.0 * stats.compiledSamples / stats.selfSamples) << "%"
+            << " " << std::setw(7) << lines[i].first
+            << "  " << stats.function << "\n";
+    }
+    if (lines.size() > maxLines) {
+        out << "  ... " << (lines.size() - maxLines) << " more lines\n";
+    }
+    if (m_outsideSamples > 0) {
+        out << "  (" << m_outsideSamples << " samples outside any BASIC line)\n";
+    }
+
+    // Self time per SUB/FUNCTION
+    std::vector<std::pair<std::string, int>> functions(m_functionSelf.begin(), m_functionSelf.end());
+    std::sort(functions.begin(), functions.end(), [](const auto& a, const auto& b) {
+        return a.second > b.second;
+    });
+    out << "\n   Self%  Function\n";
+    for (const auto& [name, samples] : functions) {
+        out << "  " << std::setw(6) << percent(samples) << "%  " << name << "\n";
+    }
+    out << "\n";
+}
+
+bool SampleProfiler::writeFolded(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file.is_open()) return false;
+    for (const auto& [stack, samples] : m_folded) {
+        file << stack << " " << samples << "\n";
+    }
+    return true;
+}
+
+} // namespace FasterBASIC
@@ -0,0 +1,79 @@
+//
+// fasterbasic_profiler.h
+// FasterBASIC - Sampling Profiler
+//
+// Samples a running program with LuaJIT's jit.profile and maps each sample
+// back to BASIC lines and SUB/FUNCTION names through the generator's
+// LuaSourceMap. Produces a hot-line report and a folded-stack file for
+// flamegraph tools.
+//
+
+#ifndef FASTERBASIC_PROFILER_H
+#define FASTERBASIC_PROFILER_H
+
+#include "fasterbasic_lua_codegen.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <ostream>
+
+struct lua_State;
+
+namespace FasterBASIC {
+
+// =============================================================================
+// Sample Profiler
+// =============================================================================
+
+class SampleProfiler {
+public:
+    explicit SampleProfiler(int intervalMs = 1);
+
+    // Start sampling the given state; the program must be loaded under
+    // LuaSourceMap::CHUNK_NAME. False (see getError) when jit.profile is
+    // unavailable
+    bool start(lua_State* L);
+
+    // Stop sampling and fold the collected stacks through the source map
+    void stop(lua_State* L, const LuaSourceMap& sourceMap);
+
+    // Sorted hot-line report (self and inclusive time per BASIC line)
+    void writeReport(std::ostream& out, size_t maxLines = 25) const;
+
+    // One "frame;frame;... count" line per distinct stack (flamegraph.pl input)
+    bool writeFolded(const std::string& path) const;
+
+    int getTotalSamples() const { return m_totalSamples; }
+    const std::string& getError() const { return m_error; }
+
+private:
+    // A BASIC-level frame: SUB/FUNCTION name and BASIC line
+    struct Frame {
+        std::string function;
+        int line;
+    };
+
+    struct LineStats {
+        std::string function;
+        int selfSamples = 0;
+        int totalSamples = 0;
+        int compiledSamples = 0;  // Self samples taken in JIT-compiled code
+    };
+
+    std::vector<Frame> mapStack(const std::string& stack, const LuaSourceMap& sourceMap, bool& inRuntime) const;
+    static std::string frameName(const Frame& frame);
+
+    int m_intervalMs;
+    int m_collectorRef;
+    int m_totalSamples;
+    int m_outsideSamples;                       // Samples with no BASIC frame on the stack
+    std::map<char, int> m_vmStates;             // jit.profile vmstate -> samples
+    std::map<int, LineStats> m_lines;           // BASIC line -> samples
+    std::map<std::string, int> m_functionSelf;  // SUB/FUNCTION -> self samples
+    std::map<std::string, int> m_folded;        // Folded stack -> samples
+    std::string m_error;
+};
+
+} // namespace FasterBASIC
+
+#endif // FASTERBASIC_PROFILER_H
@@ -247,6 +247,7 @@ bool SemanticAnalyzer::analyze(Program& program, const CompilerOptions& options)
     m_symbolTable.unicodeMode = options.unicodeMode;
     m_symbolTable.errorTracking = options.errorTracking;
     m_symbolTable.cancellableLoops = options.cancellableLoops;
+    m_symbolTable.lineCounts = options.lineCounts;
     m_cancellableLoops = options.cancellableLoops;
     
     // Clear control flow stacks
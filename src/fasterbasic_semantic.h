@@ -209,8 +209,9 @@ struct SymbolTable {
     int nextLabelId = 10000;  // Start label IDs at 10000 to avoid conflicts with line numbers
     int arrayBase = 1;  // OPTION BASE: 0 or 1 (default 1 to match Lua arrays)
     bool unicodeMode = false;  // OPTION UNICODE: if true, strings are represented as codepoint arrays
-    bool errorTracking = true;  // OPTION ERROR: if true, emit _LINE tracking for error messages
+    bool errorTracking = true;  // OPTION ERROR: if true, emit a Lua line -> BASIC line map for error messages
     bool cancellableLoops = true;  // OPTION CANCELLABLE: if true, inject script cancellation checks in loops
+    bool lineCounts = false;  // OPTION PROFILE COUNTS: if true, count entries into every BASIC line
     bool eventsUsed = false;  // EVENT DETECTION: if true, program uses ON EVENT statements and needs event processing code
 
     std::string toString() const;
@@ -0,0 +1,144 @@
+//
+// fasterbasic_threadpool.cpp
+// FasterBASIC - Work-Stealing Thread Pool Implementation
+//
+
+#include "fasterbasic_threadpool.h"
+
+namespace FasterBASIC {
+
+ThreadPool::ThreadPool(int threads)
+    : m_threadCount(resolveThreadCount(threads))
+{
+    for (int i = 0; i < m_threadCount; i++) {
+        m_queues.push_back(std::make_unique<WorkQueue>());
+    }
+    // The caller is worker 0
+    for (int i = 1; i < m_threadCount; i++) {
+        m_threads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+int ThreadPool::resolveThreadCount(int requested) {
+    if (requested > 0) {
+        return requested;
+    }
+    unsigned int hardware = std::thread::hardware_concurrency();
+    return hardware > 0 ? static_cast<int>(hardware) : 1;
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t, int)>& task) {
+    if (count == 0) {
+        return;
+    }
+    if (m_threadCount == 1 || count == 1) {
+        for (size_t i = 0; i < count; i++) {
+            task(i, 0);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = &task;
+        m_pending = count;
+        m_error = nullptr;
+    }
+
+    // Neighbouring procedures go to the same worker; stealing evens out
+    // whatever the split gets wrong
+    for (int w = 0; w < m_threadCount; w++) {
+        size_t first = count * w / m_threadCount;
+        size_t last = count * (w + 1) / m_threadCount;
+        std::lock_guard<std::mutex> lock(m_queues[w]->mutex);
+        for (size_t i = first; i < last; i++) {
+            m_queues[w]->tasks.push_back(i);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_batch++;
+    }
+    m_wake.notify_all();
+
+    runTasks(0);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_pending == 0; });
+    m_task = nullptr;
+    if (m_error) {
+        std::exception_ptr error = m_error;
+        m_error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreadPool::workerLoop(int worker) {
+    uint64_t seenBatch = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stopping || m_batch != seenBatch; });
+            if (m_stopping) {
+                return;
+            }
+            seenBatch = m_batch;
+        }
+        runTasks(worker);
+    }
+}
+
+void ThreadPool::runTasks(int worker) {
+    size_t index;
+    while (takeTask(worker, index)) {
+        try {
+            (*m_task)(index, worker);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_error) {
+                m_error = std::current_exception();
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_pending == 0) {
+            m_done.notify_all();
+        }
+    }
+}
+
+bool ThreadPool::takeTask(int worker, size_t& task) {
+    {
+        WorkQueue& own = *m_queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+    for (int i = 1; i < m_threadCount; i++) {
+        WorkQueue& victim = *m_queues[(worker + i) % m_threadCount];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace FasterBASIC
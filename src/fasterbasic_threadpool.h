@@ -0,0 +1,80 @@
+//
+// fasterbasic_threadpool.h
+// FasterBASIC - Work-Stealing Thread Pool
+//
+// Runs a batch of independent compiler tasks (one per SUB/FUNCTION body)
+// across worker threads. Each worker owns a deque of task indices: it takes
+// work from the front of its own deque and, once that is empty, steals from
+// the back of another worker's, so one long procedure does not leave the
+// rest of the pool idle. Tasks write only to their own result slot and the
+// caller combines the slots in task order, which keeps the output the same
+// for any number of threads.
+//
+
+#ifndef FASTERBASIC_THREADPOOL_H
+#define FASTERBASIC_THREADPOOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace FasterBASIC {
+
+// =============================================================================
+// Thread Pool
+// =============================================================================
+
+class ThreadPool {
+public:
+    // threads <= 0: one per hardware thread
+    explicit ThreadPool(int threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Call task(index, worker) for every index in [0, count) and wait for
+    // all of them. worker is in [0, getThreadCount()) and tasks with the same
+    // worker never overlap, so it can select per-worker scratch state; the
+    // calling thread is worker 0. The first exception a task throws is
+    // rethrown once the batch has finished
+    void run(size_t count, const std::function<void(size_t, int)>& task);
+
+    int getThreadCount() const { return m_threadCount; }
+
+    // Threads a pool asked for `requested` threads would start
+    static int resolveThreadCount(int requested);
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    void workerLoop(int worker);
+    void runTasks(int worker);
+    bool takeTask(int worker, size_t& task);
+
+    int m_threadCount;
+    std::vector<std::thread> m_threads;
+    std::vector<std::unique_ptr<WorkQueue>> m_queues;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;  // Workers: a batch was posted, or shutdown
+    std::condition_variable m_done;  // Caller: the last task of the batch finished
+    const std::function<void(size_t, int)>* m_task = nullptr;
+    uint64_t m_batch = 0;            // Batches posted so far
+    size_t m_pending = 0;            // Tasks of the current batch not yet finished
+    std::exception_ptr m_error;
+    bool m_stopping = false;
+};
+
+} // namespace FasterBASIC
+
+#endif // FASTERBASIC_THREADPOOL_H
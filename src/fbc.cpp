@@ -12,6 +12,11 @@
 #include "fasterbasic_ircode.h"
 #include "fasterbasic_lua_codegen.h"
 #include "fasterbasic_data_preprocessor.h"
+#include "fasterbasic_profiler.h"
+#include "fasterbasic_jitdiag.h"
+#include "fasterbasic_coverage.h"
+#include "fasterbasic_compile.h"
+#include "fasterbasic_threadpool.h"
 #include "modular_commands.h"
 #include "command_registry_core.h"
 #include "../runtime/data_lua_bindings.h"
@@ -21,9 +26,17 @@
 #include <sstream>
 #include <string>
 #include <cstring>
+#include <cstdlib>
 #include <chrono>
 #include <csignal>
 #include <atomic>
+#include <algorithm>
+#include <filesystem>
+#include <iomanip>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 extern "C" {
 #include <lua.h>
@@ -49,7 +62,11 @@ using namespace FasterBASIC;
 using namespace FasterBASIC::ModularCommands;
 
 // Global flag for script interruption (set by SIGINT handler)
-static std::atomic<bool> g_shouldStopScript(false);
+// Kept as a 32-bit word so generated code can poll it directly through FFI
+static std::atomic<int32_t> g_shouldStopScript(0);
+
+// Lua state of the running program (for the SIGINT count hook)
+static lua_State* volatile g_runningState = nullptr;
 
 // Copy text to macOS clipboard using pbcopy
 void copyToClipboard(const std::string& text) {
@@ -64,6 +81,8 @@ void copyToClipboard(const std::string& text) {
 std::string formatErrorForClipboard(const std::string& luaError) {
     // The error format can be:
     // "[string ...]:nnn: Runtime error at BASIC line N: [string ...]:nnn: actual error message"
+    // (the generated footer raises "Runtime error at BASIC line N: ..." itself, with the
+    // BASIC line looked up in the chunk's line map)
     // We want to extract: "Runtime error at BASIC line N: actual error message"
     
     size_t linePos = luaError.find("Runtime error at BASIC line ");
@@ -114,17 +133,30 @@ std::string formatErrorForClipboard(const std::string& luaError) {
     return luaError;
 }
 
+// Count hook armed by the SIGINT handler: stops code that never reaches a
+// loop poll (GOTO loops and other interpreted code; hooks do not run in traces)
+static void stopScriptHook(lua_State* L, lua_Debug* ar) {
+    (void)ar;
+    lua_sethook(L, nullptr, 0, 0);
+    luaL_error(L, "Interrupted by user");
+}
+
 // Signal handler for Ctrl+C (SIGINT)
 void signalHandler(int signal) {
     if (signal == SIGINT) {
-        g_shouldStopScript.store(true);
+        g_shouldStopScript.store(1);
+        // lua_sethook is safe to call from a signal handler
+        lua_State* L = g_runningState;
+        if (L) {
+            lua_sethook(L, stopScriptHook, LUA_MASKCALL | LUA_MASKRET | LUA_MASKCOUNT, 1);
+        }
         std::cerr << "\n^C (Interrupted by user)\n";
     }
 }
 
 // Lua binding for shouldStopScript()
 static int lua_shouldStopScript(lua_State* L) {
-    lua_pushboolean(L, g_shouldStopScript.load());
+    lua_pushboolean(L, g_shouldStopScript.load() != 0);
     return 1;
 }
 
@@ -145,6 +177,380 @@ void initializeFBCCommandRegistry() {
     // For now, fbc uses only core commands
 }
 
+// Report file next to the program: prog.bas -> prog<extension>
+static std::string replaceExtension(const std::string& path, const std::string& extension) {
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    bool hasExtension = dot != std::string::npos && (slash == std::string::npos || dot > slash);
+    return (hasExtension ? path.substr(0, dot) : path) + extension;
+}
+
+// Runtime modules and host hooks every program's Lua state starts with
+static void registerRuntime(lua_State* L) {
+    // Open standard libraries
+    luaL_openlibs(L);
+    
+    // Register runtime modules (unicode, bitwise, constants, file I/O) directly in Lua state
+    // This makes them always available without needing external shared libraries
+    register_unicode_module(L);
+    register_bitwise_module(L);
+    register_constants_module(L);
+    
+    FasterBASIC::register_fileio_functions(L);
+    FasterBASIC::registerDataBindings(L);
+    FasterBASIC::registerTerminalBindings(L);
+    
+    // Register shouldStopScript for Ctrl+C interruption
+    lua_pushcfunction(L, lua_shouldStopScript);
+    lua_setglobal(L, "shouldStopScript");
+    
+    // Publish the stop flag itself so loops can poll it without a C call
+    lua_pushlightuserdata(L, (void*)&g_shouldStopScript);
+    lua_setglobal(L, "__fbc_stop_flag");
+}
+
+// =============================================================================
+// Compilation
+// =============================================================================
+//
+// The pipeline itself is compileProgram() (fasterbasic_compile.cpp); what
+// is left here feeds its result to the runtime.
+
+static double millisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+    auto now = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(now - start).count();
+}
+
+// Load a program's DATA segment into the runtime
+static void loadDataSegment(const CompiledProgram& program) {
+    if (program.dataValues.empty()) return;
+    FasterBASIC::initializeDataManager(program.dataValues);
+    for (const auto& entry : program.dataLineRestorePoints) {
+        FasterBASIC::addDataRestorePoint(entry.first, entry.second);
+    }
+    for (const auto& entry : program.dataLabelRestorePoints) {
+        FasterBASIC::addDataRestorePointByLabel(entry.first, entry.second);
+    }
+}
+
+// =============================================================================
+// Batch Mode (--batch)
+// =============================================================================
+//
+// Compiles many programs in one process: the command registry, the lexer
+// keyword tables and the runtime prelude are set up once and shared, and
+// the programs compile concurrently on a thread pool. The runtime keeps
+// process-wide state (DATA, open files, constants), so programs run one at
+// a time in list order, each in a fresh Lua state, while the next group
+// compiles in the background.
+
+struct BatchSettings {
+    std::string outputDir;  // -o: write <dir>/<name>.lua instead of running
+    int threads = 0;        // Programs compiled at once (0 = one per hardware thread)
+    bool verbose = false;
+    CompileSettings compile;
+};
+
+struct BatchJob {
+    enum class Status { PENDING, OK, COMPILE_ERROR, RUNTIME_ERROR, SKIPPED };
+
+    std::string path;
+    std::string outputPath;  // Compile-only mode
+    Status status = Status::PENDING;
+    std::string error;
+    double compileMs = 0.0;
+    double runMs = 0.0;
+    CompiledProgram program;  // What the run needs from the compile
+};
+
+// Programs of a batch: the *.bas files directly in a directory, or the
+// paths listed one per line in a file (relative to the list; blank lines
+// and lines starting with '#' are skipped)
+static bool collectBatchPrograms(const std::string& source, std::vector<std::string>& paths,
+                                 std::string& error) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    if (fs::is_directory(source, ec)) {
+        for (const auto& entry : fs::directory_iterator(source, ec)) {
+            std::string extension = entry.path().extension().string();
+            std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+            if (entry.is_regular_file(ec) && extension == ".bas") {
+                paths.push_back(entry.path().string());
+            }
+        }
+        std::sort(paths.begin(), paths.end());
+    } else {
+        std::ifstream list(source);
+        if (!list.is_open()) {
+            error = "Cannot open batch list: " + source;
+            return false;
+        }
+        fs::path base = fs::path(source).parent_path();
+        std::string line;
+        while (std::getline(list, line)) {
+            size_t first = line.find_first_not_of(" \t\r");
+            if (first == std::string::npos || line[first] == '#') continue;
+            size_t last = line.find_last_not_of(" \t\r");
+            fs::path path = line.substr(first, last - first + 1);
+            paths.push_back(path.is_absolute() ? path.string() : (base / path).string());
+        }
+    }
+    if (paths.empty()) {
+        error = "No programs found in: " + source;
+        return false;
+    }
+    return true;
+}
+
+static void compileBatchJob(BatchJob& job, const BatchSettings& settings) {
+    auto startTime = std::chrono::high_resolution_clock::now();
+    job.status = BatchJob::Status::COMPILE_ERROR;
+    try {
+        std::ifstream file(job.path);
+        if (!file.is_open()) {
+            job.error = "Cannot open file";
+        } else {
+            std::string source((std::istreambuf_iterator<char>(file)),
+                              std::istreambuf_iterator<char>());
+            if (!compileProgram(source, job.path, settings.compile, job.program)) {
+                const auto& errors = job.program.parseErrors;
+                job.error = errors[0];
+                if (errors.size() > 1) {
+                    job.error += " (and " + std::to_string(errors.size() - 1) + " more)";
+                }
+            } else if (!job.outputPath.empty()) {
+                std::ofstream outFile(job.outputPath);
+                if (outFile.is_open()) {
+                    outFile << job.program.luaCode;
+                    job.status = BatchJob::Status::OK;
+                } else {
+                    job.error = "Cannot write to file: " + job.outputPath;
+                }
+                job.program = CompiledProgram();
+            } else {
+                job.status = BatchJob::Status::PENDING;
+            }
+        }
+    } catch (const std::exception& e) {
+        job.error = std::string("Compilation error: ") + e.what();
+        job.program = CompiledProgram();
+        job.status = BatchJob::Status::COMPILE_ERROR;
+    }
+    job.compileMs = millisecondsSince(startTime);
+}
+
+// Returns false if the shared prelude would not load; every later job
+// would fail the same way
+static bool runBatchJob(BatchJob& job, const std::string& preludeModule, const std::string& preludeBytecode) {
+    lua_State* L = luaL_newstate();
+    if (!L) {
+        job.status = BatchJob::Status::RUNTIME_ERROR;
+        job.error = "Cannot create Lua state";
+        return true;
+    }
+    registerRuntime(L);
+    set_constants_manager(&job.program.constants);
+
+    // The prelude was compiled once for the whole batch
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "preload");
+    std::string chunkName = "=" + preludeModule;
+    if (luaL_loadbuffer(L, preludeBytecode.data(), preludeBytecode.size(), chunkName.c_str()) != 0) {
+        job.status = BatchJob::Status::RUNTIME_ERROR;
+        job.error = std::string("Error loading runtime prelude: ") + lua_tostring(L, -1);
+        lua_close(L);
+        return false;
+    }
+    lua_setfield(L, -2, preludeModule.c_str());
+    lua_pop(L, 2);
+
+    FasterBASIC::clearDataManager();
+    loadDataSegment(job.program);
+
+    g_runningState = L;
+    auto startTime = std::chrono::high_resolution_clock::now();
+    job.status = BatchJob::Status::OK;
+    if (luaL_loadstring(L, job.program.luaCode.c_str()) != 0 || lua_pcall(L, 0, 0, 0) != 0) {
+        job.status = BatchJob::Status::RUNTIME_ERROR;
+        job.error = lua_tostring(L, -1);
+        std::cerr << job.error << "\n";
+    }
+    job.runMs = millisecondsSince(startTime);
+
+    g_runningState = nullptr;
+    lua_close(L);
+    FasterBASIC::clear_fileio_state();  // Files the program left open
+    job.program = CompiledProgram();
+    return true;
+}
+
+static const char* batchStatusName(BatchJob::Status status) {
+    switch (status) {
+        case BatchJob::Status::OK: return "ok";
+        case BatchJob::Status::COMPILE_ERROR: return "compile";
+        case BatchJob::Status::RUNTIME_ERROR: return "runtime";
+        case BatchJob::Status::SKIPPED: return "skipped";
+        default: return "pending";
+    }
+}
+
+static void writeBatchReport(std::ostream& out, const std::vector<BatchJob>& jobs, bool ran,
+                             int threads, double wallMs) {
+    size_t passed = 0;
+    double compileMs = 0.0;
+    double runMs = 0.0;
+    for (const auto& job : jobs) {
+        if (job.status == BatchJob::Status::OK) passed++;
+        compileMs += job.compileMs;
+        runMs += job.runMs;
+    }
+
+    out << std::fixed << std::setprecision(3);
+    out << "\n=== Batch: " << jobs.size() << " programs, " << passed << " ok, "
+        << (jobs.size() - passed) << " failed ===\n";
+    out << "\n  Status     Compile ms      Run ms  Program\n";
+    for (const auto& job : jobs) {
+        out << "  " << std::left << std::setw(8) << batchStatusName(job.status) << std::right
+            << "  " << std::setw(10) << job.compileMs << "  ";
+        if (ran && (job.status == BatchJob::Status::OK || job.status == BatchJob::Status::RUNTIME_ERROR)) {
+            out << std::setw(10) << job.runMs;
+        } else {
+            out << std::setw(10) << "-";
+        }
+        out << "  " << job.path << "\n";
+    }
+
+    bool headed = false;
+    for (const auto& job : jobs) {
+        if (job.error.empty()) continue;
+        if (!headed) {
+            out << "\n  Errors:\n";
+            headed = true;
+        }
+        std::string message = job.error.substr(0, job.error.find('\n'));
+        out << "    " << job.path << ": " << message << "\n";
+    }
+
+    out << "\n  Compile: " << compileMs << " ms over " << threads << " thread" << (threads == 1 ? "" : "s");
+    if (ran) {
+        out << "   Run: " << runMs << " ms";
+    }
+    out << "   Wall: " << wallMs << " ms\n\n";
+}
+
+static int runBatch(const std::string& source, const BatchSettings& settings) {
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::string> paths;
+    std::string error;
+    if (!collectBatchPrograms(source, paths, error)) {
+        std::cerr << "Error: " << error << "\n";
+        return 1;
+    }
+
+    std::vector<BatchJob> jobs(paths.size());
+    bool compileOnly = !settings.outputDir.empty();
+    if (compileOnly) {
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        fs::create_directories(settings.outputDir, ec);
+        std::set<std::string> names;
+        for (size_t i = 0; i < paths.size(); i++) {
+            std::string name = fs::path(paths[i]).stem().string() + ".lua";
+            if (!names.insert(name).second) {
+                std::cerr << "Error: Two programs would both be written to " << name << "\n";
+                return 1;
+            }
+            jobs[i].outputPath = (fs::path(settings.outputDir) / name).string();
+        }
+    }
+    for (size_t i = 0; i < paths.size(); i++) {
+        jobs[i].path = paths[i];
+    }
+
+    int threads = std::min(ThreadPool::resolveThreadCount(settings.threads), static_cast<int>(jobs.size()));
+    ThreadPool pool(threads);
+    auto compileRange = [&](size_t first, size_t last) {
+        pool.run(last - first, [&](size_t index, int) {
+            compileBatchJob(jobs[first + index], settings);
+        });
+    };
+    if (settings.verbose) {
+        std::cerr << "Batch: " << jobs.size() << " programs on " << threads << " threads\n";
+    }
+
+    if (compileOnly) {
+        compileRange(0, jobs.size());
+    } else {
+        // Compile the prelude once; every Lua state loads the bytecode
+        std::string preludeModule = settings.compile.config.preludeModule;
+        std::string preludeBytecode;
+        {
+            LuaCodeGenerator preludeGen(settings.compile.config);
+            std::string prelude = preludeGen.generatePreludeModule();
+            lua_State* L = luaL_newstate();
+            std::string chunkName = "=" + preludeModule;
+            if (!L || luaL_loadbuffer(L, prelude.data(), prelude.size(), chunkName.c_str()) != 0) {
+                std::cerr << "Error loading runtime prelude: " << (L ? lua_tostring(L, -1) : "no Lua state") << "\n";
+                if (L) lua_close(L);
+                return 1;
+            }
+            lua_dump(L, [](lua_State*, const void* data, size_t size, void* bytecode) {
+                static_cast<std::string*>(bytecode)->append(static_cast<const char*>(data), size);
+                return 0;
+            }, &preludeBytecode);
+            lua_close(L);
+        }
+
+        std::signal(SIGINT, signalHandler);
+        g_shouldStopScript.store(0);
+
+        // Programs compiled ahead of the one running, a few per thread
+        bool preludeFailed = false;
+        size_t window = static_cast<size_t>(threads) * 4;
+        size_t compiled = std::min(window, jobs.size());
+        compileRange(0, compiled);
+        for (size_t next = 0; next < jobs.size();) {
+            size_t ready = compiled;
+            std::thread background;
+            if (compiled < jobs.size()) {
+                size_t last = std::min(compiled + window, jobs.size());
+                background = std::thread(compileRange, compiled, last);
+                compiled = last;
+            }
+            for (; next < ready; next++) {
+                BatchJob& job = jobs[next];
+                if (preludeFailed || g_shouldStopScript.load() != 0) {
+                    if (job.status == BatchJob::Status::PENDING) job.status = BatchJob::Status::SKIPPED;
+                    continue;
+                }
+                if (job.status != BatchJob::Status::PENDING) continue;
+                if (settings.verbose) {
+                    std::cerr << "--- " << job.path << "\n";
+                }
+                std::cout.flush();
+                if (!runBatchJob(job, preludeModule, preludeBytecode)) {
+                    std::cerr << "Error: " << job.error << "\n";
+                    preludeFailed = true;
+                }
+                std::cout.flush();
+            }
+            if (background.joinable()) {
+                background.join();
+            }
+        }
+    }
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    double wallMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+    writeBatchReport(std::cerr, jobs, !compileOnly, threads, wallMs);
+
+    for (const auto& job : jobs) {
+        if (job.status != BatchJob::Status::OK) return 1;
+    }
+    return 0;
+}
+
 void printUsage(const char* programName) {
     std::cerr << "FasterBASIC Compiler and Runner - Compiles and runs BASIC programs\n\n";
     std::cerr << "Usage: " << programName << " [options] <input.bas>\n\n";
@@ -157,11 +563,27 @@ void printUsage(const char* programName) {
     std::cerr << "  -v, --verbose  Verbose output (compilation stats)\n";
     std::cerr << "  -h, --help     Show this help message\n";
     std::cerr << "  --profile      Show detailed timing for each compilation phase\n";
+    std::cerr << "  --profile-run  Sample the running program; report hot BASIC lines and write folded stacks\n";
+    std::cerr << "  --folded <file>  Folded-stack output for --profile-run (default: <program>.folded)\n";
+    std::cerr << "  --jit-diag     Report aborted JIT traces by BASIC line and generated construct\n";
+    std::cerr << "  --count        Count executions of every BASIC line (as OPTION PROFILE COUNTS); report coverage\n";
+    std::cerr << "  --counts <file>  Line count output for --count (default: <program>.counts)\n";
+    std::cerr << "  --prelude <m>  Load the shared runtime helpers with require('<m>') instead of inlining them\n";
+    std::cerr << "  --emit-prelude <file>  Write the shared runtime prelude module to <file>\n";
+    std::cerr << "  --batch <list|dir>  Compile and run many programs (the *.bas in <dir>, or one path\n";
+    std::cerr << "                 per line in <list>); -j sets programs compiled at once, -o <dir>\n";
+    std::cerr << "                 writes <dir>/<name>.lua instead of running; ends with a report\n";
     std::cerr << "\nOptimization Options:\n";
-    std::cerr << "  --opt-ast      Enable AST optimizer (constant folding, dead code)\n";
-    std::cerr << "  --opt-peep     Enable peephole optimizer (IR-level optimizations)\n";
+    std::cerr << "  --opt-ast      Enable AST optimizer (constant folding, dead code, CSE, strength reduction)\n";
+    std::cerr << "  --opt-peep     Enable peephole optimizer (IR-level optimizations, inlining, loop-invariant hoisting)\n";
     std::cerr << "  --opt-all      Enable all optimizers (AST + peephole)\n";
+    std::cerr << "  --inline <n>   Peephole inlining budget in IR instructions per FUNCTION/SUB (default 32, 0 = off)\n";
     std::cerr << "  --opt-stats    Show detailed optimization statistics\n";
+    std::cerr << "\nCode Generation Options:\n";
+    std::cerr << "  --no-var-cache Keep every variable in the vars table (no hot/cold locals)\n";
+    std::cerr << "  --no-jit-hints Omit LuaJIT-specific code (FFI arrays, JIT options)\n";
+    std::cerr << "  --buffer-mode  Use string buffers for MID$ assignment\n";
+    std::cerr << "  -j, --jobs <n> Threads compiling SUB/FUNCTION bodies (default: one per core, 1 = serial)\n";
     std::cerr << "\nBehavior:\n";
     std::cerr << "  Default:       Compile and run program immediately (no optimizers)\n";
     std::cerr << "  With -o:       Compile to file only (no execution)\n";
@@ -171,9 +593,14 @@ void printUsage(const char* programName) {
     std::cerr << "  " << programName << " -t program.bas           # Compile, run, and time\n";
     std::cerr << "  " << programName << " --profile prog.bas       # Show compilation phase timings\n";
     std::cerr << "  " << programName << " --opt-all -t prog.bas    # With optimizers + timing\n";
+    std::cerr << "  " << programName << " --profile-run prog.bas   # Hot-line report + prog.folded\n";
+    std::cerr << "  " << programName << " --count prog.bas         # Coverage report + prog.counts\n";
     std::cerr << "  " << programName << " -o program.lua prog.bas  # Compile to file only\n";
     std::cerr << "  " << programName << " -p preprocessed.bas p.bas # Preprocess only (strip REMs)\n";
     std::cerr << "  " << programName << " -l labeled.bas prog.bas   # Convert line numbers to labels\n";
+    std::cerr << "  " << programName << " --emit-prelude fb_prelude.lua  # Write the shared prelude once\n";
+    std::cerr << "  " << programName << " --prelude fb_prelude -o p.lua p.bas  # Program that requires it\n";
+    std::cerr << "  " << programName << " --batch tests/ -j 8         # Compile and run every program in tests/\n";
 }
 
 int main(int argc, char** argv) {
@@ -191,6 +618,19 @@ int main(int argc, char** argv) {
     bool enablePeepholeOptimizer = false;
     bool showOptStats = false;
     bool showProfile = false;
+    bool profileRun = false;
+    std::string foldedOutputFile;
+    bool jitDiagnostics = false;
+    bool countLines = false;
+    std::string countsOutputFile;
+    bool useVariableCache = true;
+    bool useLuaJITHints = true;
+    bool enableBufferMode = false;
+    int inlineBudget = -1;  // -1 = pass default
+    int compileThreads = 0;  // 0 = one per hardware thread
+    std::string preludeModule;
+    std::string preludeOutputFile;
+    std::string batchSource;
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -212,9 +652,72 @@ int main(int argc, char** argv) {
             enablePeepholeOptimizer = true;
         } else if (strcmp(argv[i], "--opt-stats") == 0) {
             showOptStats = true;
+        } else if (strcmp(argv[i], "--no-var-cache") == 0) {
+            useVariableCache = false;
+        } else if (strcmp(argv[i], "--no-jit-hints") == 0) {
+            useLuaJITHints = false;
+        } else if (strcmp(argv[i], "--buffer-mode") == 0) {
+            enableBufferMode = true;
+        } else if (strcmp(argv[i], "--inline") == 0) {
+            if (i + 1 < argc) {
+                inlineBudget = atoi(argv[++i]);
+            } else {
+                std::cerr << "Error: --inline requires an instruction budget\n";
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0) {
+            if (i + 1 < argc) {
+                compileThreads = atoi(argv[++i]);
+            } else {
+                std::cerr << "Error: " << argv[i] << " requires a thread count\n";
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            if (i + 1 < argc) {
+                batchSource = argv[++i];
+            } else {
+                std::cerr << "Error: --batch requires a list file or directory\n";
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--prelude") == 0) {
+            if (i + 1 < argc) {
+                preludeModule = argv[++i];
+            } else {
+                std::cerr << "Error: --prelude requires a module name\n";
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--emit-prelude") == 0) {
+            if (i + 1 < argc) {
+                preludeOutputFile = argv[++i];
+            } else {
+                std::cerr << "Error: --emit-prelude requires an output filename\n";
+                return 1;
+            }
         } else if (strcmp(argv[i], "--profile") == 0) {
             showProfile = true;
             verbose = true;  // Auto-enable verbose for profiling
+        } else if (strcmp(argv[i], "--profile-run") == 0) {
+            profileRun = true;
+        } else if (strcmp(argv[i], "--jit-diag") == 0) {
+            jitDiagnostics = true;
+        } else if (strcmp(argv[i], "--count") == 0) {
+            countLines = true;
+        } else if (strcmp(argv[i], "--counts") == 0) {
+            if (i + 1 < argc) {
+                countsOutputFile = argv[++i];
+                countLines = true;
+            } else {
+                std::cerr << "Error: --counts requires an output filename\n";
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--folded") == 0) {
+            if (i + 1 < argc) {
+                foldedOutputFile = argv[++i];
+                profileRun = true;
+            } else {
+                std::cerr << "Error: --folded requires an output filename\n";
+                return 1;
+            }
         } else if (strcmp(argv[i], "-o") == 0) {
             if (i + 1 < argc) {
                 outputFile = argv[++i];
@@ -250,6 +753,68 @@ int main(int argc, char** argv) {
         }
     }
     
+    // The shared prelude does not depend on any program
+    if (!preludeOutputFile.empty()) {
+        std::ofstream outFile(preludeOutputFile);
+        if (!outFile) {
+            std::cerr << "Error: Could not open output file: " << preludeOutputFile << "\n";
+            return 1;
+        }
+        LuaCodeGenerator preludeGen;
+        outFile << preludeGen.generatePreludeModule();
+        outFile.close();
+
+        if (verbose) {
+            std::cerr << "Runtime prelude written to: " << preludeOutputFile << "\n";
+        }
+        if (inputFile.empty() && batchSource.empty()) {
+            return 0;
+        }
+    }
+
+    // One set of compile settings for a single program and for --batch
+    CompileSettings compile;
+    compile.verbose = verbose;
+    compile.showOptStats = showOptStats;
+    compile.enableASTOptimizer = enableASTOptimizer;
+    compile.enablePeepholeOptimizer = enablePeepholeOptimizer;
+    compile.inlineBudget = inlineBudget;
+    compile.threads = compileThreads;
+    compile.config.emitComments = emitComments;
+    compile.config.preludeModule = preludeModule;
+    compile.config.useVariableCache = useVariableCache;
+    compile.config.useLuaJITHints = useLuaJITHints;
+    compile.config.enableBufferMode = enableBufferMode;
+    compile.config.emitLineNumbers = profileRun || jitDiagnostics;  // Tools need BASIC lines even under OPTION ERROR OFF
+    compile.config.countLines = countLines;
+
+    if (!batchSource.empty()) {
+        if (!inputFile.empty() || !preprocessOutputFile.empty() || !labelOutputFile.empty()) {
+            std::cerr << "Error: --batch takes its programs from the list, not the command line\n";
+            return 1;
+        }
+        if (showProfile || profileRun || jitDiagnostics || countLines) {
+            std::cerr << "Error: --profile, --profile-run, --jit-diag and --count apply to a single program\n";
+            return 1;
+        }
+
+        BatchSettings settings;
+        settings.outputDir = outputFile;
+        settings.threads = compileThreads;
+        settings.verbose = verbose;
+        settings.compile = compile;
+        // Programs compile concurrently, each on one thread, and their
+        // progress output would interleave
+        settings.compile.threads = 1;
+        settings.compile.verbose = false;
+        settings.compile.showOptStats = false;
+        // Programs that run share one compiled prelude instead of inlining it
+        if (outputFile.empty() && preludeModule.empty()) {
+            settings.compile.config.preludeModule = "fbc_batch_prelude";
+        }
+        return runBatch(batchSource, settings);
+    }
+
     if (inputFile.empty()) {
         std::cerr << "Error: No input file specified\n\n";
         printUsage(argv[0]);
@@ -258,7 +823,6 @@ int main(int argc, char** argv) {
     
     try {
         auto compileStartTime = std::chrono::high_resolution_clock::now();
-        auto phaseStartTime = compileStartTime;
         
         // Read source file
         if (verbose) {
@@ -279,41 +843,32 @@ int main(int argc, char** argv) {
             std::cerr << "Source size: " << source.length() << " bytes\n";
         }
         
-        auto readEndTime = std::chrono::high_resolution_clock::now();
-        double readMs = std::chrono::duration<double, std::milli>(readEndTime - phaseStartTime).count();
-        
-        // Preprocess REM statements (strip comment text to simplify parsing)
-        if (verbose) {
-            std::cerr << "Preprocessing REM statements...\n";
-        }
-        source = DataPreprocessor::preprocessREM(source);
-        
-        // Preprocess line numbers to labels (convert GOTO/GOSUB targets to symbolic labels)
-        if (verbose) {
-            std::cerr << "Converting line numbers to labels...\n";
-        }
-        source = DataPreprocessor::preprocessLineNumbersToLabels(source);
+        double readMs = millisecondsSince(compileStartTime);
         
-        // If -p option was specified, save preprocessed output and exit
-        if (!preprocessOutputFile.empty()) {
-            std::ofstream outFile(preprocessOutputFile);
-            if (!outFile) {
-                std::cerr << "Error: Could not open output file: " << preprocessOutputFile << "\n";
-                return 1;
-            }
-            outFile << source;
-            outFile.close();
-            
-            if (verbose) {
-                std::cerr << "Preprocessed source written to: " << preprocessOutputFile << "\n";
+        // -p and -l stop after preprocessing
+        if (!preprocessOutputFile.empty() || !labelOutputFile.empty()) {
+            std::string preprocessed = DataPreprocessor::preprocessREM(source);
+            preprocessed = DataPreprocessor::preprocessLineNumbersToLabels(preprocessed);
+
+            // If -p option was specified, save preprocessed output and exit
+            if (!preprocessOutputFile.empty()) {
+                std::ofstream outFile(preprocessOutputFile);
+                if (!outFile) {
+                    std::cerr << "Error: Could not open output file: " << preprocessOutputFile << "\n";
+                    return 1;
+                }
+                outFile << preprocessed;
+                outFile.close();
+
+                if (verbose) {
+                    std::cerr << "Preprocessed source written to: " << preprocessOutputFile << "\n";
+                }
+                return 0;
             }
-            return 0;
-        }
-        
-        // If -l option was specified, convert line numbers to labels and exit
-        if (!labelOutputFile.empty()) {
-            std::string labeled = DataPreprocessor::preprocessLineNumbersToLabels(source);
-            
+
+            // If -l option was specified, convert line numbers to labels and exit
+            std::string labeled = DataPreprocessor::preprocessLineNumbersToLabels(preprocessed);
+
             std::ofstream outFile(labelOutputFile);
             if (!outFile) {
                 std::cerr << "Error: Could not open output file: " << labelOutputFile << "\n";
@@ -321,213 +876,61 @@ int main(int argc, char** argv) {
             }
             outFile << labeled;
             outFile.close();
-            
+
             if (verbose) {
                 std::cerr << "Line numbers converted to labels, written to: " << labelOutputFile << "\n";
             }
             return 0;
         }
         
-        // Lexical analysis
-        phaseStartTime = std::chrono::high_resolution_clock::now();
-        if (verbose) {
-            std::cerr << "Lexing...\n";
-        }
-        
-        Lexer lexer;
-        lexer.tokenize(source);
-        auto tokens = lexer.getTokens();
-        
-        auto lexEndTime = std::chrono::high_resolution_clock::now();
-        double lexMs = std::chrono::duration<double, std::milli>(lexEndTime - phaseStartTime).count();
-        
-        if (verbose) {
-            std::cerr << "Tokens: " << tokens.size() << "\n";
-        }
-        
-        // Parsing
-        phaseStartTime = std::chrono::high_resolution_clock::now();
-        if (verbose) {
-            std::cerr << "Parsing...\n";
-        }
-        
-        Parser parser;
-        auto ast = parser.parse(tokens, inputFile);
-        
-        auto parseEndTime = std::chrono::high_resolution_clock::now();
-        double parseMs = std::chrono::duration<double, std::milli>(parseEndTime - phaseStartTime).count();
-        
-        // Check for parser errors - if parsing failed, don't continue
-        if (!ast || parser.hasErrors()) {
+        CompiledProgram program;
+        if (!compileProgram(source, inputFile, compile, program)) {
             std::cerr << "\nParsing failed with errors:\n";
-            for (const auto& error : parser.getErrors()) {
-                std::cerr << "  " << error.toString() << "\n";
+            for (const auto& error : program.parseErrors) {
+                std::cerr << "  " << error << "\n";
             }
             std::cerr << "Compilation aborted.\n";
             return 1;
         }
+        const std::string& luaCode = program.luaCode;
+        const CompilePhaseTimes& times = program.times;
         
-        // Get compiler options from OPTION statements (collected during parsing)
-        const auto& compilerOptions = parser.getOptions();
-        
-        if (verbose) {
-            std::cerr << "Program lines: " << ast->lines.size() << "\n";
-            std::cerr << "Compiler options: arrayBase=" << compilerOptions.arrayBase 
-                      << " unicodeMode=" << compilerOptions.unicodeMode << "\n";
-        }
-        
-        // Semantic analysis
-        phaseStartTime = std::chrono::high_resolution_clock::now();
-        if (verbose) {
-            std::cerr << "Semantic analysis...\n";
-        }
-        
-        SemanticAnalyzer semantic;
-        semantic.analyze(*ast, compilerOptions);
-        
-        auto semanticEndTime = std::chrono::high_resolution_clock::now();
-        double semanticMs = std::chrono::duration<double, std::milli>(semanticEndTime - phaseStartTime).count();
-        
-        if (verbose) {
-            const auto& symTable = semantic.getSymbolTable();
-            size_t varCount = symTable.variables.size();
-            size_t funcCount = symTable.functions.size();
-            size_t labelCount = symTable.lineNumbers.size();
-            std::cerr << "Symbols: " << varCount << " variables, " 
-                     << funcCount << " functions, " << labelCount << " labels\n";
-        }
-        
-        // AST Optimization (constant folding, dead code elimination)
-        double astOptMs = 0.0;
-        if (enableASTOptimizer) {
-            phaseStartTime = std::chrono::high_resolution_clock::now();
-            if (verbose) {
-                std::cerr << "Optimizing AST...\n";
-            }
-            
-            ASTOptimizer astOptimizer;
-            astOptimizer.setOptimizationLevel(1);
-            astOptimizer.optimize(*ast, semantic.getSymbolTable());
-            
-            auto astOptEndTime = std::chrono::high_resolution_clock::now();
-            astOptMs = std::chrono::duration<double, std::milli>(astOptEndTime - phaseStartTime).count();
-            
-            if (verbose || showOptStats) {
-                std::cerr << astOptimizer.generateReport();
-            }
-        }
-        
-        // Control flow graph
-        phaseStartTime = std::chrono::high_resolution_clock::now();
-        if (verbose) {
-            std::cerr << "Building CFG...\n";
-        }
-        
-        CFGBuilder cfgBuilder;
-        auto cfg = cfgBuilder.build(*ast, semantic.getSymbolTable());
-        
-        auto cfgEndTime = std::chrono::high_resolution_clock::now();
-        double cfgMs = std::chrono::duration<double, std::milli>(cfgEndTime - phaseStartTime).count();
-        
-        if (verbose) {
-            std::cerr << "CFG blocks: " << cfg->blocks.size() << "\n";
-        }
-        
-        // IR generation
-        phaseStartTime = std::chrono::high_resolution_clock::now();
-        if (verbose) {
-            std::cerr << "Generating IR...\n";
-        }
-        
-        IRGenerator irGen;
-        auto irCode = irGen.generate(*cfg, semantic.getSymbolTable());
-        
-        auto irEndTime = std::chrono::high_resolution_clock::now();
-        double irMs = std::chrono::duration<double, std::milli>(irEndTime - phaseStartTime).count();
-        
-        if (verbose) {
-            std::cerr << "IR instructions: " << irCode->instructions.size() << "\n";
-        }
-        
-        // Peephole Optimization (IR-level optimizations)
-        double peepholeMs = 0.0;
-        if (enablePeepholeOptimizer) {
-            phaseStartTime = std::chrono::high_resolution_clock::now();
-            if (verbose) {
-                std::cerr << "Running peephole optimizer...\n";
-            }
-            
-            PeepholeOptimizer peepholeOpt;
-            peepholeOpt.setOptimizationLevel(1);
-            peepholeOpt.optimize(*irCode);
-            
-            auto peepholeEndTime = std::chrono::high_resolution_clock::now();
-            peepholeMs = std::chrono::duration<double, std::milli>(peepholeEndTime - phaseStartTime).count();
-            
-            if (verbose || showOptStats) {
-                std::cerr << peepholeOpt.generateReport();
-            }
-            
-            if (verbose) {
-                std::cerr << "IR instructions after peephole: " << irCode->instructions.size() << "\n";
-            }
-        }
-        
-        // Lua code generation
-        phaseStartTime = std::chrono::high_resolution_clock::now();
-        if (verbose) {
-            std::cerr << "Generating Lua code...\n";
-        }
-        
-        LuaCodeGenConfig config;
-        config.emitComments = emitComments;
-        LuaCodeGenerator luaGen(config);
-        std::string luaCode = luaGen.generate(*irCode);
-        
-        auto codegenEndTime = std::chrono::high_resolution_clock::now();
-        double codegenMs = std::chrono::duration<double, std::milli>(codegenEndTime - phaseStartTime).count();
-        
-        if (verbose) {
-            std::cerr << "Generated Lua size: " << luaCode.length() << " bytes\n";
-        }
-        
-        auto compileEndTime = std::chrono::high_resolution_clock::now();
-        double totalCompileMs = std::chrono::duration<double, std::milli>(compileEndTime - compileStartTime).count();
+        double totalCompileMs = millisecondsSince(compileStartTime);
         
         // Show detailed profiling if requested
         if (showProfile) {
             std::cerr << "\n=== Compilation Phase Timing ===\n";
             std::cerr << "  File I/O:          " << std::fixed << std::setprecision(3) << readMs << " ms\n";
-            std::cerr << "  Lexer:             " << std::fixed << std::setprecision(3) << lexMs << " ms\n";
-            std::cerr << "  Parser:            " << std::fixed << std::setprecision(3) << parseMs << " ms\n";
-            std::cerr << "  Semantic:          " << std::fixed << std::setprecision(3) << semanticMs << " ms\n";
+            std::cerr << "  Lexer:             " << std::fixed << std::setprecision(3) << times.lexMs << " ms\n";
+            std::cerr << "  Parser:            " << std::fixed << std::setprecision(3) << times.parseMs << " ms\n";
+            std::cerr << "  Semantic:          " << std::fixed << std::setprecision(3) << times.semanticMs << " ms\n";
             if (enableASTOptimizer) {
-                std::cerr << "  AST Optimizer:     " << std::fixed << std::setprecision(3) << astOptMs << " ms\n";
+                std::cerr << "  AST Optimizer:     " << std::fixed << std::setprecision(3) << times.astOptMs << " ms\n";
             }
-            std::cerr << "  CFG Builder:       " << std::fixed << std::setprecision(3) << cfgMs << " ms\n";
-            std::cerr << "  IR Generator:      " << std::fixed << std::setprecision(3) << irMs << " ms\n";
+            std::cerr << "  CFG Builder:       " << std::fixed << std::setprecision(3) << times.cfgMs << " ms\n";
+            std::cerr << "  IR Generator:      " << std::fixed << std::setprecision(3) << times.irMs << " ms\n";
             if (enablePeepholeOptimizer) {
-                std::cerr << "  Peephole Opt:      " << std::fixed << std::setprecision(3) << peepholeMs << " ms\n";
+                std::cerr << "  Peephole Opt:      " << std::fixed << std::setprecision(3) << times.peepholeMs << " ms\n";
             }
-            std::cerr << "  Lua CodeGen:       " << std::fixed << std::setprecision(3) << codegenMs << " ms\n";
+            std::cerr << "  Lua CodeGen:       " << std::fixed << std::setprecision(3) << times.codegenMs << " ms\n";
             std::cerr << "  --------------------------------\n";
             std::cerr << "  Total Compile:     " << std::fixed << std::setprecision(3) << totalCompileMs << " ms\n";
             
             // Calculate percentages
             std::cerr << "\n=== Percentage Breakdown ===\n";
             std::cerr << "  File I/O:          " << std::fixed << std::setprecision(1) << (readMs / totalCompileMs * 100) << "%\n";
-            std::cerr << "  Lexer:             " << std::fixed << std::setprecision(1) << (lexMs / totalCompileMs * 100) << "%\n";
-            std::cerr << "  Parser:            " << std::fixed << std::setprecision(1) << (parseMs / totalCompileMs * 100) << "%\n";
-            std::cerr << "  Semantic:          " << std::fixed << std::setprecision(1) << (semanticMs / totalCompileMs * 100) << "%\n";
+            std::cerr << "  Lexer:             " << std::fixed << std::setprecision(1) << (times.lexMs / totalCompileMs * 100) << "%\n";
+            std::cerr << "  Parser:            " << std::fixed << std::setprecision(1) << (times.parseMs / totalCompileMs * 100) << "%\n";
+            std::cerr << "  Semantic:          " << std::fixed << std::setprecision(1) << (times.semanticMs / totalCompileMs * 100) << "%\n";
             if (enableASTOptimizer) {
-                std::cerr << "  AST Optimizer:     " << std::fixed << std::setprecision(1) << (astOptMs / totalCompileMs * 100) << "%\n";
+                std::cerr << "  AST Optimizer:     " << std::fixed << std::setprecision(1) << (times.astOptMs / totalCompileMs * 100) << "%\n";
             }
-            std::cerr << "  CFG Builder:       " << std::fixed << std::setprecision(1) << (cfgMs / totalCompileMs * 100) << "%\n";
-            std::cerr << "  IR Generator:      " << std::fixed << std::setprecision(1) << (irMs / totalCompileMs * 100) << "%\n";
+            std::cerr << "  CFG Builder:       " << std::fixed << std::setprecision(1) << (times.cfgMs / totalCompileMs * 100) << "%\n";
+            std::cerr << "  IR Generator:      " << std::fixed << std::setprecision(1) << (times.irMs / totalCompileMs * 100) << "%\n";
             if (enablePeepholeOptimizer) {
-                std::cerr << "  Peephole Opt:      " << std::fixed << std::setprecision(1) << (peepholeMs / totalCompileMs * 100) << "%\n";
+                std::cerr << "  Peephole Opt:      " << std::fixed << std::setprecision(1) << (times.peepholeMs / totalCompileMs * 100) << "%\n";
             }
-            std::cerr << "  Lua CodeGen:       " << std::fixed << std::setprecision(1) << (codegenMs / totalCompileMs * 100) << "%\n";
+            std::cerr << "  Lua CodeGen:       " << std::fixed << std::setprecision(1) << (times.codegenMs / totalCompileMs * 100) << "%\n";
             std::cerr << "\n";
         }
         
@@ -564,45 +967,38 @@ int main(int argc, char** argv) {
             return 1;
         }
         
-        // Open standard libraries
-        luaL_openlibs(L);
-        
-        // Register runtime modules (unicode, bitwise, constants, file I/O) directly in Lua state
-        // This makes them always available without needing external shared libraries
-        register_unicode_module(L);
-        register_bitwise_module(L);
-        register_constants_module(L);
+        registerRuntime(L);
         
         // Copy constants from semantic analyzer to runtime
-        set_constants_manager(&semantic.getConstantsManager());
+        set_constants_manager(&program.constants);
         
-        FasterBASIC::register_fileio_functions(L);
-        FasterBASIC::registerDataBindings(L);
-        FasterBASIC::registerTerminalBindings(L);
-        
-        // Register shouldStopScript for Ctrl+C interruption
-        lua_pushcfunction(L, lua_shouldStopScript);
-        lua_setglobal(L, "shouldStopScript");
+        // Serve the shared prelude from package.preload so require() finds
+        // it without a file on package.path
+        if (!preludeModule.empty()) {
+            LuaCodeGenerator preludeGen(compile.config);
+            std::string prelude = preludeGen.generatePreludeModule();
+            std::string chunkName = "=" + preludeModule;
+            lua_getglobal(L, "package");
+            lua_getfield(L, -1, "preload");
+            if (luaL_loadbuffer(L, prelude.data(), prelude.size(), chunkName.c_str()) != 0) {
+                std::cerr << "Error loading runtime prelude: " << lua_tostring(L, -1) << "\n";
+                g_runningState = nullptr;
+                lua_close(L);
+                return 1;
+            }
+            lua_setfield(L, -2, preludeModule.c_str());
+            lua_pop(L, 2);
+        }
         
         // Install signal handler for Ctrl+C
+        g_runningState = L;
         std::signal(SIGINT, signalHandler);
         
         // Reset the stop flag before running
-        g_shouldStopScript.store(false);
+        g_shouldStopScript.store(0);
         
         // Initialize DATA segment from IR code
-        if (!irCode->dataValues.empty()) {
-            FasterBASIC::initializeDataManager(irCode->dataValues);
-            
-            // Set up restore points
-            for (const auto& entry : irCode->dataLineRestorePoints) {
-                FasterBASIC::addDataRestorePoint(entry.first, entry.second);
-            }
-            
-            for (const auto& entry : irCode->dataLabelRestorePoints) {
-                FasterBASIC::addDataRestorePointByLabel(entry.first, entry.second);
-            }
-        }
+        loadDataSegment(program);
         
         // Register stub functions for standalone mode (no graphics/terminal)
         // Note: CLS is now handled by terminal bindings, so we don't need the stub
@@ -613,13 +1009,30 @@ int main(int argc, char** argv) {
         int exitCode = 0;
         auto startTime = std::chrono::high_resolution_clock::now();
         
-        // Load and execute the Lua code
-        if (luaL_loadstring(L, luaCode.c_str()) != 0) {
+        // Load and execute the Lua code; the profiler and trace diagnostics
+        // tell the program's frames apart by chunk name
+        int loadStatus = (profileRun || jitDiagnostics)
+            ? luaL_loadbuffer(L, luaCode.data(), luaCode.size(), LuaSourceMap::CHUNK_NAME)
+            : luaL_loadstring(L, luaCode.c_str());
+        if (loadStatus != 0) {
             std::cerr << "Error loading Lua code: " << lua_tostring(L, -1) << "\n";
+            g_runningState = nullptr;
             lua_close(L);
             return 1;
         }
         
+        SampleProfiler profiler;
+        if (profileRun && !profiler.start(L)) {
+            std::cerr << "Warning: " << profiler.getError() << " (running without profiling)\n";
+            profileRun = false;
+        }
+        
+        TraceDiagnostics traceDiagnostics;
+        if (jitDiagnostics && !traceDiagnostics.start(L)) {
+            std::cerr << "Warning: " << traceDiagnostics.getError() << " (running without trace diagnostics)\n";
+            jitDiagnostics = false;
+        }
+        
         if (lua_pcall(L, 0, 0, 0) != 0) {
             std::string errorMsg = lua_tostring(L, -1);
             std::cerr << errorMsg << "\n";
@@ -634,7 +1047,23 @@ int main(int argc, char** argv) {
         
         auto endTime = std::chrono::high_resolution_clock::now();
         
+        if (profileRun) {
+            profiler.stop(L, program.sourceMap);
+        }
+        if (jitDiagnostics) {
+            traceDiagnostics.stop(L, program.sourceMap, luaCode);
+        }
+        
+        // OPTION PROFILE COUNTS (or --count): the counters outlive the run
+        LineCoverage coverage;
+        bool lineCounts = !program.sourceMap.counters.empty();
+        if (lineCounts && !coverage.collect(L, program.sourceMap)) {
+            std::cerr << "Warning: " << coverage.getError() << "\n";
+            lineCounts = false;
+        }
+        
         // Clean up Lua state
+        g_runningState = nullptr;
         lua_close(L);
         
         // Display timing if requested
@@ -644,6 +1073,34 @@ int main(int argc, char** argv) {
             std::cerr << "\nExecution time: " << seconds << " seconds\n";
         }
         
+        if (profileRun) {
+            profiler.writeReport(std::cerr);
+            if (foldedOutputFile.empty()) {
+                foldedOutputFile = replaceExtension(inputFile, ".folded");
+            }
+            if (profiler.writeFolded(foldedOutputFile)) {
+                std::cerr << "Folded stacks written to: " << foldedOutputFile << "\n";
+            } else {
+                std::cerr << "Error: Cannot write to file: " << foldedOutputFile << "\n";
+            }
+        }
+        
+        if (jitDiagnostics) {
+            traceDiagnostics.writeReport(std::cerr);
+        }
+        
+        if (lineCounts) {
+            coverage.writeReport(std::cerr);
+            if (countsOutputFile.empty()) {
+                countsOutputFile = replaceExtension(inputFile, ".counts");
+            }
+            if (coverage.writeCounts(countsOutputFile)) {
+                std::cerr << "Line counts written to: " << countsOutputFile << "\n";
+            } else {
+                std::cerr << "Error: Cannot write to file: " << countsOutputFile << "\n";
+            }
+        }
+        
         return exitCode;
         
     } catch (const std::exception& e) {
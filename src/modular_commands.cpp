@@ -189,23 +189,27 @@ CommandRegistry::CommandRegistry() {
 void CommandRegistry::registerCommand(const CommandDefinition& cmd) {
     std::unique_lock<std::shared_mutex> lock(m_mutex);
     m_commands[cmd.commandName] = cmd;
+    m_generation++;
 }
 
 void CommandRegistry::registerCommand(CommandDefinition&& cmd) {
     std::unique_lock<std::shared_mutex> lock(m_mutex);
     std::string name = cmd.commandName;
     m_commands[name] = std::move(cmd);
+    m_generation++;
 }
 
 void CommandRegistry::registerFunction(const CommandDefinition& func) {
     std::unique_lock<std::shared_mutex> lock(m_mutex);
     m_functions[func.commandName] = func;
+    m_generation++;
 }
 
 void CommandRegistry::registerFunction(CommandDefinition&& func) {
     std::unique_lock<std::shared_mutex> lock(m_mutex);
     std::string name = func.commandName;
     m_functions[name] = std::move(func);
+    m_generation++;
 }
 
 bool CommandRegistry::hasCommand(const std::string& name) const {
@@ -310,6 +314,7 @@ void CommandRegistry::clear() {
     std::unique_lock<std::shared_mutex> lock(m_mutex);
     m_commands.clear();
     m_functions.clear();
+    m_generation++;
 }
 
 void CommandRegistry::initializeBuiltinCommands() {
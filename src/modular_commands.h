@@ -15,6 +15,8 @@
 #include <unordered_map>
 #include <memory>
 #include <shared_mutex>
+#include <atomic>
+#include <cstdint>
 
 namespace FasterBASIC {
 namespace ModularCommands {
@@ -72,12 +74,13 @@ struct CommandDefinition {
     bool hasCustomCodeGen;               // Whether to use custom code generation
     ReturnType returnType;               // Return type (VOID for commands, other types for functions)
     bool isFunction;                     // Whether this is a function (returns value) or command (statement)
+    bool isPure;                         // Result depends only on arguments, no side effects (safe to hoist/reuse)
     
     // Default constructor for std::unordered_map
     CommandDefinition() : commandName(""), description(""), luaFunction(""), 
                          category("general"), requiresParentheses(false),
                          customCodeTemplate(""), hasCustomCodeGen(false),
-                         returnType(ReturnType::VOID), isFunction(false) {}
+                         returnType(ReturnType::VOID), isFunction(false), isPure(false) {}
     
     CommandDefinition(const std::string& name,
                      const std::string& desc,
@@ -88,7 +91,7 @@ struct CommandDefinition {
         : commandName(name), description(desc), luaFunction(luaFunc),
           category(cat), requiresParentheses(needParens),
           customCodeTemplate(""), hasCustomCodeGen(false),
-          returnType(retType), isFunction(retType != ReturnType::VOID) {}
+          returnType(retType), isFunction(retType != ReturnType::VOID), isPure(false) {}
     
     // Add a parameter to this command
     CommandDefinition& addParameter(const std::string& name,
@@ -127,6 +130,13 @@ struct CommandDefinition {
         isFunction = (retType != ReturnType::VOID);
         return *this;
     }
+    
+    // Mark as pure: same arguments always give the same result and the call
+    // has no side effects, so optimizers may hoist or reuse it
+    CommandDefinition& setPure() {
+        isPure = true;
+        return *this;
+    }
 };
 
 // =============================================================================
@@ -176,6 +186,10 @@ public:
     
     // Get command count
     size_t getCommandCount() const { return m_commands.size(); }
+
+    // Bumped by every register/clear, so callers caching the names can
+    // tell when to rebuild
+    uint64_t getGeneration() const { return m_generation.load(); }
     
     // Initialize with built-in commands and functions
     void initializeBuiltinCommands();
@@ -185,6 +199,7 @@ private:
     std::unordered_map<std::string, CommandDefinition> m_commands;
     std::unordered_map<std::string, CommandDefinition> m_functions;
     mutable std::shared_mutex m_mutex;  // Protect concurrent access
+    std::atomic<uint64_t> m_generation{0};
     
     // Helper methods for registering built-in command sets
     void registerTextCommands();